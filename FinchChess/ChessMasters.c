@@ -25,6 +25,10 @@
 		adelante( 15 );
 		motor(10, 100,200);
 
+	O dejar que el Finch encuentre solo la salida de un laberinto de 5 x 4 celdas de 30 cm,
+	con la meta en la esquina de arriba a la derecha:
+		laberinto(5, 4, 0.3, 4, 3);
+
 	Para ver los metodos y la descripcion de los mismo asi como los valores que reciben
 	y su significado abrir el archivo FinchLibrary.h
 */
@@ -1,3 +1,3 @@
-gcc -o Chess ChessMasters.c Finch.c hidapi.dll
+gcc -o Chess ChessMasters.c Finch.c FinchBoard.c FinchBook.c FinchClient.c FinchClock.c FinchCo.c FinchConsole.c FinchFilter.c FinchFleet.c FinchFlow.c FinchGame.c FinchMaze.c FinchPath.c FinchPoll.c FinchPose.c FinchReflex.c FinchSearch.c FinchSim.c FinchTable.c FinchTrack.c hidapi.dll
 echo Si no tuvo errores ejecutar el archivo Maze.exe
 pause
\ No newline at end of file
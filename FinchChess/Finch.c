@@ -57,9 +57,9 @@ Ascii Command Codes:
                      g-force = value * 1.5/32.0
                   if value is 0x20 to 0x3f (negative)
                      g-force = (value-64) * 1.5/32.0
-         Byte 4 = Tap/Shaken flag (0-255)
+         Byte 4 = Tap/Shaken flag (0-255), the TILT register of its MMA7660 accelerometer
                   If bit 7 (0x80) is a 1, then the Finch has been shaken since the last read
-                  If bit 5 (0x20) is a 0, then the Finch has been tapped since the last read
+                  If bit 5 (0x20) is a 1, then the Finch has been tapped since the last read
 
  - 'I' - gets the values of the two obstacle sensors
          returns
@@ -83,41 +83,32 @@ Ascii Command Codes:
 #include <stdlib.h>
 
 #include "Finch.h"
-
-#ifdef _LINUX_
-#include <pthread.h>
-#include <unistd.h>
-#else
-#include <windows.h>
-#endif
-
-#include "hidapi.h"
-
-/* to be used with Fin_Cmnd */
-#define SEND       0                // command does not have a response
-#define SEND_RECV  1                // response is expected
+#include "FinchInt.h"
 
 /* Global Variables */
-static hid_device *finch_handle;    // The handle to communicate with the Finch
-static int cmnd_count = 0;          // number of commands that have been sent
-static int left_speed = 0;
-static int right_speed = 0;
-static int time_to_stop = 0;
+static struct fin_dev finch_dev;    // The Finch opened by Fin_Init
+static FIN_TLS struct fin_dev *finch = &finch_dev;  // the one used by this thread
 
 /* local prototypes */
 #ifdef _LINUX_
 void *Fin_Thread(void *arg);
-void *KeyThread(void *arg);
 #else
 void Fin_Thread(void *arg);
 #endif
 int Fin_Cmnd(int flag, char cmnd, unsigned char *buffer);
+static int Fin_CmndStamp(int flag, char cmnd, unsigned char *buffer, Fin_Stamp *stamp);
+static void Fin_DevReconnect(struct fin_dev *dev);
 
 /**  Fin_init(void).
  *  initializes the interface to the finch robot
  *  launches a background thread to prevent the finch from timing out
  *  *Must be called prior to all other finch functions
  *
+ *  If the Finch daemon (finchd) is running, the robot is shared through
+ *  it instead of being opened by this program.
+ *  If $FINCH_SIM names a maze file, a simulated robot is opened in it
+ *  (lit by $FINCH_SIM_LIGHTS), on a virtual clock.
+ *
  *  input:
  *     none
  *  returns:
@@ -125,40 +116,49 @@ int Fin_Cmnd(int flag, char cmnd, unsigned char *buffer);
  */
 int Fin_Init(void)
 {
-#ifdef _LINUX_
-    pthread_t tid;
-#else
-    HANDLE thread_res;
-    DWORD tid;
-#endif
+    long long start = Fin_Usec();
     int res;
 
+    // a simulated robot, the console is left alone
+    if (getenv("FINCH_SIM") != NULL)
+    {
+        if (Fin_SimOpen(finch, getenv("FINCH_SIM"), getenv("FINCH_SIM_LIGHTS")) < 0)
+        {
+            printf("Unable to load the maze %s\n", getenv("FINCH_SIM"));
+            return(-1);
+        }
+        return(0);
+    }
+
+    // the daemon already owns the robot and keeps it alive
+    if (Fin_Attach() == 0)
+    {
+        memset(finch, 0, sizeof(*finch));
+        finch->attached = 1;
+        Fin_DevStart(finch);
+        finch->open_usec = Fin_Usec() - start;
+        res = 0;
+    }
     // open a connection to the finch
-    // the Finch communicates using the USB HID protocol
-    // with a VID of 2354 (Hex) and a PID of 1111 (Hex)
-    finch_handle = hid_open(0x2354, 0x1111, NULL);
-    if (finch_handle == 0)
+    else if (Fin_DevOpen(finch, NULL) < 0)
     {
         // failure...
         printf("Unable to connect to the Finch\n");
-        res = -1;
+        return(-1);
     }
     else
     {
         // success... turn off the beak led
         Fin_LED(0,0,0);
+        res = 0;
+    }
 
-        // create a keep-alive thread
 #ifdef _LINUX_
-        /* create independent thread to monitor the console */
-        pthread_create( &tid, NULL, KeyThread, (void *)0 );
-
-        pthread_create( &tid, NULL, Fin_Thread, (void *)0 );
-#else
-        thread_res = CreateThread(NULL,0,(LPTHREAD_START_ROUTINE)Fin_Thread,(LPVOID)0,0,(LPDWORD)&tid);
+    /* the background thread watches the console too,
+       as long as it waits on the wall clock */
+    if (res == 0 && !Fin_Virtual())
+        Fin_ConsoleOpen(finch);
 #endif
-        res = 0;
-    }
 
     return(res);
 }
@@ -168,6 +168,9 @@ int Fin_Init(void)
  *  go back to idle mode
  *  close the connection
  *
+ *  When shared through the daemon, only the motors are stopped:
+ *  the daemon keeps the robot awake for the next program.
+ *
  *  input:
  *     none
  *  returns:
@@ -178,15 +181,337 @@ int Fin_Exit(void)
     unsigned char IoBuffer[9];
     int res;
 
+    if (finch->attached)
+    {
+        res = Fin_Motor(0,0,0);
+        Fin_DevClose(finch);
+#ifdef _LINUX_
+        Fin_ConsoleClose(finch);
+#endif
+        Fin_Detach();
+        return(res);
+    }
+
     // reset the Finch to idle mode
     res = Fin_Cmnd(SEND,'R',IoBuffer);
-    hid_close(finch_handle);
+    Fin_DevClose(finch);
+#ifdef _LINUX_
+    Fin_ConsoleClose(finch);
+#endif
     return(res);
 }
 
 
 /*
- * background (keep-alive) thread
+ * lane of the command scheduler a command goes to
+ */
+static int Fin_Lane(const unsigned char *buffer)
+{
+    switch (buffer[1])
+    {
+    case 'X':
+    case 'R':
+        return(FIN_LANE_SAFETY);
+    case 'M':
+        // stopping the wheels is a safety command
+        if (buffer[3] == 0 && buffer[5] == 0)
+            return(FIN_LANE_SAFETY);
+        return(FIN_LANE_ACTUATOR);
+    case 'O':
+    case 'B':
+        return(FIN_LANE_ACTUATOR);
+    case 'z':
+        return(FIN_LANE_KEEPALIVE);
+    default:
+        return(FIN_LANE_SENSOR);
+    }
+}
+
+
+/*
+ * mark a request done, called with the device locked
+ */
+static void Fin_Complete(struct fin_dev *dev, struct fin_req *req, int res)
+{
+    req->res = res;
+    req->done = 1;
+    if (req->complete != 0)
+        req->complete(req);
+    else
+        Fin_Broadcast(&dev->done);
+}
+
+
+/*
+ * drop the requests of a list that send one of the commands in cmnds,
+ * called with the device locked
+ */
+static int Fin_CancelList(struct fin_dev *dev, struct fin_req **link, const char *cmnds, int res)
+{
+    struct fin_req *req;
+    int count = 0;
+
+    while ((req = *link) != 0)
+    {
+        if (cmnds != NULL && strchr(cmnds, req->cmnd) == NULL)
+        {
+            link = &req->next;
+            continue;
+        }
+        *link = req->next;
+        Fin_Complete(dev, req, res);
+        count++;
+    }
+    return(count);
+}
+
+
+/*
+ * drop the queued requests below lane (all of them for -1) that
+ * send one of the commands in cmnds (any command for NULL),
+ * called with the device locked
+ */
+int Fin_Cancel(struct fin_dev *dev, int lane, const char *cmnds, int res)
+{
+    struct fin_req *req;
+    int count = 0;
+    int i;
+
+    for (i = lane + 1; i < FIN_LANES; i++)
+    {
+        count += Fin_CancelList(dev, &dev->lane_head[i], cmnds, res);
+
+        // find the new tail
+        dev->lane_tail[i] = 0;
+        for (req = dev->lane_head[i]; req != 0; req = req->next)
+            dev->lane_tail[i] = req;
+    }
+
+    // commands staged for a fleet release count as actuator commands
+    if (lane < FIN_LANE_ACTUATOR)
+        count += Fin_CancelList(dev, &dev->staged, cmnds, res);
+    return(count);
+}
+
+
+/*
+ * queue a request for the background thread of a device,
+ * req->buffer[1] holds the command and req->complete (if set)
+ * is called by the background thread once it is done
+ *
+ * returns -1 (and completes the request) if it cannot be queued
+ */
+int Fin_Submit(struct fin_dev *dev, struct fin_req *req)
+{
+    struct fin_req *tail;
+
+    req->buffer[0] = 0x00;
+    req->cmnd = req->buffer[1];
+    req->lane = Fin_Lane(req->buffer);
+    req->next = 0;
+    req->done = 0;
+
+    Fin_Lock(&dev->lock);
+
+    // while the robot is unplugged, fail right away
+    if (dev->lost || !dev->running)
+    {
+        Fin_Complete(dev, req, dev->lost ? FIN_EDISCONNECTED : -1);
+        Fin_Unlock(&dev->lock);
+        return(-1);
+    }
+
+    // a stop makes the wheel (and beak) commands queued before it pointless,
+    // and sent after it they would start the motors again
+    if (req->lane == FIN_LANE_SAFETY)
+        Fin_Cancel(dev, FIN_LANE_SAFETY, req->buffer[1] == 'M' ? "M" : "MO", FIN_ECANCELED);
+
+    tail = dev->lane_tail[req->lane];
+    if (tail == 0)
+        dev->lane_head[req->lane] = req;
+    else
+        tail->next = req;
+    dev->lane_tail[req->lane] = req;
+
+    Fin_Wake(dev);
+    Fin_Unlock(&dev->lock);
+    return(0);
+}
+
+
+/*
+ * next request to send, highest lane first, called with the device locked
+ */
+static struct fin_req *Fin_Pop(struct fin_dev *dev)
+{
+    struct fin_req *req;
+    int i;
+
+    for (i = 0; i < FIN_LANES; i++)
+    {
+        req = dev->lane_head[i];
+        if (req != 0)
+        {
+            dev->lane_head[i] = req->next;
+            if (req->next == 0)
+                dev->lane_tail[i] = 0;
+            return(req);
+        }
+    }
+    return(0);
+}
+
+
+/*
+ * is the caller the background thread of the device
+ */
+static int Fin_OnThread(struct fin_dev *dev)
+{
+#ifdef _LINUX_
+    return(dev->running && pthread_equal(pthread_self(), dev->thread));
+#else
+    return(dev->running && GetCurrentThreadId() == dev->thread_id);
+#endif
+}
+
+
+/*
+ * highest lane with a request waiting, FIN_LANES if none,
+ * called with the device locked
+ */
+static int Fin_Peek(struct fin_dev *dev)
+{
+    int i;
+
+    for (i = 0; i < FIN_LANES; i++)
+        if (dev->lane_head[i] != 0)
+            break;
+    return(i);
+}
+
+
+/* sensor commands, in the order of the poll tables */
+static const char fin_sensor_cmnd[FIN_SENSORS] = { 'L', 'I', 'A', 'T' };
+
+
+/*
+ * estimate when the Finch took a reading: half the round trip of a 'z'
+ * after the request went out (the midpoint of the transfer, minus what
+ * it took longer than a 'z')
+ */
+long long Fin_SampleTime(struct fin_dev *dev, long long sent, long long recv)
+{
+    long long round = recv - sent;
+
+    if (dev->rtt_usec > 0 && dev->rtt_usec < round)
+        round = dev->rtt_usec;
+    return(sent + round / 2);
+}
+
+
+/*
+ * keep the snapshot of the device up to date with what goes over the link
+ * and let the reflexes react to new samples,
+ * called by the background thread with the device locked
+ */
+static void Fin_Sample(struct fin_dev *dev, char cmnd, const unsigned char *buffer,
+                       long long sent, long long recv)
+{
+    Fin_Sensors *snap = &dev->snap;
+    int sensor = -1;
+
+    switch (cmnd)
+    {
+    case 'z':
+        // round trip of the link, the Finch answers 'z' without reading anything
+        if (dev->rtt_usec == 0)
+            dev->rtt_usec = recv - sent;
+        else
+            dev->rtt_usec += (recv - sent - dev->rtt_usec) / 8;
+        dev->probed_at = sent;
+        return;
+    case 'L':
+        snap->lights[0] = buffer[0];
+        snap->lights[1] = buffer[1];
+        sensor = FIN_LIGHTS;
+        break;
+    case 'I':
+        snap->obstacle[0] = buffer[0];
+        snap->obstacle[1] = buffer[1];
+        sensor = FIN_OBSTACLES;
+        break;
+    case 'A':
+        Fin_DecodeAccel(buffer, &snap->accel[0], &snap->accel[1], &snap->accel[2],
+                        &snap->tap, &snap->shake);
+        sensor = FIN_ACCEL;
+        break;
+    case 'T':
+        snap->temp = Fin_DecodeTemp(buffer);
+        sensor = FIN_TEMP;
+        break;
+    case 'M':
+        snap->left_speed = buffer[2] ? -buffer[3] : buffer[3];
+        snap->right_speed = buffer[4] ? -buffer[5] : buffer[5];
+        // the wheels took the new speeds once the write was done
+        Fin_PoseWheels(dev, recv);
+        break;
+    case 'X':
+    case 'R':
+        snap->left_speed = 0;
+        snap->right_speed = 0;
+        Fin_PoseWheels(dev, recv);
+        break;
+    default:
+        return;
+    }
+
+    if (sensor >= 0)
+    {
+        snap->count++;
+        snap->when[sensor] = Fin_SampleTime(dev, sent, recv);
+        dev->sampled_at = sent;
+        Fin_Polled(dev, sensor, sent);
+        Fin_FilterSample(dev, sensor);
+        if (sensor == FIN_ACCEL)
+            Fin_PoseAccel(dev, snap->when[sensor]);
+    }
+    if (dev->sampled != 0)
+        dev->sampled(dev);
+    Fin_Broadcast(&dev->done);
+    if (sensor >= 0 && (dev->reflex_sensors & (1 << sensor)))
+        Fin_Reflexes(dev, sensor, sent, recv);
+}
+
+
+/*
+ * send a request, called by the background thread with the device locked
+ */
+int Fin_Send(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer)
+{
+    long long sent, recv;
+    int res;
+
+    Fin_Unlock(&dev->lock);
+    sent = Fin_Usec();
+    res = Fin_Transfer(dev, flag, cmnd, buffer);
+    recv = Fin_Usec();
+    Fin_Lock(&dev->lock);
+
+    dev->sent_at = sent;
+    dev->recv_at = recv;
+    Fin_FlowSent(dev, flag, sent, recv);
+    if (res > 0)
+        Fin_Sample(dev, cmnd, buffer, sent, recv);
+    return(res);
+}
+
+
+/*
+ * background thread of a Finch:
+ * sends the queued commands highest lane first at the rate the Finch
+ * takes, samples the sensors the reflexes watch, plays the tracks of
+ * timed commands, stops the motors when their time is up,
+ * keeps the finch alive and reconnects it when unplugged
  */
 #ifdef _LINUX_
 void *Fin_Thread(void *arg)
@@ -194,49 +519,506 @@ void *Fin_Thread(void *arg)
 void Fin_Thread(void *arg)
 #endif
 {
+    struct fin_dev *dev = (struct fin_dev *)arg;
     unsigned char IoBuffer[9];
+    struct fin_req *req;
+    long long now, wake, due;
+    int lane, sensor, track;
     int res;
-    int save;
-    int count = 0;
 
-    // The Finch has a time-out where it will go back to passive color cycling mode
-    // if no commands are sent within a five second time frame.
-    while(1)
+    // on the time of the program that opened the robot
+    Fin_ClockUse(dev->clock);
+    Fin_DevUse(dev->home);
+    Fin_Lock(&dev->lock);
+    while (dev->running)
     {
-        // cmnd_count gets incremented each time something is sent to the finch
-        save = cmnd_count;
+        now = Fin_Usec();
+        wake = now + FIN_KEEPALIVE;
 
-        // pause for 1/10 second
-        Sleep(100);
-        if (finch_handle == 0)
-            break;
+        // motors running, see if we should stop
+        if (dev->stop_at != 0 && now >= dev->stop_at)
+        {
+            dev->stop_at = 0;
+            dev->left_speed = 0;
+            dev->right_speed = 0;
+            Fin_Broadcast(&dev->done);
+            memset(IoBuffer, 0, sizeof(IoBuffer));
+            Fin_Send(dev, SEND, 'M', IoBuffer);
+            continue;
+        }
 
-        if (time_to_stop > 0)
+        // commands staged by the fleet, wait for their release time
+        // and spin the last moments so every robot starts together
+        if (dev->staged != 0 && !dev->lost)
         {
-            // motors running, see if we should stop
-            if (--time_to_stop <= 0)
+            if (now >= dev->release_at - FIN_RELEASE_SPIN)
             {
-                Fin_Motor(0,0,0);
-             	count = 0;
+                // the virtual clock only moves when every thread waits
+                if (Fin_Virtual())
+                {
+                    while (Fin_Usec() < dev->release_at)
+                        Fin_WaitUntil(&dev->work, &dev->lock, dev->release_at);
+                }
+                else
+                {
+                    Fin_Unlock(&dev->lock);
+                    while (Fin_Usec() < dev->release_at)
+                        ;
+                    Fin_Lock(&dev->lock);
+                }
+                dev->released = Fin_Usec();
+                while ((req = dev->staged) != 0)
+                {
+                    dev->staged = req->next;
+                    Fin_Complete(dev, req, Fin_Send(dev, req->flag, req->cmnd, req->buffer));
+                }
                 continue;
             }
+            // keep the link free just before, only a stop may go
+            if (now >= dev->release_at - 2 * FIN_RELEASE_SPIN && Fin_Peek(dev) != FIN_LANE_SAFETY)
+            {
+                Fin_WaitUntil(&dev->work, &dev->lock, dev->release_at - FIN_RELEASE_SPIN);
+                continue;
+            }
+            if (dev->release_at - 2 * FIN_RELEASE_SPIN < wake)
+                wake = dev->release_at - 2 * FIN_RELEASE_SPIN;
         }
 
-        // see if any commands went out over the last second
-        if (save != cmnd_count)
+        // robot unplugged, fail what is queued and
+        // try to get it back every 1/10 second
+        if (dev->lost)
+        {
+            Fin_Cancel(dev, -1, NULL, FIN_EDISCONNECTED);
+            if (now >= dev->retry_at)
+            {
+                Fin_Unlock(&dev->lock);
+                Fin_DevReconnect(dev);
+                Fin_Lock(&dev->lock);
+                dev->retry_at = Fin_Usec() + 100000;
+            }
+            wake = dev->retry_at;
+        }
+        // keep to the rate the Finch takes, the commands wait in
+        // their queue for their turn, only a stop goes at once
+        else if (Fin_Peek(dev) == FIN_LANE_SAFETY ||
+                 Fin_FlowReady(dev, now, Fin_Peek(dev) < FIN_LANES, &wake))
         {
-            count = 0;
+            // timed commands (a melody, frames of the beak) go out at their
+            // time, only a stop passes them; just before a note, the link
+            // is left to wheels and beak
+            lane = Fin_Peek(dev);
+            track = Fin_TrackDue(dev, now, &due);
+            if (track >= 0 && now >= due && lane != FIN_LANE_SAFETY)
+            {
+                Fin_TrackSend(dev, track);
+                continue;
+            }
+            if (track >= 0 && dev->track[track].guard)
+            {
+                if (due - now < FIN_TRACK_GUARD && lane > FIN_LANE_ACTUATOR)
+                {
+                    Fin_WaitUntil(&dev->work, &dev->lock, due);
+                    continue;
+                }
+                due -= FIN_TRACK_GUARD;
+            }
+            if (track >= 0 && due < wake)
+                wake = due;
+
+            // wheels and beak go first, then the samples of the watched
+            // sensors, then the sensor requests of the program
+            sensor = Fin_PollDue(dev, now, &wake);
+            if (lane <= FIN_LANE_ACTUATOR || (lane < FIN_LANES && sensor < 0))
+            {
+                req = Fin_Pop(dev);
+                res = Fin_Send(dev, req->flag, req->cmnd, req->buffer);
+                req->sent = dev->sent_at;
+                req->recv = dev->recv_at;
+                Fin_Complete(dev, req, res);
+                continue;
+            }
+            if (sensor >= 0)
+            {
+                Fin_Send(dev, SEND_RECV, fin_sensor_cmnd[sensor], IoBuffer);
+                continue;
+            }
+
+            // while sensors are being read, time a 'z' round trip every second
+            // so their timestamps can be corrected for the link latency
+            if (now - dev->sampled_at < FIN_PROBE)
+            {
+                if (now - dev->probed_at >= FIN_PROBE)
+                {
+                    Fin_Send(dev, SEND_RECV, 'z', IoBuffer);
+                    continue;
+                }
+                if (dev->probed_at + FIN_PROBE < wake)
+                    wake = dev->probed_at + FIN_PROBE;
+            }
+
+            // The Finch has a time-out where it will go back to passive color cycling mode
+            // if no commands are sent within a five second time frame.
+            // wait for 2 seconds of no commands before sending keep-alive
+            // (the daemon does its own keep-alive)
+            if (!dev->attached)
+            {
+                if (now - dev->last_sent >= FIN_KEEPALIVE)
+                {
+                    // request the command count (for keep-alive)
+                    Fin_Send(dev, SEND_RECV, 'z', IoBuffer);
+                    continue;
+                }
+                if (dev->last_sent + FIN_KEEPALIVE < wake)
+                    wake = dev->last_sent + FIN_KEEPALIVE;
+            }
+        }
+
+        if (dev->stop_at != 0 && dev->stop_at < wake)
+            wake = dev->stop_at;
+#ifdef _LINUX_
+        if (dev->console)
+        {
+            Fin_ConsoleWait(dev, wake);
             continue;
         }
+#endif
+        Fin_WaitUntil(&dev->work, &dev->lock, wake);
+    }
+
+    // closing, nothing queued will be sent
+    Fin_Cancel(dev, -1, NULL, -1);
+    Fin_Unlock(&dev->lock);
+    Fin_ClockJoin(-1);
+#ifdef _LINUX_
+    return(0);
+#endif
+}
+
+
+
+/*
+ * name of the file remembering the path of the Finch between runs
+ * (and what was learned of each robot), $FINCH_CACHE, else in the home directory
+ */
+static const char *Fin_CacheName(char *name, int size)
+{
+    const char *env = getenv("FINCH_CACHE");
+
+    if (env != NULL)
+        return(env);
+#ifdef _LINUX_
+    env = getenv("HOME");
+    snprintf(name, size, "%s/.finch_cache", env ? env : ".");
+#else
+    env = getenv("APPDATA");
+    snprintf(name, size, "%s\\finch_cache.txt", env ? env : ".");
+#endif
+    return(name);
+}
+
+
+/*
+ * get a value remembered by an earlier run, the file has a "key value"
+ * line for each (e.g. the path of the Finch used by the last run)
+ */
+int Fin_CacheLoad(const char *key, char *value, int size)
+{
+    char name[512];
+    char line[300];
+    int len = strlen(key);
+    int res = -1;
+    FILE *file;
+
+    file = fopen(Fin_CacheName(name, sizeof(name)), "r");
+    if (file == NULL)
+        return(-1);
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if (strncmp(line, key, len) == 0 && line[len] == ' ' && line[len + 1] != 0)
+        {
+            strncpy(value, &line[len + 1], size - 1);
+            value[size - 1] = 0;
+            res = 0;
+        }
+    }
+    fclose(file);
+    return(res);
+}
+
+
+/*
+ * remember a value for the next runs, keeping the other lines of the file
+ */
+void Fin_CacheSave(const char *key, const char *value)
+{
+    char buf[512];
+    const char *name = Fin_CacheName(buf, sizeof(buf));
+    char lines[32][300];
+    int len = strlen(key);
+    int count = 0;
+    FILE *file;
+    int i;
+
+    file = fopen(name, "r");
+    if (file != NULL)
+    {
+        while (count < 32 && fgets(lines[count], sizeof(lines[count]), file) != NULL)
+        {
+            lines[count][strcspn(lines[count], "\r\n")] = 0;
+            if (lines[count][0] != 0 && !(strncmp(lines[count], key, len) == 0 && lines[count][len] == ' '))
+                count++;
+        }
+        fclose(file);
+    }
+
+    file = fopen(name, "w");
+    if (file == NULL)
+        return;
+    fprintf(file, "%s %s\n", key, value);
+    for (i = 0; i < count; i++)
+        fprintf(file, "%s\n", lines[i]);
+    fclose(file);
+}
+
+
+/* every Finch opened by this program, so a reconnect does not grab another one's robot */
+#define FIN_MAX_DEVS  16
+static struct fin_dev *fin_devs[FIN_MAX_DEVS];
+
+static void Fin_Register(struct fin_dev *dev)
+{
+    int i;
+
+    for (i = 0; i < FIN_MAX_DEVS; i++)
+        if (__sync_bool_compare_and_swap(&fin_devs[i], (struct fin_dev *)0, dev))
+            return;
+}
+
+static void Fin_Unregister(struct fin_dev *dev)
+{
+    int i;
+
+    for (i = 0; i < FIN_MAX_DEVS; i++)
+        __sync_bool_compare_and_swap(&fin_devs[i], dev, (struct fin_dev *)0);
+}
+
+int Fin_PathInUse(struct fin_dev *dev, const char *path)
+{
+    struct fin_dev *other;
+    int i;
+
+    for (i = 0; i < FIN_MAX_DEVS; i++)
+    {
+        other = fin_devs[i];
+        if (other != 0 && other != dev && other->handle != 0 && strcmp(other->path, path) == 0)
+            return(1);
+    }
+    return(0);
+}
+
+
+/*
+ * make sure a path still leads to a Finch,
+ * the platform may have given the path to another device since the last run
+ */
+static int Fin_IsFinch(hid_device *handle)
+{
+    wchar_t product[64];
+
+    // not every platform reports the strings, trust the path then
+    if (hid_get_product_string(handle, product, 64) < 0)
+        return(1);
+    return(wcsstr(product, L"Finch") != NULL);
+}
+
+
+/*
+ * open dev->path, and if that fails (or there is no path yet) and
+ * enumerate is set, the first Finch not already open
+ */
+static hid_device *Fin_OpenAny(struct fin_dev *dev, int enumerate)
+{
+    struct hid_device_info *devs, *info;
+    hid_device *handle = 0;
+
+    // the known path avoids enumerating every HID device of the system
+    if (dev->path[0] != 0)
+    {
+        handle = hid_open_path(dev->path);
+        if (handle != 0 && !Fin_IsFinch(handle))
+        {
+            hid_close(handle);
+            handle = 0;
+        }
+        if (handle != 0 || !enumerate)
+            return(handle);
+    }
 
-        // wait for 2 seconds of no commands before sending keep-alive
-        if (++count < 20)
+    // the Finch communicates using the USB HID protocol
+    // with a VID of 2354 (Hex) and a PID of 1111 (Hex)
+    devs = hid_enumerate(FIN_VID, FIN_PID);
+    for (info = devs; info != NULL && handle == 0; info = info->next)
+    {
+        if (Fin_PathInUse(dev, info->path))
             continue;
+        handle = hid_open_path(info->path);
+        if (handle != 0)
+        {
+            strncpy(dev->path, info->path, sizeof(dev->path) - 1);
+            if (dev->cache)
+                Fin_CacheSave("path", dev->path);
+        }
+    }
+    hid_free_enumeration(devs);
+    return(handle);
+}
+
+
+/*
+ * there is work for the background thread of a device
+ */
+void Fin_Wake(struct fin_dev *dev)
+{
+    Fin_Broadcast(&dev->work);
+#ifdef _LINUX_
+    // it may be waiting on the console instead,
+    // a full pipe will wake it up all the same
+    if (dev->console && write(dev->wake_pipe[1], "", 1) < 0)
+        return;
+#endif
+}
+
 
-        // request the command count (for keep-alive)
-        res = Fin_Cmnd(SEND_RECV,'z',IoBuffer);
-        count = 0;
+/*
+ * start the background thread of a device
+ */
+void Fin_DevStart(struct fin_dev *dev)
+{
+#ifndef _LINUX_
+    DWORD tid;
+#endif
+
+    Fin_MutexInit(&dev->lock);
+    Fin_CondInit(&dev->work);
+    Fin_CondInit(&dev->done);
+    dev->last_sent = Fin_Usec();
+    dev->clock = Fin_ClockGet();
+    dev->home = finch;
+    dev->running = 1;
+    Fin_ClockJoin(1);
+#ifdef _LINUX_
+    pthread_create(&dev->thread, NULL, Fin_Thread, dev);
+#else
+    dev->thread = CreateThread(NULL,0,(LPTHREAD_START_ROUTINE)Fin_Thread,(LPVOID)dev,0,&tid);
+    dev->thread_id = tid;
+#endif
+}
+
+
+/*
+ * open a Finch, the first one found if path is NULL
+ * (trying first the one used by the last run)
+ */
+int Fin_DevOpen(struct fin_dev *dev, const char *path)
+{
+    long long start = Fin_Usec();
+    char cached[256] = "";
+
+    memset(dev, 0, sizeof(*dev));
+    if (path != NULL)
+        strncpy(dev->path, path, sizeof(dev->path) - 1);
+    else
+    {
+        dev->cache = 1;
+        if (Fin_CacheLoad("path", cached, sizeof(cached)) == 0)
+            strcpy(dev->path, cached);
     }
+
+    dev->handle = Fin_OpenAny(dev, path == NULL);
+    if (dev->handle == 0)
+        return(-1);
+    dev->cached = cached[0] != 0 && strcmp(cached, dev->path) == 0;
+    Fin_FlowInit(dev);
+
+    Fin_Register(dev);
+    Fin_DevStart(dev);
+    dev->open_usec = Fin_Usec() - start;
+    return(0);
+}
+
+
+/*
+ * stop the background thread of a Finch and close it
+ */
+void Fin_DevClose(struct fin_dev *dev)
+{
+    int i;
+
+    if (!dev->running)
+        return;
+
+    Fin_Lock(&dev->lock);
+    dev->running = 0;
+    Fin_Wake(dev);
+    Fin_Unlock(&dev->lock);
+#ifdef _LINUX_
+    pthread_join(dev->thread, NULL);
+#else
+    WaitForSingleObject(dev->thread, INFINITE);
+    CloseHandle(dev->thread);
+#endif
+    if (dev->sim != 0)
+        Fin_SimClose(dev);
+
+    for (i = 0; i < FIN_TRACKS; i++)
+        Fin_TrackLoad(dev, i, 0);
+    dev->lost = 0;
+    if (dev->handle != 0)
+    {
+        hid_close(dev->handle);
+        dev->handle = 0;
+    }
+    Fin_Unregister(dev);
+}
+
+
+/*
+ * get back a Finch that was unplugged, from its background thread,
+ * putting back the beak color and wheel speeds it had
+ */
+static void Fin_DevReconnect(struct fin_dev *dev)
+{
+    unsigned char IoBuffer[9];
+
+    dev->handle = Fin_OpenAny(dev, 1);
+    if (dev->handle == 0)
+        return;
+
+    memcpy(&IoBuffer[2], dev->led, 3);
+    Fin_Transfer(dev, SEND, 'O', IoBuffer);
+    if (dev->motor[1] != 0 || dev->motor[3] != 0)
+    {
+        memcpy(&IoBuffer[2], dev->motor, 4);
+        Fin_Transfer(dev, SEND, 'M', IoBuffer);
+    }
+    if (dev->handle == 0)
+        return;
+
+    Fin_Lock(&dev->lock);
+    if (dev->motor[1] != 0 || dev->motor[3] != 0)
+    {
+        // the wheels turn again from now on
+        dev->snap.left_speed = dev->motor[0] ? -dev->motor[1] : dev->motor[1];
+        dev->snap.right_speed = dev->motor[2] ? -dev->motor[3] : dev->motor[3];
+        Fin_PoseWheels(dev, Fin_Usec());
+    }
+    dev->lost = 0;
+    dev->reconnects++;
+    dev->recover_usec = Fin_Usec() - dev->lost_at;
+    Fin_Unlock(&dev->lock);
+    printf("Reconnected to the Finch in %d ms\n", (int)(dev->recover_usec / 1000));
 }
 
 
@@ -245,11 +1027,130 @@ void Fin_Thread(void *arg)
  */
 int Fin_Cmnd(int flag, char cmnd, unsigned char *buffer)
 {
-    static unsigned char seq_num = 0;
+    return(Fin_CmndStamp(flag, cmnd, buffer, NULL));
+}
+
+static int Fin_CmndStamp(int flag, char cmnd, unsigned char *buffer, Fin_Stamp *stamp)
+{
+    // the program ran out of its time (Fin_ClockLimit)
+    if (Fin_ClockCheck())
+        return(-1);
+    return(Fin_DevCmndStamp(finch, flag, cmnd, buffer, stamp));
+}
+
+
+/*
+ * send/recv messages to a given finch:
+ * queue the command for the background thread and wait for it to be sent
+ */
+int Fin_DevCmnd(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer)
+{
+    return(Fin_DevCmndStamp(dev, flag, cmnd, buffer, NULL));
+}
+
+
+/*
+ * same, telling when the command went out, when the response came
+ * back and when the Finch took the reading (if stamp is not NULL)
+ */
+int Fin_DevCmndStamp(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer, Fin_Stamp *stamp)
+{
+    struct fin_req req;
+
+    // the background thread itself sends right away
+    if (Fin_OnThread(dev))
+    {
+        req.sent = Fin_Usec();
+        req.res = Fin_Transfer(dev, flag, cmnd, buffer);
+        req.recv = Fin_Usec();
+        if (stamp != NULL)
+        {
+            stamp->sent_usec = req.sent;
+            stamp->recv_usec = req.recv;
+            stamp->sample_usec = Fin_SampleTime(dev, req.sent, req.recv);
+        }
+        return(req.res);
+    }
+
+    memcpy(req.buffer, buffer, 9);
+    req.buffer[1] = cmnd;
+    req.flag = flag;
+    req.complete = 0;
+    req.sent = 0;
+    req.recv = 0;
+
+    if (Fin_Submit(dev, &req) == 0)
+    {
+        Fin_Lock(&dev->lock);
+        while (!req.done)
+            Fin_Wait(&dev->done, &dev->lock);
+        if (stamp != NULL)
+        {
+            stamp->sent_usec = req.sent;
+            stamp->recv_usec = req.recv;
+            stamp->sample_usec = req.res > 0 ? Fin_SampleTime(dev, req.sent, req.recv) : 0;
+        }
+        Fin_Unlock(&dev->lock);
+    }
+    else if (stamp != NULL)
+        memset(stamp, 0, sizeof(*stamp));
+
+    memcpy(buffer, req.buffer, 9);
+    return(req.res);
+}
+
+
+/*
+ * remember what the robot shows, to put it back after a reconnect
+ * and to skip the animation frames it shows already
+ */
+static void Fin_Shown(struct fin_dev *dev, char cmnd, const unsigned char *buffer)
+{
+    if (cmnd == 'O')
+        memcpy(dev->led, &buffer[2], 3);
+    else if (cmnd == 'M')
+        memcpy(dev->motor, &buffer[2], 4);
+    else if (cmnd == 'X' || cmnd == 'R')
+    {
+        memset(dev->led, 0, sizeof(dev->led));
+        memset(dev->motor, 0, sizeof(dev->motor));
+    }
+}
+
+
+/*
+ * the actual send/recv, only done by the background thread
+ * (and without the device locked)
+ */
+int Fin_Transfer(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer)
+{
     int res = 0;
 
+    // the daemon owns the robot, pass the command on
+    if (dev->attached)
+    {
+        dev->cmnd_count++;
+        dev->last_sent = Fin_Usec();
+        res = Fin_ShmCmnd(flag, cmnd, buffer);
+        if (res > 0)
+            Fin_Shown(dev, cmnd, buffer);
+        return(res);
+    }
+    // a simulated robot answers on the virtual clock
+    if (dev->sim != 0)
+    {
+        dev->cmnd_count++;
+        dev->last_sent = Fin_Usec();
+        res = Fin_SimTransfer(dev, flag, cmnd, buffer);
+        Fin_Shown(dev, cmnd, buffer);
+        return(res);
+    }
+    if (dev->handle == 0)
+        return(dev->lost ? FIN_EDISCONNECTED : -1);
+
     // the background thread uses this flag
-    cmnd_count++;
+    dev->cmnd_count++;
+    dev->last_sent = Fin_Usec();
 
     // all finch commands have a leading 0
     // followed by an ascii command character
@@ -257,26 +1158,106 @@ int Fin_Cmnd(int flag, char cmnd, unsigned char *buffer)
     buffer[0] = 0x00;
     buffer[1] = cmnd;
     if (flag == SEND_RECV)
-        buffer[8] = ++seq_num;
+        buffer[8] = ++dev->seq_num;
 
-	while(res == 0)
-	{
-		res = hid_write(finch_handle, buffer, 9);
-	}
+    while(res == 0)
+    {
+        res = hid_write(dev->handle, buffer, 9);
+        // the Finch cannot take it yet, give it time instead of spinning
+        if (res == 0)
+        {
+            dev->refused++;
+            Fin_Nap(1000);
+        }
+    }
+    dev->link_bytes += 9;
 
     while (res > 0 && flag == SEND_RECV)
     {
         // read back from the finch
-        res = hid_read(finch_handle, buffer, 9);
+        res = hid_read(dev->handle, buffer, 9);
+        dev->link_bytes += 9;
         // make sure the sequence number matches what was sent
-        if (cmnd == 'z' || buffer[7] == seq_num)
+        if (cmnd == 'z' || buffer[7] == dev->seq_num)
            break;
     }
 
+    if (res < 0)
+    {
+        // unplugged or USB reset, the background thread reconnects
+        Fin_Lock(&dev->lock);
+        hid_close(dev->handle);
+        dev->handle = 0;
+        dev->lost = 1;
+        dev->lost_at = Fin_Usec();
+        dev->retry_at = dev->lost_at;
+        Fin_Unlock(&dev->lock);
+        printf("Lost the connection to the Finch\n");
+        return(FIN_EDISCONNECTED);
+    }
+
+    Fin_Shown(dev, cmnd, buffer);
     return(res);
 }
 
 
+/**  Fin_LinkStatus(*link).
+ *  get the state of the connection to the finch and how long
+ *  it took to open it and to recover it
+ *
+ *  input:
+ *     Fin_Link *link = pointer where to return the state
+ *  returns
+ *     -1 if failure
+ */
+int Fin_LinkStatus(Fin_Link *link)
+{
+    link->connected = finch->handle != 0 || finch->attached;
+    link->cached = finch->cached;
+    link->reconnects = finch->reconnects;
+    link->open_usec = (long)finch->open_usec;
+    link->recover_usec = (long)finch->recover_usec;
+    link->rtt_usec = (long)finch->rtt_usec;
+    return(1);
+}
+
+
+/**  Fin_Flush(lane).
+ *  drop the commands waiting to be sent in the lanes below the given one,
+ *  their callers get FIN_ECANCELED
+ *
+ *  input:
+ *     int lane = lowest lane kept (FIN_LANE_SAFETY keeps only safety commands)
+ *  returns
+ *     number of commands dropped
+ */
+int Fin_Flush(int lane)
+{
+    int count;
+
+    Fin_Lock(&finch->lock);
+    count = Fin_Cancel(finch, lane, NULL, FIN_ECANCELED);
+    Fin_Unlock(&finch->lock);
+    return(count);
+}
+
+
+/**  Fin_Stop(void).
+ *  stop the motors ahead of everything queued, dropping
+ *  the commands waiting to be sent
+ *
+ *  input:
+ *     none
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Stop(void)
+{
+    Fin_Flush(FIN_LANE_SAFETY);
+    return(Fin_Motor(0,0,0));
+}
+
+
 /**  Fin_Motor(tenth, left, right).
  *  set the speed (and duration) of the wheels
  *
@@ -299,9 +1280,11 @@ int Fin_Motor(int tenth, int left, int right)
     int res;
 
     // save the motor speed in global variables
-    time_to_stop = 0;
-    left_speed = left;
-    right_speed = right;
+    Fin_Lock(&finch->lock);
+    finch->stop_at = 0;
+    finch->left_speed = left;
+    finch->right_speed = right;
+    Fin_Unlock(&finch->lock);
 
     // check for motor stop
     if (left == 0 && right == 0)
@@ -331,7 +1314,10 @@ int Fin_Motor(int tenth, int left, int right)
     if (res > 0 && tenth > 0)
     {
         // have the background thread stop the motors
-        time_to_stop = tenth;
+        Fin_Lock(&finch->lock);
+        finch->stop_at = Fin_Usec() + tenth * 100000LL;
+        Fin_Wake(finch);
+        Fin_Unlock(&finch->lock);
     }
 
     return(res);
@@ -353,12 +1339,14 @@ int Fin_Motor(int tenth, int left, int right)
 int Fin_Move( int tenth, int left, int right )
 {
    int toReturn = Fin_Motor( tenth, left, right );
-   while (1 && toReturn != -1)
-   {
-      Fin_Speed( &left, &right );
-      if (left == 0 && right == 0)
-         break;
-   }
+
+   // the background thread tells when it stops the wheels,
+   // unless the program runs out of time first (Fin_ClockLimit)
+   Fin_Lock(&finch->lock);
+   while (toReturn > 0 && (finch->left_speed != 0 || finch->right_speed != 0) &&
+          !Fin_ClockExpired())
+      Fin_Wait(&finch->done, &finch->lock);
+   Fin_Unlock(&finch->lock);
    return toReturn;
 }
 
@@ -372,8 +1360,8 @@ int Fin_Move( int tenth, int left, int right )
  */
 int Fin_Speed(int *left, int *right)
 {
-    *left = left_speed;
-    *right = right_speed;
+    *left = finch->left_speed;
+    *right = finch->right_speed;
     return(1);
 }
 
@@ -440,6 +1428,22 @@ int Fin_Buzzer(int msec,int freq)
  *     -1 if failure
  */
 int Fin_Lights(int *left, int *right)
+{
+    return(Fin_LightsStamped(left, right, NULL));
+}
+
+
+/**  Fin_LightsStamped(*left, *right, *stamp).
+ *  get light sensor data and when it was measured
+ *
+ *  input:
+ *     int *left/*right = pointer where to return the light sensor data
+ *     returned values range 255 to 0 (0=dark)
+ *     Fin_Stamp *stamp = pointer where to return when it was measured, NULL if not needed
+ *  returns
+ *     -1 if failure
+ */
+int Fin_LightsStamped(int *left, int *right, Fin_Stamp *stamp)
 {
     unsigned char IoBuffer[9];
     int res;
@@ -448,7 +1452,7 @@ int Fin_Lights(int *left, int *right)
     *right = 0;
 
     // request left/right sensors
-    res = Fin_Cmnd(SEND_RECV,'L',IoBuffer);
+    res = Fin_CmndStamp(SEND_RECV,'L',IoBuffer,stamp);
 
     if (res > 0)
     {
@@ -469,6 +1473,22 @@ int Fin_Lights(int *left, int *right)
  *     -1 if failure
  */
 int Fin_Obstacle(int *left, int *right)
+{
+    return(Fin_ObstacleStamped(left, right, NULL));
+}
+
+
+/**  Fin_ObstacleStamped(*left, *right, *stamp).
+ *  get obstacle sensor data and when it was measured
+ *
+ *  input:
+ *     int *left/*right = pointer where to return the obstacle flags
+ *     returned value is 1 or 0 (0=no obstacle)
+ *     Fin_Stamp *stamp = pointer where to return when it was measured, NULL if not needed
+ *  returns
+ *     -1 if failure
+ */
+int Fin_ObstacleStamped(int *left, int *right, Fin_Stamp *stamp)
 {
     unsigned char IoBuffer[9];
     int res;
@@ -477,7 +1497,7 @@ int Fin_Obstacle(int *left, int *right)
     *right = 0;
 
     // get left/right obstacle sensors
-    res = Fin_Cmnd(SEND_RECV,'I',IoBuffer);
+    res = Fin_CmndStamp(SEND_RECV,'I',IoBuffer,stamp);
 
     if (res > 0)
     {
@@ -498,6 +1518,22 @@ int Fin_Obstacle(int *left, int *right)
  *     -1 if failure
  */
 int Fin_Temp(float *temp)
+{
+    return(Fin_TempStamped(temp, NULL));
+}
+
+
+/**  Fin_TempStamped(*temp, *stamp).
+ *  get temperature sensor data and when it was measured
+ *
+ *  input:
+ *     float *temp = pointer where to return the temperature
+ *     returned value is in celsius (in 1/1000 units)
+ *     Fin_Stamp *stamp = pointer where to return when it was measured, NULL if not needed
+ *  returns
+ *     -1 if failure
+ */
+int Fin_TempStamped(float *temp, Fin_Stamp *stamp)
 {
     unsigned char IoBuffer[9];
     int res;
@@ -505,17 +1541,26 @@ int Fin_Temp(float *temp)
     *temp = 0.0;
 
     // request temperature data
-    res = Fin_Cmnd(SEND_RECV,'T',IoBuffer);
+    res = Fin_CmndStamp(SEND_RECV,'T',IoBuffer,stamp);
 
     if (res > 0)
     {
         // convert the data to celsius
-        *temp = (float)(IoBuffer[0] - 127) / 2.4 + 25;
+        *temp = Fin_DecodeTemp(IoBuffer);
     }
     return(res);
 }
 
 
+/*
+ * convert the response of a 'T' command to celsius
+ */
+float Fin_DecodeTemp(const unsigned char *buffer)
+{
+    return((float)(buffer[0] - 127) / 2.4 + 25);
+}
+
+
 /**  Fin_Accel(*x, *y, *z, *tap, *shake).
  *  get acceleration values and tap/shaken flags
  *
@@ -529,83 +1574,106 @@ int Fin_Temp(float *temp)
  */
 int Fin_Accel(float *x, float *y, float *z, int *tap, int *shake)
 {
-    float table[3] = {0.0, 0.0, 0.0};
+    return(Fin_AccelStamped(x, y, z, tap, shake, NULL));
+}
+
+
+/**  Fin_AccelStamped(*x, *y, *z, *tap, *shake, *stamp).
+ *  get acceleration values and tap/shaken flags and when it was measured
+ *
+ *  input:
+ *     float *x/*y/*z = pointer where to return the acceleration for each axis
+ *     returned value is in 'g' (in 1/1000 units) can be positive or negative
+ *     int *tap/*shake = pointer where to return the tap/shaken flags
+ *     returned value is 1 or 0 (0=not tap, not shaken)
+ *     Fin_Stamp *stamp = pointer where to return when it was measured, NULL if not needed
+ *  returns
+ *     -1 if failure
+ */
+int Fin_AccelStamped(float *x, float *y, float *z, int *tap, int *shake, Fin_Stamp *stamp)
+{
     unsigned char IoBuffer[9];
-    int res,ofst,data;
+    int res;
 
     *tap = 0;
     *shake = 0;
 
     // request sensor information
-    res = Fin_Cmnd(SEND_RECV,'A',IoBuffer);
+    res = Fin_CmndStamp(SEND_RECV,'A',IoBuffer,stamp);
 
     if (res > 0)
-    {
-        // Convert the raw accelerometer data to G-forces
-        for (ofst=0; ofst<3; ofst++)
-        {
-            data = (int)IoBuffer[ofst+1];
-            if (data > 31)
-                data -= 64;
-
-            table[ofst] = (float)data * 1.5 / 32.0;
-        }
-        *x = table[0];
-        *y = table[1];
-        *z = table[2];
-
-        // check the tap/shake sensors
-        *tap = IoBuffer[4] & 0x20 ? 1 : 0 ;
-        *shake = IoBuffer[4] & 0x80 ? 1 : 0 ;
-    }
+        Fin_DecodeAccel(IoBuffer, x, y, z, tap, shake);
 
     return(res);
 }
 
-static char _inpbuf[80];
 
-#ifdef _LINUX_
-static int _key = 0;
-
-/* secondary thread to block waiting for a keypress */
-void *KeyThread(void *arg)
+/*
+ * convert the response of an 'A' command to G-forces and tap/shake flags
+ */
+void Fin_DecodeAccel(const unsigned char *buffer, float *x, float *y, float *z, int *tap, int *shake)
 {
-   while (1)
-   {
-     usleep(1000);
-     gets(_inpbuf);
-     _key = 1;
-   }
-}
+    float table[3];
+    int ofst,data;
 
-int kbhit(void)
-{
-   fflush(stdout);
-   return(_key);
+    // Convert the raw accelerometer data to G-forces
+    for (ofst=0; ofst<3; ofst++)
+    {
+        data = (int)buffer[ofst+1];
+        if (data > 31)
+            data -= 64;
+
+        table[ofst] = (float)data * 1.5 / 32.0;
+    }
+    *x = table[0];
+    *y = table[1];
+    *z = table[2];
+
+    // check the tap/shake sensors
+    *tap = buffer[4] & 0x20 ? 1 : 0 ;
+    *shake = buffer[4] & 0x80 ? 1 : 0 ;
 }
-#endif
 
-/* CheckForKey(void)
- *    check for a keypress: combination of kbhit and getch
+
+/**  Fin_Snapshot(*snap).
+ *  copy the latest sensor readings seen by the library,
+ *  or published by the daemon when the robot is shared
  *
- * input:
- *    none
- * return:
- *    0 = no keyboard entry
- *    else, Ascii character from the keyboard
+ *  input:
+ *     Fin_Sensors *snap = pointer where to return the readings
+ *  returns
+ *     -1 if failure
  */
-char *CheckForInput(void)
+int Fin_Snapshot(Fin_Sensors *snap)
 {
-   /* see if a key has been pressed */
-   if (kbhit() == 0)
-      return(0);
+    if (finch->attached)
+    {
+        if (Fin_ShmSnapshot(snap) < 0)
+            return(-1);
+        Fin_FilterShared(finch, snap);
+        return(1);
+    }
 
-#ifdef _LINUX_
-   _key = 0;
-#else
-   gets(_inpbuf);
-#endif
-   return(_inpbuf);
+    Fin_Lock(&finch->lock);
+    *snap = finch->snap;
+    Fin_Unlock(&finch->lock);
+    return(1);
 }
 
 
+/*
+ * device used by the Fin_ functions
+ */
+struct fin_dev *Fin_Dev(void)
+{
+    return(finch);
+}
+
+
+/*
+ * have this thread use another device, NULL for the one of Fin_Init
+ */
+void Fin_DevUse(struct fin_dev *dev)
+{
+    finch = dev != NULL ? dev : &finch_dev;
+}
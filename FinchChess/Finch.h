@@ -4,10 +4,91 @@
 /** Sets the API for use with Mac or Linux, comment out if using Windows */
 //#define _LINUX_
 
-/** If using Linux/Mac, redefines sleep to match that OS call */
-#ifdef _LINUX_
-#define Sleep(mm)  usleep(mm*1000)
+/** Sleep waits on the clock of the library (see Fin_Sleep), on Windows
+ *  too: windows.h is included first so its own Sleep is left alone */
+#ifndef _LINUX_
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600         // condition variables
+#endif
+#include <windows.h>
 #endif
+#define Sleep(mm)  Fin_Sleep(mm)
+
+/** Returned by the Fin_ functions while the Finch is unplugged,
+ *  the library reconnects by itself as soon as it is back */
+#define FIN_EDISCONNECTED  -2
+
+/** Returned for a command dropped before being sent (see Fin_Flush) */
+#define FIN_ECANCELED      -3
+
+/** Lanes of the command scheduler: a command waiting in a lane
+ *  is sent before those waiting in the lanes below it */
+#define FIN_LANE_SAFETY     0   // wheel stop, 'X' and 'R'
+#define FIN_LANE_ACTUATOR   1   // wheels, beak and buzzer
+#define FIN_LANE_SENSOR     2   // sensor requests
+#define FIN_LANE_KEEPALIVE  3   // keep-alive
+#define FIN_LANES           4
+
+/**
+ *  Fin_Usec(void).
+ *  Microseconds of the clock of the library, the one the timestamps of
+ *  the readings are taken with (see Fin_Stamp): monotonic, or virtual
+ *  (see Fin_Clock).
+ *
+ *  @return the time in usec, from an arbitrary point
+ */
+long long Fin_Usec(void);
+
+/** Clocks of the library, see Fin_Clock */
+#define FIN_CLOCK_REAL      0   // the wall clock
+#define FIN_CLOCK_VIRTUAL   1   // jumps ahead whenever the program and the library wait
+
+/**
+ *  Fin_Clock(kind).
+ *  Choose the clock the library times everything with: keep-alive, wheel
+ *  durations, melodies, routines, Fin_Usec and Sleep. On the virtual
+ *  clock, time only goes by while the program and the library all wait
+ *  (then it jumps to the first thing due), or with Fin_ClockAdvance, so a
+ *  timed behaviour runs at once and always the same way. A simulated robot
+ *  (see Fin_SimStatus) always runs on it.
+ *  Call it before Fin_Init.
+ *
+ *  @param kind FIN_CLOCK_REAL (the default) or FIN_CLOCK_VIRTUAL
+ *
+ *  @return -1 if failure
+ */
+int Fin_Clock(int kind);
+
+/**
+ *  Fin_ClockAdvance(usec).
+ *  Move the virtual clock forward by hand, e.g. by the time the program
+ *  spent computing. What was due in the meantime happens right away.
+ *
+ *  @param usec by how much
+ *
+ *  @return -1 if failure (not on the virtual clock)
+ */
+int Fin_ClockAdvance(long long usec);
+
+/**
+ *  Fin_Sleep(msec).
+ *  Wait on the clock of the library (what Sleep does in the programs).
+ *
+ *  @param msec how long
+ */
+void Fin_Sleep(int msec);
+
+/**
+ *  When a reading was taken, on the clock of Fin_Usec
+ */
+typedef struct fin_stamp Fin_Stamp;
+struct fin_stamp
+{
+    long long sent_usec;    // the request went out
+    long long recv_usec;    // the response came back
+    long long sample_usec;  // estimated instant the Finch measured it: the request
+                            // went out plus half the round trip of the link
+};
 
 /**
  *  Fin_init(void).
@@ -100,6 +181,16 @@ int Fin_Buzzer(int msec,int freq);
  */
 int Fin_Lights(int *left, int *right);
 
+/**
+ *  Fin_LightsStamped(*left, *right, *stamp).
+ *  Same as Fin_Lights, also telling when the reading was taken.
+ *
+ *  @param *stamp pointer where to return when it was measured, NULL if not needed
+ *
+ *  @return -1 if failure
+ */
+int Fin_LightsStamped(int *left, int *right, Fin_Stamp *stamp);
+
 /**
  *  Fin_Obstacle(*left, *right).
  *  Get obstacle sensor data. Returned value is 1 or 0 (0=no obstacle).
@@ -111,6 +202,16 @@ int Fin_Lights(int *left, int *right);
  */
 int Fin_Obstacle(int *left, int *right);
 
+/**
+ *  Fin_ObstacleStamped(*left, *right, *stamp).
+ *  Same as Fin_Obstacle, also telling when the reading was taken.
+ *
+ *  @param *stamp pointer where to return when it was measured, NULL if not needed
+ *
+ *  @return -1 if failure
+ */
+int Fin_ObstacleStamped(int *left, int *right, Fin_Stamp *stamp);
+
 /**
  *  Fin_Temp(*temp).
  *  Get temperature sensor data
@@ -121,6 +222,16 @@ int Fin_Obstacle(int *left, int *right);
  */
 int Fin_Temp(float *temp);
 
+/**
+ *  Fin_TempStamped(*temp, *stamp).
+ *  Same as Fin_Temp, also telling when the reading was taken.
+ *
+ *  @param *stamp pointer where to return when it was measured, NULL if not needed
+ *
+ *  @return -1 if failure
+ */
+int Fin_TempStamped(float *temp, Fin_Stamp *stamp);
+
 /**
  *  Fin_Accel(*x, *y, *z, *tap, *shake).
  *  Get acceleration values and tap/shaken flags. Returned acceleration values are in 'g' (in 1/1000 units) and range from +1.5 to -1.5g.
@@ -135,6 +246,842 @@ int Fin_Temp(float *temp);
  */
 int Fin_Accel(float *x, float *y, float *z,int *tap, int *shake);
 
+/**
+ *  Fin_AccelStamped(*x, *y, *z, *tap, *shake, *stamp).
+ *  Same as Fin_Accel, also telling when the reading was taken.
+ *
+ *  @param *stamp pointer where to return when it was measured, NULL if not needed
+ *
+ *  @return -1 if failure
+ */
+int Fin_AccelStamped(float *x, float *y, float *z, int *tap, int *shake, Fin_Stamp *stamp);
+
+/**
+ *  Fin_Stop(void).
+ *  Stop the motors ahead of every command waiting to be sent,
+ *  and drop those commands (they return FIN_ECANCELED).
+ *
+ *  @return -1 if failure
+ */
+int Fin_Stop(void);
+
+/**
+ *  Fin_Flush(lane).
+ *  Drop the commands waiting to be sent in the lanes below the given one
+ *  (FIN_LANE_SAFETY drops everything but safety commands).
+ *  The dropped calls return FIN_ECANCELED.
+ *
+ *  @param lane lowest lane to keep
+ *
+ *  @return number of commands dropped
+ */
+int Fin_Flush(int lane);
+
+/**
+ *  State of the connection to the Finch, see Fin_LinkStatus
+ */
+typedef struct fin_link Fin_Link;
+struct fin_link
+{
+    int connected;          // 1 while the Finch can be reached
+    int cached;             // 1 if opened with the path remembered by the last run
+    int reconnects;         // number of times the connection was recovered
+    long open_usec;         // time Fin_Init took to open the Finch (usec)
+    long recover_usec;      // time from unplugged to reconnected, last time (usec)
+    long rtt_usec;          // round trip of a command, running average (usec)
+};
+
+/**
+ *  Fin_LinkStatus(*link).
+ *  Get the state of the connection and how long it took to open and recover it.
+ *  While the Finch is unplugged the other functions return FIN_EDISCONNECTED
+ *  right away; on reconnect the beak color and wheel speeds are put back.
+ *
+ *  @param *link pointer where to return the state
+ *
+ *  @return -1 if failure
+ */
+int Fin_LinkStatus(Fin_Link *link);
+
+/**
+ *  Flow control of the commands sent to the Finch, see Fin_FlowStatus
+ */
+typedef struct fin_flow_stats Fin_FlowStats;
+struct fin_flow_stats
+{
+    int rate;               // commands per second let through now
+    int calibrated;         // sustained rate measured by Fin_Calibrate (this run or
+                            // an earlier one), 0 if never
+    int refused;            // writes the Finch did not take at once
+    int throttled;          // times commands were held back to keep to the rate
+};
+
+/**
+ *  Fin_FlowStatus(*stats).
+ *  Get the rate the commands are sent at. The library learns it from the
+ *  writes the Finch refuses and the round trips, and holds commands back
+ *  (in their queue) rather than sending faster.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_FlowStatus(Fin_FlowStats *stats);
+
+/**
+ *  Fin_Calibrate(msec).
+ *  Measure how many commands per second the Finch takes, sending it
+ *  commands as fast as it can for msec, and remember it for the next runs
+ *  (in the file that remembers the Finch, one line per robot).
+ *
+ *  @param msec duration of the measure, 1000 is enough
+ *
+ *  @return the commands per second, -1 if failure
+ */
+int Fin_Calibrate(int msec);
+
+/** Sensors of the Finch */
+#define FIN_LIGHTS          0
+#define FIN_OBSTACLES       1
+#define FIN_ACCEL           2
+#define FIN_TEMP            3
+#define FIN_SENSORS         4
+
+/**
+ *  Sensor readings kept by the library (or published by the Finch
+ *  daemon), see Fin_Snapshot. They are sampled in the background,
+ *  so the values can be read at any time without talking to the robot.
+ */
+typedef struct fin_sensors Fin_Sensors;
+struct fin_sensors
+{
+    unsigned int count;     // number of sensor samples taken so far
+    int lights[2];          // left/right light sensors (0-255, 0=dark)
+    int obstacle[2];        // left/right obstacle sensors (1=obstacle)
+    float accel[3];         // x/y/z acceleration in 'g'
+    int tap;                // 1 if tapped since the previous sample
+    int shake;              // 1 if shaken since the previous sample
+    float temp;             // temperature in celsius
+    int left_speed;         // speed of the wheels last sent by any client
+    int right_speed;
+    long long when[FIN_SENSORS];    // when each sensor was last measured (see Fin_Stamp)
+    struct
+    {
+        float lights[2];
+        int obstacle[2];
+        float accel[3];
+        float temp;
+    } filtered;             // the same readings through the filters (see Fin_Filter)
+};
+
+/**
+ *  Fin_Snapshot(*snap).
+ *  Copy the latest sensor readings seen by the library (those asked for
+ *  by the program and those sampled for the reflexes), or published by
+ *  the Finch daemon when the robot is shared.
+ *  Only a memory copy is done, no request is sent to the robot.
+ *
+ *  @param *snap pointer where to return the readings
+ *
+ *  @return -1 if failure
+ */
+int Fin_Snapshot(Fin_Sensors *snap);
+
+/** Filters of the readings, see Fin_Filter */
+#define FIN_FILTER_NONE         0   // filtered = raw
+#define FIN_FILTER_EMA          1   // exponential moving average
+#define FIN_FILTER_MEDIAN       2   // median of the last samples
+#define FIN_FILTER_DEBOUNCE     3   // obstacles: changes must hold a few samples
+#define FIN_MEDIAN_MAX          9   // longest window of a median
+
+/**
+ *  Fin_Filter(sensor, kind, param).
+ *  Filter the readings of a sensor: each sample the library sees (asked
+ *  by the program or sampled in the background, see Fin_Subscribe) updates
+ *  the filtered values of the snapshot, next to the raw ones.
+ *  When the robot is shared through the daemon, each Fin_Snapshot takes
+ *  the sensors sampled since the last one as one sample each.
+ *  e.g. Fin_Filter(FIN_LIGHTS, FIN_FILTER_EMA, 20);
+ *     Fin_Filter(FIN_OBSTACLES, FIN_FILTER_DEBOUNCE, 3);
+ *
+ *  @param sensor FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *  @param kind FIN_FILTER_...
+ *  @param param EMA: weight of a new sample in % (1-100),
+ *               MEDIAN: samples in the window (2-FIN_MEDIAN_MAX),
+ *               DEBOUNCE: samples a change must hold
+ *
+ *  @return -1 if failure
+ */
+int Fin_Filter(int sensor, int kind, int param);
+
+/** Conditions of a reflex rule */
+#define FIN_IF_OBSTACLE_BOTH    1   // both obstacle sensors see something
+#define FIN_IF_OBSTACLE_ANY     2   // one of the obstacle sensors sees something
+#define FIN_IF_OBSTACLE_LEFT    3
+#define FIN_IF_OBSTACLE_RIGHT   4
+#define FIN_IF_SHAKE            5   // the Finch was shaken
+#define FIN_IF_TAP              6   // the Finch was tapped
+#define FIN_IF_LIGHT_BELOW      7   // a light sensor is below value (0-255)
+#define FIN_IF_LIGHT_ABOVE      8   // a light sensor is above value (0-255)
+#define FIN_IF_TEMP_ABOVE       9   // the temperature is above value (celsius)
+
+/** Actions of a reflex rule, can be combined with | */
+#define FIN_DO_STOP             1   // stop the wheels
+#define FIN_DO_LED              2   // set the beak to red, green, blue
+#define FIN_DO_BUZZ             4   // buzz for msec at freq
+
+/**
+ *  A reflex rule: when the condition becomes true on a sensor sample,
+ *  the library does the actions right away from its background thread,
+ *  even while the program is blocked in Fin_Move.
+ *  e.g. stop when both obstacle sensors fire:
+ *     Fin_Rule rule = { FIN_IF_OBSTACLE_BOTH, 0, FIN_DO_STOP, 0, 0, 0, 0, 0, 0 };
+ */
+typedef struct fin_rule Fin_Rule;
+struct fin_rule
+{
+    int when;               // FIN_IF_...
+    int value;              // threshold of the light and temperature conditions
+    int action;             // FIN_DO_...
+    int red;                // beak color for FIN_DO_LED
+    int green;
+    int blue;
+    int msec;               // buzzer for FIN_DO_BUZZ
+    int freq;
+    int once;               // 1 to remove the rule once it has fired
+};
+
+/**
+ *  Fin_Reflex(*rule).
+ *  Add a reflex rule. While a rule is armed, the sensor it watches is
+ *  sampled by the library as if it had a subscriber (see Fin_Subscribe).
+ *
+ *  @param *rule the rule (copied)
+ *
+ *  @return the rule number, -1 if failure
+ */
+int Fin_Reflex(const Fin_Rule *rule);
+
+/**
+ *  Fin_ReflexClear(id).
+ *  Remove a reflex rule.
+ *
+ *  @param id the rule number returned by Fin_Reflex, -1 for all of them
+ *
+ *  @return -1 if failure
+ */
+int Fin_ReflexClear(int id);
+
+/**
+ *  Reaction times of the reflexes, see Fin_ReflexStatus
+ */
+typedef struct fin_reflex_stats Fin_ReflexStats;
+struct fin_reflex_stats
+{
+    int fired;              // number of times a rule fired
+    long last_usec;         // from the sample received to the first action sent, last time
+    long avg_usec;
+    long max_usec;
+    long sample_usec;       // from the sample requested to the first action sent, last time
+};
+
+/**
+ *  Fin_ReflexStatus(*stats).
+ *  Get the reaction times of the reflexes.
+ *
+ *  @param *stats pointer where to return them
+ *
+ *  @return -1 if failure
+ */
+int Fin_ReflexStatus(Fin_ReflexStats *stats);
+
+/**
+ *  Fin_Subscribe(sensor).
+ *  Have the library sample a sensor in the background, the readings are
+ *  then in Fin_Snapshot. How often depends on the wheels: obstacles and
+ *  lights every 10 msec at full speed down to 50 msec at low speed and
+ *  once a second while parked, the accelerometer every 50 msec while
+ *  moving (250 parked), the temperature every 2 seconds.
+ *  Subscriptions add up, each one is undone by a Fin_Unsubscribe.
+ *
+ *  @param sensor FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *
+ *  @return -1 if failure
+ */
+int Fin_Subscribe(int sensor);
+
+/**
+ *  Fin_Unsubscribe(sensor).
+ *  Undo a Fin_Subscribe, the sensor is no longer sampled once nobody watches it.
+ *
+ *  @param sensor FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *
+ *  @return -1 if failure
+ */
+int Fin_Unsubscribe(int sensor);
+
+/**
+ *  Sampling of the sensors and traffic on the link, see Fin_PollStatus
+ */
+typedef struct fin_poll_stats Fin_PollStats;
+struct fin_poll_stats
+{
+    long period_usec[FIN_SENSORS];  // current sampling period, 0 if not sampled
+    float rate[FIN_SENSORS];        // samples per second, last second
+    long bytes_per_sec;             // USB traffic, last second
+    long cmnds_per_sec;             // commands sent, last second
+};
+
+/**
+ *  Fin_PollStatus(*stats).
+ *  Get the sampling periods of the sensors, the rates achieved and the traffic.
+ *
+ *  @param *stats pointer where to return them
+ *
+ *  @return -1 if failure
+ */
+int Fin_PollStatus(Fin_PollStats *stats);
+
+/** Robots in a fleet */
+#define FIN_FLEET           8
+
+/**
+ *  Fin_FleetOpen(void).
+ *  Make a fleet of the Finch opened by Fin_Init (robot 0) and every
+ *  other Finch plugged in (not available through the daemon).
+ *  Commands staged with Fin_FleetMotor/Fin_FleetLED are then sent to
+ *  all the robots at the same time by Fin_FleetGo, e.g. to dance together:
+ *     Fin_FleetMotor(-1, 10, 255, -255);
+ *     Fin_FleetLED(-1, 0, 0, 255);
+ *     Fin_FleetGo(20);
+ *
+ *  @return the number of robots, -1 if failure
+ */
+int Fin_FleetOpen(void);
+
+/**
+ *  Fin_FleetClose(void).
+ *  Send the robots opened by Fin_FleetOpen back to idle mode and close them.
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetClose(void);
+
+/**
+ *  Fin_FleetMotor(robot, tenth, left, right).
+ *  Stage a wheel command (see Fin_Motor) for the next Fin_FleetGo.
+ *
+ *  @param robot robot of the fleet, -1 for all of them
+ *  @param tenth motor on time (in tenths of a second), -1 to keep turning
+ *  @param left speed of left wheel (-255 to 255)
+ *  @param right speed of right wheel (-255 to 255)
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetMotor(int robot, int tenth, int left, int right);
+
+/**
+ *  Fin_FleetLED(robot, red, green, blue).
+ *  Stage a beak command (see Fin_LED) for the next Fin_FleetGo.
+ *
+ *  @param robot robot of the fleet, -1 for all of them
+ *  @param red, green, blue intensity of the beak LED (0-255)
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetLED(int robot, int red, int green, int blue);
+
+/**
+ *  Fin_FleetGo(msec).
+ *  Send the staged commands to every robot at the same time, msec from now,
+ *  and wait until they are sent. 20 msec is enough for the robots to be ready.
+ *
+ *  @param msec delay before the release
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetGo(int msec);
+
+/**
+ *  How far apart the robots got their commands, see Fin_FleetStatus
+ */
+typedef struct fin_fleet_stats Fin_FleetStats;
+struct fin_fleet_stats
+{
+    int releases;           // number of Fin_FleetGo
+    int robots;             // robots that got their commands at the last one
+    long skew_usec;         // between the first and the last robot, last time
+    long late_usec;         // from the release time to the last robot, last time
+    long max_skew_usec;
+};
+
+/**
+ *  Fin_FleetStatus(*stats).
+ *  Get how far apart the robots got their commands.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetStatus(Fin_FleetStats *stats);
+
+/**
+ *  A note of a melody, see Fin_Melody
+ */
+typedef struct fin_note Fin_Note;
+struct fin_note
+{
+    int freq;               // frequency in hz, 0 for a rest
+    int msec;               // duration of the tone
+    int rest;               // msec of silence after it
+};
+
+/**
+ *  Fin_Melody(*notes, count, loops).
+ *  Play a melody in the background: each note is encoded beforehand and
+ *  sent by the background thread of the library at its own time, so the
+ *  notes follow each other without gaps while the program goes on
+ *  (and the wheels turn). A new melody replaces the one playing.
+ *  e.g. Fin_Note scale[] = { {262, 250, 0}, {294, 250, 0}, {330, 500, 100} };
+ *     Fin_Melody(scale, 3, 1);
+ *
+ *  @param *notes the notes
+ *  @param count number of notes
+ *  @param loops times to play it, 0 for ever
+ *
+ *  @return -1 if failure
+ */
+int Fin_Melody(const Fin_Note *notes, int count, int loops);
+
+/**
+ *  Fin_MelodyStop(void).
+ *  Stop the melody and turn the buzzer off.
+ *
+ *  @return -1 if failure
+ */
+int Fin_MelodyStop(void);
+
+/**
+ *  How late the timed commands were sent, see Fin_MelodyStatus
+ */
+typedef struct fin_track_stats Fin_TrackStats;
+struct fin_track_stats
+{
+    int playing;            // commands (or frames) left to send
+    int sent;               // commands sent
+    int skipped;            // frames not sent, the robot showed them already
+    int dropped;            // skipped, too late (robot unplugged)
+    long last_usec;         // from the time of a command to it going out, last one
+    long avg_usec;
+    long max_usec;
+};
+
+/**
+ *  Fin_MelodyStatus(*stats).
+ *  Get whether the melody still plays and how late its notes went out.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_MelodyStatus(Fin_TrackStats *stats);
+
+/* easing curves of an animation, from a key frame to the next */
+#define FIN_EASE_LINEAR     0
+#define FIN_EASE_IN         1       // starts slowly
+#define FIN_EASE_OUT        2       // ends slowly
+#define FIN_EASE_INOUT      3       // both
+#define FIN_EASE_STEP       4       // keeps the previous color, then jumps
+
+/**
+ *  A key frame of an animation of the beak, see Fin_Animate
+ */
+typedef struct fin_key Fin_Key;
+struct fin_key
+{
+    int red, green, blue;   // color of the beak (0-255)
+    int msec;               // reached msec after the previous key frame
+    int ease;               // FIN_EASE_..., how it gets there
+};
+
+/**
+ *  Fin_Animate(*keys, count, fps, loops).
+ *  Animate the beak in the background (fades, pulses, color sequences):
+ *  the background thread of the library computes the frames from the key
+ *  frames at the given rate and only sends those that change the color,
+ *  while the program goes on. A first key frame after 0 msec starts from
+ *  the color shown. A new animation replaces the one playing.
+ *  e.g. pulse in blue, once a second
+ *     Fin_Key pulse[] = { {0, 0, 255, 0, 0}, {0, 0, 20, 500, FIN_EASE_INOUT},
+ *                         {0, 0, 255, 500, FIN_EASE_INOUT} };
+ *     Fin_Animate(pulse, 3, 50, 0);
+ *
+ *  @param *keys the key frames
+ *  @param count number of key frames
+ *  @param fps frames per second (1-100)
+ *  @param loops times to play it, 0 for ever
+ *
+ *  @return -1 if failure
+ */
+int Fin_Animate(const Fin_Key *keys, int count, int fps, int loops);
+
+/**
+ *  Fin_AnimateStop(void).
+ *  Stop the animation, the beak keeps its color.
+ *
+ *  @return -1 if failure
+ */
+int Fin_AnimateStop(void);
+
+/**
+ *  Fin_AnimateStatus(*stats).
+ *  Get whether the animation still plays, and how many frames were sent
+ *  and skipped because the color did not change.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_AnimateStatus(Fin_TrackStats *stats);
+
+/**
+ *  Fin_FleetAnimate(robot, *keys, count, fps, loops).
+ *  Animate the beaks of the fleet in step (see Fin_Animate), from
+ *  20 msec from now.
+ *
+ *  @param robot robot of the fleet, -1 for all of them
+ *  @param *keys, count, fps, loops as for Fin_Animate
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetAnimate(int robot, const Fin_Key *keys, int count, int fps, int loops);
+
+/**
+ *  Fin_FleetAnimateStatus(robot, *stats).
+ *  Get the frames sent and skipped by the animation of a robot of the fleet.
+ *
+ *  @param robot robot of the fleet, -1 for the sum of all of them
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_FleetAnimateStatus(int robot, Fin_TrackStats *stats);
+
+/**
+ *  Fin_OnInput(callback, *arg).
+ *  Have a function called with each line typed on the console while the
+ *  program runs (Linux/Mac: as soon as it is typed, from the background
+ *  thread of the library; Windows: when the program calls CheckForInput).
+ *  The line "stop" also stops the wheels right away.
+ *
+ *  @param callback the function, NULL to remove it
+ *  @param *arg for the function
+ *
+ *  @return -1 if failure
+ */
+int Fin_OnInput(void (*callback)(const char *line, void *arg), void *arg);
+
+/**
+ *  CheckForInput(void).
+ *  Get the next line typed on the console.
+ *
+ *  @return the line (valid until the next call), 0 if none
+ */
+char *CheckForInput(void);
+
+/**
+ *  State of the simulated robot (see Fin_SimStatus)
+ */
+typedef struct fin_sim_stats Fin_SimStats;
+struct fin_sim_stats
+{
+    double x, y;            // meters from the bottom left corner of the maze
+    double heading;         // degrees counterclockwise from east (0-360)
+    double distance;        // meters driven
+    int collisions;         // times it ran into a wall
+    int cmnds;              // commands received
+    long long usec;         // virtual time since Fin_Init
+    long long goal_usec;    // when it first reached the goal cell (G), 0 if not yet
+};
+
+/**
+ *  Fin_SimStatus(*stats).
+ *  Get where the simulated robot is and what it went through. Fin_Init
+ *  opens a simulated robot when $FINCH_SIM names a maze file (and
+ *  $FINCH_SIM_LIGHTS a light file, see FinchSim.c); it runs on the virtual
+ *  clock (see Fin_Clock).
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure (not simulating)
+ */
+int Fin_SimStatus(Fin_SimStats *stats);
+
+/**
+ *  Where the robot is (see Fin_PoseNow)
+ */
+typedef struct fin_pose_est Fin_Pose;
+struct fin_pose_est
+{
+    double x, y;            // meters from where it started (or Fin_PoseSet)
+    double heading;         // degrees counterclockwise from the x axis (0-360)
+    double cov[3][3];       // covariance of x, y (m) and heading (degrees)
+    double distance;        // meters driven
+    int lifted;             // off the floor
+    int blocked;            // hit something, the wheels slip until it turns or backs off
+    int bumps;              // hits felt
+    long long usec;         // time of the estimate (Fin_Usec)
+};
+
+/**
+ *  Fin_PoseNow(*pose).
+ *  Get where the robot is now. The background thread of the library
+ *  integrates the wheel speeds sent from the time each command took
+ *  effect and follows the accelerometer while it is sampled (see
+ *  Fin_Subscribe): off the floor the wheels do not move the robot, and a
+ *  tap while driving is taken as a hit on something. Reading it costs
+ *  the same however long the robot has been driving.
+ *
+ *  @param *pose pointer where to return it
+ *
+ *  @return -1 if failure
+ */
+int Fin_PoseNow(Fin_Pose *pose);
+
+/**
+ *  Fin_PoseSet(x, y, heading).
+ *  Tell the library where the robot is, the uncertainty starts again
+ *  from none.
+ *
+ *  @param x, y meters
+ *  @param heading degrees counterclockwise from the x axis
+ *
+ *  @return -1 if failure
+ */
+int Fin_PoseSet(double x, double y, double heading);
+
+/** Directions in a maze (see Fin_MazeOpen), x grows to the east and y to the north */
+#define FIN_MAZE_EAST       0
+#define FIN_MAZE_NORTH      1
+#define FIN_MAZE_WEST       2
+#define FIN_MAZE_SOUTH      3
+#define FIN_MAZE_HERE       4   // at the goal
+
+/**
+ *  Fin_MazeOpen(width, height, cell, x, y, heading).
+ *  Start mapping a maze the robot is in. The engine keeps a map of the
+ *  walls found (the cells not seen yet are taken as free) and a plan to
+ *  the goal, repaired around each wall found instead of being made again;
+ *  Fin_MazeStep drives the robot a cell or a quarter turn at a time,
+ *  keeping track of where it is. One maze per program thread.
+ *
+ *  @param width, height cells of the maze
+ *  @param cell meters a cell
+ *  @param x, y cell of the robot, from the south west corner
+ *  @param heading where it faces, FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH
+ *
+ *  @return -1 if failure
+ */
+int Fin_MazeOpen(int width, int height, double cell, int x, int y, int heading);
+
+/**
+ *  Fin_MazeClose(void).
+ *  Forget the maze.
+ */
+void Fin_MazeClose(void);
+
+/**
+ *  Fin_MazeGoal(x, y).
+ *  Set the cell to reach.
+ *
+ *  @return -1 if failure
+ */
+int Fin_MazeGoal(int x, int y);
+
+/**
+ *  Fin_MazeWall(x, y, wall).
+ *  Tell the engine a cell is a wall, or free after all (Fin_MazeStep does
+ *  it with what the obstacle sensors see).
+ *
+ *  @param x, y the cell
+ *  @param wall 1 for a wall, 0 for free
+ *
+ *  @return -1 if failure
+ */
+int Fin_MazeWall(int x, int y, int wall);
+
+/**
+ *  Fin_MazeNext(void).
+ *  Get where the plan goes from the cell of the robot.
+ *
+ *  @return FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH, FIN_MAZE_HERE at the
+ *  goal, -1 if no way is left
+ */
+int Fin_MazeNext(void);
+
+/**
+ *  Fin_MazeStep(void).
+ *  Take a step towards the goal: turn to where the plan goes, or look
+ *  ahead and either find a wall there or drive to the next cell.
+ *
+ *  @return 1 if a step was taken, 0 at the goal, -1 if failure or no way left
+ */
+int Fin_MazeStep(void);
+
+/**
+ *  Fin_MazeSolve(steps).
+ *  Take steps until the goal is reached.
+ *
+ *  @param steps most steps to take
+ *
+ *  @return 1 at the goal, 0 if out of steps, -1 if failure or no way
+ */
+int Fin_MazeSolve(int steps);
+
+/**
+ *  State of the maze engine (see Fin_MazeStatus)
+ */
+typedef struct fin_maze_stats Fin_MazeStats;
+struct fin_maze_stats
+{
+    int x, y, heading;      // cell of the robot and where it faces
+    int dist;               // steps left to the goal as far as known, -1 if no way
+    int walls;              // walls found
+    int steps;              // cells driven
+    int turns;              // turns made
+    int replans;            // times the plan was changed
+    long long cells;        // cells planned again, in all
+    long long replan_usec;  // wall time spent planning, in all
+    long long replan_max;   // longest change of the plan
+};
+
+/**
+ *  Fin_MazeStatus(*stats).
+ *  Get the pose of the robot in the maze and what planning took.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure (no maze)
+ */
+int Fin_MazeStatus(Fin_MazeStats *stats);
+
+/** Robots a plan of paths takes, and what they do each tick (see Fin_PathPlan) */
+#define FIN_PATH_ROBOTS     64
+#define FIN_PATH_WAIT       0
+#define FIN_PATH_FORWARD    1   // drive a cell ahead
+#define FIN_PATH_LEFT       2   // quarter turn on the spot
+#define FIN_PATH_RIGHT      3
+
+/**
+ *  Fin_PathOpen(width, height, ticks).
+ *  Start planning the paths of a fleet on a grid (the squares of a chess
+ *  board and around it): each robot gets to its cell at the same time as
+ *  the others without running into any, a robot never entering a cell
+ *  another holds at that tick nor swapping cells with it. A tick drives
+ *  a cell, makes a quarter turn or waits. One grid per program thread.
+ *  e.g. swap two robots on a row of three cells
+ *     Fin_PathOpen(3, 2, 64);
+ *     Fin_PathRobot(0, 0, FIN_MAZE_EAST, 2, 0);
+ *     Fin_PathRobot(2, 0, FIN_MAZE_WEST, 0, 0);
+ *     Fin_PathPlan();
+ *     Fin_PathGo(0.25);
+ *
+ *  @param width, height cells of the grid
+ *  @param ticks longest plan
+ *
+ *  @return -1 if failure
+ */
+int Fin_PathOpen(int width, int height, int ticks);
+
+/**
+ *  Fin_PathClose(void).
+ *  Forget the grid and the plan.
+ */
+void Fin_PathClose(void);
+
+/**
+ *  Fin_PathWall(x, y).
+ *  Tell the planner no robot goes through a cell.
+ *
+ *  @return -1 if failure
+ */
+int Fin_PathWall(int x, int y);
+
+/**
+ *  Fin_PathRobot(x, y, heading, goal_x, goal_y).
+ *  Add a robot to the fleet planned.
+ *
+ *  @param x, y cell of the robot, from the south west corner
+ *  @param heading where it faces, FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH
+ *  @param goal_x, goal_y cell to take it to
+ *
+ *  @return the number of the robot (from 0), -1 if failure
+ */
+int Fin_PathRobot(int x, int y, int heading, int goal_x, int goal_y);
+
+/**
+ *  Fin_PathPlan(void).
+ *  Plan the paths of all the robots added.
+ *
+ *  @return ticks until the last robot is at its goal, -1 if no plan was found
+ */
+int Fin_PathPlan(void);
+
+/**
+ *  Fin_PathAction(robot, tick).
+ *  Get what a robot does from a tick of the plan to the next.
+ *
+ *  @return FIN_PATH_WAIT, _FORWARD, _LEFT or _RIGHT, -1 if failure (no plan)
+ */
+int Fin_PathAction(int robot, int tick);
+
+/**
+ *  Fin_PathAt(robot, tick, *x, *y, *heading).
+ *  Get where a robot is at a tick of the plan.
+ *
+ *  @param *x, *y, *heading pointers where to return the cell and where it faces
+ *
+ *  @return -1 if failure (no plan)
+ */
+int Fin_PathAt(int robot, int tick, int *x, int *y, int *heading);
+
+/**
+ *  Fin_PathGo(cell).
+ *  Drive the plan on the fleet (see Fin_FleetOpen), robot n of the plan
+ *  being robot n of the fleet: the actions of a tick are released on all
+ *  the robots at once, with the wheels timed to take a tick.
+ *
+ *  @param cell meters a cell
+ *
+ *  @return -1 if failure
+ */
+int Fin_PathGo(double cell);
+
+/**
+ *  What the last plan takes and what making it took (see Fin_PathStatus)
+ */
+typedef struct fin_path_stats Fin_PathStats;
+struct fin_path_stats
+{
+    int robots;
+    int ticks;              // until the last robot is at its goal
+    int alone;              // ticks the robots take moved one at a time
+    int forward;            // cells driven, by all the robots
+    int turns;              // quarter turns
+    int restarts;           // times the robots were planned again in another order
+    long long expanded;     // states looked at
+    long long plan_usec;    // wall time planning took
+};
+
+/**
+ *  Fin_PathStatus(*stats).
+ *  Get what the last plan takes and what making it took.
+ *
+ *  @param *stats pointer where to return it
+ *
+ *  @return -1 if failure (no grid)
+ */
+int Fin_PathStatus(Fin_PathStats *stats);
 
 #ifdef _LINUX_
 int kbhit(void);
@@ -0,0 +1,408 @@
+/*
+ * FinchBatch - runs many routines against many mazes in the simulator
+ *
+ * Each routine is the rutina() of a build of ChessMasters.c as a shared
+ * library; each run drives its own simulated robot on its own virtual
+ * clock (FinchSim.c, FinchClock.c), so the runs share nothing and a pool
+ * of worker threads keeps every core busy. Every worker takes the runs
+ * of its own queue in order and, once it is empty, steals from the others.
+ * A routine that never calls the library cannot be stopped: once its run
+ * is past the wall seconds each run has, it is given up on and another
+ * worker takes the place of the one it holds.
+ * One CSV line is printed per run: routine, maze, status (ok, timeout
+ * when it ran out of virtual time, hung when it did not come back in
+ * time on the wall clock, error when the maze could not be loaded,
+ * not run), virtual time, when the goal (G) was reached, collisions,
+ * commands and meters driven.
+ *
+ * build (Linux/Mac):
+ *    gcc -D_LINUX_ -rdynamic -o FinchBatch FinchBatch.c Finch.c FinchClient.c FinchClock.c FinchCo.c FinchConsole.c FinchFilter.c FinchFleet.c FinchFlow.c FinchMaze.c FinchPath.c FinchPoll.c FinchPose.c FinchReflex.c FinchSim.c FinchTrack.c -lhidapi-libusb -lpthread -lrt -lm -ldl
+ *    gcc -D_LINUX_ -shared -fPIC -o ruta1.so ChessMasters.c
+ * build (Windows):
+ *    gcc -o FinchBatch FinchBatch.c Finch.c FinchClient.c FinchClock.c FinchCo.c FinchConsole.c FinchFilter.c FinchFleet.c FinchFlow.c FinchMaze.c FinchPath.c FinchPoll.c FinchPose.c FinchReflex.c FinchSim.c FinchTrack.c hidapi.dll -Wl,--export-all-symbols,--out-implib,libFinchBatch.a
+ *    gcc -shared -o ruta1.dll ChessMasters.c libFinchBatch.a
+ * usage:
+ *    FinchBatch [-j threads] [-t virtual seconds] [-w wall seconds] routines... -- mazes...
+ *    -t and -w are the time each run has, 600 virtual seconds and 60 wall seconds
+ *    a maze is given as maze file[,light file]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifdef _LINUX_
+#include <dlfcn.h>
+#endif
+
+#define BATCH_THREADS   64          // most worker threads
+
+/* status of a run */
+#define BATCH_PENDING   0
+#define BATCH_RUNNING   1
+#define BATCH_OK        2
+#define BATCH_TIMEOUT   3
+#define BATCH_ERROR     4
+#define BATCH_HUNG      5
+
+static const char *batch_status[] = { "not run", "hung", "ok", "timeout", "error", "hung" };
+
+typedef void (*batch_routine)(void);
+
+/*
+ * a run of a routine in a maze
+ */
+struct batch_job
+{
+    int routine;
+    int maze;
+    int status;                     // BATCH_..., guarded by batch_lock
+    int worker;                     // queue of the worker running it
+    long long started;              // wall usec it was started at
+    Fin_SimStats stats;
+};
+
+/*
+ * queue of runs of a worker, it and the others take from the head
+ */
+struct batch_queue
+{
+    fin_mutex lock;
+    struct batch_job **job;
+    int head, tail;
+#ifdef _LINUX_
+    pthread_t thread;
+#else
+    HANDLE thread;
+#endif
+};
+
+static const char **batch_names;            // routines
+static batch_routine *batch_routines;
+static char **batch_mazes;                  // maze files
+static char **batch_lights;                 // their light files, NULL if none
+static struct batch_queue batch_queues[BATCH_THREADS];
+static int batch_threads;
+static long long batch_limit = 600000000;   // virtual usec a run has
+static long long batch_wall = 60000000;     // wall usec a run has before it is hung
+
+static FIN_TLS jmp_buf batch_out;           // back to Batch_Run when a run is out of time
+
+static fin_mutex batch_lock;                // guards the status of the runs and batch_done
+static fin_cond batch_cond;                 // signaled when a run starts or is done
+static int batch_done = 0;
+
+
+/*
+ * load the rutina() of a shared library
+ */
+static batch_routine Batch_Load(const char *file)
+{
+#ifdef _LINUX_
+    char path[512];
+    void *lib;
+
+    // a name without a directory would be looked for in the system ones
+    snprintf(path, sizeof(path), "%s%s", strchr(file, '/') ? "" : "./", file);
+    lib = dlopen(path, RTLD_NOW);
+    if (lib == NULL)
+    {
+        printf("%s\n", dlerror());
+        return(0);
+    }
+    return((batch_routine)dlsym(lib, "rutina"));
+#else
+    HMODULE lib = LoadLibraryA(file);
+
+    if (lib == NULL)
+    {
+        printf("Unable to load %s\n", file);
+        return(0);
+    }
+    return((batch_routine)GetProcAddress(lib, "rutina"));
+#endif
+}
+
+
+/*
+ * next run of a worker: the oldest of its own, or the oldest of another
+ */
+static struct batch_job *Batch_Next(int self)
+{
+    struct batch_queue *queue;
+    struct batch_job *job = 0;
+    int i;
+
+    for (i = 0; i < batch_threads && job == 0; i++)
+    {
+        queue = &batch_queues[(self + i) % batch_threads];
+        Fin_Lock(&queue->lock);
+        if (queue->head < queue->tail)
+            job = queue->job[queue->head++];
+        Fin_Unlock(&queue->lock);
+    }
+    return(job);
+}
+
+
+/*
+ * a routine ran out of its virtual time, called by the library
+ * from a command or a Sleep of the routine
+ */
+static void Batch_Expired(void)
+{
+    longjmp(batch_out, 1);
+}
+
+
+/*
+ * run a routine in its maze, with a robot and a virtual clock of its own,
+ * returns 0 if the run was given up on and the worker was replaced
+ */
+static int Batch_Run(struct batch_job *job, int self)
+{
+    struct fin_dev *dev;
+    Fin_SimStats stats;
+    volatile int status = BATCH_ERROR;      // kept across the longjmp of Batch_Expired
+    volatile int res = 1;
+
+    memset(&stats, 0, sizeof(stats));
+    Fin_Lock(&batch_lock);
+    job->status = BATCH_RUNNING;
+    job->worker = self;
+    job->started = Fin_WallUsec();
+    Fin_CondBroadcast(&batch_cond);
+    Fin_Unlock(&batch_lock);
+
+    dev = calloc(1, sizeof(*dev));
+    if (dev != 0)
+    {
+        Fin_DevUse(dev);
+        Fin_Clock(FIN_CLOCK_VIRTUAL);
+        if (Fin_SimOpen(dev, batch_mazes[job->maze], batch_lights[job->maze]) == 0)
+        {
+            // a routine that keeps going after its time is taken out of it
+            Fin_ClockLimit(batch_limit, Batch_Expired);
+            if (setjmp(batch_out) == 0)
+                batch_routines[job->routine]();
+            status = Fin_ClockExpired() ? BATCH_TIMEOUT : BATCH_OK;
+            Fin_ClockLimit(0, NULL);
+            Fin_SimStatus(&stats);
+            Fin_Exit();
+        }
+        Fin_Clock(FIN_CLOCK_REAL);
+        Fin_DevUse(NULL);
+        free(dev);
+    }
+
+    Fin_Lock(&batch_lock);
+    if (job->status == BATCH_HUNG)
+        res = 0;
+    else
+    {
+        job->status = status;
+        job->stats = stats;
+        batch_done++;
+        Fin_CondBroadcast(&batch_cond);
+    }
+    Fin_Unlock(&batch_lock);
+    return(res);
+}
+
+
+/*
+ * worker thread: runs until no queue has any run left, or until it is
+ * replaced
+ */
+#ifdef _LINUX_
+static void *Batch_Worker(void *arg)
+#else
+static DWORD WINAPI Batch_Worker(void *arg)
+#endif
+{
+    struct batch_job *job;
+    int self = (int)(long)arg;
+
+    while ((job = Batch_Next(self)) != 0)
+        if (!Batch_Run(job, self))
+            break;
+    return(0);
+}
+
+
+/*
+ * start the worker of a queue
+ */
+static void Batch_Start(int self)
+{
+#ifdef _LINUX_
+    pthread_create(&batch_queues[self].thread, NULL, Batch_Worker, (void *)(long)self);
+#else
+    DWORD tid;
+
+    batch_queues[self].thread = CreateThread(NULL, 0, Batch_Worker, (LPVOID)(long)self, 0, &tid);
+#endif
+}
+
+
+/*
+ * cores of the computer
+ */
+static int Batch_Cores(void)
+{
+#ifdef _LINUX_
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return(cores > 0 ? (int)cores : 1);
+#else
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return((int)info.dwNumberOfProcessors);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct batch_job *jobs;
+    int routines = 0, mazes = 0, runs;
+    long long begin, now, next, virtual_usec = 0;
+    char *comma;
+    int hung = 0;
+    int i, j, n;
+
+    batch_threads = Batch_Cores();
+    batch_names = calloc(argc, sizeof(*batch_names));
+    batch_routines = calloc(argc, sizeof(*batch_routines));
+    batch_mazes = calloc(argc, sizeof(*batch_mazes));
+    batch_lights = calloc(argc, sizeof(*batch_lights));
+    if (batch_names == 0 || batch_routines == 0 || batch_mazes == 0 || batch_lights == 0)
+        return(1);
+
+    for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            batch_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            batch_limit = atoi(argv[++i]) * 1000000LL;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            batch_wall = atoi(argv[++i]) * 1000000LL;
+        else
+        {
+            batch_routines[routines] = Batch_Load(argv[i]);
+            if (batch_routines[routines] == 0)
+            {
+                printf("no rutina() in %s\n", argv[i]);
+                return(1);
+            }
+            batch_names[routines++] = argv[i];
+        }
+    }
+    for (i++; i < argc; i++)
+    {
+        batch_mazes[mazes] = argv[i];
+        if ((comma = strchr(argv[i], ',')) != NULL)
+        {
+            *comma = 0;
+            batch_lights[mazes] = comma + 1;
+        }
+        mazes++;
+    }
+    if (routines == 0 || mazes == 0 || batch_limit <= 0 || batch_wall <= 0)
+    {
+        printf("usage: FinchBatch [-j threads] [-t virtual seconds] [-w wall seconds] "
+               "routines... -- maze[,lights]...\n");
+        return(1);
+    }
+    if (batch_threads < 1)
+        batch_threads = 1;
+    if (batch_threads > BATCH_THREADS)
+        batch_threads = BATCH_THREADS;
+
+    // deal the runs to the workers, round robin
+    runs = routines * mazes;
+    jobs = calloc(runs, sizeof(*jobs));
+    if (jobs == 0)
+        return(1);
+    for (i = 0; i < batch_threads; i++)
+    {
+        Fin_MutexInit(&batch_queues[i].lock);
+        batch_queues[i].job = calloc(runs / batch_threads + 1, sizeof(struct batch_job *));
+        if (batch_queues[i].job == 0)
+            return(1);
+    }
+    for (n = 0; n < runs; n++)
+    {
+        jobs[n].routine = n / mazes;
+        jobs[n].maze = n % mazes;
+        batch_queues[n % batch_threads].job[batch_queues[n % batch_threads].tail++] = &jobs[n];
+    }
+    Fin_MutexInit(&batch_lock);
+    Fin_CondInit(&batch_cond);
+
+    begin = Fin_Usec();
+    for (i = 0; i < batch_threads; i++)
+        Batch_Start(i);
+
+    // a run past its wall seconds is given up on, and a new worker
+    // goes on with the runs of the one it holds
+    Fin_Lock(&batch_lock);
+    while (batch_done < runs)
+    {
+        now = Fin_WallUsec();
+        next = now + batch_wall;
+        for (n = 0; n < runs; n++)
+        {
+            if (jobs[n].status != BATCH_RUNNING)
+                continue;
+            if (now >= jobs[n].started + batch_wall)
+            {
+                jobs[n].status = BATCH_HUNG;
+                batch_done++;
+                hung++;
+                Batch_Start(jobs[n].worker);
+            }
+            else if (jobs[n].started + batch_wall < next)
+                next = jobs[n].started + batch_wall;
+        }
+        if (batch_done < runs)
+            Fin_WaitUntil(&batch_cond, &batch_lock, next);
+    }
+    Fin_Unlock(&batch_lock);
+    begin = Fin_Usec() - begin;
+
+    Fin_Lock(&batch_lock);
+    printf("routine,maze,status,usec,goal_usec,collisions,cmnds,distance\n");
+    for (n = 0; n < runs; n++)
+    {
+        printf("%s,%s,%s,%lld,%lld,%d,%d,%.3f\n", batch_names[jobs[n].routine],
+               batch_mazes[jobs[n].maze], batch_status[jobs[n].status],
+               jobs[n].stats.usec, jobs[n].stats.goal_usec, jobs[n].stats.collisions,
+               jobs[n].stats.cmnds, jobs[n].stats.distance);
+        virtual_usec += jobs[n].stats.usec;
+    }
+    j = batch_done - hung;
+    Fin_Unlock(&batch_lock);
+    fprintf(stderr, "%d of %d runs in %.3f s on %d threads, %.1f runs/s, "
+            "%.0f virtual seconds\n", j, runs, begin / 1e6, batch_threads,
+            j * 1e6 / (begin > 0 ? begin : 1), virtual_usec / 1e6);
+
+    // hung workers are not waited for
+    if (hung > 0)
+        exit(1);
+    for (i = 0; i < batch_threads; i++)
+    {
+#ifdef _LINUX_
+        pthread_join(batch_queues[i].thread, NULL);
+#else
+        WaitForSingleObject(batch_queues[i].thread, INFINITE);
+        CloseHandle(batch_queues[i].thread);
+#endif
+    }
+    return(0);
+}
@@ -0,0 +1,813 @@
+/*
+ * Benchmarks of the Finch library, run against a connected Finch
+ * (or the daemon); filter, maze and path only time the computation
+ * and need none.
+ *
+ * build:
+ *    gcc -o FinchBench FinchBench.c Finch.c FinchClient.c FinchClock.c FinchCo.c FinchConsole.c FinchFilter.c FinchFleet.c FinchFlow.c FinchMaze.c FinchPath.c FinchPoll.c FinchPose.c FinchReflex.c FinchSim.c FinchTrack.c FinchBoard.c FinchBook.c FinchGame.c FinchSearch.c FinchTable.c hidapi.dll
+ * usage:
+ *    FinchBench stop [threads] [rounds]
+ *    FinchBench poll [seconds]
+ *    FinchBench co [routines]
+ *    FinchBench fleet [rounds]
+ *    FinchBench melody [notes]
+ *    FinchBench animate [seconds]
+ *    FinchBench flow [threads]
+ *    FinchBench filter [samples]
+ *    FinchBench sim [minutes]        (with FINCH_SIM=maze file)
+ *    FinchBench maze [size]
+ *    FinchBench game [moves]
+ *    FinchBench path [resets]
+ *    FinchBench decode
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _LINUX_
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "Finch.h"
+#include "FinchInt.h"
+#include "FinchCo.h"
+#include "FinchBoard.h"
+
+static volatile int bench_running = 1;
+static volatile long bench_load = 0;        // background commands sent
+static int bench_robot = 0;                 // connected to a Finch (or the simulator)
+
+
+/*
+ * latency samples, in usec
+ */
+struct bench_stat
+{
+    const char *name;
+    long sample[1000];
+    int count;
+};
+
+static void Bench_Add(struct bench_stat *stat, long usec)
+{
+    if (stat->count < 1000)
+        stat->sample[stat->count++] = usec;
+}
+
+static int Bench_Cmp(const void *a, const void *b)
+{
+    return(*(const long *)a < *(const long *)b ? -1 : *(const long *)a > *(const long *)b);
+}
+
+static void Bench_Print(struct bench_stat *stat)
+{
+    long total = 0;
+    int i;
+
+    if (stat->count == 0)
+        return;
+    qsort(stat->sample, stat->count, sizeof(long), Bench_Cmp);
+    for (i = 0; i < stat->count; i++)
+        total += stat->sample[i];
+    printf("%-28s min %6ld  avg %6ld  p99 %6ld  max %6ld usec\n", stat->name,
+           stat->sample[0], total / stat->count,
+           stat->sample[stat->count * 99 / 100], stat->sample[stat->count - 1]);
+}
+
+
+/*
+ * background load: odd threads poll the light sensors, even ones animate the beak
+ */
+#ifdef _LINUX_
+static void *Bench_Load(void *arg)
+#else
+static DWORD WINAPI Bench_Load(void *arg)
+#endif
+{
+    int id = (int)(long)arg;
+    int left, right;
+    int level = 0;
+
+    while (bench_running)
+    {
+        if (id & 1)
+            Fin_Lights(&left, &right);
+        else
+            Fin_LED(level, 0, 255 - level);
+        level = (level + 8) & 0xff;
+        __sync_fetch_and_add(&bench_load, 1);
+    }
+    return(0);
+}
+
+
+/*
+ * latency of a wheel stop while the link is saturated by other threads,
+ * compared with a beak command queued in the actuator lane
+ */
+static int Bench_Stop(int threads, int rounds)
+{
+    struct bench_stat led = { "beak (actuator lane)" };
+    struct bench_stat stop = { "Fin_Motor(0,0,0) (safety)" };
+    struct bench_stat flush = { "Fin_Stop (safety + flush)" };
+    long long start, begin;
+    int i;
+
+    begin = Fin_Usec();
+    for (i = 0; i < threads; i++)
+    {
+#ifdef _LINUX_
+        pthread_t tid;
+        pthread_create(&tid, NULL, Bench_Load, (void *)(long)i);
+#else
+        CreateThread(NULL, 0, Bench_Load, (void *)(long)i, 0, NULL);
+#endif
+    }
+    Sleep(200);
+
+    for (i = 0; i < rounds; i++)
+    {
+        start = Fin_Usec();
+        Fin_LED(0, 255, 0);
+        Bench_Add(&led, (long)(Fin_Usec() - start));
+
+        Fin_Motor(-1, 100, 100);
+        start = Fin_Usec();
+        Fin_Motor(0, 0, 0);
+        Bench_Add(&stop, (long)(Fin_Usec() - start));
+
+        Fin_Motor(-1, 100, 100);
+        start = Fin_Usec();
+        Fin_Stop();
+        Bench_Add(&flush, (long)(Fin_Usec() - start));
+        Sleep(10);
+    }
+    bench_running = 0;
+
+    printf("%d background threads, %ld commands/sec of load\n", threads,
+           (long)(bench_load * 1000000LL / (Fin_Usec() - begin)));
+    Bench_Print(&led);
+    Bench_Print(&stop);
+    Bench_Print(&flush);
+    Sleep(200);
+    return(0);
+}
+
+
+/*
+ * sampling rates and link traffic with every sensor subscribed,
+ * parked then at half and full speed
+ */
+static void Bench_PollPrint(const char *state)
+{
+    static const char *names[FIN_SENSORS] = { "lights", "obstacles", "accel", "temp" };
+    Fin_PollStats stats;
+    int i;
+
+    Fin_PollStatus(&stats);
+    printf("%s: %ld bytes/sec, %ld commands/sec\n", state, stats.bytes_per_sec, stats.cmnds_per_sec);
+    for (i = 0; i < FIN_SENSORS; i++)
+        printf("   %-10s period %7ld usec  %6.1f samples/sec\n", names[i],
+               stats.period_usec[i], stats.rate[i]);
+}
+
+static int Bench_Poll(int seconds)
+{
+    int i;
+
+    for (i = 0; i < FIN_SENSORS; i++)
+        Fin_Subscribe(i);
+
+    // rates are measured over the last second
+    Sleep(seconds * 1000);
+    Bench_PollPrint("parked");
+    Fin_Motor(-1, 128, 128);
+    Sleep(seconds * 1000);
+    Bench_PollPrint("half speed");
+    Fin_Motor(-1, 255, 255);
+    Sleep(seconds * 1000);
+    Bench_PollPrint("full speed");
+    Fin_Motor(0, 0, 0);
+
+    for (i = 0; i < FIN_SENSORS; i++)
+        Fin_Unsubscribe(i);
+    return(0);
+}
+
+
+/*
+ * routines on one thread: each one sleeps 10 msec in a loop, every
+ * tenth round it also sets the beak; how late are they resumed
+ */
+static struct bench_stat co_late = { "resume after Fin_CoSleep" };
+
+static int Bench_Routine(Fin_Co *co)
+{
+    long long *wake_at = (long long *)co->arg;
+
+    FIN_CO_BEGIN(co);
+    for (wake_at[1] = 0; wake_at[1] < 50; wake_at[1]++)
+    {
+        if (wake_at[1] % 10 == 0)
+            FIN_AWAIT(co, Fin_CoLED(co, 0, (int)wake_at[1] * 5, 0));
+        wake_at[0] = Fin_Usec() + 10000;
+        FIN_AWAIT(co, Fin_CoSleep(co, 10));
+        Bench_Add(&co_late, (long)(Fin_Usec() - wake_at[0]));
+    }
+    FIN_CO_END(co);
+}
+
+static int Bench_Co(int routines)
+{
+    Fin_Co *co = calloc(routines, sizeof(Fin_Co));
+    long long (*state)[2] = calloc(routines, sizeof(*state));
+    long long start;
+    int i;
+
+    for (i = 0; i < routines; i++)
+        Fin_CoStart(&co[i], Bench_Routine, state[i]);
+    start = Fin_Usec();
+    Fin_CoRun();
+
+    printf("%d routines on one thread, %d sleeps in %ld msec\n", routines, routines * 50,
+           (long)((Fin_Usec() - start) / 1000));
+    Bench_Print(&co_late);
+    free(state);
+    free(co);
+    return(0);
+}
+
+
+/*
+ * start skew of the robots plugged in, for wheel and beak commands
+ * released together
+ */
+static int Bench_Fleet(int rounds)
+{
+    struct bench_stat skew = { "start skew across the fleet" };
+    struct bench_stat late = { "last start after release" };
+    Fin_FleetStats stats;
+    int robots;
+    int i;
+
+    robots = Fin_FleetOpen();
+    if (robots < 0)
+    {
+        printf("no fleet (is the daemon running?)\n");
+        return(1);
+    }
+
+    for (i = 0; i < rounds; i++)
+    {
+        Fin_FleetMotor(-1, 1, (i & 1) ? 150 : -150, (i & 1) ? -150 : 150);
+        Fin_FleetLED(-1, (i & 1) ? 255 : 0, 0, (i & 1) ? 0 : 255);
+        Fin_FleetGo(20);
+        Fin_FleetStatus(&stats);
+        Bench_Add(&skew, stats.skew_usec);
+        Bench_Add(&late, stats.late_usec);
+        Sleep(100);
+    }
+
+    printf("%d robots, %d releases\n", robots, rounds);
+    Bench_Print(&skew);
+    Bench_Print(&late);
+    Fin_FleetClose();
+    return(0);
+}
+
+
+/*
+ * a scale played while the wheels turn and the obstacles are sampled,
+ * first with Fin_Buzzer and Sleep, then with Fin_Melody:
+ * how far from their time do the notes start
+ */
+static int Bench_Melody(int notes)
+{
+    struct bench_stat drift = { "Fin_Buzzer + Sleep drift" };
+    Fin_Note *melody = calloc(notes, sizeof(Fin_Note));
+    Fin_TrackStats stats;
+    long long start;
+    int i;
+
+    for (i = 0; i < notes; i++)
+    {
+        melody[i].freq = 440 + 40 * (i % 12);
+        melody[i].msec = 50;
+    }
+    Fin_Subscribe(FIN_OBSTACLES);
+    Fin_Motor(-1, 100, 100);
+
+    start = Fin_Usec();
+    for (i = 0; i < notes; i++)
+    {
+        Bench_Add(&drift, (long)(Fin_Usec() - start - i * 50000LL));
+        Fin_Buzzer(melody[i].msec, melody[i].freq);
+        Sleep(melody[i].msec);
+    }
+    Sleep(100);
+
+    Fin_Melody(melody, notes, 1);
+    do
+    {
+        Sleep(10);
+        Fin_MelodyStatus(&stats);
+    } while (stats.playing > 0);
+
+    Fin_Stop();
+    Fin_Unsubscribe(FIN_OBSTACLES);
+    printf("%d notes of 50 msec while moving\n", notes);
+    Bench_Print(&drift);
+    printf("%-28s last %6ld  avg %6ld  max %6ld usec, %d sent, %d dropped\n", "Fin_Melody lateness",
+           stats.last_usec, stats.avg_usec, stats.max_usec, stats.sent, stats.dropped);
+    free(melody);
+    return(0);
+}
+
+
+/*
+ * a slow fade of the beak and back at 50 frames a second, first with
+ * Fin_LED in a loop, then with Fin_Animate (on every robot plugged in):
+ * how many writes, how long the program was held
+ */
+static int Bench_Animate(int seconds)
+{
+    Fin_Key fade[] = { { 0, 0, 0, 0, FIN_EASE_LINEAR },
+                       { 0, 0, 40, 500, FIN_EASE_INOUT },
+                       { 0, 0, 0, 500, FIN_EASE_INOUT } };
+    Fin_TrackStats stats;
+    long long start, held;
+    int frames = seconds * 50;
+    int count, robots;
+    int i, level;
+
+    count = Fin_Dev()->cmnd_count;
+    start = Fin_Usec();
+    for (i = 0; i < frames; i++)
+    {
+        level = i % 50 < 25 ? (i % 50) * 40 / 25 : (50 - i % 50) * 40 / 25;
+        Fin_LED(0, 0, level);
+        Sleep(20);
+    }
+    held = Fin_Usec() - start;
+    printf("Fin_LED loop       %5d writes, program held %ld msec\n", Fin_Dev()->cmnd_count - count,
+           (long)(held / 1000));
+
+    robots = Fin_FleetOpen();
+    start = Fin_Usec();
+    if (robots > 0)
+        Fin_FleetAnimate(-1, fade, 3, 50, seconds);
+    else
+        Fin_Animate(fade, 3, 50, seconds);
+    held = Fin_Usec() - start;
+    do
+    {
+        Sleep(50);
+        if (robots > 0)
+            Fin_FleetAnimateStatus(-1, &stats);
+        else
+            Fin_AnimateStatus(&stats);
+    } while (stats.playing > 0);
+    printf("Fin_Animate        %5d writes, %d frames skipped, program held %ld usec",
+           stats.sent, stats.skipped, (long)held);
+    printf(robots > 1 ? ", on %d robots\n" : "\n", robots);
+    printf("frame lateness     avg %ld  max %ld usec\n", stats.avg_usec, stats.max_usec);
+    if (robots > 0)
+        Fin_FleetClose();
+    return(0);
+}
+
+
+/*
+ * sustained rate of the Finch, then background threads sending as fast
+ * as they can: the rate learned, the writes refused and held back
+ */
+static int Bench_Flow(int threads)
+{
+    static char cache[600];
+    Fin_FlowStats stats;
+    long long begin;
+    int rate;
+    int i;
+
+    // the calibration is remembered in a cache file of its own, removed
+    // at the end, so the bench does not touch the one of the user
+#ifdef _LINUX_
+    snprintf(cache, sizeof(cache), "/tmp/finch_bench_%d", (int)getpid());
+    setenv("FINCH_CACHE", cache, 1);
+#else
+    {
+        char dir[MAX_PATH];
+
+        GetTempPathA(sizeof(dir), dir);
+        snprintf(cache, sizeof(cache), "FINCH_CACHE=%sfinch_bench_%lu.txt", dir,
+                 (unsigned long)GetCurrentProcessId());
+        _putenv(cache);
+    }
+#endif
+    rate = Fin_Calibrate(1000);
+    printf("calibrated         %d commands/sec\n", rate);
+
+    begin = Fin_Usec();
+    for (i = 0; i < threads; i++)
+    {
+#ifdef _LINUX_
+        pthread_t tid;
+        pthread_create(&tid, NULL, Bench_Load, (void *)(long)i);
+#else
+        CreateThread(NULL, 0, Bench_Load, (void *)(long)i, 0, NULL);
+#endif
+    }
+    Sleep(2000);
+    bench_running = 0;
+    Fin_FlowStatus(&stats);
+
+    printf("%d background threads, %ld commands/sec sent\n", threads,
+           (long)(bench_load * 1000000LL / (Fin_Usec() - begin)));
+    printf("rate now           %d commands/sec, %d writes refused, %d times held back\n",
+           stats.rate, stats.refused, stats.throttled);
+    Sleep(200);
+    remove(getenv("FINCH_CACHE"));
+    return(0);
+}
+
+
+/*
+ * wall clock in usec, Fin_Usec tells the virtual time while simulating
+ */
+static long long Bench_Real(void)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return((long long)GetTickCount64() * 1000);
+#endif
+}
+
+
+/*
+ * cost of the filters for each sample of the accelerometer, run on a
+ * copy of the device so only the computation is timed
+ */
+static int Bench_Filter(int samples)
+{
+    static const char *names[] = { "none", "EMA 20%", "median of 3", "median of 9" };
+    static const int kinds[] = { FIN_FILTER_NONE, FIN_FILTER_EMA, FIN_FILTER_MEDIAN, FIN_FILTER_MEDIAN };
+    static const int params[] = { 0, 20, 3, 9 };
+    static struct fin_dev dev;
+    long long start;
+    int i, j;
+
+    for (i = 0; i < 4; i++)
+    {
+        memset(&dev.filter[FIN_ACCEL], 0, sizeof(dev.filter[FIN_ACCEL]));
+        dev.filter[FIN_ACCEL].kind = kinds[i];
+        dev.filter[FIN_ACCEL].param = params[i];
+        start = Bench_Real();
+        for (j = 0; j < samples; j++)
+        {
+            dev.snap.accel[0] = (float)(rand() % 64) / 32;
+            dev.snap.accel[1] = (float)(rand() % 64) / 32;
+            dev.snap.accel[2] = (float)(rand() % 64) / 32;
+            Fin_FilterSample(&dev, FIN_ACCEL);
+        }
+        printf("%-28s %6ld nsec per sample\n", names[i],
+               (long)((Bench_Real() - start) * 1000 / samples));
+    }
+    return(0);
+}
+
+
+/*
+ * a simulated robot wanders in its maze for a few minutes of virtual
+ * time, turning away from the walls: how long it took for real
+ */
+static int Bench_Sim(int minutes)
+{
+    Fin_SimStats stats;
+    long long begin, real;
+    int left, right;
+    int moves = 0;
+
+    if (Fin_SimStatus(&stats) < 0)
+    {
+        printf("not simulating, set FINCH_SIM to a maze file\n");
+        return(1);
+    }
+
+    real = Bench_Real();
+    begin = Fin_Usec();
+    while (Fin_Usec() - begin < minutes * 60000000LL)
+    {
+        Fin_Obstacle(&left, &right);
+        if (left || right)
+            Fin_Move(3, left ? 150 : -150, left ? -150 : 150);
+        else
+            Fin_Move(5, 200, 200);
+        moves++;
+    }
+    real = Bench_Real() - real;
+    Fin_SimStatus(&stats);
+
+    printf("%d virtual minutes in %.1f msec, %d moves, %d commands\n",
+           minutes, real / 1000.0, moves, stats.cmnds);
+    printf("at %.2f, %.2f heading %.0f, %.1f meters driven, %d collisions\n",
+           stats.x, stats.y, stats.heading, stats.distance, stats.collisions);
+    return(0);
+}
+
+
+/*
+ * planning of the maze engine on a size x size grid: walls found one at
+ * a time, the plan repaired around each, against making it from scratch
+ */
+static int Bench_Maze(int size)
+{
+    static struct bench_stat repair = { "repair after a wall" };
+    static struct bench_stat scratch = { "plan from scratch" };
+    Fin_MazeStats before, stats;
+    long long start;
+    int i, x, y;
+
+    if (Fin_MazeOpen(size, size, 0.3, 0, 0, FIN_MAZE_EAST) < 0)
+    {
+        printf("cannot map a maze of %d x %d\n", size, size);
+        return(1);
+    }
+    Fin_MazeGoal(size - 1, size - 1);
+    Fin_MazeStatus(&before);
+
+    srand(1);
+    for (i = 0; i < 1000; i++)
+    {
+        x = rand() % size;
+        y = rand() % size;
+        if ((x == 0 && y == 0) || (x == size - 1 && y == size - 1))
+            continue;
+        start = Fin_WallUsec();
+        Fin_MazeWall(x, y, 1);
+        Bench_Add(&repair, (long)(Fin_WallUsec() - start));
+    }
+    Fin_MazeStatus(&stats);
+    for (i = 0; i < 20; i++)
+    {
+        start = Fin_WallUsec();
+        Fin_MazeGoal(size - 1, size - 1);
+        Bench_Add(&scratch, (long)(Fin_WallUsec() - start));
+    }
+
+    printf("%d x %d cells, %d walls, %lld cells planned again per wall\n", size, size,
+           stats.walls, (stats.cells - before.cells) / (stats.replans > before.replans ?
+                                                        stats.replans - before.replans : 1));
+    Bench_Print(&repair);
+    Bench_Print(&scratch);
+    Fin_MazeClose();
+    return(0);
+}
+
+
+/*
+ * the robot plays a few moves of a game, a second to think each, and
+ * carries each out for two seconds while the other side takes two more
+ * to reply (the move pondered on two times in three): how long the robot
+ * kept the other side waiting, without pondering and with it
+ */
+static int Bench_Game(int moves)
+{
+    Fin_BoardMove list[FIN_BOARD_MOVES];
+    Fin_GameStats stats;
+    char text[6];
+    int ponder, i, n;
+
+    for (ponder = 0; ponder <= 1; ponder++)
+    {
+        if (Fin_GameStart(NULL, 1000000, 0, ponder) < 0)
+        {
+            printf("cannot start a game\n");
+            return(1);
+        }
+        srand(1);
+        for (i = 0; i < moves && Fin_GameMove(text) > 0; i++)
+        {
+            // the robot moves the piece, or the time it takes is waited
+            if (bench_robot)
+            {
+                Fin_Move(10, 100, 100);
+                Fin_Move(10, -100, -100);
+            }
+            Sleep(2000);
+
+            Fin_GameStatus(&stats);
+            if (stats.expected == FIN_MOVE_NONE || rand() % 3 == 0)
+            {
+                if ((n = Fin_BoardMoves(Fin_GameBoard(), list)) == 0)
+                    break;
+                stats.expected = list[rand() % n];
+            }
+            Fin_GameReply(Fin_BoardText(stats.expected, text));
+        }
+        Fin_GameStatus(&stats);
+        Fin_GameEnd();
+
+        printf("pondering %-3s %2d moves, think %6.0f msec average %6.0f msec most,"
+               " %d replies pondered on, %d missed\n", ponder ? "on" : "off", stats.moves,
+               stats.think_usec / 1000.0 / (stats.moves ? stats.moves : 1),
+               stats.think_max / 1000.0, stats.hits, stats.misses);
+    }
+    return(0);
+}
+
+
+/*
+ * a chess set carried by 32 robots is put back for a new game: the pieces
+ * scattered at random over the board and two files on each side of it go
+ * to their squares together, a piece to the nearest free square of its kind
+ */
+static int Bench_Path(int resets)
+{
+    static struct bench_stat plan = { "plan a reset" };
+    static const int back[8] = { FIN_ROOK, FIN_KNIGHT, FIN_BISHOP, FIN_QUEEN,
+                                 FIN_KING, FIN_BISHOP, FIN_KNIGHT, FIN_ROOK };
+    Fin_PathStats stats;
+    int piece[12 * 8], home[32], kind[32], taken[32];
+    int i, k, cell, best, dist, near = 0, ticks = 0, alone = 0, most = 0, restarts = 0, failed = 0;
+
+    // the squares of a new game, the board on files 2 to 9 of the grid
+    for (i = 0; i < 8; i++)
+    {
+        home[i] = i + 2;
+        kind[i] = FIN_PIECE(FIN_WHITE, back[i]);
+        home[8 + i] = 12 + i + 2;
+        kind[8 + i] = FIN_PIECE(FIN_WHITE, FIN_PAWN);
+        home[16 + i] = 6 * 12 + i + 2;
+        kind[16 + i] = FIN_PIECE(FIN_BLACK, FIN_PAWN);
+        home[24 + i] = 7 * 12 + i + 2;
+        kind[24 + i] = FIN_PIECE(FIN_BLACK, back[i]);
+    }
+
+    srand(1);
+    for (k = 0; k < resets; k++)
+    {
+        if (Fin_PathOpen(12, 8, 512) < 0)
+        {
+            printf("cannot plan on a grid of 12 x 8\n");
+            return(1);
+        }
+        for (i = 0; i < 12 * 8; i++)
+            piece[i] = -1;
+        for (i = 0; i < 32; i++)
+        {
+            while (piece[cell = rand() % (12 * 8)] >= 0)
+                ;
+            piece[cell] = kind[i];
+            taken[i] = 0;
+        }
+        for (cell = 0; cell < 12 * 8; cell++)
+        {
+            if (piece[cell] < 0)
+                continue;
+            for (i = 0, best = -1; i < 32; i++)
+            {
+                dist = abs(cell % 12 - home[i] % 12) + abs(cell / 12 - home[i] / 12);
+                if (!taken[i] && kind[i] == piece[cell] && (best < 0 || dist < near))
+                {
+                    best = i;
+                    near = dist;
+                }
+            }
+            taken[best] = 1;
+            Fin_PathRobot(cell % 12, cell / 12, FIN_COLOR(piece[cell]) ? FIN_MAZE_SOUTH : FIN_MAZE_NORTH,
+                          home[best] % 12, home[best] / 12);
+        }
+
+        if (Fin_PathPlan() < 0)
+            failed++;
+        Fin_PathStatus(&stats);
+        Bench_Add(&plan, (long)stats.plan_usec);
+        if (stats.ticks > most)
+            most = stats.ticks;
+        ticks += stats.ticks;
+        alone += stats.alone;
+        restarts += stats.restarts;
+        Fin_PathClose();
+    }
+
+    printf("%d resets of 32 pieces, %d without a plan, %.1f ticks (%d most) against %.1f "
+           "one piece at a time, %.1f restarts\n", resets, failed,
+           (double)ticks / (resets - failed > 0 ? resets - failed : 1), most,
+           (double)alone / (resets > 0 ? resets : 1), (double)restarts / (resets > 0 ? resets : 1));
+    Bench_Print(&plan);
+    return(0);
+}
+
+
+/*
+ * responses of the Finch decoded the way the protocol says (the tap/shake
+ * byte is the TILT register of the accelerometer: bit 7 shaken, bit 5
+ * tapped, the others orientation and alert), no robot needed
+ */
+static int Bench_Decode(void)
+{
+    static const struct
+    {
+        unsigned char buffer[5];
+        float x, y, z;
+        int tap, shake;
+    } cases[] =
+    {
+        { { 153,  0,  0, 21, 0x00 },  0.0f,       0.0f,       0.984375f, 0, 0 },
+        { { 153, 63,  1, 21, 0x20 }, -0.046875f,  0.046875f,  0.984375f, 1, 0 },
+        { { 153,  0,  0, 21, 0x80 },  0.0f,       0.0f,       0.984375f, 0, 1 },
+        { { 153, 32, 31, 42, 0xa0 }, -1.5f,       1.453125f, -1.03125f,  1, 1 },
+        { { 153,  0,  0, 21, 0x5f },  0.0f,       0.0f,       0.984375f, 0, 0 },
+    };
+    float x, y, z;
+    int tap, shake;
+    int wrong = 0;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        Fin_DecodeAccel(cases[i].buffer, &x, &y, &z, &tap, &shake);
+        if (x != cases[i].x || y != cases[i].y || z != cases[i].z ||
+            tap != cases[i].tap || shake != cases[i].shake)
+        {
+            printf("'A' %02x %02x %02x %02x: %.6f %.6f %.6f tap %d shake %d, expected "
+                   "%.6f %.6f %.6f tap %d shake %d\n", cases[i].buffer[1], cases[i].buffer[2],
+                   cases[i].buffer[3], cases[i].buffer[4], x, y, z, tap, shake,
+                   cases[i].x, cases[i].y, cases[i].z, cases[i].tap, cases[i].shake);
+            wrong++;
+        }
+    }
+    printf("%d accelerometer responses decoded, %d wrong\n", i, wrong);
+    return(wrong != 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int res = 1;
+
+    if (argc < 2)
+    {
+        printf("usage: FinchBench stop [threads] [rounds]\n"
+               "       FinchBench poll [seconds]\n"
+               "       FinchBench co [routines]\n"
+               "       FinchBench fleet [rounds]\n"
+               "       FinchBench melody [notes]\n"
+               "       FinchBench animate [seconds]\n"
+               "       FinchBench flow [threads]\n"
+               "       FinchBench filter [samples]\n"
+               "       FinchBench sim [minutes]  (with FINCH_SIM=maze file)\n"
+               "       FinchBench maze [size]\n"
+               "       FinchBench game [moves]\n"
+               "       FinchBench path [resets]\n"
+               "       FinchBench decode\n");
+        return(1);
+    }
+    // the benches of the computation alone need no robot, the game
+    // moves it when there is one
+    if (strcmp(argv[1], "filter") != 0 && strcmp(argv[1], "maze") != 0 &&
+        strcmp(argv[1], "path") != 0 && strcmp(argv[1], "decode") != 0)
+    {
+        bench_robot = Fin_Init() >= 0;
+        if (!bench_robot && strcmp(argv[1], "game") != 0)
+            return(1);
+    }
+
+    if (strcmp(argv[1], "stop") == 0)
+        res = Bench_Stop(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 200);
+    else if (strcmp(argv[1], "poll") == 0)
+        res = Bench_Poll(argc > 2 ? atoi(argv[2]) : 2);
+    else if (strcmp(argv[1], "co") == 0)
+        res = Bench_Co(argc > 2 ? atoi(argv[2]) : 32);
+    else if (strcmp(argv[1], "fleet") == 0)
+        res = Bench_Fleet(argc > 2 ? atoi(argv[2]) : 50);
+    else if (strcmp(argv[1], "melody") == 0)
+        res = Bench_Melody(argc > 2 ? atoi(argv[2]) : 40);
+    else if (strcmp(argv[1], "animate") == 0)
+        res = Bench_Animate(argc > 2 ? atoi(argv[2]) : 4);
+    else if (strcmp(argv[1], "flow") == 0)
+        res = Bench_Flow(argc > 2 ? atoi(argv[2]) : 4);
+    else if (strcmp(argv[1], "filter") == 0)
+        res = Bench_Filter(argc > 2 ? atoi(argv[2]) : 1000000);
+    else if (strcmp(argv[1], "sim") == 0)
+        res = Bench_Sim(argc > 2 ? atoi(argv[2]) : 2);
+    else if (strcmp(argv[1], "maze") == 0)
+        res = Bench_Maze(argc > 2 ? atoi(argv[2]) : 512);
+    else if (strcmp(argv[1], "game") == 0)
+        res = Bench_Game(argc > 2 ? atoi(argv[2]) : 10);
+    else if (strcmp(argv[1], "path") == 0)
+        res = Bench_Path(argc > 2 ? atoi(argv[2]) : 20);
+    else if (strcmp(argv[1], "decode") == 0)
+        res = Bench_Decode();
+    else
+        printf("unknown benchmark %s\n", argv[1]);
+
+    if (bench_robot)
+        Fin_Exit();
+    return(res);
+}
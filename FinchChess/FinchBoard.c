@@ -0,0 +1,1190 @@
+/*
+ * Chess board of the workshop: bitboards, magic bitboard tables for the
+ * sliders, Zobrist keys and a legal move generator.
+ *
+ * The moves are legal as generated: the pieces pinned to their king only
+ * move along the pin, in check only the moves that take the checker or
+ * come in between are tried, the king only goes to squares nothing
+ * attacks once it has left, and en passant (which takes two pieces off a
+ * rank at once) is checked by looking from the king again. So nothing is
+ * made and taken back to find out, and perft counts the last moves
+ * without making them.
+ * The magic numbers are looked for when the tables are built, from fixed
+ * seeds so they are the same every time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "FinchBoard.h"
+
+#define BOARD_START  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+#define BOARD_RANK1  0x00000000000000ffULL
+#define BOARD_RANK8  0xff00000000000000ULL
+#define BOARD_FILEA  0x0101010101010101ULL
+#define BOARD_FILEH  0x8080808080808080ULL
+
+#define Board_Lsb(bits)     __builtin_ctzll(bits)
+#define Board_Count(bits)   __builtin_popcountll(bits)
+
+/*
+ * a slider on a square: the squares that can block it, and where the
+ * attacks of each set of blockers are
+ */
+struct board_magic
+{
+    Fin_Bits mask;
+    Fin_Bits magic;
+    Fin_Bits *attacks;
+    int shift;
+};
+
+static struct board_magic board_rook[64];
+static struct board_magic board_bishop[64];
+static Fin_Bits board_rook_table[102400];
+static Fin_Bits board_bishop_table[5248];
+
+static Fin_Bits board_knight[64];
+static Fin_Bits board_king[64];
+static Fin_Bits board_pawn[2][64];          // squares a pawn of each color attacks
+static Fin_Bits board_between[64][64];      // squares strictly between two aligned ones
+static Fin_Bits board_line[64][64];         // whole line through two aligned squares
+
+static unsigned long long board_zobrist[12][64];
+static unsigned long long board_zobrist_castle[16];
+static unsigned long long board_zobrist_ep[8];
+static unsigned long long board_zobrist_turn;
+
+static int board_score[12][64];             // material and square of each piece, FIN_SCORE
+static const int board_phase[6] = { 0, 1, 1, 2, 4, 0 };
+
+static unsigned char board_castle_mask[64];  // rights left when a piece leaves or lands on a square
+
+static int board_ready = 0;
+
+static const char board_pieces[] = "PNBRQKpnbrqk";
+
+
+/*
+ * pseudo random numbers, xorshift
+ */
+static unsigned long long Board_Random(unsigned long long *seed)
+{
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return(*seed * 2685821657736338717ULL);
+}
+
+
+/*
+ * squares a slider reaches from a square, walking each direction until
+ * a blocker (included) or the edge
+ */
+static Fin_Bits Board_Slide(int square, Fin_Bits blockers, const int dir[4][2])
+{
+    Fin_Bits attacks = 0;
+    int d, file, rank;
+
+    for (d = 0; d < 4; d++)
+    {
+        file = FIN_FILE(square) + dir[d][0];
+        rank = FIN_RANK(square) + dir[d][1];
+        while (file >= 0 && file < 8 && rank >= 0 && rank < 8)
+        {
+            attacks |= FIN_BIT(FIN_SQUARE(file, rank));
+            if (blockers & FIN_BIT(FIN_SQUARE(file, rank)))
+                break;
+            file += dir[d][0];
+            rank += dir[d][1];
+        }
+    }
+    return(attacks);
+}
+
+static const int board_rook_dir[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+static const int board_bishop_dir[4][2] = { { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 } };
+
+
+/*
+ * find the magic number of a slider on a square: one that sends every set
+ * of blockers to a slot of the table that has the same attacks
+ */
+static Fin_Bits *Board_Magic(struct board_magic *m, int square, const int dir[4][2],
+                             Fin_Bits *table)
+{
+    // seeds known to find the magics of each rank in a few tries
+    static const unsigned long long seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+    static Fin_Bits blockers[4096], attacks[4096];
+    static int used[4096];
+    Fin_Bits edges, subset;
+    unsigned long long seed = seeds[FIN_RANK(square)];
+    int size, n, i, slot, tries;
+
+    // the edges never block, unless the slider is on them
+    edges = ((BOARD_RANK1 | BOARD_RANK8) & ~(BOARD_RANK1 << (FIN_RANK(square) * 8))) |
+            ((BOARD_FILEA | BOARD_FILEH) & ~(BOARD_FILEA << FIN_FILE(square)));
+    m->mask = Board_Slide(square, 0, dir) & ~edges;
+    m->shift = 64 - Board_Count(m->mask);
+    m->attacks = table;
+    size = 1 << Board_Count(m->mask);
+
+    // every subset of the mask
+    n = 0;
+    subset = 0;
+    do
+    {
+        blockers[n] = subset;
+        attacks[n++] = Board_Slide(square, subset, dir);
+        subset = (subset - m->mask) & m->mask;
+    } while (subset != 0);
+
+    memset(used, 0, sizeof(used));
+    for (tries = 1; ; tries++)
+    {
+        do
+            m->magic = Board_Random(&seed) & Board_Random(&seed) & Board_Random(&seed);
+        while (Board_Count((m->mask * m->magic) >> 56) < 6);
+
+        for (i = 0; i < n; i++)
+        {
+            slot = (int)((blockers[i] * m->magic) >> m->shift);
+            if (used[slot] < tries)
+            {
+                used[slot] = tries;
+                table[slot] = attacks[i];
+            }
+            else if (table[slot] != attacks[i])
+                break;
+        }
+        if (i == n)
+            return(table + size);
+    }
+}
+
+
+static Fin_Bits Board_Rook(int square, Fin_Bits all)
+{
+    const struct board_magic *m = &board_rook[square];
+
+    return(m->attacks[((all & m->mask) * m->magic) >> m->shift]);
+}
+
+static Fin_Bits Board_Bishop(int square, Fin_Bits all)
+{
+    const struct board_magic *m = &board_bishop[square];
+
+    return(m->attacks[((all & m->mask) * m->magic) >> m->shift]);
+}
+
+
+/*
+ * material and squares of the pieces: toward the center, pawns forward,
+ * the king home until the end
+ */
+static void Board_Scores(void)
+{
+    static const int mg[6] = { 82, 337, 365, 477, 1025, 0 };
+    static const int eg[6] = { 94, 281, 297, 512, 936, 0 };
+    int sq, kind, file, rank, center, m_sq, e_sq;
+
+    for (sq = 0; sq < 64; sq++)
+    {
+        file = FIN_FILE(sq);
+        rank = FIN_RANK(sq);
+        center = (abs(2 * file - 7) > abs(2 * rank - 7) ? abs(2 * file - 7) : abs(2 * rank - 7)) / 2;
+        for (kind = FIN_PAWN; kind <= FIN_KING; kind++)
+        {
+            switch (kind)
+            {
+            case FIN_PAWN:
+                m_sq = 5 * (rank - 1) + ((file == 3 || file == 4) && rank >= 2 && rank <= 4 ? 15 : 0);
+                e_sq = 12 * (rank - 1);
+                break;
+            case FIN_KNIGHT:
+                m_sq = 20 - 12 * center;
+                e_sq = 15 - 10 * center;
+                break;
+            case FIN_BISHOP:
+                m_sq = e_sq = 10 - 6 * center;
+                break;
+            case FIN_ROOK:
+                m_sq = (rank == 6 ? 20 : 0) + (file == 3 || file == 4 ? 5 : 0);
+                e_sq = rank == 6 ? 15 : 0;
+                break;
+            case FIN_QUEEN:
+                m_sq = 5 - 3 * center;
+                e_sq = 15 - 8 * center;
+                break;
+            default:
+                m_sq = rank == 0 ? (file <= 2 || file >= 6 ? 20 : 0) : (rank > 2 ? -60 : -20 * rank);
+                e_sq = 30 - 15 * center;
+                break;
+            }
+            board_score[FIN_PIECE(FIN_WHITE, kind)][sq] = FIN_SCORE(mg[kind] + m_sq, eg[kind] + e_sq);
+            board_score[FIN_PIECE(FIN_BLACK, kind)][sq ^ 56] = -FIN_SCORE(mg[kind] + m_sq, eg[kind] + e_sq);
+        }
+    }
+}
+
+
+/*
+ * build the tables of the moves, the Zobrist keys and the scores
+ */
+static void Board_Init(void)
+{
+    static const int knight[8][2] = { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 },
+                                      { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+    static const int king[8][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 },
+                                    { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+    unsigned long long seed = 0x46696e6368ULL;
+    Fin_Bits *rook = board_rook_table, *bishop = board_bishop_table;
+    Fin_Bits from, to;
+    int sq, other, i, file, rank;
+
+    for (sq = 0; sq < 64; sq++)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            file = FIN_FILE(sq) + knight[i][0];
+            rank = FIN_RANK(sq) + knight[i][1];
+            if (file >= 0 && file < 8 && rank >= 0 && rank < 8)
+                board_knight[sq] |= FIN_BIT(FIN_SQUARE(file, rank));
+            file = FIN_FILE(sq) + king[i][0];
+            rank = FIN_RANK(sq) + king[i][1];
+            if (file >= 0 && file < 8 && rank >= 0 && rank < 8)
+                board_king[sq] |= FIN_BIT(FIN_SQUARE(file, rank));
+        }
+        from = FIN_BIT(sq);
+        board_pawn[FIN_WHITE][sq] = ((from & ~BOARD_FILEA) << 7) | ((from & ~BOARD_FILEH) << 9);
+        board_pawn[FIN_BLACK][sq] = ((from & ~BOARD_FILEA) >> 9) | ((from & ~BOARD_FILEH) >> 7);
+
+        rook = Board_Magic(&board_rook[sq], sq, board_rook_dir, rook);
+        bishop = Board_Magic(&board_bishop[sq], sq, board_bishop_dir, bishop);
+    }
+
+    for (sq = 0; sq < 64; sq++)
+        for (other = 0; other < 64; other++)
+        {
+            to = FIN_BIT(other);
+            if (sq == other)
+                continue;
+            if (Board_Slide(sq, 0, board_rook_dir) & to)
+            {
+                board_between[sq][other] = Board_Slide(sq, to, board_rook_dir) &
+                                           Board_Slide(other, FIN_BIT(sq), board_rook_dir);
+                board_line[sq][other] = (Board_Slide(sq, 0, board_rook_dir) &
+                                         Board_Slide(other, 0, board_rook_dir)) | FIN_BIT(sq) | to;
+            }
+            else if (Board_Slide(sq, 0, board_bishop_dir) & to)
+            {
+                board_between[sq][other] = Board_Slide(sq, to, board_bishop_dir) &
+                                           Board_Slide(other, FIN_BIT(sq), board_bishop_dir);
+                board_line[sq][other] = (Board_Slide(sq, 0, board_bishop_dir) &
+                                         Board_Slide(other, 0, board_bishop_dir)) | FIN_BIT(sq) | to;
+            }
+        }
+
+    for (i = 0; i < 12; i++)
+        for (sq = 0; sq < 64; sq++)
+            board_zobrist[i][sq] = Board_Random(&seed);
+    for (i = 0; i < 16; i++)
+        board_zobrist_castle[i] = Board_Random(&seed);
+    for (i = 0; i < 8; i++)
+        board_zobrist_ep[i] = Board_Random(&seed);
+    board_zobrist_turn = Board_Random(&seed);
+
+    for (sq = 0; sq < 64; sq++)
+        board_castle_mask[sq] = 15;
+    board_castle_mask[FIN_SQUARE(4, 0)] &= ~(FIN_CASTLE_WK | FIN_CASTLE_WQ);
+    board_castle_mask[FIN_SQUARE(7, 0)] &= ~FIN_CASTLE_WK;
+    board_castle_mask[FIN_SQUARE(0, 0)] &= ~FIN_CASTLE_WQ;
+    board_castle_mask[FIN_SQUARE(4, 7)] &= ~(FIN_CASTLE_BK | FIN_CASTLE_BQ);
+    board_castle_mask[FIN_SQUARE(7, 7)] &= ~FIN_CASTLE_BK;
+    board_castle_mask[FIN_SQUARE(0, 7)] &= ~FIN_CASTLE_BQ;
+
+    Board_Scores();
+    board_ready = 1;
+}
+
+
+/*
+ * pieces of a color attacking a square, with the given occupancy
+ */
+static Fin_Bits Board_Attackers(const Fin_Board *board, int square, int color, Fin_Bits all)
+{
+    const Fin_Bits *p = &board->pieces[FIN_PIECE(color, FIN_PAWN)];
+
+    return((board_pawn[!color][square] & p[FIN_PAWN]) |
+           (board_knight[square] & p[FIN_KNIGHT]) |
+           (board_king[square] & p[FIN_KING]) |
+           (Board_Rook(square, all) & (p[FIN_ROOK] | p[FIN_QUEEN])) |
+           (Board_Bishop(square, all) & (p[FIN_BISHOP] | p[FIN_QUEEN])));
+}
+
+
+/*
+ * put a piece on an empty square or take it off
+ */
+static void Board_Toggle(Fin_Board *board, int piece, int square)
+{
+    Fin_Bits bit = FIN_BIT(square);
+
+    board->pieces[piece] ^= bit;
+    board->color[FIN_COLOR(piece)] ^= bit;
+    board->all ^= bit;
+}
+
+
+/*
+ * can a pawn of the side to move take en passant on a square?
+ */
+static int Board_EpPossible(const Fin_Board *board, int ep)
+{
+    return((board_pawn[!board->turn][ep] & board->pieces[FIN_PIECE(board->turn, FIN_PAWN)]) != 0);
+}
+
+
+unsigned long long Fin_BoardKey(const Fin_Board *board)
+{
+    unsigned long long key = 0;
+    int sq;
+
+    for (sq = 0; sq < 64; sq++)
+        if (board->square[sq] != FIN_EMPTY)
+            key ^= board_zobrist[board->square[sq]][sq];
+    key ^= board_zobrist_castle[board->castle];
+    if (board->ep >= 0)
+        key ^= board_zobrist_ep[FIN_FILE(board->ep)];
+    if (board->turn == FIN_BLACK)
+        key ^= board_zobrist_turn;
+    return(key);
+}
+
+
+/**  Fin_BoardScore(*board, *phase).
+ *  material and squares of the pieces, worked out from them
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     int *phase = where to return the phase of the game
+ *  returns
+ *     the score, white's less black's (FIN_SCORE)
+ */
+int Fin_BoardScore(const Fin_Board *board, int *phase)
+{
+    int score = 0, piece;
+    Fin_Bits bits;
+
+    *phase = 0;
+    for (piece = 0; piece < 12; piece++)
+        for (bits = board->pieces[piece]; bits; bits &= bits - 1)
+        {
+            score += board_score[piece][Board_Lsb(bits)];
+            *phase += board_phase[FIN_KIND(piece)];
+        }
+    return(score);
+}
+
+
+/**  Fin_BoardSet(*board, *fen).
+ *  set up a position
+ *
+ *  input:
+ *     Fin_Board *board = to set up
+ *     const char *fen = the position, NULL for the start
+ *  returns
+ *     -1 if failure
+ */
+int Fin_BoardSet(Fin_Board *board, const char *fen)
+{
+    const char *p, *s;
+    int file = 0, rank = 7, sq;
+
+    if (!board_ready)
+        Board_Init();
+    if (fen == NULL)
+        fen = BOARD_START;
+
+    memset(board, 0, sizeof(*board) - sizeof(board->undo));
+    memset(board->square, FIN_EMPTY, sizeof(board->square));
+    board->ep = -1;
+    board->fullmove = 1;
+
+    while (*fen == ' ')
+        fen++;
+    for (p = fen; *p && *p != ' '; p++)
+    {
+        if (*p == '/')
+        {
+            if (file != 8 || rank == 0)
+                return(-1);
+            file = 0;
+            rank--;
+        }
+        else if (*p >= '1' && *p <= '8')
+            file += *p - '0';
+        else if ((s = strchr(board_pieces, *p)) != NULL && file < 8)
+        {
+            sq = FIN_SQUARE(file++, rank);
+            board->square[sq] = (unsigned char)(s - board_pieces);
+            Board_Toggle(board, board->square[sq], sq);
+        }
+        else
+            return(-1);
+        if (file > 8)
+            return(-1);
+    }
+    if (file != 8 || rank != 0 || Board_Count(board->pieces[FIN_PIECE(FIN_WHITE, FIN_KING)]) != 1 ||
+        Board_Count(board->pieces[FIN_PIECE(FIN_BLACK, FIN_KING)]) != 1)
+        return(-1);
+
+    // side to move
+    while (*p == ' ')
+        p++;
+    if (*p == 'b')
+        board->turn = FIN_BLACK;
+    else if (*p != 'w')
+        return(-1);
+    p++;
+
+    // castling rights, only if the king and the rook are still home
+    while (*p == ' ')
+        p++;
+    for (; *p && *p != ' '; p++)
+    {
+        if (*p == 'K')
+            board->castle |= FIN_CASTLE_WK;
+        else if (*p == 'Q')
+            board->castle |= FIN_CASTLE_WQ;
+        else if (*p == 'k')
+            board->castle |= FIN_CASTLE_BK;
+        else if (*p == 'q')
+            board->castle |= FIN_CASTLE_BQ;
+        else if (*p != '-')
+            return(-1);
+    }
+    if (board->square[FIN_SQUARE(4, 0)] != FIN_PIECE(FIN_WHITE, FIN_KING))
+        board->castle &= ~(FIN_CASTLE_WK | FIN_CASTLE_WQ);
+    if (board->square[FIN_SQUARE(7, 0)] != FIN_PIECE(FIN_WHITE, FIN_ROOK))
+        board->castle &= ~FIN_CASTLE_WK;
+    if (board->square[FIN_SQUARE(0, 0)] != FIN_PIECE(FIN_WHITE, FIN_ROOK))
+        board->castle &= ~FIN_CASTLE_WQ;
+    if (board->square[FIN_SQUARE(4, 7)] != FIN_PIECE(FIN_BLACK, FIN_KING))
+        board->castle &= ~(FIN_CASTLE_BK | FIN_CASTLE_BQ);
+    if (board->square[FIN_SQUARE(7, 7)] != FIN_PIECE(FIN_BLACK, FIN_ROOK))
+        board->castle &= ~FIN_CASTLE_BK;
+    if (board->square[FIN_SQUARE(0, 7)] != FIN_PIECE(FIN_BLACK, FIN_ROOK))
+        board->castle &= ~FIN_CASTLE_BQ;
+
+    // en passant, kept only if a pawn can take (so equal positions have equal keys)
+    while (*p == ' ')
+        p++;
+    if (p[0] >= 'a' && p[0] <= 'h' && (p[1] == '3' || p[1] == '6'))
+    {
+        sq = FIN_SQUARE(p[0] - 'a', p[1] - '1');
+        if (Board_EpPossible(board, sq))
+            board->ep = sq;
+        p += 2;
+    }
+    else if (*p == '-')
+        p++;
+    else if (*p)
+        return(-1);
+
+    // move counters, may be missing
+    board->halfmove = (int)strtol(p, (char **)&p, 10);
+    board->fullmove = (int)strtol(p, (char **)&p, 10);
+    if (board->fullmove < 1)
+        board->fullmove = 1;
+    if (board->halfmove < 0 || board->halfmove > 255)
+        board->halfmove = 0;
+
+    // the side that just moved cannot be in check
+    sq = Board_Lsb(board->pieces[FIN_PIECE(!board->turn, FIN_KING)]);
+    if (Board_Attackers(board, sq, board->turn, board->all))
+        return(-1);
+
+    board->key = Fin_BoardKey(board);
+    board->score = Fin_BoardScore(board, &board->phase);
+    return(0);
+}
+
+
+/**  Fin_BoardFen(*board, *fen, size).
+ *  write a position in Forsyth-Edwards notation
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     char *fen = where to write it
+ *     int size = of fen
+ *  returns
+ *     -1 if failure
+ */
+int Fin_BoardFen(const Fin_Board *board, char *fen, int size)
+{
+    char text[100], *p = text;
+    int file, rank, empty, piece;
+
+    for (rank = 7; rank >= 0; rank--)
+    {
+        for (file = 0, empty = 0; file < 8; file++)
+        {
+            piece = board->square[FIN_SQUARE(file, rank)];
+            if (piece == FIN_EMPTY)
+                empty++;
+            else
+            {
+                if (empty)
+                    *p++ = (char)('0' + empty);
+                empty = 0;
+                *p++ = board_pieces[piece];
+            }
+        }
+        if (empty)
+            *p++ = (char)('0' + empty);
+        if (rank)
+            *p++ = '/';
+    }
+    *p++ = ' ';
+    *p++ = board->turn == FIN_WHITE ? 'w' : 'b';
+    *p++ = ' ';
+    if (board->castle & FIN_CASTLE_WK)
+        *p++ = 'K';
+    if (board->castle & FIN_CASTLE_WQ)
+        *p++ = 'Q';
+    if (board->castle & FIN_CASTLE_BK)
+        *p++ = 'k';
+    if (board->castle & FIN_CASTLE_BQ)
+        *p++ = 'q';
+    if (board->castle == 0)
+        *p++ = '-';
+    *p++ = ' ';
+    if (board->ep >= 0)
+    {
+        *p++ = (char)('a' + FIN_FILE(board->ep));
+        *p++ = (char)('1' + FIN_RANK(board->ep));
+    }
+    else
+        *p++ = '-';
+    sprintf(p, " %d %d", board->halfmove, board->fullmove);
+
+    if ((int)strlen(text) >= size)
+        return(-1);
+    strcpy(fen, text);
+    return(0);
+}
+
+
+/*
+ * add the moves of a piece from a square to a set of squares
+ */
+static Fin_BoardMove *Board_Add(Fin_BoardMove *moves, int from, Fin_Bits to)
+{
+    for (; to; to &= to - 1)
+        *moves++ = FIN_MOVE(from, Board_Lsb(to), FIN_MOVE_NORMAL);
+    return(moves);
+}
+
+/*
+ * add the moves of pawns shifted by a step, promoting on the last rank
+ */
+static Fin_BoardMove *Board_AddPawns(Fin_BoardMove *moves, Fin_Bits to, int step, int flags)
+{
+    int sq;
+
+    for (; to; to &= to - 1)
+    {
+        sq = Board_Lsb(to);
+        if (FIN_BIT(sq) & (BOARD_RANK1 | BOARD_RANK8))
+        {
+            *moves++ = FIN_MOVE(sq - step, sq, FIN_MOVE_PROMO + FIN_QUEEN - FIN_KNIGHT);
+            *moves++ = FIN_MOVE(sq - step, sq, FIN_MOVE_PROMO + FIN_ROOK - FIN_KNIGHT);
+            *moves++ = FIN_MOVE(sq - step, sq, FIN_MOVE_PROMO + FIN_BISHOP - FIN_KNIGHT);
+            *moves++ = FIN_MOVE(sq - step, sq, FIN_MOVE_PROMO);
+        }
+        else
+            *moves++ = FIN_MOVE(sq - step, sq, flags);
+    }
+    return(moves);
+}
+
+
+/**  Fin_BoardMoves(*board, *moves).
+ *  generate the legal moves of the side to move
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     Fin_BoardMove *moves = where to return them (FIN_BOARD_MOVES)
+ *  returns
+ *     the number of moves
+ */
+int Fin_BoardMoves(const Fin_Board *board, Fin_BoardMove *moves)
+{
+    Fin_BoardMove *start = moves;
+    int us = board->turn, them = !us;
+    const Fin_Bits *mine = &board->pieces[FIN_PIECE(us, FIN_PAWN)];
+    const Fin_Bits *theirs = &board->pieces[FIN_PIECE(them, FIN_PAWN)];
+    Fin_Bits all = board->all, own = board->color[us], enemy = board->color[them];
+    Fin_Bits checkers, pinned, snipers, target, bits, to, pawns, push, free;
+    int king = Board_Lsb(mine[FIN_KING]);
+    int sq, step, cap;
+
+    checkers = Board_Attackers(board, king, them, all);
+
+    // the king, to the squares nothing attacks once it has left its own
+    for (to = board_king[king] & ~own; to; to &= to - 1)
+        if (!Board_Attackers(board, Board_Lsb(to), them, all ^ FIN_BIT(king)))
+            *moves++ = FIN_MOVE(king, Board_Lsb(to), FIN_MOVE_NORMAL);
+    if (checkers & (checkers - 1))
+        return((int)(moves - start));
+
+    // in check, only taking the checker or coming in between
+    target = ~own;
+    if (checkers)
+        target &= checkers | board_between[king][Board_Lsb(checkers)];
+
+    // pieces alone between their king and a slider of the other side
+    pinned = 0;
+    snipers = (Board_Rook(king, 0) & (theirs[FIN_ROOK] | theirs[FIN_QUEEN])) |
+              (Board_Bishop(king, 0) & (theirs[FIN_BISHOP] | theirs[FIN_QUEEN]));
+    for (; snipers; snipers &= snipers - 1)
+    {
+        bits = board_between[king][Board_Lsb(snipers)] & all;
+        if (bits && !(bits & (bits - 1)))
+            pinned |= bits & own;
+    }
+
+    for (bits = mine[FIN_KNIGHT] & ~pinned; bits; bits &= bits - 1)
+    {
+        sq = Board_Lsb(bits);
+        moves = Board_Add(moves, sq, board_knight[sq] & target);
+    }
+    for (bits = mine[FIN_BISHOP] | mine[FIN_QUEEN]; bits; bits &= bits - 1)
+    {
+        sq = Board_Lsb(bits);
+        to = Board_Bishop(sq, all) & target;
+        if (pinned & FIN_BIT(sq))
+            to &= board_line[king][sq];
+        moves = Board_Add(moves, sq, to);
+    }
+    for (bits = mine[FIN_ROOK] | mine[FIN_QUEEN]; bits; bits &= bits - 1)
+    {
+        sq = Board_Lsb(bits);
+        to = Board_Rook(sq, all) & target;
+        if (pinned & FIN_BIT(sq))
+            to &= board_line[king][sq];
+        moves = Board_Add(moves, sq, to);
+    }
+
+    // pawns not pinned go by whole sets, the pinned ones one by one
+    step = us == FIN_WHITE ? 8 : -8;
+    free = ~all;
+    pawns = mine[FIN_PAWN] & ~pinned;
+    if (us == FIN_WHITE)
+    {
+        push = (pawns << 8) & free;
+        moves = Board_AddPawns(moves, push & target, 8, FIN_MOVE_NORMAL);
+        moves = Board_AddPawns(moves, ((push & (BOARD_RANK1 << 16)) << 8) & free & target, 16,
+                               FIN_MOVE_DOUBLE);
+        moves = Board_AddPawns(moves, ((pawns & ~BOARD_FILEA) << 7) & enemy & target, 7,
+                               FIN_MOVE_NORMAL);
+        moves = Board_AddPawns(moves, ((pawns & ~BOARD_FILEH) << 9) & enemy & target, 9,
+                               FIN_MOVE_NORMAL);
+    }
+    else
+    {
+        push = (pawns >> 8) & free;
+        moves = Board_AddPawns(moves, push & target, -8, FIN_MOVE_NORMAL);
+        moves = Board_AddPawns(moves, ((push & (BOARD_RANK8 >> 16)) >> 8) & free & target, -16,
+                               FIN_MOVE_DOUBLE);
+        moves = Board_AddPawns(moves, ((pawns & ~BOARD_FILEH) >> 7) & enemy & target, -7,
+                               FIN_MOVE_NORMAL);
+        moves = Board_AddPawns(moves, ((pawns & ~BOARD_FILEA) >> 9) & enemy & target, -9,
+                               FIN_MOVE_NORMAL);
+    }
+    for (bits = mine[FIN_PAWN] & pinned; bits; bits &= bits - 1)
+    {
+        sq = Board_Lsb(bits);
+        to = board_pawn[us][sq] & enemy;
+        if (free & FIN_BIT(sq + step))
+        {
+            to |= FIN_BIT(sq + step);
+            if (FIN_RANK(sq) == (us == FIN_WHITE ? 1 : 6) && (free & FIN_BIT(sq + 2 * step)))
+                moves = Board_AddPawns(moves, FIN_BIT(sq + 2 * step) & target &
+                                       board_line[king][sq], 2 * step, FIN_MOVE_DOUBLE);
+        }
+        for (to &= target & board_line[king][sq]; to; to &= to - 1)
+            moves = Board_AddPawns(moves, to & -to, Board_Lsb(to) - sq, FIN_MOVE_NORMAL);
+    }
+
+    // en passant: look from the king again with both pawns gone
+    if (board->ep >= 0)
+    {
+        cap = board->ep - step;
+        for (bits = board_pawn[them][board->ep] & mine[FIN_PAWN]; bits; bits &= bits - 1)
+        {
+            sq = Board_Lsb(bits);
+            to = (all ^ FIN_BIT(sq) ^ FIN_BIT(cap)) | FIN_BIT(board->ep);
+            if (!((Board_Rook(king, to) & (theirs[FIN_ROOK] | theirs[FIN_QUEEN])) |
+                  (Board_Bishop(king, to) & (theirs[FIN_BISHOP] | theirs[FIN_QUEEN])) |
+                  (board_knight[king] & theirs[FIN_KNIGHT]) |
+                  (board_pawn[us][king] & theirs[FIN_PAWN] & ~FIN_BIT(cap))))
+                *moves++ = FIN_MOVE(sq, board->ep, FIN_MOVE_EP);
+        }
+    }
+
+    // castling, out of check, through empty squares nothing attacks
+    if (!checkers && (board->castle & (us == FIN_WHITE ? FIN_CASTLE_WK | FIN_CASTLE_WQ :
+                                                         FIN_CASTLE_BK | FIN_CASTLE_BQ)))
+    {
+        if ((board->castle & (us == FIN_WHITE ? FIN_CASTLE_WK : FIN_CASTLE_BK)) &&
+            !(all & (FIN_BIT(king + 1) | FIN_BIT(king + 2))) &&
+            !Board_Attackers(board, king + 1, them, all) &&
+            !Board_Attackers(board, king + 2, them, all))
+            *moves++ = FIN_MOVE(king, king + 2, FIN_MOVE_CASTLE);
+        if ((board->castle & (us == FIN_WHITE ? FIN_CASTLE_WQ : FIN_CASTLE_BQ)) &&
+            !(all & (FIN_BIT(king - 1) | FIN_BIT(king - 2) | FIN_BIT(king - 3))) &&
+            !Board_Attackers(board, king - 1, them, all) &&
+            !Board_Attackers(board, king - 2, them, all))
+            *moves++ = FIN_MOVE(king, king - 2, FIN_MOVE_CASTLE);
+    }
+
+    return((int)(moves - start));
+}
+
+
+/**  Fin_BoardMake(*board, move).
+ *  play a legal move
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     Fin_BoardMove move = to play
+ *  returns
+ *     -1 if failure
+ */
+int Fin_BoardMake(Fin_Board *board, Fin_BoardMove move)
+{
+    struct fin_board_undo *undo;
+    int from = FIN_MOVE_FROM(move), to = FIN_MOVE_TO(move), flags = FIN_MOVE_FLAGS(move);
+    int piece = board->square[from], us = board->turn;
+    int captured, cap = to, rook, rook_from, rook_to, score = board->score;
+    unsigned long long key = board->key;
+
+    if (board->ply >= FIN_BOARD_HISTORY)
+        return(-1);
+    undo = &board->undo[board->ply++];
+    undo->key = key;
+    undo->score = score;
+    undo->phase = (unsigned char)board->phase;
+    undo->move = move;
+    undo->castle = (unsigned char)board->castle;
+    undo->ep = (signed char)board->ep;
+    undo->halfmove = (unsigned char)(board->halfmove > 255 ? 255 : board->halfmove);
+
+    if (board->ep >= 0)
+        key ^= board_zobrist_ep[FIN_FILE(board->ep)];
+    board->ep = -1;
+
+    // a pass (the null move of a search) only gives the turn away
+    if (move == FIN_MOVE_NONE)
+    {
+        undo->captured = FIN_EMPTY;
+        board->halfmove++;
+        if (us == FIN_BLACK)
+            board->fullmove++;
+        board->turn = !us;
+        board->key = key ^ board_zobrist_turn;
+        return(0);
+    }
+
+    // take off what it captures
+    if (flags == FIN_MOVE_EP)
+        cap = to + (us == FIN_WHITE ? -8 : 8);
+    captured = board->square[cap];
+    undo->captured = (unsigned char)captured;
+    if (captured != FIN_EMPTY)
+    {
+        Board_Toggle(board, captured, cap);
+        board->square[cap] = FIN_EMPTY;
+        key ^= board_zobrist[captured][cap];
+        score -= board_score[captured][cap];
+        board->phase -= board_phase[FIN_KIND(captured)];
+    }
+
+    // the piece, promoted if it is
+    Board_Toggle(board, piece, from);
+    board->square[from] = FIN_EMPTY;
+    key ^= board_zobrist[piece][from];
+    score -= board_score[piece][from];
+    if (flags >= FIN_MOVE_PROMO)
+    {
+        piece = FIN_PIECE(us, FIN_MOVE_PROMOTED(move));
+        board->phase += board_phase[FIN_MOVE_PROMOTED(move)];
+    }
+    Board_Toggle(board, piece, to);
+    board->square[to] = (unsigned char)piece;
+    key ^= board_zobrist[piece][to];
+    score += board_score[piece][to];
+
+    if (flags == FIN_MOVE_CASTLE)
+    {
+        rook = FIN_PIECE(us, FIN_ROOK);
+        rook_from = to > from ? to + 1 : to - 2;
+        rook_to = to > from ? to - 1 : to + 1;
+        Board_Toggle(board, rook, rook_from);
+        Board_Toggle(board, rook, rook_to);
+        board->square[rook_from] = FIN_EMPTY;
+        board->square[rook_to] = (unsigned char)rook;
+        key ^= board_zobrist[rook][rook_from] ^ board_zobrist[rook][rook_to];
+        score += board_score[rook][rook_to] - board_score[rook][rook_from];
+    }
+    else if (flags == FIN_MOVE_DOUBLE)
+    {
+        board->turn = !us;
+        if (Board_EpPossible(board, (from + to) / 2))
+        {
+            board->ep = (from + to) / 2;
+            key ^= board_zobrist_ep[FIN_FILE(board->ep)];
+        }
+        board->turn = us;
+    }
+
+    key ^= board_zobrist_castle[board->castle];
+    board->castle &= board_castle_mask[from] & board_castle_mask[to];
+    key ^= board_zobrist_castle[board->castle];
+
+    if (captured != FIN_EMPTY || FIN_KIND(piece) == FIN_PAWN || flags >= FIN_MOVE_PROMO)
+        board->halfmove = 0;
+    else
+        board->halfmove++;
+    if (us == FIN_BLACK)
+        board->fullmove++;
+    board->turn = !us;
+    board->key = key ^ board_zobrist_turn;
+    board->score = score;
+    return(0);
+}
+
+
+/*
+ * give back the turn and what a move changed to the side that made it
+ */
+static void Board_Restore(Fin_Board *board, const struct fin_board_undo *undo, int us)
+{
+    board->turn = us;
+    board->castle = undo->castle;
+    board->ep = undo->ep;
+    board->halfmove = undo->halfmove;
+    if (us == FIN_BLACK)
+        board->fullmove--;
+    board->key = undo->key;
+    board->score = undo->score;
+    board->phase = undo->phase;
+}
+
+
+/**  Fin_BoardUnmake(*board).
+ *  take back the last move made
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *  returns
+ *     -1 if failure
+ */
+int Fin_BoardUnmake(Fin_Board *board)
+{
+    struct fin_board_undo *undo;
+    int from, to, flags, piece, us, cap, rook, rook_from, rook_to;
+
+    if (board->ply == 0)
+        return(-1);
+    undo = &board->undo[--board->ply];
+    from = FIN_MOVE_FROM(undo->move);
+    to = FIN_MOVE_TO(undo->move);
+    flags = FIN_MOVE_FLAGS(undo->move);
+    us = !board->turn;
+    if (undo->move == FIN_MOVE_NONE)
+    {
+        Board_Restore(board, undo, us);
+        return(0);
+    }
+
+    piece = board->square[to];
+    Board_Toggle(board, piece, to);
+    board->square[to] = FIN_EMPTY;
+    if (flags >= FIN_MOVE_PROMO)
+        piece = FIN_PIECE(us, FIN_PAWN);
+    Board_Toggle(board, piece, from);
+    board->square[from] = (unsigned char)piece;
+
+    if (undo->captured != FIN_EMPTY)
+    {
+        cap = flags == FIN_MOVE_EP ? to + (us == FIN_WHITE ? -8 : 8) : to;
+        Board_Toggle(board, undo->captured, cap);
+        board->square[cap] = undo->captured;
+    }
+    if (flags == FIN_MOVE_CASTLE)
+    {
+        rook = FIN_PIECE(us, FIN_ROOK);
+        rook_from = to > from ? to + 1 : to - 2;
+        rook_to = to > from ? to - 1 : to + 1;
+        Board_Toggle(board, rook, rook_to);
+        Board_Toggle(board, rook, rook_from);
+        board->square[rook_to] = FIN_EMPTY;
+        board->square[rook_from] = (unsigned char)rook;
+    }
+
+    Board_Restore(board, undo, us);
+    return(0);
+}
+
+
+/**  Fin_BoardCheck(*board).
+ *  is the side to move in check?
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *  returns
+ *     1 if it is
+ */
+int Fin_BoardCheck(const Fin_Board *board)
+{
+    int king = Board_Lsb(board->pieces[FIN_PIECE(board->turn, FIN_KING)]);
+
+    return(Board_Attackers(board, king, !board->turn, board->all) != 0);
+}
+
+
+/**  Fin_BoardAttacked(*board, square, color).
+ *  does a color attack a square?
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     int square = 0 to 63
+ *     int color = FIN_WHITE or FIN_BLACK
+ *  returns
+ *     1 if it does
+ */
+int Fin_BoardAttacked(const Fin_Board *board, int square, int color)
+{
+    return(Board_Attackers(board, square, color, board->all) != 0);
+}
+
+
+/**  Fin_BoardText(move, *text).
+ *  write a move in coordinate notation
+ *
+ *  input:
+ *     Fin_BoardMove move = the move
+ *     char *text = where to write it (6 characters)
+ *  returns
+ *     text
+ */
+char *Fin_BoardText(Fin_BoardMove move, char *text)
+{
+    int from = FIN_MOVE_FROM(move), to = FIN_MOVE_TO(move);
+
+    text[0] = (char)('a' + FIN_FILE(from));
+    text[1] = (char)('1' + FIN_RANK(from));
+    text[2] = (char)('a' + FIN_FILE(to));
+    text[3] = (char)('1' + FIN_RANK(to));
+    text[4] = FIN_MOVE_FLAGS(move) >= FIN_MOVE_PROMO ? "nbrq"[FIN_MOVE_PROMOTED(move) - FIN_KNIGHT] : 0;
+    text[5] = 0;
+    return(text);
+}
+
+
+/**  Fin_BoardParse(*board, *text).
+ *  read a move in coordinate notation
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     const char *text = the move
+ *  returns
+ *     the move, FIN_MOVE_NONE if not legal
+ */
+Fin_BoardMove Fin_BoardParse(const Fin_Board *board, const char *text)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    char legal[6];
+    int i, n = Fin_BoardMoves(board, moves);
+
+    for (i = 0; i < n; i++)
+    {
+        Fin_BoardText(moves[i], legal);
+        if (strncmp(text, legal, strlen(legal)) == 0 &&
+            (text[strlen(legal)] == 0 || text[strlen(legal)] == ' ' || text[strlen(legal)] == '\n'))
+            return(moves[i]);
+    }
+    return(FIN_MOVE_NONE);
+}
+
+
+/**  Fin_BoardSan(*board, *text).
+ *  read a move in standard algebraic notation (as in PGN files)
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     const char *text = the move (e4, Nbd7, exd5, O-O, e8=Q+)
+ *  returns
+ *     the move, FIN_MOVE_NONE if not legal or ambiguous
+ */
+Fin_BoardMove Fin_BoardSan(const Fin_Board *board, const char *text)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES], found = FIN_MOVE_NONE;
+    int i, n, len, from, to = -1, kind = FIN_PAWN, promo = -1, file = -1, rank = -1, castle = 0;
+    const char *p;
+
+    for (len = 0; text[len] && strchr("+#!? \t\r\n", text[len]) == NULL; len++)
+        ;
+    if (strncmp(text, "O-O-O", 5) == 0 || strncmp(text, "0-0-0", 5) == 0)
+        castle = 2;
+    else if (strncmp(text, "O-O", 3) == 0 || strncmp(text, "0-0", 3) == 0)
+        castle = 1;
+    else
+    {
+        p = text;
+        if (len > 0 && strchr("NBRQK", *p))
+            kind = (int)(strchr("PNBRQK", *p++) - "PNBRQK");
+        for (; p < text + len; p++)
+        {
+            if (*p >= 'a' && *p <= 'h' && p + 1 < text + len && p[1] >= '1' && p[1] <= '8')
+            {
+                // a square: the one moved to, unless another comes after it
+                if (to >= 0)
+                {
+                    file = FIN_FILE(to);
+                    rank = FIN_RANK(to);
+                }
+                to = FIN_SQUARE(*p - 'a', p[1] - '1');
+                p++;
+            }
+            else if (*p >= 'a' && *p <= 'h')
+                file = *p - 'a';
+            else if (*p >= '1' && *p <= '8')
+                rank = *p - '1';
+            else if (strchr("NBRQ", *p) && to >= 0)
+                promo = (int)(strchr("PNBRQK", *p) - "PNBRQK");
+        }
+        if (to < 0)
+            return(FIN_MOVE_NONE);
+    }
+
+    n = Fin_BoardMoves(board, moves);
+    for (i = 0; i < n; i++)
+    {
+        from = FIN_MOVE_FROM(moves[i]);
+        if (castle)
+        {
+            if (FIN_MOVE_FLAGS(moves[i]) != FIN_MOVE_CASTLE ||
+                (castle == 1) != (FIN_MOVE_TO(moves[i]) > from))
+                continue;
+        }
+        else if (FIN_MOVE_TO(moves[i]) != to || FIN_KIND(board->square[from]) != kind ||
+                 (file >= 0 && FIN_FILE(from) != file) || (rank >= 0 && FIN_RANK(from) != rank) ||
+                 (FIN_MOVE_FLAGS(moves[i]) >= FIN_MOVE_PROMO ? FIN_MOVE_PROMOTED(moves[i]) : -1) != promo)
+            continue;
+        if (found != FIN_MOVE_NONE)
+            return(FIN_MOVE_NONE);
+        found = moves[i];
+    }
+    return(found);
+}
+
+
+/**  Fin_BoardSanText(*board, move, *text).
+ *  write a move in standard algebraic notation
+ *
+ *  input:
+ *     Fin_Board *board = the position (the move is made and taken back)
+ *     Fin_BoardMove move = a legal move
+ *     char *text = where to write it (8 characters)
+ *  returns
+ *     text
+ */
+char *Fin_BoardSanText(Fin_Board *board, Fin_BoardMove move, char *text)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    int from = FIN_MOVE_FROM(move), to = FIN_MOVE_TO(move), flags = FIN_MOVE_FLAGS(move);
+    int kind = FIN_KIND(board->square[from]), capture, other, files = 0, ranks = 0, same = 0;
+    int i, n, len = 0;
+
+    capture = board->square[to] != FIN_EMPTY || flags == FIN_MOVE_EP;
+    if (flags == FIN_MOVE_CASTLE)
+        len = sprintf(text, to > from ? "O-O" : "O-O-O");
+    else
+    {
+        if (kind != FIN_PAWN)
+        {
+            // the file, the rank or both when another piece of the kind goes there too
+            text[len++] = "PNBRQK"[kind];
+            n = Fin_BoardMoves(board, moves);
+            for (i = 0; i < n; i++)
+            {
+                other = FIN_MOVE_FROM(moves[i]);
+                if (other == from || FIN_MOVE_TO(moves[i]) != to || FIN_KIND(board->square[other]) != kind)
+                    continue;
+                same = 1;
+                files += FIN_FILE(other) == FIN_FILE(from);
+                ranks += FIN_RANK(other) == FIN_RANK(from);
+            }
+            if (same && (files == 0 || ranks > 0))
+                text[len++] = (char)('a' + FIN_FILE(from));
+            if (same && files > 0)
+                text[len++] = (char)('1' + FIN_RANK(from));
+        }
+        else if (capture)
+            text[len++] = (char)('a' + FIN_FILE(from));
+        if (capture)
+            text[len++] = 'x';
+        text[len++] = (char)('a' + FIN_FILE(to));
+        text[len++] = (char)('1' + FIN_RANK(to));
+        if (flags >= FIN_MOVE_PROMO)
+        {
+            text[len++] = '=';
+            text[len++] = "PNBRQK"[FIN_MOVE_PROMOTED(move)];
+        }
+    }
+
+    if (Fin_BoardMake(board, move) == 0)
+    {
+        if (Fin_BoardCheck(board))
+            text[len++] = Fin_BoardMoves(board, moves) == 0 ? '#' : '+';
+        Fin_BoardUnmake(board);
+    }
+    text[len] = 0;
+    return(text);
+}
+
+
+/**  Fin_BoardPerft(*board, depth).
+ *  count the positions depth moves ahead
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     int depth = moves ahead
+ *  returns
+ *     positions
+ */
+unsigned long long Fin_BoardPerft(Fin_Board *board, int depth)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    unsigned long long nodes = 0;
+    int i, n;
+
+    if (depth <= 0)
+        return(1);
+    n = Fin_BoardMoves(board, moves);
+    if (depth == 1)
+        return(n);
+    for (i = 0; i < n; i++)
+    {
+        Fin_BoardMake(board, moves[i]);
+        nodes += Fin_BoardPerft(board, depth - 1);
+        Fin_BoardUnmake(board);
+    }
+    return(nodes);
+}
@@ -0,0 +1,680 @@
+#ifndef FINCHBOARD_H
+#define FINCHBOARD_H
+
+/*
+ * Chess board of the workshop (FinchBoard.c), its search (FinchSearch.c),
+ * its opening book (FinchBook.c), its endgame tables (FinchTable.c) and
+ * the games of the robot (FinchGame.c).
+ *
+ * The position is kept as bitboards, a 64 bit set of squares per piece
+ * and per color (bit 0 is a1, bit 7 h1, bit 63 h8), along with the piece
+ * on each square. Sliders are looked up in magic bitboard tables built by
+ * the first Fin_BoardSet. Fin_BoardMoves only generates legal moves (no
+ * move leaves its king in check) and Fin_BoardMake/Fin_BoardUnmake play
+ * and take them back in place, keeping the Zobrist key of the position and
+ * its score (material and squares of the pieces) up to date, e.g. count
+ * the positions three moves ahead:
+ *
+ *    Fin_Board board;
+ *    Fin_BoardMove moves[FIN_BOARD_MOVES];
+ *    unsigned long long total = 0;
+ *    int i, n;
+ *
+ *    Fin_BoardSet(&board, NULL);
+ *    n = Fin_BoardMoves(&board, moves);
+ *    for (i = 0; i < n; i++)
+ *    {
+ *        Fin_BoardMake(&board, moves[i]);
+ *        total += Fin_BoardPerft(&board, 2);
+ *        Fin_BoardUnmake(&board);
+ *    }
+ *
+ * A board is a plain structure without pointers, it can be copied to
+ * give each thread its own.
+ */
+
+/* colors */
+#define FIN_WHITE   0
+#define FIN_BLACK   1
+
+/* kinds of pieces, a piece is color * 6 + kind */
+#define FIN_PAWN    0
+#define FIN_KNIGHT  1
+#define FIN_BISHOP  2
+#define FIN_ROOK    3
+#define FIN_QUEEN   4
+#define FIN_KING    5
+#define FIN_EMPTY   12              // no piece on the square
+
+#define FIN_PIECE(color, kind)  ((color) * 6 + (kind))
+#define FIN_COLOR(piece)        ((piece) >= 6)
+#define FIN_KIND(piece)         ((piece) % 6)
+
+/* squares */
+#define FIN_SQUARE(file, rank)  ((rank) * 8 + (file))
+#define FIN_FILE(square)        ((square) & 7)
+#define FIN_RANK(square)        ((square) >> 3)
+#define FIN_BIT(square)         (1ULL << (square))
+
+/* castling rights */
+#define FIN_CASTLE_WK   1           // white, king side
+#define FIN_CASTLE_WQ   2
+#define FIN_CASTLE_BK   4
+#define FIN_CASTLE_BQ   8
+
+/* a move: from square, to square and what kind of move */
+#define FIN_MOVE(from, to, flags)   ((Fin_BoardMove)((from) | (to) << 6 | (flags) << 12))
+#define FIN_MOVE_FROM(move)         ((move) & 63)
+#define FIN_MOVE_TO(move)           (((move) >> 6) & 63)
+#define FIN_MOVE_FLAGS(move)        ((move) >> 12)
+#define FIN_MOVE_NONE               0   // no move, or a pass for Fin_BoardMake
+
+#define FIN_MOVE_NORMAL     0
+#define FIN_MOVE_DOUBLE     1       // pawn two squares ahead
+#define FIN_MOVE_CASTLE     2       // the king, the rook goes along
+#define FIN_MOVE_EP         3       // en passant
+#define FIN_MOVE_PROMO      4       // + kind - FIN_KNIGHT, to a knight ... a queen
+#define FIN_MOVE_PROMOTED(move)     (FIN_MOVE_FLAGS(move) - FIN_MOVE_PROMO + FIN_KNIGHT)
+
+#define FIN_BOARD_MOVES     256     // most legal moves of a position (218 is the known most)
+#define FIN_BOARD_HISTORY   1024    // most moves made on a board
+
+/*
+ * a score of the middle game and one of the end game in an int (16 bits
+ * each), added and subtracted together
+ */
+#define FIN_SCORE(mg, eg)       ((int)((unsigned int)(eg) << 16) + (mg))
+#define FIN_SCORE_MG(score)     ((int)(short)(unsigned short)(score))
+#define FIN_SCORE_EG(score)     ((int)(short)(unsigned short)((unsigned int)((score) + 0x8000) >> 16))
+
+typedef unsigned long long Fin_Bits;
+typedef unsigned short Fin_BoardMove;
+
+/*
+ * what a move changed, to take it back
+ */
+struct fin_board_undo
+{
+    unsigned long long key;
+    int score;
+    Fin_BoardMove move;
+    unsigned char captured;         // FIN_EMPTY if none
+    unsigned char castle;
+    signed char ep;
+    unsigned char halfmove;
+    unsigned char phase;
+};
+
+typedef struct fin_board Fin_Board;
+struct fin_board
+{
+    Fin_Bits pieces[12];            // squares of each piece
+    Fin_Bits color[2];              // squares of each color
+    Fin_Bits all;
+    unsigned char square[64];       // piece on each square, FIN_EMPTY if none
+    int turn;                       // FIN_WHITE or FIN_BLACK to move
+    int castle;                     // FIN_CASTLE_... still allowed
+    int ep;                         // square a pawn can take en passant, -1 if none
+    int halfmove;                   // moves since a capture or a pawn move
+    int fullmove;
+    unsigned long long key;         // Zobrist key of the position
+    int score;                      // material and squares, white's less black's, FIN_SCORE
+    int phase;                      // of the game: 24 with all the pieces, 0 with pawns only
+    int ply;                        // moves made since Fin_BoardSet
+    struct fin_board_undo undo[FIN_BOARD_HISTORY];
+};
+
+/**
+ *  Fin_BoardSet(*board, *fen).
+ *  Set up a position, the first call also builds the tables of the
+ *  moves (call it once before starting threads).
+ *
+ *  @param *board to set up
+ *  @param *fen position in Forsyth-Edwards notation, NULL for the start
+ *
+ *  @return -1 if the position cannot be read
+ */
+int Fin_BoardSet(Fin_Board *board, const char *fen);
+
+/**
+ *  Fin_BoardFen(*board, *fen, size).
+ *  Write the position in Forsyth-Edwards notation.
+ *
+ *  @param *board the position
+ *  @param *fen where to write it, 90 characters are always enough
+ *  @param size of fen
+ *
+ *  @return -1 if failure
+ */
+int Fin_BoardFen(const Fin_Board *board, char *fen, int size);
+
+/**
+ *  Fin_BoardMoves(*board, *moves).
+ *  Generate the legal moves of the side to move.
+ *
+ *  @param *board the position
+ *  @param *moves where to return them, FIN_BOARD_MOVES of room
+ *
+ *  @return the number of moves, 0 if mate or stalemate
+ */
+int Fin_BoardMoves(const Fin_Board *board, Fin_BoardMove *moves);
+
+/**
+ *  Fin_BoardMake(*board, move).
+ *  Play a legal move (one returned by Fin_BoardMoves), or pass with
+ *  FIN_MOVE_NONE (never when in check).
+ *
+ *  @param *board the position
+ *  @param move to play
+ *
+ *  @return -1 if there is no room left to take it back
+ */
+int Fin_BoardMake(Fin_Board *board, Fin_BoardMove move);
+
+/**
+ *  Fin_BoardUnmake(*board).
+ *  Take back the last move made.
+ *
+ *  @param *board the position
+ *
+ *  @return -1 if no move was made
+ */
+int Fin_BoardUnmake(Fin_Board *board);
+
+/**
+ *  Fin_BoardCheck(*board).
+ *  Is the side to move in check?
+ *
+ *  @param *board the position
+ *
+ *  @return 1 if it is, 0 if not
+ */
+int Fin_BoardCheck(const Fin_Board *board);
+
+/**
+ *  Fin_BoardAttacked(*board, square, color).
+ *  Does any piece of a color attack a square?
+ *
+ *  @param *board the position
+ *  @param square 0 (a1) to 63 (h8)
+ *  @param color FIN_WHITE or FIN_BLACK
+ *
+ *  @return 1 if it does, 0 if not
+ */
+int Fin_BoardAttacked(const Fin_Board *board, int square, int color);
+
+/**
+ *  Fin_BoardKey(*board).
+ *  Zobrist key of a position computed from scratch (board->key is kept
+ *  up to date by the moves, this is to check it).
+ *
+ *  @param *board the position
+ *
+ *  @return the key
+ */
+unsigned long long Fin_BoardKey(const Fin_Board *board);
+
+/**
+ *  Fin_BoardText(move, *text).
+ *  Write a move in coordinate notation (e2e4, e7e8q).
+ *
+ *  @param move the move
+ *  @param *text where to write it, 6 characters of room
+ *
+ *  @return text
+ */
+char *Fin_BoardText(Fin_BoardMove move, char *text);
+
+/**
+ *  Fin_BoardParse(*board, *text).
+ *  Read a move in coordinate notation.
+ *
+ *  @param *board the position
+ *  @param *text the move (e2e4, e7e8q)
+ *
+ *  @return the move, FIN_MOVE_NONE if it is not a legal one
+ */
+Fin_BoardMove Fin_BoardParse(const Fin_Board *board, const char *text);
+
+/**
+ *  Fin_BoardSan(*board, *text).
+ *  Read a move in standard algebraic notation, as in PGN files.
+ *
+ *  @param *board the position
+ *  @param *text the move (e4, Nbd7, exd5, O-O, e8=Q+)
+ *
+ *  @return the move, FIN_MOVE_NONE if it is not a legal one or is ambiguous
+ */
+Fin_BoardMove Fin_BoardSan(const Fin_Board *board, const char *text);
+
+/**
+ *  Fin_BoardScore(*board, *phase).
+ *  Work out the score of a position from its pieces, the one Fin_BoardMake
+ *  keeps up to date in board->score: the material and the squares of the
+ *  pieces, white's less black's.
+ *
+ *  @param *board the position
+ *  @param *phase where to return the phase of the game (board->phase)
+ *
+ *  @return the score, FIN_SCORE_MG and FIN_SCORE_EG take it apart
+ */
+int Fin_BoardScore(const Fin_Board *board, int *phase);
+
+/**
+ *  Fin_BoardSanText(*board, move, *text).
+ *  Write a move in standard algebraic notation.
+ *
+ *  @param *board the position (the move is made and taken back to see
+ *  whether it checks)
+ *  @param move a legal move
+ *  @param *text where to write it, 8 characters of room
+ *
+ *  @return text
+ */
+char *Fin_BoardSanText(Fin_Board *board, Fin_BoardMove move, char *text);
+
+/**
+ *  Fin_BoardPerft(*board, depth).
+ *  Count the positions depth moves ahead.
+ *
+ *  @param *board the position
+ *  @param depth moves ahead
+ *
+ *  @return positions
+ */
+unsigned long long Fin_BoardPerft(Fin_Board *board, int depth);
+
+
+/*
+ * Search (FinchSearch.c)
+ *
+ * Iterative deepening alpha-beta on as many threads as asked: each one
+ * searches the same position on its own copy of the board, sharing what
+ * they find through a transposition table (Lazy SMP).
+ */
+
+#define FIN_SEARCH_MATE     30000   // score of being mated now, mate in n plies is n away from it
+#define FIN_SEARCH_PLIES    128     // deepest the search goes
+#define FIN_SEARCH_THREADS  64      // most threads
+
+/*
+ * what a search found, the best line first
+ */
+typedef struct fin_search_info Fin_SearchInfo;
+struct fin_search_info
+{
+    Fin_BoardMove move;             // best move, FIN_MOVE_NONE if there is none (mate, stalemate)
+    Fin_BoardMove ponder;           // reply expected, FIN_MOVE_NONE if not known
+    int score;                      // centipawns for the side to move
+    int depth;                      // last depth completed
+    int seldepth;                   // deepest ply reached
+    unsigned long long nodes;       // positions searched by all the threads
+    unsigned long long tables;      // of them found in the endgame tables
+    long long usec;                 // time searched
+    int threads;
+    int length;                     // of the line
+    Fin_BoardMove line[FIN_SEARCH_PLIES];
+};
+
+/*
+ * when to stop, 0 for no limit (a search without limits goes on until
+ * Fin_SearchStop)
+ */
+typedef struct fin_search_limits Fin_SearchLimits;
+struct fin_search_limits
+{
+    int depth;
+    long long usec;                 // time for the move
+    unsigned long long nodes;
+    int threads;                    // 0 for one per core
+    int ponder;                     // no limit until Fin_SearchPonderHit
+    void (*report)(const Fin_SearchInfo *info);     // after each depth, NULL if not wanted
+};
+
+/**
+ *  Fin_SearchHash(megabytes).
+ *  Size the transposition table (16 MB if never called), this also
+ *  forgets what it had.
+ *
+ *  @param megabytes of memory for it
+ *
+ *  @return -1 if there is not enough memory
+ */
+int Fin_SearchHash(int megabytes);
+
+/**
+ *  Fin_SearchClear().
+ *  Forget what previous searches found (a new game).
+ */
+void Fin_SearchClear(void);
+
+/**
+ *  Fin_Search(*board, *limits, *info).
+ *  Look for the best move of a position, only one search at a time.
+ *
+ *  @param *board the position (set up with Fin_BoardSet)
+ *  @param *limits when to stop
+ *  @param *info where to return the best move and line
+ *
+ *  @return -1 if failure
+ */
+int Fin_Search(const Fin_Board *board, const Fin_SearchLimits *limits, Fin_SearchInfo *info);
+
+/**
+ *  Fin_SearchStart(*board, *limits).
+ *  Start looking for the best move of a position on threads of their
+ *  own and return at once, Fin_SearchWait tells what was found.
+ *
+ *  @param *board the position (set up with Fin_BoardSet)
+ *  @param *limits when to stop
+ *
+ *  @return -1 if failure or a search is already running
+ */
+int Fin_SearchStart(const Fin_Board *board, const Fin_SearchLimits *limits);
+
+/**
+ *  Fin_SearchWait(*info).
+ *  Wait for the search started to be done.
+ *
+ *  @param *info where to return the best move and line
+ *
+ *  @return -1 if no search was started
+ */
+int Fin_SearchWait(Fin_SearchInfo *info);
+
+/**
+ *  Fin_SearchPonderHit().
+ *  The reply a search started with limits->ponder was pondering on was
+ *  played: it goes on with its limits, the time spent pondering counting
+ *  toward them.
+ */
+void Fin_SearchPonderHit(void);
+
+/**
+ *  Fin_SearchStop().
+ *  Have the search in progress return its best move now (called from
+ *  another thread).
+ */
+void Fin_SearchStop(void);
+
+/**
+ *  Fin_SearchCores().
+ *  Cores of the computer.
+ *
+ *  @return the number of cores
+ */
+int Fin_SearchCores(void);
+
+
+/*
+ * Opening book (FinchBook.c)
+ *
+ * The moves played from the first positions of a set of games, built once
+ * from PGN files into a binary file sorted by the Zobrist keys of the
+ * positions. Fin_BookOpen maps the file in memory, so opening a book takes
+ * no time whatever its size, and a probe looks a key up in it without
+ * reading the rest.
+ */
+
+/*
+ * what making a book read, see Fin_BookBuild
+ */
+typedef struct fin_book_stats Fin_BookStats;
+struct fin_book_stats
+{
+    long long games;
+    long long moves;                // read from the games
+    long long bad;                  // not understood, the rest of their game is left out
+    long long positions;            // positions and moves taken
+    long long entries;              // written, each move from a position once
+    long long bytes;                // of the book
+    long long usec;                 // time it took
+};
+
+/**
+ *  Fin_BookBuild(*book, *pgn[], files, plies, *stats).
+ *  Make a book from the games of PGN files: a move from a position is
+ *  worth two points for each game won with it, one for each draw.
+ *
+ *  @param *book the file to write
+ *  @param *pgn[] files of games
+ *  @param files how many
+ *  @param plies moves taken from each game, both sides counted
+ *  @param *stats where to return what was read, NULL if not wanted
+ *
+ *  @return entries written, -1 if failure
+ */
+int Fin_BookBuild(const char *book, const char *const *pgn, int files, int plies, Fin_BookStats *stats);
+
+/**
+ *  Fin_BookOpen(*book).
+ *  Map a book in memory, in place of the one open.
+ *
+ *  @param *book the file
+ *
+ *  @return entries of the book, -1 if failure (or made with other boards)
+ */
+int Fin_BookOpen(const char *book);
+
+/**
+ *  Fin_BookClose().
+ *  Forget the book.
+ */
+void Fin_BookClose(void);
+
+/**
+ *  Fin_BookFind(key, *moves, *weights, size).
+ *  Look a position up in the book by its key.
+ *
+ *  @param key Zobrist key of the position (board->key)
+ *  @param *moves where to return the moves
+ *  @param *weights where to return their points, NULL if not wanted
+ *  @param size room for moves
+ *
+ *  @return number of moves, 0 if out of the book
+ */
+int Fin_BookFind(unsigned long long key, Fin_BoardMove *moves, int *weights, int size);
+
+/**
+ *  Fin_BookMoves(*board, *moves, *weights, size).
+ *  The moves of the book from a position, those legal in it.
+ *
+ *  @param *board the position
+ *  @param *moves where to return the moves
+ *  @param *weights where to return their points, NULL if not wanted
+ *  @param size room for moves
+ *
+ *  @return number of moves, 0 if out of the book
+ */
+int Fin_BookMoves(const Fin_Board *board, Fin_BoardMove *moves, int *weights, int size);
+
+/**
+ *  Fin_BookPick(*board).
+ *  Pick a move of the book at random, the more points the likelier.
+ *
+ *  @param *board the position
+ *
+ *  @return the move, FIN_MOVE_NONE if out of the book
+ */
+Fin_BoardMove Fin_BookPick(const Fin_Board *board);
+
+
+/*
+ * Endgame tables (FinchTable.c)
+ *
+ * The plies to mate of every position of the kings and one or two more
+ * pieces, one table per material (KQK, KRKN, KBNK, KPK ...) worked out
+ * backwards from the mates and written to a file. Fin_TableOpen maps the
+ * files in memory and the search looks the positions of few pieces up
+ * instead of searching them:
+ *
+ *    Fin_TableBuild("tables", "KRKN", 0, NULL);     (once, KRK and KNK too)
+ *    Fin_TableOpen("tables");
+ */
+
+/* outcomes for the side to move */
+#define FIN_TABLE_DRAW  0
+#define FIN_TABLE_WIN   1
+#define FIN_TABLE_LOSS  2
+
+/*
+ * what building a table took, see Fin_TableBuild
+ */
+typedef struct fin_table_stats Fin_TableStats;
+struct fin_table_stats
+{
+    char name[8];                   // KRKN
+    int threads;
+    long long positions;            // that can happen, both sides to move
+    long long wins;                 // for the side to move
+    long long losses;
+    long long draws;
+    int longest;                    // plies of the longest mate
+    int passes;                     // over the table
+    int bits;                       // per position in the file
+    long long memory;               // bytes used to build it
+    long long bytes;                // of the file
+    long long usec;                 // time it took
+};
+
+/**
+ *  Fin_TableBuild(*dir, *name, threads, *report).
+ *  Build the table of a material and write it to a directory, first
+ *  those its captures and promotions lead to if they are not there, then
+ *  open them all.
+ *
+ *  @param *dir where the tables are, NULL for the current directory
+ *  @param *name material, the kings and the pieces of each side (KQKR)
+ *  @param threads to build with, 0 for one per core
+ *  @param *report called with each table built, NULL if not wanted
+ *
+ *  @return -1 if failure (more than 4 pieces, no memory, cannot write)
+ */
+int Fin_TableBuild(const char *dir, const char *name, int threads, void (*report)(const Fin_TableStats *stats));
+
+/**
+ *  Fin_TableOpen(*dir).
+ *  Map in memory the tables of a directory (before searching).
+ *
+ *  @param *dir where the tables are, NULL for the current directory
+ *
+ *  @return tables open, those open before counted
+ */
+int Fin_TableOpen(const char *dir);
+
+/**
+ *  Fin_TableClose().
+ *  Forget the tables open.
+ */
+void Fin_TableClose(void);
+
+/**
+ *  Fin_TableProbe(*board, *plies).
+ *  Look a position up in the tables open (no castling left, no capture
+ *  en passant to make).
+ *
+ *  @param *board the position
+ *  @param *plies where to return the plies to mate, won or lost
+ *
+ *  @return FIN_TABLE_WIN, FIN_TABLE_LOSS or FIN_TABLE_DRAW for the side to
+ *          move, -1 if no table has it
+ */
+int Fin_TableProbe(const Fin_Board *board, int *plies);
+
+
+/*
+ * Games (FinchGame.c)
+ *
+ * The robot plays one side, Fin_GameMove gives its move and Fin_GameReply
+ * takes the move of the other side. With pondering on, Fin_GameMove
+ * returns as soon as the move is found and the search goes on in the
+ * background on the reply expected, while the robot carries the move out
+ * and the other side thinks:
+ *
+ *    Fin_GameStart(NULL, 5000000, 0, 1);
+ *    while (Fin_GameMove(text) > 0)
+ *    {
+ *        ... the robot plays text, then waits for the reply ...
+ *        Fin_GameReply(reply);
+ *    }
+ *    Fin_GameEnd();
+ */
+
+/*
+ * how a game goes
+ */
+typedef struct fin_game_stats Fin_GameStats;
+struct fin_game_stats
+{
+    int moves;                      // of the robot
+    int book;                       // of them from the book
+    int hits;                       // replies pondered on that were played
+    int misses;                     // other replies
+    long long think_usec;           // time spent in Fin_GameMove, all moves
+    long long think_max;            // longest of them
+    long long ponder_usec;          // time pondered
+    int depth;                      // of the last move
+    int score;                      // of the last move, centipawns for the robot
+    Fin_BoardMove expected;         // reply pondered on now, FIN_MOVE_NONE if none
+};
+
+/**
+ *  Fin_GameStart(*fen, usec, threads, ponder).
+ *  Start a game of the robot, ending the one in progress.
+ *
+ *  @param *fen position to start from, NULL for the usual one
+ *  @param usec time the robot thinks each move
+ *  @param threads of the search, 0 for all the cores but one
+ *  @param ponder 1 to ponder while the robot moves and the other side thinks
+ *
+ *  @return -1 if failure
+ */
+int Fin_GameStart(const char *fen, long long usec, int threads, int ponder);
+
+/**
+ *  Fin_GameMove(*text).
+ *  Find the move of the robot (in the book open, see Fin_BookOpen, or
+ *  by searching) and play it on the board of the game, then start
+ *  pondering (with pondering on).
+ *
+ *  @param *text where to return the move, 6 characters (e2e4, e7e8q)
+ *
+ *  @return -1 if failure or waiting for a reply, 0 if the game is over
+ */
+int Fin_GameMove(char *text);
+
+/**
+ *  Fin_GameReply(*text).
+ *  Play the move of the other side.
+ *
+ *  @param *text the move (e2e4, e7e8q)
+ *
+ *  @return -1 if it is not a legal move
+ */
+int Fin_GameReply(const char *text);
+
+/**
+ *  Fin_GameBoard().
+ *  Position of the game.
+ *
+ *  @return the board, NULL if no game was started
+ */
+const Fin_Board *Fin_GameBoard(void);
+
+/**
+ *  Fin_GameStatus(*stats).
+ *  How the game goes.
+ *
+ *  @param *stats where to return it
+ *
+ *  @return -1 if no game was started
+ */
+int Fin_GameStatus(Fin_GameStats *stats);
+
+/**
+ *  Fin_GameEnd().
+ *  End the game, stopping the search in progress.
+ */
+void Fin_GameEnd(void);
+
+#endif
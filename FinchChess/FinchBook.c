@@ -0,0 +1,552 @@
+/*
+ * Opening book of the chess search: the moves played from the positions
+ * of the first moves of a set of games, read from PGN files once and
+ * kept in a binary file.
+ *  - an entry is a position (its Zobrist key), a move and how well the
+ *    move did: two points a game won with it, one a game drawn; the
+ *    entries are sorted by key, all the moves of a position together
+ *  - Fin_BookOpen maps the file in memory instead of reading it, so it
+ *    costs the same whatever the size of the book and only the pages
+ *    probed are ever read from the disk
+ *  - the keys are spread evenly, so a probe guesses where a key is from
+ *    the keys at both ends of the part left (interpolation), a few
+ *    guesses and it is found; it falls back to halving the part if the
+ *    guesses do not get there
+ * The keys are those of FinchBoard.c, a book is only good for the boards
+ * that made it (the file keeps the key of the usual position to check).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "FinchBoard.h"
+
+#ifdef _LINUX_
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <windows.h>
+#endif
+
+#define BOOK_MAGIC      "FINBOOK1"
+#define BOOK_GUESSES    8           // interpolation steps before halving
+
+/*
+ * start of the file
+ */
+struct book_header
+{
+    char magic[8];
+    unsigned long long check;       // key of the usual position
+    unsigned int count;             // entries
+    unsigned int plies;             // deepest ply of the games taken
+    unsigned int games;
+    unsigned int pad;
+};
+
+/*
+ * a move from a position, 16 bytes
+ */
+struct book_entry
+{
+    unsigned long long key;
+    Fin_BoardMove move;
+    unsigned short weight;          // points of the games it was played in
+    unsigned int games;             // times it was played
+};
+
+/* the book open */
+static const struct book_entry *book_entries = 0;
+static unsigned int book_count = 0;
+static size_t book_size = 0;
+static const void *book_map = 0;
+
+
+static long long Book_Usec(void)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return((long long)GetTickCount64() * 1000);
+#endif
+}
+
+
+static int Book_Cmp(const void *a, const void *b)
+{
+    const struct book_entry *x = a, *y = b;
+
+    if (x->key != y->key)
+        return(x->key < y->key ? -1 : 1);
+    return((int)x->move - (int)y->move);
+}
+
+
+/*
+ * first entry of a key, -1 if none
+ */
+static long Book_Find(unsigned long long key)
+{
+    const struct book_entry *e = book_entries;
+    long lo = 0, hi = (long)book_count - 1, mid;
+    int guesses = 0;
+
+    while (lo <= hi && key >= e[lo].key && key <= e[hi].key)
+    {
+        if (guesses++ < BOOK_GUESSES && e[hi].key > e[lo].key)
+            mid = lo + (long)((double)(key - e[lo].key) / (double)(e[hi].key - e[lo].key) * (hi - lo));
+        else
+            mid = lo + (hi - lo) / 2;
+        if (e[mid].key < key)
+            lo = mid + 1;
+        else if (e[mid].key > key)
+            hi = mid - 1;
+        else
+        {
+            while (mid > 0 && e[mid - 1].key == key)
+                mid--;
+            return(mid);
+        }
+    }
+    return(-1);
+}
+
+
+/*
+ * the entries taken from the games, growing
+ */
+struct book_build
+{
+    struct book_entry *entry;
+    size_t count, size;
+    struct book_entry game[FIN_BOARD_HISTORY];  // moves of the game read
+    int moves;
+    int skip;                       // a move was not understood, the rest is left
+    Fin_Board board;
+    Fin_BookStats *stats;
+    int plies;
+};
+
+
+/*
+ * a game ended: its moves go to the book with the points of the side that played them
+ */
+static int Book_GameEnd(struct book_build *b, const char *result)
+{
+    struct book_entry *more;
+    int i, white;
+
+    white = strcmp(result, "1-0") == 0 ? 2 : strcmp(result, "0-1") == 0 ? 0 : 1;
+    if (b->count + b->moves > b->size)
+    {
+        more = realloc(b->entry, (b->size * 2 + b->moves) * sizeof(*more));
+        if (more == 0)
+            return(-1);
+        b->entry = more;
+        b->size = b->size * 2 + b->moves;
+    }
+    for (i = 0; i < b->moves; i++)
+    {
+        b->game[i].weight = (unsigned short)(i % 2 == 0 ? white : 2 - white);
+        b->game[i].games = 1;
+        b->entry[b->count++] = b->game[i];
+    }
+    b->stats->games++;
+    b->stats->positions += b->moves;
+    b->moves = 0;
+    b->skip = 0;
+    Fin_BoardSet(&b->board, NULL);
+    return(0);
+}
+
+
+/*
+ * a word of the moves of a game
+ */
+static int Book_Word(struct book_build *b, char *word)
+{
+    Fin_BoardMove move;
+
+    if (strcmp(word, "1-0") == 0 || strcmp(word, "0-1") == 0 ||
+        strcmp(word, "1/2-1/2") == 0 || strcmp(word, "*") == 0)
+        return(Book_GameEnd(b, word));
+
+    // move numbers (12. 12...), glued to the move or not, and annotations
+    while (isdigit((unsigned char)*word))
+        word++;
+    while (*word == '.')
+        word++;
+    if (*word == 0 || *word == '$' || b->skip)
+        return(0);
+
+    b->stats->moves++;
+    move = Fin_BoardSan(&b->board, word);
+    if (move == FIN_MOVE_NONE)
+    {
+        b->stats->bad++;
+        b->skip = 1;
+        return(0);
+    }
+    if (b->board.ply < b->plies && b->moves < FIN_BOARD_HISTORY)
+    {
+        b->game[b->moves].key = b->board.key;
+        b->game[b->moves].move = move;
+        b->moves++;
+    }
+    if (b->board.ply >= FIN_BOARD_HISTORY - 1)
+        b->skip = 1;
+    else
+        Fin_BoardMake(&b->board, move);
+    return(0);
+}
+
+
+/*
+ * read the games of a PGN file
+ */
+static int Book_Read(struct book_build *b, const char *pgn)
+{
+    FILE *fp = fopen(pgn, "r");
+    char line[4096], word[256], *p, *fen;
+    int comment = 0, variation = 0, n;
+
+    if (fp == 0)
+        return(-1);
+    while (fgets(line, sizeof(line), fp))
+    {
+        // tags: a game that does not start from the usual position
+        if (comment == 0 && variation == 0 && line[0] == '[')
+        {
+            if (strncmp(line, "[FEN \"", 6) == 0)
+            {
+                fen = line + 6;
+                fen[strcspn(fen, "\"")] = 0;
+                if (Fin_BoardSet(&b->board, fen) < 0)
+                    b->skip = 1;
+            }
+            continue;
+        }
+        for (p = line; *p; )
+        {
+            if (comment)
+                comment = *p++ != '}';
+            else if (*p == '{')
+            {
+                comment = 1;
+                p++;
+            }
+            else if (*p == ';')
+                break;
+            else if (*p == '(')
+            {
+                variation++;
+                p++;
+            }
+            else if (*p == ')')
+            {
+                variation -= variation > 0;
+                p++;
+            }
+            else if (isspace((unsigned char)*p))
+                p++;
+            else
+            {
+                for (n = 0; *p && !isspace((unsigned char)*p) && strchr("{}();", *p) == NULL; p++)
+                    if (n < (int)sizeof(word) - 1)
+                        word[n++] = *p;
+                word[n] = 0;
+                if (variation == 0 && Book_Word(b, word) < 0)
+                {
+                    fclose(fp);
+                    return(-1);
+                }
+            }
+        }
+    }
+    fclose(fp);
+    // a last game without a result
+    return(b->moves > 0 ? Book_GameEnd(b, "*") : 0);
+}
+
+
+/**  Fin_BookBuild(*book, *pgn[], files, plies, *stats).
+ *  make a book from the games of PGN files
+ *
+ *  input:
+ *     const char *book = file to write
+ *     const char *pgn[] = files of games
+ *     int files = how many
+ *     int plies = moves of each side taken from each game, both counted
+ *     Fin_BookStats *stats = pointer where to return what was read, NULL if not wanted
+ *  returns
+ *     entries written, -1 if failure
+ */
+int Fin_BookBuild(const char *book, const char *const *pgn, int files, int plies, Fin_BookStats *stats)
+{
+    struct book_build *b;
+    struct book_header header;
+    Fin_BookStats local;
+    FILE *fp;
+    size_t i, n = 0, kept;
+    long long start = Book_Usec();
+    int f, res = 0;
+
+    b = calloc(1, sizeof(*b));
+    if (b == 0)
+        return(-1);
+    memset(&local, 0, sizeof(local));
+    b->stats = stats ? stats : &local;
+    memset(b->stats, 0, sizeof(*b->stats));
+    b->plies = plies;
+    b->size = 4096;
+    b->entry = malloc(b->size * sizeof(*b->entry));
+    Fin_BoardSet(&b->board, NULL);
+    for (f = 0; f < files && b->entry && res == 0; f++)
+        res = Book_Read(b, pgn[f]);
+    if (b->entry == 0 || res < 0)
+    {
+        free(b->entry);
+        free(b);
+        return(-1);
+    }
+
+    // the same move from the same position once, with its points added up
+    qsort(b->entry, b->count, sizeof(*b->entry), Book_Cmp);
+    for (i = 0; i < b->count; i++)
+    {
+        if (n > 0 && b->entry[n - 1].key == b->entry[i].key && b->entry[n - 1].move == b->entry[i].move)
+        {
+            b->entry[n - 1].weight = (unsigned short)(b->entry[n - 1].weight + b->entry[i].weight > 65535 ?
+                                                      65535 : b->entry[n - 1].weight + b->entry[i].weight);
+            b->entry[n - 1].games += b->entry[i].games;
+        }
+        else
+            b->entry[n++] = b->entry[i];
+    }
+    // moves that never did better than a loss are left out
+    for (i = kept = 0; i < n; i++)
+        if (b->entry[i].weight > 0)
+            b->entry[kept++] = b->entry[i];
+    n = kept;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, 8);
+    Fin_BoardSet(&b->board, NULL);
+    header.check = b->board.key;
+    header.count = (unsigned int)n;
+    header.plies = (unsigned int)plies;
+    header.games = (unsigned int)b->stats->games;
+    fp = fopen(book, "wb");
+    if (fp == 0 || fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        (n > 0 && fwrite(b->entry, sizeof(*b->entry), n, fp) != n))
+        res = -1;
+    if (fp && fclose(fp) != 0)
+        res = -1;
+    free(b->entry);
+    free(b);
+
+    if (stats)
+    {
+        stats->entries = (long long)n;
+        stats->bytes = (long long)(sizeof(header) + n * sizeof(struct book_entry));
+        stats->usec = Book_Usec() - start;
+    }
+    return(res < 0 ? -1 : (int)n);
+}
+
+
+/**  Fin_BookOpen(*book).
+ *  map a book in memory, closing the one open
+ *
+ *  input:
+ *     const char *book = the file
+ *  returns
+ *     entries of the book, -1 if failure
+ */
+int Fin_BookOpen(const char *book)
+{
+    const struct book_header *header;
+    Fin_Board board;
+    const void *map;
+    size_t size;
+#ifdef _LINUX_
+    struct stat st;
+    int fd;
+
+    fd = open(book, O_RDONLY);
+    if (fd < 0)
+        return(-1);
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct book_header))
+    {
+        close(fd);
+        return(-1);
+    }
+    size = (size_t)st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return(-1);
+#else
+    HANDLE file, mapping;
+    LARGE_INTEGER length;
+
+    file = CreateFileA(book, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return(-1);
+    if (!GetFileSizeEx(file, &length) || length.QuadPart < (LONGLONG)sizeof(struct book_header))
+    {
+        CloseHandle(file);
+        return(-1);
+    }
+    size = (size_t)length.QuadPart;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return(-1);
+    map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (map == NULL)
+        return(-1);
+#endif
+
+    // a book of these boards, whole
+    header = map;
+    Fin_BoardSet(&board, NULL);
+    if (memcmp(header->magic, BOOK_MAGIC, 8) != 0 || header->check != board.key ||
+        size < sizeof(*header) + (size_t)header->count * sizeof(struct book_entry))
+    {
+#ifdef _LINUX_
+        munmap((void *)map, size);
+#else
+        UnmapViewOfFile(map);
+#endif
+        return(-1);
+    }
+
+    Fin_BookClose();
+    book_map = map;
+    book_size = size;
+    book_entries = (const struct book_entry *)(header + 1);
+    book_count = header->count;
+    return((int)book_count);
+}
+
+
+/**  Fin_BookClose(void).
+ *  forget the book
+ *
+ *  returns
+ *     none
+ */
+void Fin_BookClose(void)
+{
+    if (book_map == 0)
+        return;
+#ifdef _LINUX_
+    munmap((void *)book_map, book_size);
+#else
+    UnmapViewOfFile(book_map);
+#endif
+    book_map = 0;
+    book_entries = 0;
+    book_count = 0;
+}
+
+
+/**  Fin_BookFind(key, *moves, *weights, size).
+ *  the moves of the book from a position, by its key
+ *
+ *  input:
+ *     unsigned long long key = Zobrist key of the position
+ *     Fin_BoardMove *moves = where to return the moves
+ *     int *weights = where to return their points, NULL if not wanted
+ *     int size = room for moves
+ *  returns
+ *     number of moves, 0 if out of the book
+ */
+int Fin_BookFind(unsigned long long key, Fin_BoardMove *moves, int *weights, int size)
+{
+    long i;
+    int n = 0;
+
+    if (book_count == 0 || (i = Book_Find(key)) < 0)
+        return(0);
+    for (; i < (long)book_count && book_entries[i].key == key && n < size; i++, n++)
+    {
+        moves[n] = book_entries[i].move;
+        if (weights)
+            weights[n] = book_entries[i].weight;
+    }
+    return(n);
+}
+
+
+/**  Fin_BookMoves(*board, *moves, *weights, size).
+ *  the legal moves of the book from a position
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     Fin_BoardMove *moves = where to return the moves
+ *     int *weights = where to return their points, NULL if not wanted
+ *     int size = room for moves
+ *  returns
+ *     number of moves, 0 if out of the book
+ */
+int Fin_BookMoves(const Fin_Board *board, Fin_BoardMove *moves, int *weights, int size)
+{
+    Fin_BoardMove legal[FIN_BOARD_MOVES];
+    int i, j, k, n, count;
+
+    n = Fin_BookFind(board->key, moves, weights, size);
+    if (n == 0)
+        return(0);
+
+    // a key shared by another position could give moves that are not legal here
+    count = Fin_BoardMoves(board, legal);
+    for (i = k = 0; i < n; i++)
+    {
+        for (j = 0; j < count && legal[j] != moves[i]; j++)
+            ;
+        if (j == count)
+            continue;
+        moves[k] = moves[i];
+        if (weights)
+            weights[k] = weights[i];
+        k++;
+    }
+    return(k);
+}
+
+
+/**  Fin_BookPick(*board).
+ *  a move of the book from a position, the better it did the likelier
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *  returns
+ *     the move, FIN_MOVE_NONE if out of the book
+ */
+Fin_BoardMove Fin_BookPick(const Fin_Board *board)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    int weights[FIN_BOARD_MOVES];
+    int i, n, total = 0, pick;
+
+    n = Fin_BookMoves(board, moves, weights, FIN_BOARD_MOVES);
+    for (i = 0; i < n; i++)
+        total += weights[i];
+    if (total == 0)
+        return(FIN_MOVE_NONE);
+    pick = rand() % total;
+    for (i = 0; pick >= weights[i]; i++)
+        pick -= weights[i];
+    return(moves[i]);
+}
@@ -0,0 +1,273 @@
+/*
+ * Client side of the Finch daemon protocol (see FinchShm.h).
+ *
+ * Fin_Init calls Fin_Attach first; when a daemon is listening the program
+ * shares its robot and every Fin_Cmnd goes through the shared command ring.
+ * Set FINCH_DIRECT=1 in the environment to always open the robot directly,
+ * FINCH_DEVICE=n to pick another robot of the daemon and FINCHD_SOCKET to
+ * use another handshake socket.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+#include "FinchShm.h"
+
+#ifdef _LINUX_
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static struct fin_shm *fin_shm = 0;     // segment of the shared robot
+static struct fin_ring *fin_ring = 0;   // our command ring in the segment
+static int fin_sock = -1;               // handshake socket, kept open
+static fin_mutex fin_ring_lock;         // one producer at a time on the ring
+
+
+/*
+ * read one line from the handshake socket
+ */
+static int Fin_ReadLine(int fd, char *line, int size)
+{
+    int len = 0;
+
+    while (len < size - 1)
+    {
+        if (read(fd, &line[len], 1) != 1)
+            return(-1);
+        if (line[len] == '\n')
+            break;
+        len++;
+    }
+    line[len] = 0;
+    return(len);
+}
+
+
+/*
+ * attach to the daemon
+ * returns -1 if there is no daemon to attach to
+ */
+int Fin_Attach(void)
+{
+    struct sockaddr_un addr;
+    struct fin_shm *shm;
+    char line[128];
+    char name[64];
+    const char *env;
+    int device = 0;
+    int ring;
+    int shm_fd;
+    int fd;
+
+    if (getenv("FINCH_DIRECT") != NULL)
+        return(-1);
+    if ((env = getenv("FINCH_DEVICE")) != NULL)
+        device = atoi(env);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    env = getenv("FINCHD_SOCKET");
+    strncpy(addr.sun_path, env ? env : FIN_SOCKET, sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return(-1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return(-1);
+    }
+
+    // ask for a command ring on the device
+    sprintf(line, "ATTACH %d\n", device);
+    if (write(fd, line, strlen(line)) < 0 ||
+        Fin_ReadLine(fd, line, sizeof(line)) < 0 ||
+        sscanf(line, "OK %63s %d", name, &ring) != 2 ||
+        ring < 0 || ring >= FIN_SHM_CLIENTS)
+    {
+        printf("Finch daemon refused the connection: %s\n", line);
+        close(fd);
+        return(-1);
+    }
+
+    // map the segment of the device
+    shm_fd = shm_open(name, O_RDWR, 0);
+    if (shm_fd < 0)
+    {
+        close(fd);
+        return(-1);
+    }
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (shm == MAP_FAILED || shm->magic != FIN_SHM_MAGIC || shm->version != FIN_SHM_VERSION)
+    {
+        printf("Finch daemon shared memory %s is not usable\n", name);
+        if (shm != MAP_FAILED)
+            munmap(shm, sizeof(*shm));
+        close(fd);
+        return(-1);
+    }
+
+    Fin_MutexInit(&fin_ring_lock);
+    fin_sock = fd;
+    fin_ring = &shm->ring[ring];
+    fin_shm = shm;
+    return(0);
+}
+
+
+/*
+ * let the daemon know we are done with the robot
+ */
+int Fin_Detach(void)
+{
+    struct fin_shm *shm = fin_shm;
+
+    if (shm == 0)
+        return(-1);
+
+    Fin_Lock(&fin_ring_lock);
+    fin_shm = 0;
+    fin_ring = 0;
+    Fin_Unlock(&fin_ring_lock);
+
+    munmap(shm, sizeof(*shm));
+    close(fin_sock);
+    fin_sock = -1;
+    return(0);
+}
+
+
+/*
+ * is the robot shared through the daemon
+ */
+int Fin_Attached(void)
+{
+    return(fin_shm != 0);
+}
+
+
+/*
+ * queue a command on our ring, wait for the response if one is expected
+ */
+int Fin_ShmCmnd(int flag, char cmnd, unsigned char *buffer)
+{
+    struct fin_slot *slot;
+    unsigned int head;
+    int res = -1;
+    int wait;
+
+    Fin_Lock(&fin_ring_lock);
+    if (fin_ring == 0)
+    {
+        Fin_Unlock(&fin_ring_lock);
+        return(-1);
+    }
+
+    // wait for the daemon to be done with the slot
+    head = fin_ring->head;
+    slot = &fin_ring->slot[head % FIN_RING_SLOTS];
+    for (wait = 0; slot->state == FIN_SLOT_READY; wait++)
+    {
+        if (wait >= FIN_SHM_TIMEOUT)
+            goto done;
+        Fin_Nap(100);
+    }
+    Fin_Barrier();
+
+    buffer[0] = 0x00;
+    buffer[1] = cmnd;
+    memcpy(slot->buffer, buffer, 9);
+    slot->flag = flag;
+    slot->state = FIN_SLOT_READY;
+    Fin_Barrier();
+    fin_ring->head = head + 1;
+
+    // the daemon sleeps once every ring is empty, wake it up
+    Fin_Barrier();
+    if (fin_shm->idle && write(fin_sock, "!", 1) != 1)
+        goto done;
+
+    // commands without a response return as soon as they are queued
+    if (flag == SEND)
+    {
+        res = 9;
+        goto done;
+    }
+
+    // spin briefly, the daemon usually answers within a USB frame
+    for (wait = 0; slot->state != FIN_SLOT_DONE; wait++)
+    {
+        if (wait >= FIN_SHM_TIMEOUT)
+            goto done;
+        if (wait < 100)
+            sched_yield();
+        else
+            Fin_Nap(100);
+    }
+    Fin_Barrier();
+    memcpy(buffer, slot->buffer, 9);
+    res = slot->res;
+
+done:
+    Fin_Unlock(&fin_ring_lock);
+    return(res);
+}
+
+
+/*
+ * copy the sensor snapshot published by the daemon, no system call involved
+ */
+int Fin_ShmSnapshot(Fin_Sensors *snap)
+{
+    unsigned int seq;
+
+    if (fin_shm == 0)
+        return(-1);
+
+    do
+    {
+        seq = fin_shm->snap_seq;
+        Fin_Barrier();
+        memcpy(snap, (const void *)&fin_shm->snap, sizeof(*snap));
+        Fin_Barrier();
+    } while ((seq & 1) || seq != fin_shm->snap_seq);
+
+    return(1);
+}
+
+#else
+
+/* the daemon is only available on Linux/Mac */
+int Fin_Attach(void)
+{
+    return(-1);
+}
+
+int Fin_Detach(void)
+{
+    return(-1);
+}
+
+int Fin_Attached(void)
+{
+    return(0);
+}
+
+int Fin_ShmCmnd(int flag, char cmnd, unsigned char *buffer)
+{
+    return(-1);
+}
+
+int Fin_ShmSnapshot(Fin_Sensors *snap)
+{
+    return(-1);
+}
+
+#endif
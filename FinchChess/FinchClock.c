@@ -0,0 +1,478 @@
+/*
+ * Time of the Finch library: Fin_Usec, the waits of the program and of
+ * the background threads (keep-alive, motor deadlines, tracks, routines)
+ * and Sleep all go through a clock.
+ *  - the real clock is the wall clock of the system
+ *  - the virtual clock only moves when told to (Fin_ClockAdvance, or the
+ *    link time of a simulated robot), and when the program and the
+ *    background threads all wait it jumps to the first of their deadlines,
+ *    so timed behaviour takes no time at all and always goes the same way
+ * Each program thread has its clock, so several simulations can run side
+ * by side, each on its own virtual clock; the background threads of the
+ * robots use the clock of the thread that opened them and take part in
+ * it (Fin_ClockJoin).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifdef _LINUX_
+#include <time.h>
+#else
+#undef Sleep                        // the one of Windows, Finch.h routes it here
+#endif
+
+struct fin_clock;
+
+/*
+ * implementation of a clock
+ */
+struct fin_clock_ops
+{
+    long long (*now)(struct fin_clock *clock);                                      // usec
+    void (*wait)(struct fin_clock *clock, fin_cond *cond, fin_mutex *mutex, long long usec);
+                                                                                    // 0 for no deadline
+    void (*wake)(struct fin_clock *clock, fin_cond *cond);
+};
+
+/* a wait on a virtual clock */
+struct fin_vwait
+{
+    long long at;                   // deadline, 0 if none
+    struct fin_vwait *next;
+};
+
+/*
+ * a clock, the state is only used by the virtual ones
+ */
+struct fin_clock
+{
+    const struct fin_clock_ops *ops;
+    fin_mutex lock;
+    fin_cond cond;                  // all the waits are on it
+    long long now;
+    unsigned int gen;               // changes at each wake up
+    int threads;                    // threads taking part: the program and the device threads
+    int idle;                       // those waiting
+    struct fin_vwait *waits;
+    long long limit;                // the program runs out of time then, 0 if never
+    void (*expired)(void);          // called then by the library, may not return
+    fin_mutex sleep_lock;           // for Fin_Sleep
+    fin_cond sleep_cond;
+};
+
+
+/*
+ * wall clock, from an arbitrary point
+ */
+static long long Fin_RealNow(struct fin_clock *clock)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    (void)clock;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    (void)clock;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return((long long)(now.QuadPart * 1000000.0 / freq.QuadPart));
+#endif
+}
+
+
+/*
+ * wait for cond to be signaled or for the wall clock to reach usec
+ */
+static void Fin_RealWait(struct fin_clock *clock, fin_cond *cond, fin_mutex *mutex, long long usec)
+{
+    long long wait = usec - Fin_RealNow(clock);
+#ifdef _LINUX_
+    struct timespec ts;
+
+    if (usec == 0)
+    {
+        Fin_CondWait(cond, mutex);
+        return;
+    }
+    // pthread waits are on the wall clock
+    if (wait <= 0)
+        return;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    wait += ts.tv_nsec / 1000;
+    ts.tv_sec += wait / 1000000;
+    ts.tv_nsec = (wait % 1000000) * 1000;
+    pthread_cond_timedwait(cond, mutex, &ts);
+#else
+    if (usec == 0)
+    {
+        Fin_CondWait(cond, mutex);
+        return;
+    }
+    if (wait <= 0)
+        return;
+    SleepConditionVariableCS(cond, mutex, (DWORD)((wait + 999) / 1000));
+#endif
+}
+
+
+static void Fin_RealWake(struct fin_clock *clock, fin_cond *cond)
+{
+    (void)clock;
+    Fin_CondBroadcast(cond);
+}
+
+
+/*
+ * wake up every waiter of a virtual clock, called with it locked
+ */
+static void Fin_VirtualWakeAll(struct fin_clock *clock)
+{
+    clock->gen++;
+    clock->idle = 0;
+    Fin_CondBroadcast(&clock->cond);
+}
+
+
+/*
+ * everyone waits: jump to the first deadline, called with the clock locked;
+ * one already past still moves the clock a little, as the wall clock
+ * would while they check again
+ */
+static void Fin_VirtualJump(struct fin_clock *clock)
+{
+    struct fin_vwait *w;
+    long long next = 0;
+
+    for (w = clock->waits; w != 0; w = w->next)
+        if (w->at != 0 && (next == 0 || w->at < next))
+            next = w->at;
+    // no deadline, nobody would ever wake up on the wall clock either
+    if (next == 0)
+        return;
+    clock->now = next > clock->now ? next : clock->now + 1;
+    Fin_VirtualWakeAll(clock);
+}
+
+
+static long long Fin_VirtualNow(struct fin_clock *clock)
+{
+    long long now;
+
+    Fin_Lock(&clock->lock);
+    now = clock->now;
+    Fin_Unlock(&clock->lock);
+    return(now);
+}
+
+
+/*
+ * wait on the virtual clock for a wake up or for usec, the waits are all
+ * on one condition; a deadline already past still waits for the others
+ * to move on, the clock would not otherwise
+ */
+static void Fin_VirtualWait(struct fin_clock *clock, fin_cond *cond, fin_mutex *mutex, long long usec)
+{
+    struct fin_vwait w, **link;
+    unsigned int gen;
+
+    (void)cond;
+    Fin_Lock(&clock->lock);
+    // anything changed under mutex from now on comes with a wake up
+    Fin_Unlock(mutex);
+    w.at = usec;
+    w.next = clock->waits;
+    clock->waits = &w;
+    gen = clock->gen;
+    if (++clock->idle >= clock->threads)
+        Fin_VirtualJump(clock);
+    while (gen == clock->gen)
+        Fin_CondWait(&clock->cond, &clock->lock);
+
+    for (link = &clock->waits; *link != &w; link = &(*link)->next)
+        ;
+    *link = w.next;
+    Fin_Unlock(&clock->lock);
+    Fin_Lock(mutex);
+}
+
+
+static void Fin_VirtualWake(struct fin_clock *clock, fin_cond *cond)
+{
+    (void)cond;
+    Fin_Lock(&clock->lock);
+    Fin_VirtualWakeAll(clock);
+    Fin_Unlock(&clock->lock);
+}
+
+
+static const struct fin_clock_ops fin_real_ops = { Fin_RealNow, Fin_RealWait, Fin_RealWake };
+static const struct fin_clock_ops fin_virtual_ops = { Fin_VirtualNow, Fin_VirtualWait, Fin_VirtualWake };
+
+static struct fin_clock fin_real_clock = { .ops = &fin_real_ops };
+static FIN_TLS struct fin_clock *fin_clock = &fin_real_clock;   // clock of this thread
+
+
+/*
+ * is the clock of this thread virtual
+ */
+int Fin_Virtual(void)
+{
+    return(fin_clock->ops == &fin_virtual_ops);
+}
+
+
+/*
+ * clock of this thread, and have a background thread use the clock
+ * of the one that opened its robot
+ */
+struct fin_clock *Fin_ClockGet(void)
+{
+    return(fin_clock);
+}
+
+void Fin_ClockUse(struct fin_clock *clock)
+{
+    fin_clock = clock;
+}
+
+
+/*
+ * a background thread starts (1) or stops (-1) taking part in the virtual clock
+ */
+void Fin_ClockJoin(int count)
+{
+    struct fin_clock *clock = fin_clock;
+
+    if (!Fin_Virtual())
+        return;
+
+    Fin_Lock(&clock->lock);
+    clock->threads += count;
+    if (clock->idle >= clock->threads)
+        Fin_VirtualJump(clock);
+    Fin_Unlock(&clock->lock);
+}
+
+
+/*
+ * give the program usec from now on the virtual clock (0 for no limit),
+ * after that its commands fail and its delays are cut short; the library
+ * calls expired (if not NULL) at its next command or delay, from where
+ * nothing is locked, so it may longjmp out of the program
+ */
+void Fin_ClockLimit(long long usec, void (*expired)(void))
+{
+    if (!Fin_Virtual())
+        return;
+    fin_clock->limit = usec != 0 ? Fin_Usec() + usec : 0;
+    fin_clock->expired = expired;
+}
+
+int Fin_ClockExpired(void)
+{
+    return(fin_clock->limit != 0 && Fin_Usec() >= fin_clock->limit);
+}
+
+int Fin_ClockCheck(void)
+{
+    if (!Fin_ClockExpired())
+        return(0);
+    if (fin_clock->expired != 0)
+        fin_clock->expired();
+    return(1);
+}
+
+
+/*
+ * condition variable whose waits are timed with Fin_Usec
+ */
+void Fin_CondInit(fin_cond *cond)
+{
+#ifdef _LINUX_
+    pthread_cond_init(cond, NULL);
+#else
+    InitializeConditionVariable(cond);
+#endif
+}
+
+
+/*
+ * wait for cond to be signaled, called with mutex locked
+ */
+void Fin_Wait(fin_cond *cond, fin_mutex *mutex)
+{
+    fin_clock->ops->wait(fin_clock, cond, mutex, 0);
+}
+
+
+/*
+ * wait for cond to be signaled or for Fin_Usec to reach usec,
+ * called with mutex locked
+ */
+void Fin_WaitUntil(fin_cond *cond, fin_mutex *mutex, long long usec)
+{
+    fin_clock->ops->wait(fin_clock, cond, mutex, usec > 0 ? usec : 1);
+}
+
+
+/*
+ * signal cond to those waiting on it
+ */
+void Fin_Broadcast(fin_cond *cond)
+{
+    fin_clock->ops->wake(fin_clock, cond);
+}
+
+
+/*
+ * give the hardware (or the daemon) time, on the wall clock whatever
+ * the clock of the library
+ */
+void Fin_Nap(long usec)
+{
+#ifdef _LINUX_
+    usleep(usec);
+#else
+    Sleep((DWORD)((usec + 999) / 1000));
+#endif
+}
+
+
+/*
+ * microseconds on the wall clock, whatever the clock of the library,
+ * to time the work of the program itself
+ */
+long long Fin_WallUsec(void)
+{
+    return(Fin_RealNow(&fin_real_clock));
+}
+
+
+/**  Fin_Usec(void).
+ *  microseconds from an arbitrary point, on the clock of the library
+ *
+ *  returns
+ *     the time
+ */
+long long Fin_Usec(void)
+{
+    return(fin_clock->ops->now(fin_clock));
+}
+
+
+/**  Fin_Sleep(msec).
+ *  wait, on the clock of the library
+ *
+ *  input:
+ *     int msec = how long
+ *  returns
+ *     none
+ */
+void Fin_Sleep(int msec)
+{
+    struct fin_clock *clock = fin_clock;
+    long long at;
+
+    if (!Fin_Virtual())
+    {
+        Fin_Nap(msec * 1000L);
+        return;
+    }
+    if (Fin_ClockCheck())
+        return;
+
+    // the program waits like the background threads do, no longer than
+    // the time it has
+    at = Fin_Usec() + msec * 1000LL;
+    if (clock->limit != 0 && at > clock->limit)
+        at = clock->limit;
+    Fin_Lock(&clock->sleep_lock);
+    while (Fin_Usec() < at)
+        Fin_VirtualWait(clock, &clock->sleep_cond, &clock->sleep_lock, at);
+    Fin_Unlock(&clock->sleep_lock);
+}
+
+
+/**  Fin_Clock(kind).
+ *  choose the clock of the library for this thread, before Fin_Init
+ *
+ *  input:
+ *     int kind = FIN_CLOCK_REAL or FIN_CLOCK_VIRTUAL
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Clock(int kind)
+{
+    struct fin_clock *clock = fin_clock;
+
+    if (Fin_Dev()->running || (kind != FIN_CLOCK_REAL && kind != FIN_CLOCK_VIRTUAL))
+        return(-1);
+    if (kind == FIN_CLOCK_VIRTUAL && Fin_Virtual())
+        return(1);
+
+    // back on the wall clock, the virtual one is done with
+    if (kind == FIN_CLOCK_REAL)
+    {
+        if (Fin_Virtual())
+        {
+            Fin_MutexFree(&clock->lock);
+            Fin_MutexFree(&clock->sleep_lock);
+            free(clock);
+        }
+        fin_clock = &fin_real_clock;
+        return(1);
+    }
+
+    clock = calloc(1, sizeof(*clock));
+    if (clock == 0)
+        return(-1);
+    clock->ops = &fin_virtual_ops;
+    Fin_MutexInit(&clock->lock);
+    Fin_CondInit(&clock->cond);
+    Fin_MutexInit(&clock->sleep_lock);
+    Fin_CondInit(&clock->sleep_cond);
+    clock->now = FIN_CLOCK_EPOCH;
+    clock->threads = 1;
+    fin_clock = clock;
+    return(1);
+}
+
+
+/**  Fin_ClockAdvance(usec).
+ *  move the virtual clock forward, those waiting for a time now past
+ *  wake up
+ *
+ *  input:
+ *     long long usec = by how much
+ *  returns
+ *     -1 if failure (not on the virtual clock)
+ */
+int Fin_ClockAdvance(long long usec)
+{
+    struct fin_clock *clock = fin_clock;
+    struct fin_vwait *w;
+
+    if (!Fin_Virtual() || usec < 0)
+        return(-1);
+
+    Fin_Lock(&clock->lock);
+    clock->now += usec;
+    for (w = clock->waits; w != 0; w = w->next)
+        if (w->at != 0 && w->at <= clock->now)
+        {
+            Fin_VirtualWakeAll(clock);
+            break;
+        }
+    Fin_Unlock(&clock->lock);
+    return(1);
+}
@@ -0,0 +1,337 @@
+/*
+ * Scheduler of the routines of FinchCo.h.
+ *
+ * The routines run on the thread calling Fin_CoRun. Their commands go to
+ * the background thread of the Finch without waiting, and Fin_CoRun sleeps
+ * on the device until a command is done, a sample comes in or a timer is up.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+#include "FinchCo.h"
+
+/* what a routine waits for */
+#define FIN_CO_READY    0
+#define FIN_CO_TIME     1           // wake_at
+#define FIN_CO_CMND     2           // its command to be sent
+#define FIN_CO_MOVE     3           // its wheel command to be sent, then the wheels to stop
+#define FIN_CO_EDGE     4           // an obstacle to appear
+#define FIN_CO_INPUT    5           // a line typed on the console
+
+#define FIN_CO_NAP      100000      // usec, longest sleep of the scheduler
+
+/*
+ * command of a routine in flight
+ */
+struct fin_co_req
+{
+    struct fin_req req;
+    struct fin_dev *dev;            // device it was queued on
+    Fin_Co *co;
+    long long usec;                 // how long the wheels turn, for FIN_CO_MOVE
+    int left;
+    int right;
+};
+
+static FIN_TLS Fin_Co *fin_cos = 0; // routines not finished yet, of this thread
+
+
+/*
+ * the wheel command of a Fin_CoMove went out, start timing it,
+ * called by the background thread with the device locked
+ */
+static void Fin_CoMoved(struct fin_req *req)
+{
+    struct fin_co_req *co_req = (struct fin_co_req *)req;
+    struct fin_dev *dev = co_req->dev;
+
+    if (req->res > 0)
+    {
+        dev->left_speed = co_req->left;
+        dev->right_speed = co_req->right;
+        dev->stop_at = Fin_Usec() + co_req->usec;
+        Fin_Wake(dev);
+    }
+    Fin_Broadcast(&dev->done);
+}
+
+
+/*
+ * queue a command for a routine
+ */
+static int Fin_CoCmnd(Fin_Co *co, int wait, char cmnd, const unsigned char *args)
+{
+    struct fin_co_req *co_req = (struct fin_co_req *)co->req;
+
+    if (co_req == 0)
+    {
+        co->res = -1;
+        return(-1);
+    }
+
+    memset(co_req->req.buffer, 0, sizeof(co_req->req.buffer));
+    memcpy(&co_req->req.buffer[2], args, 6);
+    co_req->req.buffer[1] = cmnd;
+    co_req->req.flag = SEND;
+    co_req->req.complete = (wait == FIN_CO_MOVE ? Fin_CoMoved : 0);
+    co_req->req.arg = co;
+    co_req->dev = Fin_Dev();
+    co->wait = wait;
+    if (Fin_Submit(co_req->dev, &co_req->req) < 0)
+    {
+        co->wait = FIN_CO_READY;
+        co->res = co_req->req.res;
+        return(-1);
+    }
+    return(0);
+}
+
+
+/*
+ * can a routine be resumed, *wake is lowered to when it can,
+ * called with the device locked
+ */
+static int Fin_CoReady(struct fin_dev *dev, Fin_Co *co, long long now, long long *wake)
+{
+    struct fin_co_req *co_req = (struct fin_co_req *)co->req;
+    int seen;
+
+    switch (co->wait)
+    {
+    case FIN_CO_TIME:
+        if (now >= co->wake_at)
+            return(1);
+        if (co->wake_at < *wake)
+            *wake = co->wake_at;
+        return(0);
+
+    case FIN_CO_CMND:
+        co->res = co_req->req.res;
+        return(co_req->req.done);
+
+    case FIN_CO_MOVE:
+        co->res = co_req->req.res;
+        if (!co_req->req.done)
+            return(0);
+        if (co->res < 0 || (dev->left_speed == 0 && dev->right_speed == 0))
+            return(1);
+        if (dev->stop_at != 0 && dev->stop_at < *wake)
+            *wake = dev->stop_at;
+        return(0);
+
+    case FIN_CO_EDGE:
+        // clear, then something
+        if (dev->lost)
+        {
+            co->res = FIN_EDISCONNECTED;
+            return(1);
+        }
+        if (dev->polled_at[FIN_OBSTACLES] == 0)
+            return(0);
+        seen = dev->snap.obstacle[0] || dev->snap.obstacle[1];
+        if (co->seen == 0 && seen)
+        {
+            co->left = dev->snap.obstacle[0];
+            co->right = dev->snap.obstacle[1];
+            co->res = 1;
+            return(1);
+        }
+        co->seen = seen;
+        return(0);
+
+    case FIN_CO_INPUT:
+#ifdef _LINUX_
+        return(Fin_ConsolePending());
+#else
+        // read by CheckForInput on Windows
+        return(Fin_ConsolePending() || kbhit());
+#endif
+
+    default:
+        return(1);
+    }
+}
+
+
+/**  Fin_CoStart(*co, run, *arg).
+ *  add a routine
+ *
+ *  input:
+ *     Fin_Co *co = state of the routine
+ *     run = the routine
+ *     void *arg = for the routine
+ *  returns
+ *     -1 if failure
+ */
+int Fin_CoStart(Fin_Co *co, int (*run)(Fin_Co *co), void *arg)
+{
+    Fin_Co **link;
+
+    memset(co, 0, sizeof(*co));
+    co->req = calloc(1, sizeof(struct fin_co_req));
+    if (co->req == 0)
+        return(-1);
+    ((struct fin_co_req *)co->req)->req.done = 1;
+    co->run = run;
+    co->arg = arg;
+
+    // at the end, so a routine started by another one does not
+    // disturb the round in progress
+    for (link = &fin_cos; *link != 0; link = &(*link)->next)
+        ;
+    *link = co;
+    return(1);
+}
+
+
+/**  Fin_CoRun(void).
+ *  run the routines until all of them are finished
+ *
+ *  returns
+ *     -1 if failure
+ */
+int Fin_CoRun(void)
+{
+    struct fin_dev *dev = Fin_Dev();
+    long long now, wake;
+    Fin_Co **link, *co;
+    int wait, ran;
+
+    Fin_Lock(&dev->lock);
+    while (fin_cos != 0)
+    {
+        now = Fin_Usec();
+        wake = now + FIN_CO_NAP;
+        ran = 0;
+
+        link = &fin_cos;
+        while ((co = *link) != 0)
+        {
+            if (!Fin_CoReady(dev, co, now, &wake))
+            {
+                link = &co->next;
+                continue;
+            }
+            wait = co->wait;
+            co->wait = FIN_CO_READY;
+            Fin_Unlock(&dev->lock);
+
+            if (wait == FIN_CO_EDGE)
+                Fin_DevSubscribe(dev, FIN_OBSTACLES, 0);
+            ran = 1;
+            if (co->run(co) == FIN_CO_DONE)
+            {
+                Fin_Lock(&dev->lock);
+                *link = co->next;
+                free(co->req);
+                co->req = 0;
+                continue;
+            }
+            Fin_Lock(&dev->lock);
+            link = &co->next;
+        }
+
+        // commands done and samples wake us up
+        if (!ran)
+            Fin_WaitUntil(&dev->done, &dev->lock, wake);
+    }
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
+
+
+/**  Fin_CoSleep(*co, msec).
+ *  resume after msec
+ */
+int Fin_CoSleep(Fin_Co *co, int msec)
+{
+    co->wake_at = Fin_Usec() + msec * 1000LL;
+    co->wait = FIN_CO_TIME;
+    co->res = 1;
+    return(0);
+}
+
+
+/**  Fin_CoMove(*co, msec, left, right).
+ *  turn the wheels for msec, resume once they stop
+ */
+int Fin_CoMove(Fin_Co *co, int msec, int left, int right)
+{
+    struct fin_co_req *co_req = (struct fin_co_req *)co->req;
+    unsigned char args[6] = { 0 };
+
+    if (co_req == 0)
+    {
+        co->res = -1;
+        return(-1);
+    }
+    co_req->usec = msec * 1000LL;
+    co_req->left = left;
+    co_req->right = right;
+
+    args[0] = left < 0;
+    args[1] = (char)(left < 0 ? -left : left);
+    args[2] = right < 0;
+    args[3] = (char)(right < 0 ? -right : right);
+    return(Fin_CoCmnd(co, FIN_CO_MOVE, 'M', args));
+}
+
+
+/**  Fin_CoLED(*co, red, green, blue).
+ *  set the beak, resume once it is sent
+ */
+int Fin_CoLED(Fin_Co *co, int red, int green, int blue)
+{
+    unsigned char args[6] = { 0 };
+
+    args[0] = (char)red;
+    args[1] = (char)green;
+    args[2] = (char)blue;
+    return(Fin_CoCmnd(co, FIN_CO_CMND, 'O', args));
+}
+
+
+/**  Fin_CoBuzzer(*co, msec, freq).
+ *  start the buzzer, resume once it is sent
+ */
+int Fin_CoBuzzer(Fin_Co *co, int msec, int freq)
+{
+    unsigned char args[6] = { 0 };
+
+    args[0] = (char)(msec >> 8);
+    args[1] = (char)msec;
+    args[2] = (char)(freq >> 8);
+    args[3] = (char)freq;
+    return(Fin_CoCmnd(co, FIN_CO_CMND, 'B', args));
+}
+
+
+/**  Fin_CoObstacle(*co).
+ *  resume when an obstacle appears
+ */
+int Fin_CoObstacle(Fin_Co *co)
+{
+    if (Fin_DevSubscribe(Fin_Dev(), FIN_OBSTACLES, 1) < 0)
+    {
+        co->res = -1;
+        return(-1);
+    }
+    co->seen = -1;
+    co->wait = FIN_CO_EDGE;
+    return(0);
+}
+
+
+/**  Fin_CoInput(*co).
+ *  resume when a line is typed on the console
+ */
+int Fin_CoInput(Fin_Co *co)
+{
+    co->wait = FIN_CO_INPUT;
+    co->res = 1;
+    return(0);
+}
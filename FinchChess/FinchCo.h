@@ -0,0 +1,139 @@
+#ifndef FINCHCO_H
+#define FINCHCO_H
+
+/*
+ * Routines that run side by side on one thread (FinchCo.c).
+ *
+ * A routine is a function that gives the hand back at each FIN_AWAIT
+ * instead of blocking; Fin_CoRun resumes it once what it waits for is
+ * done (time elapsed, wheels stopped, obstacle seen...), in between the
+ * other routines run. e.g. blink while driving:
+ *
+ *    int Blink(Fin_Co *co)
+ *    {
+ *        FIN_CO_BEGIN(co);
+ *        while (1)
+ *        {
+ *            FIN_AWAIT(co, Fin_CoLED(co, 255, 0, 0));
+ *            FIN_AWAIT(co, Fin_CoSleep(co, 250));
+ *            FIN_AWAIT(co, Fin_CoLED(co, 0, 0, 0));
+ *            FIN_AWAIT(co, Fin_CoSleep(co, 250));
+ *        }
+ *        FIN_CO_END(co);
+ *    }
+ *
+ *    Fin_CoStart(&blink, Blink, NULL);
+ *    Fin_CoStart(&drive, Drive, NULL);
+ *    Fin_CoRun();
+ *
+ * Local variables of a routine are lost at each FIN_AWAIT, keep what must
+ * last in static variables or in the structure pointed to by co->arg.
+ * A routine must not call the blocking Fin_ functions (Fin_Move...).
+ */
+
+#include "Finch.h"
+
+/* returned by a routine */
+#define FIN_CO_WAIT   0             // waiting, resume it later
+#define FIN_CO_DONE   1             // finished
+
+typedef struct fin_co Fin_Co;
+struct fin_co
+{
+    void *arg;                      // for the routine
+    int res;                        // result of the last FIN_AWAIT, < 0 if failure
+    int left;                       // obstacle sensors when Fin_CoObstacle resumed
+    int right;
+
+    /* used by the scheduler */
+    int line;                       // where to resume
+    int (*run)(Fin_Co *co);
+    Fin_Co *next;
+    int wait;                       // what the routine waits for
+    long long wake_at;
+    void *req;                      // command in flight
+    int seen;                       // last obstacle state seen, -1 if none yet
+};
+
+/* first and last statements of a routine */
+#define FIN_CO_BEGIN(co)    switch ((co)->line) { case 0:
+#define FIN_CO_END(co)      } (co)->line = -1; return(FIN_CO_DONE)
+
+/* fallthrough: a routine goes on to the resume point of its FIN_AWAIT,
+   said with the attribute since a comment does not survive the macro */
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define FIN_CO_FALLTHROUGH  __attribute__((fallthrough))
+#else
+#define FIN_CO_FALLTHROUGH
+#endif
+
+/* start an operation and give the hand back until it is done,
+   goes on right away (co->res < 0) if it could not be started */
+#define FIN_AWAIT(co, start) \
+    do { (co)->line = __LINE__; if ((start) >= 0) return(FIN_CO_WAIT); \
+         FIN_CO_FALLTHROUGH; /* fallthrough */ case __LINE__:; } while (0)
+
+/* let the other routines run */
+#define FIN_CO_YIELD(co)    FIN_AWAIT(co, Fin_CoSleep(co, 0))
+
+/**
+ *  Fin_CoStart(*co, run, *arg).
+ *  Add a routine, it starts at the next round of Fin_CoRun
+ *  (can be called from a routine).
+ *
+ *  @param *co state of the routine, must last until it is finished
+ *  @param run the routine
+ *  @param *arg for the routine (co->arg)
+ *
+ *  @return -1 if failure
+ */
+int Fin_CoStart(Fin_Co *co, int (*run)(Fin_Co *co), void *arg);
+
+/**
+ *  Fin_CoRun(void).
+ *  Run the routines until all of them are finished.
+ *
+ *  @return -1 if failure
+ */
+int Fin_CoRun(void);
+
+/**
+ *  Fin_CoSleep(*co, msec).
+ *  To be awaited: resume after msec.
+ */
+int Fin_CoSleep(Fin_Co *co, int msec);
+
+/**
+ *  Fin_CoMove(*co, msec, left, right).
+ *  To be awaited: turn the wheels for msec, resume once they stop
+ *  (time up, a reflex or Fin_Stop).
+ */
+int Fin_CoMove(Fin_Co *co, int msec, int left, int right);
+
+/**
+ *  Fin_CoLED(*co, red, green, blue).
+ *  To be awaited: set the beak, resume once it is sent.
+ */
+int Fin_CoLED(Fin_Co *co, int red, int green, int blue);
+
+/**
+ *  Fin_CoBuzzer(*co, msec, freq).
+ *  To be awaited: start the buzzer, resume once it is sent.
+ */
+int Fin_CoBuzzer(Fin_Co *co, int msec, int freq);
+
+/**
+ *  Fin_CoObstacle(*co).
+ *  To be awaited: resume when an obstacle appears in front of one
+ *  of the sensors (co->left and co->right tell which).
+ */
+int Fin_CoObstacle(Fin_Co *co);
+
+/**
+ *  Fin_CoInput(*co).
+ *  To be awaited: resume when a line is typed on the console,
+ *  CheckForInput then returns it.
+ */
+int Fin_CoInput(Fin_Co *co);
+
+#endif  /* FINCHCO_H */
@@ -0,0 +1,325 @@
+/*
+ * Console of the operator: the lines typed while a program runs.
+ *
+ * On Linux/Mac the background thread of the Finch opened by Fin_Init
+ * watches stdin along with its own work (poll on stdin and on a wake-up
+ * pipe), so a line is handled as soon as it is typed: "stop" stops the
+ * wheels right away, like a reflex, and every line is passed to the
+ * Fin_OnInput callback and kept for CheckForInput.
+ * On Windows the lines are read when the program calls CheckForInput.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifdef _LINUX_
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+/*
+ * a line typed, waiting for CheckForInput
+ */
+struct fin_line
+{
+    struct fin_line *next;
+    char text[1];                   // allocated to the length of the line
+};
+
+static struct fin_dev *fin_console = 0;     // device whose thread watches stdin
+static fin_mutex fin_console_lock;          // guards the lines and the callback
+static volatile int fin_console_ready = 0;  // 1 while the lock is set up, 2 once it is
+static struct fin_line *fin_lines = 0;      // lines not read yet, oldest first
+static struct fin_line **fin_lines_tail = &fin_lines;
+static void (*fin_on_input)(const char *line, void *arg) = 0;
+static void *fin_on_input_arg = 0;
+static struct fin_line *fin_returned = 0;  // last line returned by CheckForInput
+static char *fin_input = 0;                 // line being typed
+static int fin_input_len = 0;
+static int fin_input_size = 0;
+
+
+/*
+ * lock the lines typed and the callback, whatever the device and thread
+ * (the lock is set up by the first one to take it)
+ */
+static void Fin_ConsoleLock(void)
+{
+    if (fin_console_ready != 2)
+    {
+        if (__sync_bool_compare_and_swap(&fin_console_ready, 0, 1))
+        {
+            Fin_MutexInit(&fin_console_lock);
+            __sync_synchronize();
+            fin_console_ready = 2;
+        }
+        while (fin_console_ready != 2)
+            Fin_Nap(100);
+    }
+    Fin_Lock(&fin_console_lock);
+}
+
+
+/*
+ * add a character to the line being typed, the buffer grows as needed
+ */
+static int Fin_InputAdd(char c)
+{
+    char *input;
+
+    if (fin_input_len + 1 >= fin_input_size)
+    {
+        input = realloc(fin_input, fin_input_size ? fin_input_size * 2 : 128);
+        if (input == 0)
+            return(-1);
+        fin_input = input;
+        fin_input_size = fin_input_size ? fin_input_size * 2 : 128;
+    }
+    fin_input[fin_input_len++] = c;
+    fin_input[fin_input_len] = 0;
+    return(0);
+}
+
+
+/*
+ * commands of the operator handled by the library itself,
+ * called with the device locked
+ */
+static void Fin_ConsoleCommand(struct fin_dev *dev, const char *line)
+{
+    unsigned char IoBuffer[9];
+
+    if (strcmp(line, "stop") == 0)
+    {
+        // like a reflex: drop what is queued and stop the wheels now
+        dev->stop_at = 0;
+        dev->left_speed = 0;
+        dev->right_speed = 0;
+        Fin_Cancel(dev, FIN_LANE_SAFETY, NULL, FIN_ECANCELED);
+        Fin_Unlock(&dev->lock);
+        memset(IoBuffer, 0, sizeof(IoBuffer));
+        Fin_DevCmnd(dev, SEND, 'M', IoBuffer);
+        Fin_Lock(&dev->lock);
+        dev->snap.left_speed = 0;
+        dev->snap.right_speed = 0;
+        Fin_PoseWheels(dev, Fin_Usec());
+    }
+}
+
+
+/*
+ * a whole line was typed: handle it, keep it for CheckForInput and
+ * pass a copy of it to the callback, which runs with the device unlocked,
+ * called with the device locked
+ */
+static void Fin_ConsoleLine(struct fin_dev *dev)
+{
+    void (*on_input)(const char *line, void *arg);
+    void *arg;
+    struct fin_line *line;
+    char *copy = 0;
+
+    line = malloc(sizeof(*line) + fin_input_len);
+    fin_input_len = 0;
+    if (line == 0)
+        return;
+    strcpy(line->text, fin_input ? fin_input : "");
+    line->next = 0;
+
+    Fin_ConsoleCommand(dev, line->text);
+
+    // once queued, CheckForInput may take the line and free it
+    Fin_ConsoleLock();
+    on_input = fin_on_input;
+    arg = fin_on_input_arg;
+    if (on_input != 0 && (copy = malloc(strlen(line->text) + 1)) != 0)
+        strcpy(copy, line->text);
+    *fin_lines_tail = line;
+    fin_lines_tail = &line->next;
+    Fin_Unlock(&fin_console_lock);
+    Fin_Broadcast(&dev->done);
+
+    if (copy != 0)
+    {
+        Fin_Unlock(&dev->lock);
+        on_input(copy, arg);
+        free(copy);
+        Fin_Lock(&dev->lock);
+    }
+}
+
+
+#ifdef _LINUX_
+
+/*
+ * have the background thread of a device watch stdin
+ */
+void Fin_ConsoleOpen(struct fin_dev *dev)
+{
+    if (pipe(dev->wake_pipe) < 0)
+        return;
+    fcntl(dev->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(dev->wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    Fin_Lock(&dev->lock);
+    dev->console = 1;
+    dev->console_fd = 0;
+    fin_console = dev;
+    Fin_Wake(dev);
+    Fin_Unlock(&dev->lock);
+}
+
+
+/*
+ * wait for work, a line typed or the time usec, instead of Fin_WaitUntil,
+ * called by the background thread with the device locked
+ */
+void Fin_ConsoleWait(struct fin_dev *dev, long long usec)
+{
+    struct pollfd fds[2];
+    char buffer[256];
+    long long wait;
+    int len, i;
+
+    fds[0].fd = dev->wake_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = dev->console_fd;
+    fds[1].events = POLLIN;
+    wait = usec - Fin_Usec();
+    if (wait <= 0)
+        return;
+
+    Fin_Unlock(&dev->lock);
+    poll(fds, dev->console_fd < 0 ? 1 : 2, (int)((wait + 999) / 1000));
+    while (read(dev->wake_pipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+    len = 0;
+    if (dev->console_fd >= 0 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+        len = read(dev->console_fd, buffer, sizeof(buffer));
+    Fin_Lock(&dev->lock);
+
+    // end of the input, stop watching it
+    if (len < 0 || (len == 0 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))))
+        dev->console_fd = -1;
+
+    for (i = 0; i < len; i++)
+    {
+        if (buffer[i] == '\n')
+            Fin_ConsoleLine(dev);
+        else if (buffer[i] != '\r')
+            Fin_InputAdd(buffer[i]);
+    }
+}
+
+
+/*
+ * stop watching stdin, once the background thread is stopped
+ */
+void Fin_ConsoleClose(struct fin_dev *dev)
+{
+    if (!dev->console)
+        return;
+    dev->console = 0;
+    if (fin_console == dev)
+        fin_console = 0;
+    close(dev->wake_pipe[0]);
+    close(dev->wake_pipe[1]);
+}
+
+
+/*
+ * is there a line waiting for CheckForInput
+ */
+int kbhit(void)
+{
+    int pending = 0;
+
+    fflush(stdout);
+    Fin_ConsoleLock();
+    pending = fin_lines != 0;
+    Fin_Unlock(&fin_console_lock);
+    return(pending);
+}
+
+#endif
+
+
+/*
+ * is there a line waiting
+ */
+int Fin_ConsolePending(void)
+{
+    int pending;
+
+    Fin_ConsoleLock();
+    pending = fin_lines != 0;
+    Fin_Unlock(&fin_console_lock);
+    return(pending);
+}
+
+
+/**  Fin_OnInput(callback, *arg).
+ *  have a function called with each line typed on the console
+ *
+ *  input:
+ *     callback = the function, NULL to remove it
+ *     void *arg = for the function
+ *  returns
+ *     -1 if failure
+ */
+int Fin_OnInput(void (*callback)(const char *line, void *arg), void *arg)
+{
+    Fin_ConsoleLock();
+    fin_on_input = callback;
+    fin_on_input_arg = arg;
+    Fin_Unlock(&fin_console_lock);
+    return(1);
+}
+
+
+/* CheckForInput(void)
+ *    check for a line typed on the console
+ *
+ * input:
+ *    none
+ * return:
+ *    0 = no keyboard entry
+ *    else, the line typed (valid until the next call)
+ */
+char *CheckForInput(void)
+{
+    struct fin_line *line;
+#ifndef _LINUX_
+    struct fin_dev *dev = Fin_Dev();
+    int c;
+
+    // Windows consoles are not watched by the thread, read the line now
+    if (kbhit() != 0)
+    {
+        fin_input_len = 0;
+        while ((c = getchar()) != EOF && c != '\n')
+            Fin_InputAdd((char)c);
+        Fin_Lock(&dev->lock);
+        Fin_ConsoleLine(dev);
+        Fin_Unlock(&dev->lock);
+    }
+#endif
+
+    // the previous line is no longer needed
+    Fin_ConsoleLock();
+    line = fin_lines;
+    if (line != 0)
+    {
+        fin_lines = line->next;
+        if (fin_lines == 0)
+            fin_lines_tail = &fin_lines;
+    }
+    free(fin_returned);
+    fin_returned = line;
+    Fin_Unlock(&fin_console_lock);
+    return(line != 0 ? line->text : 0);
+}
@@ -0,0 +1,446 @@
+/*
+ * finchd - Finch daemon
+ *
+ * Opens every Finch plugged into the computer, keeps them awake and lets
+ * several programs use them at the same time, e.g. a visualizer and a
+ * routine driving the same robot. Programs built with Finch.c attach to it
+ * automatically in Fin_Init, so they start without opening the robot.
+ *
+ * The protocol is described in FinchShm.h.
+ *
+ * build (Linux/Mac only):
+ *    gcc -D_LINUX_ -o finchd FinchDaemon.c Finch.c FinchClient.c FinchClock.c FinchCo.c FinchConsole.c FinchFilter.c FinchFleet.c FinchFlow.c FinchMaze.c FinchPath.c FinchPoll.c FinchPose.c FinchReflex.c FinchSim.c FinchTrack.c -lhidapi-libusb -lpthread -lrt -lm
+ * usage:
+ *    finchd [socket path]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+#include "FinchShm.h"
+
+#ifndef _LINUX_
+#error finchd needs the Linux/Mac build, define _LINUX_ in Finch.h
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define FINCHD_DEVICES      8               // robots served at once
+#define FINCHD_IDLE         500000          // usec a service thread sleeps at most
+#define FINCHD_HELLO        200000          // usec a new client has to send its ATTACH line
+#define FINCHD_MODE         0660            // socket and shared memory: user and group of finchd
+
+/* a robot served by the daemon */
+struct finchd_dev
+{
+    struct fin_dev dev;
+    char shm_name[64];
+    struct fin_shm *shm;
+    int sock[FIN_SHM_CLIENTS];              // handshake socket of each ring, -1 if free
+    fin_mutex ring_lock;                    // held while a ring is drained or reset
+    fin_cond bell;                          // a client queued a command while idle
+    unsigned int gen[FIN_SHM_CLIENTS];      // bumped each time a ring is handed out
+    struct fin_req req[FIN_SHM_CLIENTS][FIN_RING_SLOTS];    // one per ring slot
+    unsigned int req_gen[FIN_SHM_CLIENTS][FIN_RING_SLOTS];  // gen of the ring when queued
+    char req_busy[FIN_SHM_CLIENTS][FIN_RING_SLOTS];         // queued on the robot, not done yet
+    struct fin_req stop;                    // stop when the last client leaves
+    pthread_t tid;
+};
+
+static struct finchd_dev finchd_devs[FINCHD_DEVICES];
+static int finchd_count = 0;
+static const char *finchd_socket = FIN_SOCKET;
+static volatile int finchd_running = 1;
+
+/*
+ * copy the snapshot of the robot to the shared memory,
+ * called by the background thread of the robot whenever a sample comes in
+ */
+static void Finchd_Publish(struct fin_dev *dev)
+{
+    struct finchd_dev *d = (struct finchd_dev *)dev->arg;
+
+    d->shm->snap_seq++;
+    Fin_Barrier();
+    d->shm->snap = dev->snap;
+    Fin_Barrier();
+    d->shm->snap_seq++;
+}
+
+
+/*
+ * a request of the daemon is done, called by the background thread of the robot
+ */
+static void Finchd_Done(struct fin_req *req)
+{
+    struct finchd_dev *d = (struct finchd_dev *)req->arg;
+    struct fin_slot *slot;
+    int i, r;
+
+    if (req == &d->stop)
+        return;
+
+    // give the response back to the client, unless the ring
+    // was handed to another client in the meantime
+    i = req - &d->req[0][0];
+    r = i / FIN_RING_SLOTS;
+    Fin_Lock(&d->ring_lock);
+    if (d->req_gen[r][i % FIN_RING_SLOTS] == d->gen[r])
+    {
+        slot = &d->shm->ring[r].slot[i % FIN_RING_SLOTS];
+        memcpy(slot->buffer, req->buffer, 9);
+        slot->res = req->res;
+        Fin_Barrier();
+        slot->state = FIN_SLOT_DONE;
+    }
+    d->req_busy[r][i % FIN_RING_SLOTS] = 0;
+    Fin_Unlock(&d->ring_lock);
+}
+
+
+/*
+ * has a client queued a command, called with ring_lock held
+ */
+static int Finchd_Pending(struct finchd_dev *d)
+{
+    int r;
+
+    for (r = 0; r < FIN_SHM_CLIENTS; r++)
+        if (d->shm->ring[r].attached && d->shm->ring[r].tail != d->shm->ring[r].head)
+            return(1);
+    return(0);
+}
+
+
+/*
+ * service thread of one robot:
+ * passes the commands of the client rings on to the scheduler of the
+ * robot, which sends them by lane and samples the sensors in between,
+ * and sleeps while every ring is empty
+ */
+static void *Finchd_Service(void *arg)
+{
+    struct finchd_dev *d = (struct finchd_dev *)arg;
+    struct fin_ring *ring;
+    struct fin_req *req;
+    int busy;
+    int i, r;
+
+    while (finchd_running)
+    {
+        busy = 0;
+
+        for (r = 0; r < FIN_SHM_CLIENTS; r++)
+        {
+            ring = &d->shm->ring[r];
+            while (ring->attached && ring->tail != ring->head)
+            {
+                Fin_Lock(&d->ring_lock);
+                if (!ring->attached || ring->tail == ring->head)
+                {
+                    Fin_Unlock(&d->ring_lock);
+                    break;
+                }
+                // the request of the slot may still be queued for the
+                // client the ring had before, it is reused once done
+                i = ring->tail % FIN_RING_SLOTS;
+                if (d->req_busy[r][i])
+                {
+                    Fin_Unlock(&d->ring_lock);
+                    break;
+                }
+                Fin_Barrier();
+                req = &d->req[r][i];
+                memcpy(req->buffer, ring->slot[i].buffer, 9);
+                req->flag = ring->slot[i].flag;
+                req->complete = Finchd_Done;
+                req->arg = d;
+                d->req_gen[r][i] = d->gen[r];
+                d->req_busy[r][i] = 1;
+                ring->tail++;
+                Fin_Unlock(&d->ring_lock);
+
+                Fin_Submit(&d->dev, req);
+                busy = 1;
+            }
+        }
+
+        // a client that sees idle set rings the bell through its socket,
+        // one that does not queued its command before the rings were checked
+        if (!busy)
+        {
+            Fin_Lock(&d->ring_lock);
+            d->shm->idle = 1;
+            Fin_Barrier();
+            if (!Finchd_Pending(d))
+                Fin_WaitUntil(&d->bell, &d->ring_lock, Fin_Usec() + FINCHD_IDLE);
+            d->shm->idle = 0;
+            Fin_Unlock(&d->ring_lock);
+        }
+    }
+    return(0);
+}
+
+
+/*
+ * open a robot and create its shared memory segment
+ */
+static int Finchd_Open(struct finchd_dev *d, const char *path, int index)
+{
+    unsigned char IoBuffer[9];
+    int fd;
+    int r;
+
+    if (Fin_DevOpen(&d->dev, path) < 0)
+        return(-1);
+
+    sprintf(d->shm_name, "/finchd.%d", index);
+    shm_unlink(d->shm_name);
+    fd = shm_open(d->shm_name, O_CREAT | O_RDWR, FINCHD_MODE);
+    if (fd < 0 || ftruncate(fd, sizeof(struct fin_shm)) < 0)
+    {
+        perror("finchd: shm_open");
+        Fin_DevClose(&d->dev);
+        return(-1);
+    }
+    fchmod(fd, FINCHD_MODE);
+    d->shm = mmap(NULL, sizeof(struct fin_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (d->shm == MAP_FAILED)
+    {
+        perror("finchd: mmap");
+        Fin_DevClose(&d->dev);
+        return(-1);
+    }
+
+    memset(d->shm, 0, sizeof(struct fin_shm));
+    d->shm->magic = FIN_SHM_MAGIC;
+    d->shm->version = FIN_SHM_VERSION;
+    for (r = 0; r < FIN_SHM_CLIENTS; r++)
+        d->sock[r] = -1;
+    Fin_MutexInit(&d->ring_lock);
+    Fin_CondInit(&d->bell);
+    d->stop.arg = d;
+    d->stop.complete = Finchd_Done;
+    d->stop.done = 1;
+
+    // every sample the robot takes goes to the snapshot of the clients,
+    // all the sensors are sampled (faster while the wheels turn)
+    Fin_Lock(&d->dev.lock);
+    d->dev.arg = d;
+    d->dev.sampled = Finchd_Publish;
+    Fin_Unlock(&d->dev.lock);
+    for (r = 0; r < FIN_SENSORS; r++)
+        Fin_DevSubscribe(&d->dev, r, 1);
+
+    // beak off, like Fin_Init does
+    IoBuffer[2] = IoBuffer[3] = IoBuffer[4] = 0;
+    Fin_DevCmnd(&d->dev, SEND, 'O', IoBuffer);
+
+    pthread_create(&d->tid, NULL, Finchd_Service, d);
+    printf("finchd: robot %d at %s, opened in %d ms\n", index, path, (int)(d->dev.open_usec / 1000));
+    return(0);
+}
+
+
+/*
+ * hand a command ring to a new client
+ */
+static void Finchd_Attach(int fd)
+{
+    struct finchd_dev *d;
+    struct fin_ring *ring;
+    struct timeval wait = { 0, FINCHD_HELLO };
+    long long deadline = Fin_Usec() + FINCHD_HELLO;
+    char line[128];
+    int device = -1;
+    int len = 0;
+    int r;
+
+    // read the "ATTACH <device>" line, a client that does not send it
+    // in time is dropped so it does not hold up the others
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+    while (len < (int)sizeof(line) - 1 && Fin_Usec() < deadline &&
+           read(fd, &line[len], 1) == 1 && line[len] != '\n')
+        len++;
+    line[len] = 0;
+
+    if (sscanf(line, "ATTACH %d", &device) != 1 || device < 0 || device >= finchd_count)
+    {
+        dprintf(fd, "ERR no robot %d\n", device);
+        close(fd);
+        return;
+    }
+
+    d = &finchd_devs[device];
+    for (r = 0; r < FIN_SHM_CLIENTS; r++)
+        if (d->sock[r] < 0)
+            break;
+    if (r == FIN_SHM_CLIENTS)
+    {
+        dprintf(fd, "ERR robot %d is shared by too many programs\n", device);
+        close(fd);
+        return;
+    }
+
+    ring = &d->shm->ring[r];
+    Fin_Lock(&d->ring_lock);
+    d->gen[r]++;
+    ring->head = 0;
+    ring->tail = 0;
+    for (len = 0; len < FIN_RING_SLOTS; len++)
+        ring->slot[len].state = FIN_SLOT_FREE;
+    Fin_Barrier();
+    ring->attached = 1;
+    Fin_Unlock(&d->ring_lock);
+
+    d->sock[r] = fd;
+    dprintf(fd, "OK %s %d\n", d->shm_name, r);
+}
+
+
+/*
+ * a client went away, stop the motors if it was the last one
+ */
+static void Finchd_Detach(struct finchd_dev *d, int r)
+{
+    int i;
+
+    Fin_Lock(&d->ring_lock);
+    d->shm->ring[r].attached = 0;
+    Fin_Unlock(&d->ring_lock);
+    close(d->sock[r]);
+    d->sock[r] = -1;
+
+    for (i = 0; i < FIN_SHM_CLIENTS; i++)
+        if (d->sock[i] >= 0)
+            return;
+
+    if (d->stop.done)
+    {
+        memset(d->stop.buffer, 0, sizeof(d->stop.buffer));
+        d->stop.buffer[1] = 'M';
+        d->stop.flag = SEND;
+        Fin_Submit(&d->dev, &d->stop);
+    }
+}
+
+
+static void Finchd_Signal(int sig)
+{
+    (void)sig;
+    finchd_running = 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct pollfd fds[1 + FINCHD_DEVICES * FIN_SHM_CLIENTS];
+    struct hid_device_info *devs, *info;
+    struct sockaddr_un addr;
+    unsigned char IoBuffer[9];
+    char dummy[64];
+    int listener;
+    int nfds, i, r;
+
+    if (argc > 1)
+        finchd_socket = argv[1];
+
+    // open every Finch plugged in
+    devs = hid_enumerate(FIN_VID, FIN_PID);
+    for (info = devs; info != NULL && finchd_count < FINCHD_DEVICES; info = info->next)
+    {
+        if (Finchd_Open(&finchd_devs[finchd_count], info->path, finchd_count) == 0)
+            finchd_count++;
+    }
+    hid_free_enumeration(devs);
+    if (finchd_count == 0)
+    {
+        printf("finchd: unable to connect to the Finch\n");
+        return(1);
+    }
+
+    // the handshake socket
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, finchd_socket, sizeof(addr.sun_path) - 1);
+    unlink(finchd_socket);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 16) < 0)
+    {
+        perror("finchd: socket");
+        return(1);
+    }
+    chmod(finchd_socket, FINCHD_MODE);
+
+    signal(SIGINT, Finchd_Signal);
+    signal(SIGTERM, Finchd_Signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (finchd_running)
+    {
+        // listen for new clients and for clients going away
+        nfds = 0;
+        fds[nfds].fd = listener;
+        fds[nfds++].events = POLLIN;
+        for (i = 0; i < finchd_count; i++)
+            for (r = 0; r < FIN_SHM_CLIENTS; r++)
+            {
+                fds[nfds].fd = finchd_devs[i].sock[r];
+                fds[nfds++].events = POLLIN;
+            }
+
+        if (poll(fds, nfds, 500) <= 0)
+            continue;
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0)
+                Finchd_Attach(fd);
+        }
+
+        // a client socket is readable when the client rings the bell
+        // of an idle robot, or when it closes
+        for (i = 0; i < finchd_count; i++)
+            for (r = 0; r < FIN_SHM_CLIENTS; r++)
+            {
+                struct pollfd *p = &fds[1 + i * FIN_SHM_CLIENTS + r];
+                if (p->fd < 0 || p->fd != finchd_devs[i].sock[r] || !p->revents)
+                    continue;
+                if (read(p->fd, dummy, sizeof(dummy)) <= 0)
+                    Finchd_Detach(&finchd_devs[i], r);
+                else
+                {
+                    Fin_Lock(&finchd_devs[i].ring_lock);
+                    Fin_CondBroadcast(&finchd_devs[i].bell);
+                    Fin_Unlock(&finchd_devs[i].ring_lock);
+                }
+            }
+    }
+
+    // leave the robots idle
+    for (i = 0; i < finchd_count; i++)
+    {
+        pthread_join(finchd_devs[i].tid, NULL);
+        Fin_DevCmnd(&finchd_devs[i].dev, SEND, 'R', IoBuffer);
+        Fin_DevClose(&finchd_devs[i].dev);
+        shm_unlink(finchd_devs[i].shm_name);
+    }
+    close(listener);
+    unlink(finchd_socket);
+    return(0);
+}
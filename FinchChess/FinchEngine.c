@@ -0,0 +1,678 @@
+/*
+ * FinchEngine - the chess search of the workshop (FinchSearch.c) as a
+ * UCI engine, to try it in a chess GUI against people or other engines,
+ * and its benchmark.
+ *
+ * The search runs on threads of its own so "stop", "ponderhit" and
+ * "isready" are answered while it thinks. The time for a move is a share of the clock
+ * left (wtime/btime, winc/binc, movestogo), or movetime, depth, nodes.
+ * bench searches a set of positions to a fixed depth with 1, 2, 4...
+ * threads, reporting the positions per second and the time to reach the
+ * depth of each against one thread. book makes an opening book from PGN
+ * files (FinchBook.c) and reports how long a probe takes; the engine plays
+ * from the book set with the BookFile option as long as it has a move.
+ * tables builds endgame tables (FinchTable.c), reporting the time and the
+ * memory each took and how long a probe takes; the search looks up the
+ * tables of the directory set with the TablePath option. eval walks the
+ * moves from the positions of the benchmark and times the score of each
+ * position kept up to date by the moves against working it out again.
+ *
+ * build (Linux/Mac):
+ *    gcc -O2 -D_LINUX_ -o FinchEngine FinchEngine.c FinchBoard.c FinchBook.c FinchSearch.c FinchTable.c -lpthread -lm
+ * build (Windows):
+ *    gcc -O2 -o FinchEngine FinchEngine.c FinchBoard.c FinchBook.c FinchSearch.c FinchTable.c
+ * usage:
+ *    FinchEngine                               (UCI on the console)
+ *    FinchEngine bench [depth] [threads]
+ *    FinchEngine book file [-p plies] [games.pgn ...]
+ *    FinchEngine tables dir [-t threads] KQK KRK KPK KBNK KQKR ...
+ *    FinchEngine eval [depth]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "FinchBoard.h"
+
+#ifdef _LINUX_
+#include <pthread.h>
+#include <time.h>
+#else
+#include <windows.h>
+#endif
+
+#define ENGINE_NAME     "FinchChess"
+#define ENGINE_PROBES   50000       // positions of the book probed by "book"
+#define ENGINE_ENDINGS  1000        // positions of each table probed by "tables"
+
+/* positions of the benchmark */
+static const char *engine_bench[] =
+{
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 10",
+    "2r3k1/pp3ppp/4p3/3pP3/3P4/P4N2/1P3PPP/2R3K1 w - - 0 25",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+static Fin_Board engine_board;
+static Fin_SearchLimits engine_limits;
+static int engine_threads = 1;
+static int engine_searching = 0;
+static int engine_book = 0;         // a book is open
+#ifdef _LINUX_
+static pthread_t engine_thread;
+#else
+static HANDLE engine_thread;
+#endif
+
+
+/*
+ * a line of the search, as UCI info
+ */
+static void Engine_Report(const Fin_SearchInfo *info)
+{
+    char text[6];
+    int i;
+
+    printf("info depth %d seldepth %d ", info->depth, info->seldepth);
+    if (info->score >= FIN_SEARCH_MATE - FIN_SEARCH_PLIES)
+        printf("score mate %d ", (FIN_SEARCH_MATE - info->score + 1) / 2);
+    else if (info->score <= -FIN_SEARCH_MATE + FIN_SEARCH_PLIES)
+        printf("score mate %d ", -(FIN_SEARCH_MATE + info->score) / 2);
+    else
+        printf("score cp %d ", info->score);
+    printf("nodes %llu nps %llu tbhits %llu time %lld pv", info->nodes,
+           info->usec > 0 ? info->nodes * 1000000 / info->usec : 0, info->tables, info->usec / 1000);
+    for (i = 0; i < info->length; i++)
+        printf(" %s", Fin_BoardText(info->line[i], text));
+    printf("\n");
+    fflush(stdout);
+}
+
+
+/*
+ * waits for the search, says the best move when done
+ */
+#ifdef _LINUX_
+static void *Engine_Think(void *arg)
+#else
+static DWORD WINAPI Engine_Think(void *arg)
+#endif
+{
+    Fin_SearchInfo info;
+    char move[6], ponder[6];
+
+    (void)arg;
+    if (Fin_SearchWait(&info) < 0 || info.move == FIN_MOVE_NONE)
+        printf("bestmove 0000\n");
+    else if (info.ponder != FIN_MOVE_NONE)
+        printf("bestmove %s ponder %s\n", Fin_BoardText(info.move, move), Fin_BoardText(info.ponder, ponder));
+    else
+        printf("bestmove %s\n", Fin_BoardText(info.move, move));
+    fflush(stdout);
+    return(0);
+}
+
+
+/*
+ * wait for the search thread to be done
+ */
+static void Engine_Wait(void)
+{
+    if (!engine_searching)
+        return;
+#ifdef _LINUX_
+    pthread_join(engine_thread, NULL);
+#else
+    WaitForSingleObject(engine_thread, INFINITE);
+    CloseHandle(engine_thread);
+#endif
+    engine_searching = 0;
+}
+
+
+/*
+ * position [startpos | fen ...] [moves ...]
+ */
+static void Engine_Position(char *args)
+{
+    char *moves = strstr(args, "moves");
+    char *move;
+    Fin_BoardMove m;
+
+    if (moves)
+        *moves = 0;
+    if (strncmp(args, "fen", 3) == 0)
+    {
+        if (Fin_BoardSet(&engine_board, args + 3) < 0)
+        {
+            printf("info string cannot read fen%s\n", args + 3);
+            Fin_BoardSet(&engine_board, NULL);
+            return;
+        }
+    }
+    else
+        Fin_BoardSet(&engine_board, NULL);
+    if (moves == 0)
+        return;
+
+    for (move = strtok(moves + 5, " \t\r\n"); move; move = strtok(NULL, " \t\r\n"))
+    {
+        m = Fin_BoardParse(&engine_board, move);
+        if (m == FIN_MOVE_NONE)
+        {
+            printf("info string illegal move %s\n", move);
+            return;
+        }
+        // the oldest moves are forgotten when the game is too long to keep
+        if (engine_board.ply >= FIN_BOARD_HISTORY - FIN_SEARCH_PLIES)
+        {
+            memmove(engine_board.undo, engine_board.undo + FIN_BOARD_HISTORY / 2,
+                    (engine_board.ply - FIN_BOARD_HISTORY / 2) * sizeof(engine_board.undo[0]));
+            engine_board.ply -= FIN_BOARD_HISTORY / 2;
+        }
+        Fin_BoardMake(&engine_board, m);
+    }
+}
+
+
+/*
+ * value of a word of the go command
+ */
+static long long Engine_Arg(const char *args, const char *name)
+{
+    const char *p = strstr(args, name);
+
+    return(p ? atoll(p + strlen(name)) : 0);
+}
+
+
+/*
+ * go [ponder] [wtime btime winc binc movestogo | movetime | depth | nodes | infinite]
+ */
+static void Engine_Go(const char *args)
+{
+    long long left, inc, moves;
+    Fin_BoardMove book;
+    char text[6];
+#ifndef _LINUX_
+    DWORD tid;
+#endif
+
+    // no thinking while the book has a move, unless asked to ponder or think on
+    if (engine_book && strstr(args, "ponder") == NULL && strstr(args, "infinite") == NULL &&
+        (book = Fin_BookPick(&engine_board)) != FIN_MOVE_NONE)
+    {
+        printf("info string book\nbestmove %s\n", Fin_BoardText(book, text));
+        return;
+    }
+
+    memset(&engine_limits, 0, sizeof(engine_limits));
+    engine_limits.threads = engine_threads;
+    engine_limits.report = Engine_Report;
+    engine_limits.depth = (int)Engine_Arg(args, "depth ");
+    engine_limits.nodes = (unsigned long long)Engine_Arg(args, "nodes ");
+    engine_limits.usec = Engine_Arg(args, "movetime ") * 1000;
+    engine_limits.ponder = strstr(args, "ponder") != NULL;
+
+    left = Engine_Arg(args, engine_board.turn == FIN_WHITE ? "wtime " : "btime ");
+    inc = Engine_Arg(args, engine_board.turn == FIN_WHITE ? "winc " : "binc ");
+    moves = Engine_Arg(args, "movestogo ");
+    if (left > 0 && strstr(args, "infinite") == NULL)
+    {
+        // a share of what is left, never all of it
+        engine_limits.usec = (left / (moves > 0 ? moves + 1 : 30) + inc * 3 / 4) * 1000;
+        if (engine_limits.usec > (left - 50) * 1000 / 2)
+            engine_limits.usec = (left - 50) * 1000 / 2;
+        if (engine_limits.usec < 1000)
+            engine_limits.usec = 1000;
+    }
+
+    // started here, so a ponderhit right after finds it running
+    if (Fin_SearchStart(&engine_board, &engine_limits) < 0)
+    {
+        printf("bestmove 0000\n");
+        return;
+    }
+    engine_searching = 1;
+#ifdef _LINUX_
+    pthread_create(&engine_thread, NULL, Engine_Think, NULL);
+#else
+    engine_thread = CreateThread(NULL, 0, Engine_Think, NULL, 0, &tid);
+#endif
+}
+
+
+/*
+ * search the positions of the benchmark with a number of threads,
+ * returns the time taken in usec
+ */
+static long long Engine_Bench(int depth, int threads, unsigned long long *nodes)
+{
+    Fin_SearchLimits limits;
+    Fin_SearchInfo info;
+    Fin_Board board;
+    long long usec = 0;
+    int i;
+
+    memset(&limits, 0, sizeof(limits));
+    limits.depth = depth;
+    limits.threads = threads;
+    *nodes = 0;
+    for (i = 0; i < (int)(sizeof(engine_bench) / sizeof(engine_bench[0])); i++)
+    {
+        Fin_SearchClear();
+        Fin_BoardSet(&board, engine_bench[i]);
+        Fin_Search(&board, &limits, &info);
+        usec += info.usec;
+        *nodes += info.nodes;
+    }
+    return(usec);
+}
+
+
+/*
+ * clock for the probes of the book, in nsec
+ */
+static long long Engine_Nsec(void)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000000 + ts.tv_nsec);
+#else
+    LARGE_INTEGER count, freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return((long long)(count.QuadPart * (1e9 / freq.QuadPart)));
+#endif
+}
+
+
+/*
+ * make a book from PGN files (none to only probe it), then time probes of
+ * positions in it, found by playing its moves, and of positions out of it
+ */
+static int Engine_Book(int argc, char *argv[])
+{
+    static unsigned long long keys[2 * ENGINE_PROBES];
+    const char *book = argv[2];
+    Fin_BookStats stats;
+    Fin_BoardMove moves[FIN_BOARD_MOVES], move;
+    Fin_Board board;
+    long long start, open;
+    int i, k, n, plies = 24, found;
+
+    if (argc > 4 && strcmp(argv[3], "-p") == 0)
+    {
+        plies = atoi(argv[4]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc > 3)
+    {
+        if (Fin_BookBuild(book, (const char *const *)argv + 3, argc - 3, plies, &stats) < 0)
+        {
+            printf("cannot make %s\n", book);
+            return(1);
+        }
+        printf("%lld games, %lld moves (%lld not understood), %lld positions taken\n",
+               stats.games, stats.moves, stats.bad, stats.positions);
+        printf("%lld entries, %lld bytes, made in %.3f s\n", stats.entries, stats.bytes, stats.usec / 1e6);
+    }
+
+    start = Engine_Nsec();
+    n = Fin_BookOpen(book);
+    open = Engine_Nsec() - start;
+    if (n < 0)
+    {
+        printf("cannot open %s\n", book);
+        return(1);
+    }
+    printf("%d entries, opened in %.1f usec\n", n, open / 1e3);
+
+    // positions of the book, playing its moves from the start, and as many out of it
+    srand(1);
+    for (k = 0; k < ENGINE_PROBES; )
+    {
+        Fin_BoardSet(&board, NULL);
+        while (k < ENGINE_PROBES && (move = Fin_BookPick(&board)) != FIN_MOVE_NONE)
+        {
+            keys[k++] = board.key;
+            Fin_BoardMake(&board, move);
+        }
+        if (board.ply == 0)
+            break;
+    }
+    if (k == 0)
+    {
+        printf("no move from the usual position\n");
+        Fin_BookClose();
+        return(0);
+    }
+    for (i = k; i < 2 * k; i++)
+        keys[i] = (unsigned long long)rand() << 40 ^ (unsigned long long)rand() << 20 ^ (unsigned long long)rand();
+
+    // a million probes in the book, then a million out of it
+    for (n = 0; n < 2; n++)
+    {
+        found = 0;
+        start = Engine_Nsec();
+        for (i = 0; i < 1000000; i++)
+            found += Fin_BookFind(keys[n * k + i % k], moves, NULL, FIN_BOARD_MOVES) > 0;
+        open = Engine_Nsec() - start;
+        printf("%s: %d of 1000000 found, %.0f nsec a probe\n", n == 0 ? "in the book" : "out of it ",
+               found, open / 1e6);
+    }
+    Fin_BookClose();
+    return(0);
+}
+
+
+/*
+ * a table built
+ */
+static void Engine_Table(const Fin_TableStats *stats)
+{
+    printf("%-6s %10lld %10lld %10lld %10lld %5d %5d %3d %9.1f %9.1f %8.2f\n", stats->name,
+           stats->positions, stats->wins, stats->losses, stats->draws, stats->longest, stats->passes,
+           stats->bits, stats->memory / 1048576.0, stats->bytes / 1024.0, stats->usec / 1e6);
+    fflush(stdout);
+}
+
+
+/*
+ * a position of the pieces of a table (KQKR) on squares at random, -1
+ * if the name is not one
+ */
+static int Engine_Ending(const char *name, Fin_Board *board)
+{
+    char squares[64], fen[100], *f;
+    const char *p;
+    int color, sq, empty, rank, file, kings = 0;
+
+    for (p = name; *p; p++)
+        kings += *p == 'K';
+    if (name[0] != 'K' || kings != 2 || strspn(name, "KQRBNP") != strlen(name) || strlen(name) > 32)
+        return(-1);
+    do
+    {
+        memset(squares, 0, sizeof(squares));
+        for (p = name, color = -1; *p; p++)
+        {
+            if (*p == 'K')
+                color = !color;
+            do
+                sq = rand() % 64;
+            while (squares[sq] || (*p == 'P' && (sq < 8 || sq >= 56)));
+            squares[sq] = color == FIN_WHITE ? *p : (char)(*p - 'A' + 'a');
+        }
+
+        f = fen;
+        for (rank = 7; rank >= 0; rank--)
+        {
+            for (file = 0, empty = 0; file < 8; file++)
+            {
+                if (squares[FIN_SQUARE(file, rank)] == 0)
+                {
+                    empty++;
+                    continue;
+                }
+                if (empty)
+                    *f++ = (char)('0' + empty);
+                empty = 0;
+                *f++ = squares[FIN_SQUARE(file, rank)];
+            }
+            if (empty)
+                *f++ = (char)('0' + empty);
+            *f++ = rank > 0 ? '/' : ' ';
+        }
+        sprintf(f, "%c - - 0 1", rand() % 2 ? 'b' : 'w');
+    }
+    while (Fin_BoardSet(board, fen) < 0);
+    return(0);
+}
+
+
+/*
+ * build endgame tables, then time probes of positions of each
+ */
+static int Engine_Tables(int argc, char *argv[])
+{
+    static Fin_Board boards[ENGINE_ENDINGS];
+    const char *dir = argv[2];
+    long long start, usec;
+    int i, k, threads = 0, plies, found;
+
+    if (argc > 4 && strcmp(argv[3], "-t") == 0)
+    {
+        threads = atoi(argv[4]);
+        argv += 2;
+        argc -= 2;
+    }
+    printf("table   positions       wins     losses      draws  mate passes bits   memory MB   file KB  seconds\n");
+    for (i = 3; i < argc; i++)
+        if (Fin_TableBuild(dir, argv[i], threads, Engine_Table) < 0)
+        {
+            printf("cannot build %s in %s\n", argv[i], dir);
+            return(1);
+        }
+
+    Fin_TableClose();
+    start = Engine_Nsec();
+    k = Fin_TableOpen(dir);
+    usec = Engine_Nsec() - start;
+    printf("%d tables, opened in %.1f usec\n", k, usec / 1e3);
+
+    // a million probes of positions of each table
+    srand(1);
+    for (i = 3; i < argc; i++)
+    {
+        for (k = 0; k < ENGINE_ENDINGS; k++)
+            if (Engine_Ending(argv[i], &boards[k]) < 0)
+                break;
+        if (k < ENGINE_ENDINGS)
+            continue;
+        found = 0;
+        start = Engine_Nsec();
+        for (k = 0; k < 1000000; k++)
+            found += Fin_TableProbe(&boards[k % ENGINE_ENDINGS], &plies) >= 0;
+        usec = Engine_Nsec() - start;
+        printf("%-6s: %d of 1000000 found, %.0f nsec a probe\n", argv[i], found, usec / 1e6);
+    }
+    Fin_TableClose();
+    return(0);
+}
+
+
+/*
+ * every position to a depth, scored from the board (how 1), worked out
+ * again (how 2) or not at all (how 0); the positions whose two scores
+ * differ are counted
+ */
+static unsigned long long Engine_Walk(Fin_Board *board, int depth, int how, long long *sum, int *wrong)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    unsigned long long nodes = 1;
+    int i, n, phase, score;
+
+    if (how == 1)
+        *sum += FIN_SCORE_MG(board->score) + FIN_SCORE_EG(board->score) + board->phase;
+    else if (how == 2)
+    {
+        score = Fin_BoardScore(board, &phase);
+        *sum += FIN_SCORE_MG(score) + FIN_SCORE_EG(score) + phase;
+        if (score != board->score || phase != board->phase)
+            (*wrong)++;
+    }
+    if (depth == 0)
+        return(nodes);
+    n = Fin_BoardMoves(board, moves);
+    for (i = 0; i < n; i++)
+    {
+        Fin_BoardMake(board, moves[i]);
+        nodes += Engine_Walk(board, depth - 1, how, sum, wrong);
+        Fin_BoardUnmake(board);
+    }
+    return(nodes);
+}
+
+
+/*
+ * time the scores kept by the moves against those worked out again
+ */
+static int Engine_Eval(int depth)
+{
+    static const char *how[3] = { "moves only", "kept", "worked out" };
+    Fin_Board board;
+    unsigned long long nodes = 0;
+    long long start, nsec[3], sum[3];
+    int i, k, wrong = 0;
+
+    for (k = 0; k < 3; k++)
+    {
+        nsec[k] = 0;
+        sum[k] = 0;
+        nodes = 0;
+        for (i = 0; i < (int)(sizeof(engine_bench) / sizeof(engine_bench[0])); i++)
+        {
+            Fin_BoardSet(&board, engine_bench[i]);
+            start = Engine_Nsec();
+            nodes += Engine_Walk(&board, depth, k, &sum[k], &wrong);
+            nsec[k] += Engine_Nsec() - start;
+        }
+    }
+    printf("%llu positions to depth %d, %d scores kept wrong\n", nodes, depth, wrong);
+    for (k = 0; k < 3; k++)
+        printf("%-10s: %6.1f nsec a position, %5.1f for the score\n", how[k], (double)nsec[k] / nodes,
+               (double)(nsec[k] - nsec[0]) / nodes);
+    if (nsec[1] > nsec[0])
+        printf("kept %.1fx faster\n", (double)(nsec[2] - nsec[0]) / (nsec[1] - nsec[0]));
+    return(sum[1] != sum[2] || wrong);
+}
+
+
+int main(int argc, char *argv[])
+{
+    char line[8192], *args;
+    unsigned long long nodes, nodes1 = 0;
+    long long usec, usec1 = 0;
+    int depth, threads, most;
+
+    Fin_BoardSet(&engine_board, NULL);
+
+    if (argc > 2 && strcmp(argv[1], "book") == 0)
+        return(Engine_Book(argc, argv));
+    if (argc > 2 && strcmp(argv[1], "tables") == 0)
+        return(Engine_Tables(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "eval") == 0)
+        return(Engine_Eval(argc > 2 ? atoi(argv[2]) : 4));
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        depth = argc > 2 ? atoi(argv[2]) : 12;
+        most = argc > 3 ? atoi(argv[3]) : Fin_SearchCores();
+        if (depth <= 0 || most <= 0)
+        {
+            printf("usage: FinchEngine bench [depth] [threads]\n");
+            return(1);
+        }
+        Fin_SearchHash(64);
+        printf("%d positions to depth %d\n", (int)(sizeof(engine_bench) / sizeof(engine_bench[0])), depth);
+        printf("threads      nodes   seconds      knps  nps/thread  speedup  efficiency\n");
+        for (threads = 1; ; threads = threads * 2 < most ? threads * 2 : most)
+        {
+            usec = Engine_Bench(depth, threads, &nodes);
+            if (threads == 1)
+            {
+                usec1 = usec;
+                nodes1 = nodes;
+            }
+            printf("%7d %10llu %9.3f %9.0f %10.0f%% %7.2fx %10.0f%%\n", threads, nodes, usec / 1e6,
+                   nodes * 1e3 / (usec > 0 ? usec : 1),
+                   100.0 * nodes / (usec > 0 ? usec : 1) / threads / (nodes1 * 1.0 / (usec1 > 0 ? usec1 : 1)),
+                   (double)usec1 / (usec > 0 ? usec : 1), 100.0 * usec1 / (usec > 0 ? usec : 1) / threads);
+            fflush(stdout);
+            if (threads == most)
+                break;
+        }
+        return(0);
+    }
+
+    // UCI
+    while (fgets(line, sizeof(line), stdin))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        args = strchr(line, ' ') ? strchr(line, ' ') + 1 : line + strlen(line);
+
+        if (strcmp(line, "uci") == 0)
+        {
+            printf("id name " ENGINE_NAME "\nid author FinchChess workshop\n");
+            printf("option name Threads type spin default 1 min 1 max %d\n", FIN_SEARCH_THREADS);
+            printf("option name Hash type spin default 16 min 1 max 4096\n");
+            printf("option name Ponder type check default false\n");
+            printf("option name BookFile type string default <empty>\n");
+            printf("option name TablePath type string default <empty>\n");
+            printf("uciok\n");
+        }
+        else if (strcmp(line, "isready") == 0)
+            printf("readyok\n");
+        else if (strncmp(line, "setoption ", 10) == 0)
+        {
+            Engine_Wait();
+            if (strstr(args, "name Threads value "))
+                engine_threads = atoi(strstr(args, "value ") + 6);
+            else if (strstr(args, "name Hash value "))
+                Fin_SearchHash(atoi(strstr(args, "value ") + 6));
+            else if (strstr(args, "name BookFile value "))
+            {
+                Fin_BookClose();
+                engine_book = Fin_BookOpen(strstr(args, "value ") + 6) > 0;
+                if (!engine_book && strcmp(strstr(args, "value ") + 6, "<empty>") != 0)
+                    printf("info string cannot open book %s\n", strstr(args, "value ") + 6);
+            }
+            else if (strstr(args, "name TablePath value "))
+            {
+                Fin_TableClose();
+                if (strcmp(strstr(args, "value ") + 6, "<empty>") != 0)
+                    printf("info string %d endgame tables\n", Fin_TableOpen(strstr(args, "value ") + 6));
+            }
+            if (engine_threads < 1)
+                engine_threads = 1;
+        }
+        else if (strcmp(line, "ucinewgame") == 0)
+        {
+            Engine_Wait();
+            Fin_SearchClear();
+        }
+        else if (strncmp(line, "position ", 9) == 0)
+        {
+            Engine_Wait();
+            Engine_Position(args);
+        }
+        else if (strncmp(line, "go", 2) == 0)
+        {
+            Engine_Wait();
+            Engine_Go(args);
+        }
+        else if (strcmp(line, "ponderhit") == 0)
+            Fin_SearchPonderHit();
+        else if (strcmp(line, "stop") == 0)
+        {
+            Fin_SearchStop();
+            Engine_Wait();
+        }
+        else if (strcmp(line, "quit") == 0)
+            break;
+        fflush(stdout);
+    }
+    Fin_SearchStop();
+    Engine_Wait();
+    return(0);
+}
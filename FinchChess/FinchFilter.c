@@ -0,0 +1,241 @@
+/*
+ * Streaming filters of the sensor readings: each sample seen by the
+ * background thread of a Finch updates the filtered values of the
+ * snapshot, next to the raw ones, at a fixed cost per sample.
+ *  - EMA: exponential moving average, the new sample weighs param percent
+ *  - median of the last param samples (up to FIN_MEDIAN_MAX), kept sorted
+ *    as samples come and go
+ *  - debounce of the obstacle bits: a change is taken once it held for
+ *    param samples in a row
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+
+/*
+ * raw values of a sensor in the snapshot, as floats
+ */
+static int Fin_FilterRaw(Fin_Sensors *snap, int sensor, float *raw)
+{
+    switch (sensor)
+    {
+    case FIN_LIGHTS:
+        raw[0] = (float)snap->lights[0];
+        raw[1] = (float)snap->lights[1];
+        return(2);
+    case FIN_OBSTACLES:
+        raw[0] = (float)snap->obstacle[0];
+        raw[1] = (float)snap->obstacle[1];
+        return(2);
+    case FIN_ACCEL:
+        memcpy(raw, snap->accel, 3 * sizeof(float));
+        return(3);
+    default:
+        raw[0] = snap->temp;
+        return(1);
+    }
+}
+
+
+/*
+ * put the filtered values in the snapshot, the obstacle bits rounded back
+ */
+static void Fin_FilterPut(Fin_Sensors *snap, int sensor, const float *value)
+{
+    switch (sensor)
+    {
+    case FIN_LIGHTS:
+        memcpy(snap->filtered.lights, value, 2 * sizeof(float));
+        break;
+    case FIN_OBSTACLES:
+        snap->filtered.obstacle[0] = value[0] >= 0.5f;
+        snap->filtered.obstacle[1] = value[1] >= 0.5f;
+        break;
+    case FIN_ACCEL:
+        memcpy(snap->filtered.accel, value, 3 * sizeof(float));
+        break;
+    default:
+        snap->filtered.temp = value[0];
+        break;
+    }
+}
+
+
+/*
+ * move the window of a median filter by one sample, keeping it sorted
+ */
+static float Fin_Median(struct fin_filter *filter, int channel, float raw)
+{
+    float *sorted = filter->sorted[channel];
+    int count = filter->filled;
+    float old;
+    int i;
+
+    // take the oldest sample out once the window is full
+    if (count == filter->param)
+    {
+        old = filter->window[channel][filter->pos];
+        for (i = 0; sorted[i] != old; i++)
+            ;
+        for (count--; i < count; i++)
+            sorted[i] = sorted[i + 1];
+    }
+    filter->window[channel][filter->pos] = raw;
+
+    // and put the new one in its place
+    for (i = count; i > 0 && sorted[i - 1] > raw; i--)
+        sorted[i] = sorted[i - 1];
+    sorted[i] = raw;
+    count++;
+
+    if (count % 2)
+        return(sorted[count / 2]);
+    return((sorted[count / 2 - 1] + sorted[count / 2]) / 2);
+}
+
+
+/*
+ * run a new sample of a sensor through its filter
+ */
+static void Fin_FilterRun(struct fin_filter *filter, Fin_Sensors *snap, int sensor)
+{
+    float raw[3];
+    float *value = filter->value;
+    int channels;
+    int i;
+
+    channels = Fin_FilterRaw(snap, sensor, raw);
+    for (i = 0; i < channels; i++)
+    {
+        switch (filter->kind)
+        {
+        case FIN_FILTER_EMA:
+            if (filter->filled == 0)
+                filter->state[i] = raw[i];
+            else
+                filter->state[i] += (raw[i] - filter->state[i]) * filter->param / 100;
+            value[i] = filter->state[i];
+            break;
+        case FIN_FILTER_MEDIAN:
+            value[i] = Fin_Median(filter, i, raw[i]);
+            break;
+        case FIN_FILTER_DEBOUNCE:
+            if (filter->filled == 0 || raw[i] == filter->state[i] ||
+                ++filter->held[i] >= filter->param)
+            {
+                filter->state[i] = raw[i];
+                filter->held[i] = 0;
+            }
+            value[i] = filter->state[i];
+            break;
+        default:
+            value[i] = raw[i];
+            break;
+        }
+    }
+
+    if (filter->kind == FIN_FILTER_MEDIAN)
+    {
+        filter->pos = (filter->pos + 1) % filter->param;
+        if (filter->filled < filter->param)
+            filter->filled++;
+    }
+    else
+        filter->filled = 1;
+    Fin_FilterPut(snap, sensor, value);
+}
+
+
+/*
+ * a sensor was sampled, update its filtered values,
+ * called by the background thread with the device locked
+ */
+void Fin_FilterSample(struct fin_dev *dev, int sensor)
+{
+    // when attached the filters take the samples of the daemon instead
+    if (!dev->attached)
+        Fin_FilterRun(&dev->filter[sensor], &dev->snap, sensor);
+}
+
+
+/*
+ * filter a snapshot published by the daemon, which filters nothing:
+ * each sensor sampled since the last snapshot is one sample, the ones
+ * the daemon saw in between are not seen here
+ */
+void Fin_FilterShared(struct fin_dev *dev, Fin_Sensors *snap)
+{
+    struct fin_filter *filter;
+    int sensor;
+
+    Fin_Lock(&dev->lock);
+    for (sensor = 0; sensor < FIN_SENSORS; sensor++)
+    {
+        filter = &dev->filter[sensor];
+        if (filter->kind == FIN_FILTER_NONE || snap->when[sensor] == 0)
+            continue;
+        if (snap->when[sensor] != filter->at)
+        {
+            filter->at = snap->when[sensor];
+            Fin_FilterRun(filter, snap, sensor);
+        }
+        else
+            Fin_FilterPut(snap, sensor, filter->value);
+    }
+    Fin_Unlock(&dev->lock);
+}
+
+
+/**  Fin_Filter(sensor, kind, param).
+ *  filter the readings of a sensor in the snapshot
+ *
+ *  input:
+ *     int sensor = FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *     int kind = FIN_FILTER_NONE,
+ *                FIN_FILTER_EMA (not for obstacles), param = weight of a new sample in %
+ *                FIN_FILTER_MEDIAN, param = samples in the window (2 to FIN_MEDIAN_MAX)
+ *                FIN_FILTER_DEBOUNCE (obstacles), param = samples a change must hold
+ *  when attached to the daemon the samples are those of the snapshots taken
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Filter(int sensor, int kind, int param)
+{
+    struct fin_dev *dev = Fin_Dev();
+    struct fin_filter *filter;
+
+    if (sensor < 0 || sensor >= FIN_SENSORS)
+        return(-1);
+    switch (kind)
+    {
+    case FIN_FILTER_NONE:
+        break;
+    case FIN_FILTER_EMA:
+        if (sensor == FIN_OBSTACLES || param < 1 || param > 100)
+            return(-1);
+        break;
+    case FIN_FILTER_MEDIAN:
+        if (param < 2 || param > FIN_MEDIAN_MAX)
+            return(-1);
+        break;
+    case FIN_FILTER_DEBOUNCE:
+        if (sensor != FIN_OBSTACLES || param < 1)
+            return(-1);
+        break;
+    default:
+        return(-1);
+    }
+
+    Fin_Lock(&dev->lock);
+    filter = &dev->filter[sensor];
+    memset(filter, 0, sizeof(*filter));
+    filter->kind = kind;
+    filter->param = param;
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
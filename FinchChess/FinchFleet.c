@@ -0,0 +1,375 @@
+/*
+ * Fleet of Finches: the same program drives every robot plugged in, and
+ * commands staged for several robots are released together.
+ *
+ * The staged commands are encoded beforehand and handed to the background
+ * thread of each robot with a common release time; each thread sleeps until
+ * just before it, spins the last moments and writes its commands, so the
+ * robots get them in parallel instead of one after the other.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#define FIN_FLEET_CMNDS  4          // commands staged per robot and release
+
+/*
+ * command staged for a robot
+ */
+struct fin_fleet_req
+{
+    struct fin_req req;
+    struct fin_dev *dev;
+    long long usec;                 // how long the wheels turn after the release, 0 for ever
+    int left;
+    int right;
+};
+
+static struct fin_dev *fin_fleet[FIN_FLEET];        // robots of the fleet
+static int fin_fleet_owned[FIN_FLEET];              // opened by the fleet (not Fin_Init)
+static int fin_fleet_count = 0;
+static struct fin_fleet_req fin_staged[FIN_FLEET][FIN_FLEET_CMNDS];
+static int fin_staged_count[FIN_FLEET];
+static Fin_FleetStats fin_fleet_stats;
+
+
+/*
+ * a staged wheel command went out, time the stop from the release,
+ * called by the background thread with the device locked
+ */
+static void Fin_FleetMoved(struct fin_req *req)
+{
+    struct fin_fleet_req *fleet_req = (struct fin_fleet_req *)req;
+    struct fin_dev *dev = fleet_req->dev;
+
+    if (req->res > 0)
+    {
+        dev->left_speed = fleet_req->left;
+        dev->right_speed = fleet_req->right;
+        dev->stop_at = fleet_req->usec > 0 ? dev->released + fleet_req->usec : 0;
+        Fin_Wake(dev);
+    }
+    Fin_Broadcast(&dev->done);
+}
+
+
+/*
+ * stage a command for one robot, or all of them for -1
+ */
+static int Fin_FleetStage(int robot, char cmnd, const unsigned char *args, long long usec,
+                          int left, int right)
+{
+    struct fin_fleet_req *fleet_req;
+    int first = robot, last = robot;
+    int i;
+
+    if (robot == -1)
+    {
+        first = 0;
+        last = fin_fleet_count - 1;
+    }
+    if (first < 0 || last >= fin_fleet_count || fin_fleet_count == 0)
+        return(-1);
+
+    for (i = first; i <= last; i++)
+    {
+        if (fin_staged_count[i] == FIN_FLEET_CMNDS)
+            return(-1);
+        fleet_req = &fin_staged[i][fin_staged_count[i]++];
+        memset(fleet_req, 0, sizeof(*fleet_req));
+        fleet_req->req.buffer[1] = cmnd;
+        memcpy(&fleet_req->req.buffer[2], args, 6);
+        fleet_req->req.flag = SEND;
+        fleet_req->dev = fin_fleet[i];
+        fleet_req->usec = usec;
+        fleet_req->left = left;
+        fleet_req->right = right;
+        if (cmnd == 'M')
+            fleet_req->req.complete = Fin_FleetMoved;
+    }
+    return(1);
+}
+
+
+/**  Fin_FleetOpen(void).
+ *  make a fleet of the Finch opened by Fin_Init and every other one plugged in
+ *
+ *  input:
+ *     none
+ *  returns
+ *     the number of robots, -1 if failure
+ */
+int Fin_FleetOpen(void)
+{
+    struct hid_device_info *devs, *info;
+    struct fin_dev *dev;
+
+    // the daemon owns the robots, a simulation has only one
+    if (Fin_Attached() || Fin_Virtual() || fin_fleet_count != 0)
+        return(-1);
+
+    dev = Fin_Dev();
+    if (dev->running)
+        fin_fleet[fin_fleet_count++] = dev;
+
+    devs = hid_enumerate(FIN_VID, FIN_PID);
+    for (info = devs; info != NULL && fin_fleet_count < FIN_FLEET; info = info->next)
+    {
+        if (Fin_PathInUse(NULL, info->path))
+            continue;
+        dev = malloc(sizeof(*dev));
+        if (dev == 0 || Fin_DevOpen(dev, info->path) < 0)
+        {
+            free(dev);
+            continue;
+        }
+        fin_fleet_owned[fin_fleet_count] = 1;
+        fin_fleet[fin_fleet_count++] = dev;
+    }
+    hid_free_enumeration(devs);
+
+    memset(fin_staged_count, 0, sizeof(fin_staged_count));
+    memset(&fin_fleet_stats, 0, sizeof(fin_fleet_stats));
+    return(fin_fleet_count > 0 ? fin_fleet_count : -1);
+}
+
+
+/**  Fin_FleetClose(void).
+ *  send the robots opened by the fleet back to idle mode and close them
+ *
+ *  input:
+ *     none
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetClose(void)
+{
+    unsigned char IoBuffer[9];
+    int i;
+
+    for (i = 0; i < fin_fleet_count; i++)
+    {
+        if (!fin_fleet_owned[i])
+            continue;
+        Fin_DevCmnd(fin_fleet[i], SEND, 'R', IoBuffer);
+        Fin_DevClose(fin_fleet[i]);
+        free(fin_fleet[i]);
+        fin_fleet_owned[i] = 0;
+    }
+    fin_fleet_count = 0;
+    return(1);
+}
+
+
+/**  Fin_FleetMotor(robot, tenth, left, right).
+ *  stage a wheel command, sent at the next Fin_FleetGo
+ *
+ *  input:
+ *     int robot = robot of the fleet, -1 for all of them
+ *     int tenth, left, right = as for Fin_Motor
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetMotor(int robot, int tenth, int left, int right)
+{
+    unsigned char args[6] = { 0 };
+
+    if (left == 0 && right == 0)
+        tenth = 0;
+    args[0] = left < 0;
+    args[1] = (char)(left < 0 ? -left : left);
+    args[2] = right < 0;
+    args[3] = (char)(right < 0 ? -right : right);
+    return(Fin_FleetStage(robot, 'M', args, tenth > 0 ? tenth * 100000LL : 0, left, right));
+}
+
+
+/**  Fin_FleetLED(robot, red, green, blue).
+ *  stage a beak command, sent at the next Fin_FleetGo
+ *
+ *  input:
+ *     int robot = robot of the fleet, -1 for all of them
+ *     int red, green, blue = as for Fin_LED
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetLED(int robot, int red, int green, int blue)
+{
+    unsigned char args[6] = { 0 };
+
+    args[0] = (char)red;
+    args[1] = (char)green;
+    args[2] = (char)blue;
+    return(Fin_FleetStage(robot, 'O', args, 0, 0, 0));
+}
+
+
+/**  Fin_FleetGo(msec).
+ *  release the staged commands on every robot at once, msec from now,
+ *  and wait until they are sent
+ *
+ *  input:
+ *     int msec = delay before the release, enough for every robot to be ready
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetGo(int msec)
+{
+    long long release = Fin_Usec() + msec * 1000LL;
+    long long first = 0, last = 0;
+    struct fin_dev *dev;
+    int robots = 0;
+    int res = 1;
+    int i, j;
+
+    // hand the commands to each robot
+    for (i = 0; i < fin_fleet_count; i++)
+    {
+        dev = fin_fleet[i];
+        Fin_Lock(&dev->lock);
+        if (dev->lost || !dev->running)
+        {
+            Fin_Unlock(&dev->lock);
+            fin_staged_count[i] = 0;
+            res = -1;
+            continue;
+        }
+        for (j = fin_staged_count[i] - 1; j >= 0; j--)
+        {
+            fin_staged[i][j].req.buffer[0] = 0x00;
+            fin_staged[i][j].req.cmnd = fin_staged[i][j].req.buffer[1];
+            fin_staged[i][j].req.lane = FIN_LANE_ACTUATOR;
+            fin_staged[i][j].req.done = 0;
+            fin_staged[i][j].req.next = dev->staged;
+            dev->staged = &fin_staged[i][j].req;
+        }
+        dev->release_at = release;
+        Fin_Wake(dev);
+        Fin_Unlock(&dev->lock);
+    }
+
+    // wait for them to be sent, and see how far apart they went out
+    for (i = 0; i < fin_fleet_count; i++)
+    {
+        if (fin_staged_count[i] == 0)
+            continue;
+        dev = fin_fleet[i];
+        Fin_Lock(&dev->lock);
+        for (j = 0; j < fin_staged_count[i]; j++)
+            while (!fin_staged[i][j].req.done)
+                Fin_Wait(&dev->done, &dev->lock);
+        if (fin_staged[i][0].req.res > 0)
+        {
+            if (robots == 0 || dev->released < first)
+                first = dev->released;
+            if (robots == 0 || dev->released > last)
+                last = dev->released;
+            robots++;
+        }
+        else
+            res = -1;
+        Fin_Unlock(&dev->lock);
+        fin_staged_count[i] = 0;
+    }
+
+    fin_fleet_stats.releases++;
+    fin_fleet_stats.robots = robots;
+    fin_fleet_stats.skew_usec = (long)(last - first);
+    fin_fleet_stats.late_usec = robots ? (long)(last - release) : 0;
+    if (fin_fleet_stats.skew_usec > fin_fleet_stats.max_skew_usec)
+        fin_fleet_stats.max_skew_usec = fin_fleet_stats.skew_usec;
+    return(res);
+}
+
+
+/**  Fin_FleetStatus(*stats).
+ *  get how far apart the robots started at the last release
+ *
+ *  input:
+ *     Fin_FleetStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetStatus(Fin_FleetStats *stats)
+{
+    *stats = fin_fleet_stats;
+    return(1);
+}
+
+
+/**  Fin_FleetAnimate(robot, *keys, count, fps, loops).
+ *  animate the beaks of the fleet in step, from 20 msec from now
+ *
+ *  input:
+ *     int robot = robot of the fleet, -1 for all of them
+ *     Fin_Key *keys, int count, int fps, int loops = as for Fin_Animate
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetAnimate(int robot, const Fin_Key *keys, int count, int fps, int loops)
+{
+    long long start = Fin_Usec() + 20000;
+    int first = robot, last = robot;
+    int res = 1;
+    int i;
+
+    if (robot == -1)
+    {
+        first = 0;
+        last = fin_fleet_count - 1;
+    }
+    if (first < 0 || last >= fin_fleet_count || fin_fleet_count == 0)
+        return(-1);
+
+    for (i = first; i <= last; i++)
+        if (Fin_DevAnimate(fin_fleet[i], keys, count, fps, loops, start) < 0)
+            res = -1;
+    return(res);
+}
+
+
+/**  Fin_FleetAnimateStatus(robot, *stats).
+ *  get the frames sent and skipped by the animation of a robot
+ *
+ *  input:
+ *     int robot = robot of the fleet, -1 for the sum of all of them
+ *     Fin_TrackStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FleetAnimateStatus(int robot, Fin_TrackStats *stats)
+{
+    Fin_TrackStats one;
+    long long total = 0;
+    int i;
+
+    if (robot >= 0 && robot < fin_fleet_count)
+    {
+        Fin_TrackStatus(fin_fleet[robot], FIN_TRACK_LED, stats);
+        return(1);
+    }
+    if (robot != -1 || fin_fleet_count == 0)
+        return(-1);
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < fin_fleet_count; i++)
+    {
+        Fin_TrackStatus(fin_fleet[i], FIN_TRACK_LED, &one);
+        if (one.playing > stats->playing)
+            stats->playing = one.playing;
+        stats->sent += one.sent;
+        stats->skipped += one.skipped;
+        stats->dropped += one.dropped;
+        stats->last_usec = one.last_usec;
+        if (one.max_usec > stats->max_usec)
+            stats->max_usec = one.max_usec;
+        total += (long long)one.avg_usec * one.sent;
+    }
+    if (stats->sent > 0)
+        stats->avg_usec = (long)(total / stats->sent);
+    return(1);
+}
@@ -0,0 +1,199 @@
+/*
+ * Flow control of the commands sent to a Finch: the background thread
+ * only sends a command when the token bucket of the device has one, so a
+ * burst waits in the queues instead of being pushed at a robot that cannot
+ * take it. The rate is learned as the commands go: it grows a little with
+ * each command taken, and drops by a quarter when a write is refused or
+ * the round trip gets much longer than usual. Fin_Calibrate measures the
+ * rate a robot sustains, which is remembered for the next runs and caps
+ * what is learned.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+
+/*
+ * line of the cache file with the rate of a robot, -1 if it has no
+ * path to tell it from the others (simulated, or attached to the daemon)
+ */
+static int Fin_FlowKey(struct fin_dev *dev, char *key, int size)
+{
+    if (dev->path[0] == 0)
+        return(-1);
+    snprintf(key, size, "rate %s", dev->path);
+    return(0);
+}
+
+
+/*
+ * start the bucket of a device just opened, with the rate calibrated
+ * by an earlier run if there is one
+ */
+void Fin_FlowInit(struct fin_dev *dev)
+{
+    char key[300];
+    char value[32];
+    int rate = 0;
+
+    if (Fin_FlowKey(dev, key, sizeof(key)) == 0 && Fin_CacheLoad(key, value, sizeof(value)) == 0)
+        rate = atoi(value);
+
+    dev->flow_stats.calibrated = rate >= FIN_RATE_MIN ? rate : 0;
+    dev->rate_max = dev->flow_stats.calibrated ? rate : FIN_RATE_MAX;
+    dev->rate = dev->flow_stats.calibrated ? rate : FIN_RATE_DEFAULT;
+    dev->tokens = FIN_BURST;
+    dev->filled_at = Fin_Usec();
+}
+
+
+/*
+ * see if a command may go now, else when (pending if one of the
+ * program is queued), called by the background thread with the device locked
+ */
+int Fin_FlowReady(struct fin_dev *dev, long long now, int pending, long long *wake)
+{
+    long long at;
+
+    // the daemon keeps to the rate of the robot itself
+    if (dev->attached || dev->calibrating || dev->rate == 0)
+        return(1);
+
+    dev->tokens += (now - dev->filled_at) * dev->rate / 1000000;
+    if (dev->tokens > FIN_BURST)
+        dev->tokens = FIN_BURST;
+    dev->filled_at = now;
+    if (dev->tokens >= 1)
+        return(1);
+
+    at = now + (long long)((1 - dev->tokens) * 1000000 / dev->rate) + 1;
+    if (at < *wake)
+        *wake = at;
+    if (pending)
+        dev->flow_stats.throttled++;
+    return(0);
+}
+
+
+/*
+ * a command went out, take its token and adjust the rate,
+ * called by the background thread with the device locked
+ */
+void Fin_FlowSent(struct fin_dev *dev, int flag, long long sent, long long recv)
+{
+    long long rtt = recv - sent;
+
+    if (dev->attached || dev->rate == 0)
+        return;
+
+    // commands sent ahead of their turn (stops) are paid later
+    if (dev->tokens > -FIN_BURST)
+        dev->tokens -= 1;
+
+    if (flag == SEND_RECV && (dev->rtt_best == 0 || rtt < dev->rtt_best))
+        dev->rtt_best = rtt;
+
+    // the Finch could not keep up, or the link is queuing: cut the rate,
+    // once for the whole burst that did it
+    if (dev->refused != dev->refused_seen || (flag == SEND_RECV && rtt > 3 * dev->rtt_best))
+    {
+        dev->refused_seen = dev->refused;
+        dev->tokens = 0;
+        if (recv - dev->cut_at >= FIN_RATE_CUT)
+        {
+            dev->rate *= 0.75;
+            dev->cut_at = recv;
+        }
+    }
+    else if (!dev->calibrating)
+        dev->rate += 1;
+
+    if (dev->rate < FIN_RATE_MIN)
+        dev->rate = FIN_RATE_MIN;
+    if (dev->rate > dev->rate_max)
+        dev->rate = dev->rate_max;
+    dev->flow_stats.rate = (int)dev->rate;
+    dev->flow_stats.refused = dev->refused;
+}
+
+
+/**  Fin_FlowStatus(*stats).
+ *  get the rate the commands are sent at
+ *
+ *  input:
+ *     Fin_FlowStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_FlowStatus(Fin_FlowStats *stats)
+{
+    struct fin_dev *dev = Fin_Dev();
+
+    Fin_Lock(&dev->lock);
+    dev->flow_stats.rate = (int)dev->rate;
+    *stats = dev->flow_stats;
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
+
+
+/**  Fin_Calibrate(msec).
+ *  measure how many commands per second the Finch takes
+ *  and remember it for the next runs (of a robot opened by its path)
+ *
+ *  input:
+ *     int msec = duration of the measure
+ *  returns
+ *     the commands per second, -1 if failure
+ */
+int Fin_Calibrate(int msec)
+{
+    struct fin_dev *dev = Fin_Dev();
+    unsigned char IoBuffer[9];
+    long long start, elapsed;
+    char key[300];
+    char value[32];
+    int count = 0;
+    int rate;
+
+    if (dev->attached || msec <= 0)
+        return(-1);
+
+    // the bucket is open while the Finch is given the same beak color
+    // as fast as it takes it
+    Fin_Lock(&dev->lock);
+    dev->calibrating = 1;
+    memcpy(&IoBuffer[2], dev->led, 3);
+    Fin_Unlock(&dev->lock);
+    start = Fin_Usec();
+    while ((elapsed = Fin_Usec() - start) < msec * 1000LL)
+    {
+        if (Fin_DevCmnd(dev, SEND, 'O', IoBuffer) <= 0)
+            break;
+        count++;
+    }
+    rate = elapsed > 0 ? (int)(count * 1000000LL / elapsed) : 0;
+
+    Fin_Lock(&dev->lock);
+    dev->calibrating = 0;
+    if (rate >= FIN_RATE_MIN)
+    {
+        dev->flow_stats.calibrated = rate;
+        dev->rate_max = rate;
+        dev->rate = rate;
+    }
+    Fin_Unlock(&dev->lock);
+    if (rate < FIN_RATE_MIN)
+        return(-1);
+
+    if (Fin_FlowKey(dev, key, sizeof(key)) == 0)
+    {
+        snprintf(value, sizeof(value), "%d", rate);
+        Fin_CacheSave(key, value);
+    }
+    return(rate);
+}
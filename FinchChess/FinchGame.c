@@ -0,0 +1,244 @@
+/*
+ * Chess game of a robot: the robot's moves come from the search
+ * (FinchSearch.c), and while the robot carries one out and the other
+ * side thinks, the search goes on in the background on the reply it
+ * expects (pondering). When that reply is played the search in progress
+ * becomes the robot's own, the time it spent pondering already counted,
+ * so the next move is often ready at once; any other reply stops it, and
+ * what it left in the transposition table speeds up the new search.
+ * With no reply expected the position is searched for the other side,
+ * which fills the table all the same. While the book open (FinchBook.c)
+ * has a move, the robot plays it without thinking.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+#include "FinchBoard.h"
+
+/*
+ * the game in progress
+ */
+static struct
+{
+    int started;
+    Fin_Board board;
+    Fin_Board ahead;                // position pondered on
+    Fin_SearchLimits limits;
+    int ponder;                     // ponder between the moves of the robot
+    int searching;                  // a search was started and not waited for
+    int pondering;                  // it is pondering, the reply has not come yet
+    long long ponder_at;            // when it started
+    Fin_GameStats stats;
+} fin_game;
+
+
+/*
+ * ponder on the reply expected after a move of the robot
+ */
+static void Fin_GamePonder(Fin_BoardMove expected)
+{
+    Fin_SearchLimits limits = fin_game.limits;
+
+    fin_game.ahead = fin_game.board;
+    fin_game.stats.expected = FIN_MOVE_NONE;
+    if (expected != FIN_MOVE_NONE && Fin_BoardMake(&fin_game.ahead, expected) == 0)
+        fin_game.stats.expected = expected;
+
+    limits.ponder = 1;
+    limits.report = NULL;
+    if (Fin_SearchStart(&fin_game.ahead, &limits) == 0)
+    {
+        fin_game.searching = 1;
+        fin_game.pondering = 1;
+        fin_game.ponder_at = Fin_WallUsec();
+    }
+}
+
+
+/*
+ * stop the search in progress, if any, and forget it
+ */
+static void Fin_GameDrop(void)
+{
+    Fin_SearchInfo info;
+
+    if (!fin_game.searching)
+        return;
+    Fin_SearchStop();
+    Fin_SearchWait(&info);
+    fin_game.searching = 0;
+    fin_game.pondering = 0;
+}
+
+
+/**  Fin_GameStart(*fen, usec, threads, ponder).
+ *  start a game of the robot
+ *
+ *  input:
+ *     const char *fen = position to start from, NULL for the usual one
+ *     long long usec = time the robot thinks each move
+ *     int threads = of the search, 0 for all the cores but one
+ *     int ponder = 1 to ponder while the robot moves and the other side thinks
+ *  returns
+ *     -1 if failure
+ */
+int Fin_GameStart(const char *fen, long long usec, int threads, int ponder)
+{
+    Fin_GameEnd();
+    if (Fin_BoardSet(&fin_game.board, fen) < 0)
+        return(-1);
+    Fin_SearchClear();
+
+    memset(&fin_game.limits, 0, sizeof(fin_game.limits));
+    fin_game.limits.usec = usec;
+    // a core is left for the background thread of the library
+    fin_game.limits.threads = threads > 0 ? threads : Fin_SearchCores() - 1;
+    if (fin_game.limits.threads < 1)
+        fin_game.limits.threads = 1;
+    fin_game.ponder = ponder;
+    memset(&fin_game.stats, 0, sizeof(fin_game.stats));
+    fin_game.started = 1;
+    return(0);
+}
+
+
+/**  Fin_GameMove(*text).
+ *  the move of the robot, then pondering starts in the background
+ *
+ *  input:
+ *     char *text = where to return the move, 6 characters (e2e4, e7e8q)
+ *  returns
+ *     -1 if failure, 0 if the game is over (no legal move)
+ */
+int Fin_GameMove(char *text)
+{
+    Fin_SearchInfo info;
+    Fin_BoardMove book;
+    long long start = Fin_WallUsec(), think;
+
+    if (!fin_game.started || fin_game.pondering)
+        return(-1);
+
+    // the reply pondered on was played, the search goes on, else the book or a new one
+    if (fin_game.searching)
+    {
+        Fin_SearchWait(&info);
+        fin_game.searching = 0;
+    }
+    else if ((book = Fin_BookPick(&fin_game.board)) != FIN_MOVE_NONE)
+    {
+        memset(&info, 0, sizeof(info));
+        info.move = book;
+        fin_game.stats.book++;
+    }
+    else if (Fin_Search(&fin_game.board, &fin_game.limits, &info) < 0)
+        return(-1);
+
+    think = Fin_WallUsec() - start;
+    fin_game.stats.think_usec += think;
+    if (think > fin_game.stats.think_max)
+        fin_game.stats.think_max = think;
+    fin_game.stats.depth = info.depth;
+    fin_game.stats.score = info.score;
+    if (info.move == FIN_MOVE_NONE)
+        return(0);
+
+    if (Fin_BoardMake(&fin_game.board, info.move) < 0)
+        return(-1);
+    Fin_BoardText(info.move, text);
+    fin_game.stats.moves++;
+    if (fin_game.ponder)
+        Fin_GamePonder(info.ponder);
+    return(1);
+}
+
+
+/**  Fin_GameReply(*text).
+ *  the move of the other side
+ *
+ *  input:
+ *     const char *text = the move (e2e4, e7e8q)
+ *  returns
+ *     -1 if it is not a legal move
+ */
+int Fin_GameReply(const char *text)
+{
+    Fin_BoardMove move;
+
+    if (!fin_game.started)
+        return(-1);
+    move = Fin_BoardParse(&fin_game.board, text);
+    if (move == FIN_MOVE_NONE)
+        return(-1);
+
+    if (fin_game.pondering)
+    {
+        fin_game.stats.ponder_usec += Fin_WallUsec() - fin_game.ponder_at;
+        if (move == fin_game.stats.expected)
+        {
+            fin_game.pondering = 0;
+            fin_game.stats.hits++;
+            Fin_SearchPonderHit();
+        }
+        else
+        {
+            if (fin_game.stats.expected != FIN_MOVE_NONE)
+                fin_game.stats.misses++;
+            Fin_GameDrop();
+        }
+        fin_game.stats.expected = FIN_MOVE_NONE;
+    }
+
+    if (Fin_BoardMake(&fin_game.board, move) < 0)
+    {
+        Fin_GameDrop();
+        return(-1);
+    }
+    return(1);
+}
+
+
+/**  Fin_GameBoard(void).
+ *  the position of the game
+ *
+ *  returns
+ *     the board, NULL if no game was started
+ */
+const Fin_Board *Fin_GameBoard(void)
+{
+    return(fin_game.started ? &fin_game.board : NULL);
+}
+
+
+/**  Fin_GameStatus(*stats).
+ *  how the game goes
+ *
+ *  input:
+ *     Fin_GameStats *stats = pointer where to return it
+ *  returns
+ *     -1 if no game was started
+ */
+int Fin_GameStatus(Fin_GameStats *stats)
+{
+    if (!fin_game.started)
+        return(-1);
+    *stats = fin_game.stats;
+    return(1);
+}
+
+
+/**  Fin_GameEnd(void).
+ *  end the game, stopping the search in progress
+ *
+ *  returns
+ *     none
+ */
+void Fin_GameEnd(void)
+{
+    Fin_GameDrop();
+    fin_game.started = 0;
+}
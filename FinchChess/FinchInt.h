@@ -0,0 +1,400 @@
+#ifndef FINCHINT_H
+#define FINCHINT_H
+
+/*
+ * Internal interface shared by the modules of the Finch library
+ * (Finch.c, FinchClient.c, FinchClock.c, FinchCo.c, FinchConsole.c,
+ * FinchFilter.c, FinchFleet.c, FinchFlow.c, FinchMaze.c, FinchPath.c,
+ * FinchPoll.c, FinchPose.c, FinchReflex.c, FinchSim.c, FinchTrack.c)
+ * and the Finch daemon (FinchDaemon.c) and batch runner (FinchBatch.c).
+ * Robot programs should only include Finch.h.
+ */
+
+#include "Finch.h"
+#include "hidapi.h"
+
+#ifdef _LINUX_
+#include <pthread.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#include <conio.h>                  // kbhit
+#endif
+
+/* USB ids of the Finch */
+#define FIN_VID    0x2354
+#define FIN_PID    0x1111
+
+/* to be used with Fin_Cmnd */
+#define SEND       0                // command does not have a response
+#define SEND_RECV  1                // response is expected
+
+/* keep-alive period, the Finch times out after five seconds without commands */
+#define FIN_KEEPALIVE  2000000      // usec
+
+/* round trip of the link measured every second while sensors are read */
+#define FIN_PROBE      1000000      // usec
+
+/* fleet commands are released by spinning the last usec before the release time,
+   the waits of Windows are much coarser */
+#ifdef _LINUX_
+#define FIN_RELEASE_SPIN  2000
+#else
+#define FIN_RELEASE_SPIN  20000
+#endif
+
+/* timed commands (FinchTrack.c): the link is kept free this long before each one,
+   and those more than FIN_TRACK_LATE behind (after a reconnect) are dropped */
+#define FIN_TRACK_GUARD  2000       // usec
+#define FIN_TRACK_LATE   50000
+
+/* tracks of timed commands per device */
+#define FIN_TRACK_BUZZER 0          // Fin_Melody
+#define FIN_TRACK_LED    1          // Fin_Animate
+#define FIN_TRACKS       2
+
+/* flow control (FinchFlow.c): commands per second let through before the rate
+   is learned or calibrated, the range it is learned in, and the burst allowed */
+#define FIN_RATE_DEFAULT 500
+#define FIN_RATE_MIN     50
+#define FIN_RATE_MAX     2000
+#define FIN_BURST        8
+#define FIN_RATE_CUT     100000     // usec, the rate is cut at most once in this time
+
+/* simulated Finch (FinchSim.c): the robot is a disk with the wheels FIN_SIM_AXLE
+   apart, the obstacle sensors look FIN_SIM_RANGE ahead, FIN_SIM_SENSOR to each side */
+#define FIN_SIM_SPEED    0.30       // m/s at speed 255
+#define FIN_SIM_AXLE     0.10       // meters
+#define FIN_SIM_RADIUS   0.08       // meters
+#define FIN_SIM_RANGE    0.10       // meters
+#define FIN_SIM_SENSOR   0.35       // radians
+#define FIN_SIM_CELL     0.25       // meters a cell of a maze, unless the file tells
+#define FIN_SIM_AMBIENT  100        // light everywhere without a light file (0-255)
+#define FIN_SIM_TEMP     25.0       // celsius
+#define FIN_SIM_LINK     1000       // usec of virtual time a write, or a read, takes
+#define FIN_SIM_STEP     5000       // usec, the robot is moved in steps this long
+
+/* pose estimate (FinchPose.c): variance added per meter driven and per radian
+   turned, heading drift per meter, and the cues of the accelerometer */
+#define FIN_POSE_SLIP    0.0025     // m^2 a meter
+#define FIN_POSE_TURN    0.01       // rad^2 a radian
+#define FIN_POSE_DRIFT   0.005      // rad^2 a meter
+#define FIN_POSE_FLAT    0.7        // g, less on z is off the floor
+#define FIN_POSE_BUMP    0.05       // m, uncertainty added by a hit
+#define FIN_POSE_MOVED   0.5        // m, by being put back on the floor
+#define FIN_POSE_FREED   0.05       // radians turned away from a hit that free the robot
+
+/* maze engine (FinchMaze.c): wheel speed it drives at (the robot taken to move as
+   the simulator has it), distance of the cells with no way to the goal, largest maze */
+#define FIN_MAZE_WHEEL   150
+#define FIN_MAZE_FAR     0x3fffffff
+#define FIN_MAZE_MAX     (4096 * 4096)
+
+/* paths of a fleet (FinchPath.c): largest grid times ticks, ticks a robot is
+   given to leave its cell before the robots planned earlier come through it */
+#define FIN_PATH_MAX     (1 << 26)
+#define FIN_PATH_LEAVE   4
+
+/* virtual time when the virtual clock starts (FinchClock.c) */
+#define FIN_CLOCK_EPOCH  1000000    // usec
+
+/* reflex rules per device */
+#define FIN_REFLEXES     16
+
+/* usec between two samples of a watched sensor (FinchPoll.c) */
+#define FIN_POLL_FAST    10000      // obstacles and lights at full speed
+#define FIN_POLL_SLOW    50000      // obstacles and lights at low speed, accel while moving
+#define FIN_POLL_IDLE    1000000    // obstacles and lights while parked
+#define FIN_POLL_TEMP    2000000    // temperature
+#define FIN_POLL_WINDOW  1000000    // rates are measured over one second
+
+/* state kept for each program thread (the device and clock in use) */
+#define FIN_TLS  __thread
+
+/* locking between the program and the background threads */
+#ifdef _LINUX_
+typedef pthread_mutex_t fin_mutex;
+typedef pthread_cond_t fin_cond;
+#define Fin_MutexInit(m)    pthread_mutex_init(m, NULL)
+#define Fin_MutexFree(m)    pthread_mutex_destroy(m)
+#define Fin_Lock(m)         pthread_mutex_lock(m)
+#define Fin_Unlock(m)       pthread_mutex_unlock(m)
+#define Fin_CondWait(c, m)  pthread_cond_wait(c, m)
+#define Fin_CondBroadcast(c) pthread_cond_broadcast(c)
+#else
+typedef CRITICAL_SECTION fin_mutex;
+typedef CONDITION_VARIABLE fin_cond;
+#define Fin_MutexInit(m)    InitializeCriticalSection(m)
+#define Fin_MutexFree(m)    DeleteCriticalSection(m)
+#define Fin_Lock(m)         EnterCriticalSection(m)
+#define Fin_Unlock(m)       LeaveCriticalSection(m)
+#define Fin_CondWait(c, m)  SleepConditionVariableCS(c, m, INFINITE)
+#define Fin_CondBroadcast(c) WakeAllConditionVariable(c)
+#endif
+
+/*
+ * a command waiting in the scheduler of a device
+ */
+struct fin_req
+{
+    struct fin_req *next;
+    int flag;                       // SEND or SEND_RECV
+    int lane;                       // FIN_LANE_... (set by Fin_Submit)
+    char cmnd;                      // command, buffer[1] is overwritten by the response
+    unsigned char buffer[9];        // command, then response
+    int res;                        // result of the transfer
+    long long sent;                 // when it went out and the response came back (Fin_Usec)
+    long long recv;
+    volatile int done;
+    void (*complete)(struct fin_req *req);  // called by the background thread with
+                                            // the device locked, 0 to wake the sender
+    void *arg;                      // for complete
+};
+
+/*
+ * a reflex rule of a device (FinchReflex.c)
+ */
+struct fin_reflex
+{
+    Fin_Rule rule;
+    int armed;                      // evaluated on each sample
+    int active;                     // condition held on the previous sample
+};
+
+/*
+ * where a device is, by dead reckoning (FinchPose.c)
+ */
+struct fin_pose
+{
+    double x, y, heading;           // meters, radians, at usec
+    double cov[3][3];               // covariance of x, y, heading
+    long long usec;                 // time of the estimate
+    double left, right;             // m/s of the wheels since
+    double distance;                // meters driven
+    int lifted;                     // off the floor, the wheels do not move it
+    int blocked;                    // hit something, the wheels slip until it turns or backs off
+    double blocked_heading;         // heading, and direction (1 forward, -1 back), it hit at
+    int blocked_way;
+    int bumps;                      // hits felt
+};
+
+/*
+ * filter of the readings of a sensor (FinchFilter.c)
+ */
+struct fin_filter
+{
+    int kind;                       // FIN_FILTER_...
+    int param;
+    int filled;                     // samples seen (in the window for a median)
+    int pos;                        // oldest sample of the window
+    float state[3];                 // average, or debounced value, of each channel
+    int held[3];                    // samples the raw value differed from the debounced one
+    float window[3][FIN_MEDIAN_MAX];    // last samples of each channel
+    float sorted[3][FIN_MEDIAN_MAX];    // the same, sorted
+    float value[3];                 // last filtered values
+    long long at;                   // when of the last sample filtered, when attached
+};
+
+/*
+ * a command of a track, encoded beforehand (FinchTrack.c),
+ * or a key frame of an animation (color in args, args[3] the easing)
+ */
+struct fin_step
+{
+    long long at;                   // usec from the start of the pass
+    char cmnd;
+    unsigned char args[4];          // buffer[2] to buffer[5]
+};
+
+/*
+ * commands the background thread sends each at its own time,
+ * or frames it computes from the key frames of an animation
+ */
+struct fin_track
+{
+    struct fin_step *step;          // malloc'ed, 0 if the track is empty
+    int steps;
+    long period;                    // usec between frames, 0 to send the steps as they are
+    int guard;                      // keep the link free before each command
+    int count;                      // steps, or frames, of a pass
+    int next;                       // next one to send, count once over
+    long long start;                // when the current pass started (Fin_Usec)
+    long long length;               // usec of a pass
+    int loops;                      // passes left after this one, -1 for ever
+    int serial;                     // changes each time the track is replaced
+    Fin_TrackStats stats;
+    long long late_total;           // sum of the delays, for the average
+};
+
+/*
+ * state kept for each opened Finch
+ */
+struct fin_dev
+{
+    hid_device *handle;             // the handle to communicate with the Finch
+    char path[256];                 // platform path of the device ("" if unknown)
+    int attached;                   // commands go through the daemon instead (FinchClient.c)
+    struct fin_sim *sim;            // simulated robot instead (FinchSim.c)
+    struct fin_clock *clock;        // clock of the thread that opened it (FinchClock.c)
+    struct fin_dev *home;           // device in use by that thread
+
+    fin_mutex lock;                 // guards the lanes and the state below
+    fin_cond work;                  // signaled when there is work for the thread (Fin_Wake)
+    fin_cond done;                  // signaled when a request is done or snap changes
+    struct fin_req *lane_head[FIN_LANES];
+    struct fin_req *lane_tail[FIN_LANES];
+    int running;                    // background thread running
+#ifdef _LINUX_
+    pthread_t thread;
+#else
+    HANDLE thread;
+    DWORD thread_id;
+#endif
+    long long last_sent;            // when the last command went out (Fin_Usec)
+    long long sent_at;              // times of the last transfer of the background thread
+    long long recv_at;
+    long long rtt_usec;             // round trip of a 'z', running average
+    long long probed_at;            // last 'z' sent
+    long long sampled_at;           // last sensor reading sent
+    long long retry_at;             // next reconnect attempt
+    unsigned char seq_num;          // sequence number of the last request
+    int cmnd_count;                 // number of commands that have been sent
+    int left_speed;                 // last speeds sent with 'M'
+    int right_speed;
+    long long stop_at;              // when the motors must stop (Fin_Usec), 0 if not timed
+    struct fin_req *staged;         // fleet commands waiting for release_at (FinchFleet.c)
+    long long release_at;
+    long long released;             // when they were actually sent
+    Fin_Sensors snap;               // latest readings seen on the link
+    struct fin_filter filter[FIN_SENSORS];
+    struct fin_pose pose;           // guarded by lock
+    void (*sampled)(struct fin_dev *dev);   // called with the device locked when snap changes
+    void *arg;                      // for sampled
+    int subscribers[FIN_SENSORS];   // sample these sensors in the background
+    long long polled_at[FIN_SENSORS];   // last sample of each sensor
+    long long link_bytes;           // bytes that went over the link
+    long long window_at;            // start of the measuring window
+    long long window_bytes;         // link_bytes, cmnd_count at that time
+    int window_cmnds;
+    int window_samples[FIN_SENSORS];    // samples in the window
+    Fin_PollStats poll_stats;
+    struct fin_reflex reflex[FIN_REFLEXES];
+    int reflex_sensors;             // mask of the sensors the armed reflexes watch
+    Fin_ReflexStats reflex_stats;
+    long long reflex_total;         // sum of the reaction times, for the average
+    struct fin_track track[FIN_TRACKS];
+    double rate;                    // commands per second the bucket lets through
+    double rate_max;                // calibrated rate, else FIN_RATE_MAX
+    double tokens;                  // commands that may go now, up to FIN_BURST
+    long long filled_at;            // when tokens were last added
+    long long rtt_best;             // shortest round trip seen
+    int refused;                    // writes the Finch did not take at once
+    int refused_seen;               // refused when the rate was last adjusted
+    long long cut_at;               // when the rate was last cut
+    int calibrating;                // Fin_Calibrate runs, the bucket is open
+    Fin_FlowStats flow_stats;
+    unsigned char led[3];           // last 'O' and 'M' sent, put back after a reconnect
+    unsigned char motor[4];
+    int lost;                       // unplugged, waiting to reconnect
+    long long lost_at;              // when it was unplugged (Fin_Usec)
+    int cache;                      // remember the path between runs
+    int cached;                     // opened with the path remembered by the last run
+    int reconnects;                 // number of times the link was recovered
+    long long open_usec;            // time taken to open the robot
+    long long recover_usec;         // time taken by the last reconnect
+    int console;                    // the thread watches the console (FinchConsole.c)
+#ifdef _LINUX_
+    int console_fd;                 // stdin, -1 once closed
+    int wake_pipe[2];               // wakes the thread up while it waits on the console
+#endif
+};
+
+/* Finch.c */
+void Fin_Wake(struct fin_dev *dev);
+int Fin_DevOpen(struct fin_dev *dev, const char *path);
+void Fin_DevStart(struct fin_dev *dev);
+void Fin_DevClose(struct fin_dev *dev);
+int Fin_DevCmnd(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer);
+int Fin_DevCmndStamp(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer, Fin_Stamp *stamp);
+long long Fin_SampleTime(struct fin_dev *dev, long long sent, long long recv);
+int Fin_Submit(struct fin_dev *dev, struct fin_req *req);
+int Fin_Cancel(struct fin_dev *dev, int lane, const char *cmnds, int res);
+int Fin_Transfer(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer);
+int Fin_Send(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer);
+struct fin_dev *Fin_Dev(void);
+void Fin_DevUse(struct fin_dev *dev);
+void Fin_DecodeAccel(const unsigned char *buffer, float *x, float *y, float *z, int *tap, int *shake);
+float Fin_DecodeTemp(const unsigned char *buffer);
+int Fin_PathInUse(struct fin_dev *dev, const char *path);
+int Fin_CacheLoad(const char *key, char *value, int size);
+void Fin_CacheSave(const char *key, const char *value);
+
+/* FinchClock.c */
+int Fin_Virtual(void);
+struct fin_clock *Fin_ClockGet(void);
+void Fin_ClockUse(struct fin_clock *clock);
+void Fin_ClockJoin(int count);
+void Fin_ClockLimit(long long usec, void (*expired)(void));
+int Fin_ClockExpired(void);
+int Fin_ClockCheck(void);
+void Fin_CondInit(fin_cond *cond);
+void Fin_Wait(fin_cond *cond, fin_mutex *mutex);
+void Fin_WaitUntil(fin_cond *cond, fin_mutex *mutex, long long usec);
+void Fin_Broadcast(fin_cond *cond);
+void Fin_Nap(long usec);
+long long Fin_WallUsec(void);
+
+/* FinchConsole.c */
+#ifdef _LINUX_
+void Fin_ConsoleOpen(struct fin_dev *dev);
+void Fin_ConsoleWait(struct fin_dev *dev, long long usec);
+void Fin_ConsoleClose(struct fin_dev *dev);
+#endif
+int Fin_ConsolePending(void);
+
+/* FinchFilter.c */
+void Fin_FilterSample(struct fin_dev *dev, int sensor);
+void Fin_FilterShared(struct fin_dev *dev, Fin_Sensors *snap);
+
+/* FinchFlow.c */
+void Fin_FlowInit(struct fin_dev *dev);
+int Fin_FlowReady(struct fin_dev *dev, long long now, int pending, long long *wake);
+void Fin_FlowSent(struct fin_dev *dev, int flag, long long sent, long long recv);
+
+/* FinchMaze.c: all in Finch.h */
+
+/* FinchPath.c: all in Finch.h */
+
+/* FinchPose.c */
+void Fin_PoseWheels(struct fin_dev *dev, long long at);
+void Fin_PoseAccel(struct fin_dev *dev, long long at);
+
+/* FinchPoll.c */
+int Fin_PollDue(struct fin_dev *dev, long long now, long long *wake);
+void Fin_Polled(struct fin_dev *dev, int sensor, long long sent);
+int Fin_DevSubscribe(struct fin_dev *dev, int sensor, int on);
+
+/* FinchReflex.c */
+void Fin_Reflexes(struct fin_dev *dev, int sensor, long long sent, long long recv);
+
+/* FinchSim.c */
+int Fin_SimOpen(struct fin_dev *dev, const char *maze, const char *lights);
+void Fin_SimClose(struct fin_dev *dev);
+int Fin_SimTransfer(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer);
+
+/* FinchTrack.c */
+int Fin_TrackDue(struct fin_dev *dev, long long now, long long *due);
+void Fin_TrackSend(struct fin_dev *dev, int track);
+void Fin_TrackLoad(struct fin_dev *dev, int track, struct fin_track *from);
+void Fin_TrackStatus(struct fin_dev *dev, int track, Fin_TrackStats *stats);
+int Fin_DevAnimate(struct fin_dev *dev, const Fin_Key *keys, int count, int fps, int loops,
+                   long long start);
+
+/* FinchClient.c */
+int Fin_Attach(void);
+int Fin_Detach(void);
+int Fin_Attached(void);
+int Fin_ShmCmnd(int flag, char cmnd, unsigned char *buffer);
+int Fin_ShmSnapshot(Fin_Sensors *snap);
+
+#endif  /* FINCHINT_H */
@@ -75,6 +75,7 @@ int obtenerLuz(int ojo);
 int terminarConexion(void);
 int adelante(int segundos);
 int detectarObstaculo(void);
+int frenarAnteObstaculo(void);
 int inicializarConexion(void);
 int obtenerObstaculo(int ojo);
 float obtenerTemperatura(void);
@@ -85,6 +86,8 @@ int buzzer(int segundos, int frecuencia);
 int vuelta(int duracion, int motor1, int motor2);
 int motorContinuo(int duracion, int motor1, int motor2);
 int motorBloqueante(int duracion, int motor1, int motor2);
+int laberinto(int ancho, int alto, float celda, int metaX, int metaY);
+struct punto ubicacion(void);
 
 /**********************************************************************************************
 ***********************************************************************************************
@@ -208,6 +211,26 @@ int detectarObstaculo(void){
 	}
 }
 
+/**********************************************************************************************
+***********************************************************************************************
+frenarAnteObstaculo(void)
+
+Metodo que hace que el Finch se detenga por si solo en cuanto ambos sensores de deteccion de
+obstaculos vean algo, aun mientras el programa espera en adelante() o motor().
+
+Entrada:
+	Sin valores de entrada
+
+Regreso:
+	@return -1 si hay errores
+***********************************************************************************************
+**********************************************************************************************/
+int frenarAnteObstaculo(void){
+	Fin_Rule regla = { FIN_IF_OBSTACLE_BOTH, 0, FIN_DO_STOP, 0, 0, 0, 0, 0, 0 };
+
+	return Fin_Reflex(&regla);
+}
+
 /**********************************************************************************************
 ***********************************************************************************************
 obtenerObstaculo(int ojo)
@@ -461,5 +484,65 @@ int vuelta(int duracion, int motor1, int motor2){
 	return motor(duracion, motor1, motor2);
 }
 
+/**********************************************************************************************
+***********************************************************************************************
+laberinto(int ancho, int alto, float celda, int metaX, int metaY)
+
+Metodo que lleva al Finch hasta la meta de un laberinto que no conoce. El laberinto es una
+cuadricula de celdas; el Finch empieza en la celda de la esquina de abajo a la izquierda
+(0, 0) viendo hacia la derecha, avanza de celda en celda y da vueltas de 90 grados, y cada
+pared que encuentra con sus sensores de obstaculos la agrega a su mapa para buscar otro
+camino.
+
+Entrada:
+	@param ancho numero de celdas de izquierda a derecha
+	@param alto numero de celdas de abajo hacia arriba
+	@param celda tamano de una celda (en metros)
+	@param metaX columna de la meta (0 es la de la izquierda)
+	@param metaY fila de la meta (0 es la de abajo)
+
+Regreso:
+	@return -1 si hay errores o no hay camino
+	@return 1 si llego a la meta
+***********************************************************************************************
+**********************************************************************************************/
+int laberinto(int ancho, int alto, float celda, int metaX, int metaY){
+	int res;
+
+	if(Fin_MazeOpen(ancho, alto, celda, 0, 0, FIN_MAZE_EAST) < 0 || Fin_MazeGoal(metaX, metaY) < 0){
+		return -1;
+	}
+	res = Fin_MazeSolve(ancho * alto * 8);
+	Fin_MazeClose();
+	return res > 0 ? 1 : -1;
+}
+
+
+/**********************************************************************************************
+***********************************************************************************************
+ubicacion(void)
+
+Metodo que regresa donde cree el Finch que esta, por lo que han girado sus ruedas desde que
+se inicio la conexion: empieza en (0, 0) viendo hacia la derecha. Si lo levantan o choca con
+algo lo toma en cuenta, pero el error crece con lo que avanza.
+
+Regreso:
+	@return Punto con x, y (en metros) y en z hacia donde ve (en grados, contra las
+	manecillas del reloj desde la derecha)
+***********************************************************************************************
+**********************************************************************************************/
+struct punto ubicacion(void){
+	struct punto res;
+	Fin_Pose pose;
+
+	res.x = res.y = res.z = 0;
+	if(Fin_PoseNow(&pose) > 0){
+		res.x = pose.x;
+		res.y = pose.y;
+		res.z = pose.heading;
+	}
+	return res;
+}
+
 #endif
 
@@ -0,0 +1,583 @@
+/*
+ * Maze engine: the robot finds its way to a goal cell of a maze it does
+ * not know, one cell at a time.
+ *  - the map is a grid of cells, a bit per cell for the walls found so
+ *    far and one for the cells known free; the cells not seen yet are
+ *    taken as free
+ *  - the plan is the number of steps from each cell to the goal (a flood
+ *    fill from the goal); when a wall is found, only the cells whose way
+ *    went through it are flooded again, the rest of the plan stays
+ *  - the pose is kept by dead reckoning: the engine drives the robot
+ *    itself, a cell forward or a quarter turn at a time, and the obstacle
+ *    sensors tell whether the cell ahead is a wall
+ * The grid has x to the east and y to the north, as the simulator.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+/* cell next to a cell in each direction */
+static const int fin_maze_dx[4] = { 1, 0, -1, 0 };
+static const int fin_maze_dy[4] = { 0, 1, 0, -1 };
+
+/*
+ * a cell waiting to be flooded, at its distance
+ */
+struct fin_maze_item
+{
+    int dist;
+    int cell;
+};
+
+/*
+ * the maze as known by the robot
+ */
+struct fin_maze
+{
+    int width, height;
+    double cell;                    // meters a cell
+    unsigned int *wall;             // a bit per cell, walls found
+    unsigned int *known;            // a bit per cell, cells seen free
+    int *dist;                      // steps to the goal, FIN_MAZE_FAR if none
+    int goal;                       // cell, -1 if none
+    int x, y, heading;              // pose of the robot, FIN_MAZE_EAST...
+    struct fin_maze_item *heap;     // cells to flood, nearest first
+    int heap_count, heap_size;
+    int *raised;                    // cells whose way went through a new wall
+    unsigned int *mark;             // a bit per cell, those raised
+    Fin_MazeStats stats;
+};
+
+static FIN_TLS struct fin_maze *fin_maze = 0;   // maze of this thread
+
+
+static int Fin_MazeBit(const unsigned int *bits, int cell)
+{
+    return((bits[cell / 32] >> (cell % 32)) & 1);
+}
+
+static void Fin_MazeSetBit(unsigned int *bits, int cell, int on)
+{
+    if (on)
+        bits[cell / 32] |= 1u << (cell % 32);
+    else
+        bits[cell / 32] &= ~(1u << (cell % 32));
+}
+
+
+/*
+ * cell next to a cell in a direction, -1 if out of the maze
+ */
+static int Fin_MazeNeighbor(struct fin_maze *maze, int cell, int dir)
+{
+    int x = cell % maze->width + fin_maze_dx[dir];
+    int y = cell / maze->width + fin_maze_dy[dir];
+
+    if (x < 0 || y < 0 || x >= maze->width || y >= maze->height)
+        return(-1);
+    return(y * maze->width + x);
+}
+
+
+/*
+ * queue a cell to flood at a distance
+ */
+static int Fin_MazePush(struct fin_maze *maze, int cell, int dist)
+{
+    struct fin_maze_item item, *more;
+    int i = maze->heap_count;
+
+    if (maze->heap_count == maze->heap_size)
+    {
+        more = realloc(maze->heap, 2 * maze->heap_size * sizeof(*more));
+        if (more == 0)
+            return(-1);
+        maze->heap = more;
+        maze->heap_size *= 2;
+    }
+    item.dist = dist;
+    item.cell = cell;
+    for (; i > 0 && maze->heap[(i - 1) / 2].dist > dist; i = (i - 1) / 2)
+        maze->heap[i] = maze->heap[(i - 1) / 2];
+    maze->heap[i] = item;
+    maze->heap_count++;
+    return(0);
+}
+
+
+static struct fin_maze_item Fin_MazePop(struct fin_maze *maze)
+{
+    struct fin_maze_item top = maze->heap[0];
+    struct fin_maze_item last = maze->heap[--maze->heap_count];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < maze->heap_count)
+    {
+        if (child + 1 < maze->heap_count && maze->heap[child + 1].dist < maze->heap[child].dist)
+            child++;
+        if (maze->heap[child].dist >= last.dist)
+            break;
+        maze->heap[i] = maze->heap[child];
+        i = child;
+    }
+    maze->heap[i] = last;
+    return(top);
+}
+
+
+/*
+ * flood the queued cells outwards, each one only lowering the distance of
+ * its neighbors; returns the cells changed
+ */
+static int Fin_MazeFlood(struct fin_maze *maze)
+{
+    struct fin_maze_item item;
+    int dir, next, changed = 0;
+
+    while (maze->heap_count > 0)
+    {
+        item = Fin_MazePop(maze);
+        if (item.dist != maze->dist[item.cell])
+            continue;
+        changed++;
+        for (dir = 0; dir < 4; dir++)
+        {
+            next = Fin_MazeNeighbor(maze, item.cell, dir);
+            if (next < 0 || Fin_MazeBit(maze->wall, next) || maze->dist[next] <= item.dist + 1)
+                continue;
+            maze->dist[next] = item.dist + 1;
+            if (Fin_MazePush(maze, next, item.dist + 1) < 0)
+                return(-1);
+        }
+    }
+    return(changed);
+}
+
+
+/*
+ * does a cell still have a way to the goal through a neighbor
+ * not raised
+ */
+static int Fin_MazeSupported(struct fin_maze *maze, int cell)
+{
+    int dir, next;
+
+    for (dir = 0; dir < 4; dir++)
+    {
+        next = Fin_MazeNeighbor(maze, cell, dir);
+        if (next >= 0 && !Fin_MazeBit(maze->wall, next) && !Fin_MazeBit(maze->mark, next) &&
+            maze->dist[next] == maze->dist[cell] - 1)
+            return(1);
+    }
+    return(0);
+}
+
+
+/*
+ * a cell became a wall: take back the distances that went through it
+ * (nearest first, each cell once its last way to the goal is gone), then
+ * flood them again from the cells around them that kept theirs
+ */
+static int Fin_MazeRaise(struct fin_maze *maze, int cell)
+{
+    int head = 0, tail = 0, dir, next, i, best;
+
+    if (maze->dist[cell] == FIN_MAZE_FAR)
+        return(0);
+    Fin_MazeSetBit(maze->mark, cell, 1);
+    maze->raised[tail++] = cell;
+    while (head < tail)
+    {
+        cell = maze->raised[head++];
+        for (dir = 0; dir < 4; dir++)
+        {
+            next = Fin_MazeNeighbor(maze, cell, dir);
+            if (next >= 0 && next != maze->goal && maze->dist[next] == maze->dist[cell] + 1 &&
+                !Fin_MazeBit(maze->wall, next) && !Fin_MazeBit(maze->mark, next) &&
+                !Fin_MazeSupported(maze, next))
+            {
+                Fin_MazeSetBit(maze->mark, next, 1);
+                maze->raised[tail++] = next;
+            }
+        }
+    }
+
+    for (i = 0; i < tail; i++)
+    {
+        cell = maze->raised[i];
+        Fin_MazeSetBit(maze->mark, cell, 0);
+        maze->dist[cell] = FIN_MAZE_FAR;
+    }
+    for (i = 0; i < tail; i++)
+    {
+        cell = maze->raised[i];
+        if (Fin_MazeBit(maze->wall, cell))
+            continue;
+        best = FIN_MAZE_FAR;
+        for (dir = 0; dir < 4; dir++)
+        {
+            next = Fin_MazeNeighbor(maze, cell, dir);
+            if (next >= 0 && !Fin_MazeBit(maze->wall, next) && maze->dist[next] + 1 < best)
+                best = maze->dist[next] + 1;
+        }
+        if (best < FIN_MAZE_FAR)
+        {
+            maze->dist[cell] = best;
+            if (Fin_MazePush(maze, cell, best) < 0)
+                return(-1);
+        }
+    }
+    return(tail + Fin_MazeFlood(maze));
+}
+
+
+/*
+ * time a change of the plan
+ */
+static void Fin_MazeTimed(struct fin_maze *maze, long long start, int cells)
+{
+    long long usec = Fin_WallUsec() - start;
+
+    maze->stats.replans++;
+    maze->stats.cells += cells;
+    maze->stats.replan_usec += usec;
+    if (usec > maze->stats.replan_max)
+        maze->stats.replan_max = usec;
+}
+
+
+/*
+ * plan from scratch: flood the whole maze from the goal
+ */
+static int Fin_MazePlan(struct fin_maze *maze)
+{
+    long long start = Fin_WallUsec();
+    int i, cells = 0;
+
+    for (i = 0; i < maze->width * maze->height; i++)
+        maze->dist[i] = FIN_MAZE_FAR;
+    maze->heap_count = 0;
+    if (maze->goal >= 0 && !Fin_MazeBit(maze->wall, maze->goal))
+    {
+        maze->dist[maze->goal] = 0;
+        if (Fin_MazePush(maze, maze->goal, 0) < 0)
+            return(-1);
+        cells = Fin_MazeFlood(maze);
+        if (cells < 0)
+            return(-1);
+    }
+    Fin_MazeTimed(maze, start, cells);
+    return(1);
+}
+
+
+/*
+ * drive both wheels for usec, timed by the background thread as Fin_Move
+ */
+static int Fin_MazeDrive(int left, int right, long long usec)
+{
+    struct fin_dev *dev = Fin_Dev();
+    int res;
+
+    res = Fin_Motor(-1, left, right);
+    if (res < 0)
+        return(res);
+    Fin_Lock(&dev->lock);
+    dev->stop_at = Fin_Usec() + usec;
+    Fin_Wake(dev);
+    while (dev->left_speed != 0 || dev->right_speed != 0)
+        Fin_Wait(&dev->done, &dev->lock);
+    Fin_Unlock(&dev->lock);
+    return(res);
+}
+
+
+/*
+ * free a maze
+ */
+static void Fin_MazeFree(struct fin_maze *maze)
+{
+    free(maze->wall);
+    free(maze->known);
+    free(maze->dist);
+    free(maze->heap);
+    free(maze->raised);
+    free(maze->mark);
+    free(maze);
+}
+
+
+/**  Fin_MazeOpen(width, height, cell, x, y, heading).
+ *  start mapping a maze, with the robot in a cell of it
+ *
+ *  input:
+ *     int width/height = cells of the maze
+ *     double cell = meters a cell
+ *     int x/y = cell of the robot, from the south west corner
+ *     int heading = where it faces, FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH
+ *  returns
+ *     -1 if failure
+ */
+int Fin_MazeOpen(int width, int height, double cell, int x, int y, int heading)
+{
+    struct fin_maze *maze;
+    int cells = width * height;
+    int words = (cells + 31) / 32;
+
+    if (width <= 0 || height <= 0 || cells > FIN_MAZE_MAX || cell <= 0 ||
+        x < 0 || y < 0 || x >= width || y >= height || heading < 0 || heading > 3)
+        return(-1);
+
+    maze = calloc(1, sizeof(*maze));
+    if (maze == 0)
+        return(-1);
+    maze->wall = calloc(words, sizeof(unsigned int));
+    maze->known = calloc(words, sizeof(unsigned int));
+    maze->dist = malloc(cells * sizeof(int));
+    maze->heap_size = 64;
+    maze->heap = malloc(maze->heap_size * sizeof(struct fin_maze_item));
+    maze->raised = malloc(cells * sizeof(int));
+    maze->mark = calloc(words, sizeof(unsigned int));
+    if (maze->wall == 0 || maze->known == 0 || maze->dist == 0 || maze->heap == 0 ||
+        maze->raised == 0 || maze->mark == 0)
+    {
+        Fin_MazeFree(maze);
+        return(-1);
+    }
+    maze->width = width;
+    maze->height = height;
+    maze->cell = cell;
+    maze->goal = -1;
+    maze->x = x;
+    maze->y = y;
+    maze->heading = heading;
+    Fin_MazeSetBit(maze->known, y * width + x, 1);
+    Fin_MazePlan(maze);
+    memset(&maze->stats, 0, sizeof(maze->stats));
+
+    Fin_MazeClose();
+    fin_maze = maze;
+    return(1);
+}
+
+
+/**  Fin_MazeClose(void).
+ *  forget the maze
+ *
+ *  returns
+ *     none
+ */
+void Fin_MazeClose(void)
+{
+    if (fin_maze != 0)
+        Fin_MazeFree(fin_maze);
+    fin_maze = 0;
+}
+
+
+/**  Fin_MazeGoal(x, y).
+ *  set the cell to reach, the plan is made again
+ *
+ *  input:
+ *     int x/y = the cell
+ *  returns
+ *     -1 if failure
+ */
+int Fin_MazeGoal(int x, int y)
+{
+    struct fin_maze *maze = fin_maze;
+
+    if (maze == 0 || x < 0 || y < 0 || x >= maze->width || y >= maze->height)
+        return(-1);
+    maze->goal = y * maze->width + x;
+    return(Fin_MazePlan(maze));
+}
+
+
+/**  Fin_MazeWall(x, y, wall).
+ *  tell the engine a cell is a wall (or free after all), the plan is
+ *  repaired around it
+ *
+ *  input:
+ *     int x/y = the cell
+ *     int wall = 1 for a wall, 0 for free
+ *  returns
+ *     -1 if failure
+ */
+int Fin_MazeWall(int x, int y, int wall)
+{
+    struct fin_maze *maze = fin_maze;
+    long long start = Fin_WallUsec();
+    int cell, dir, next, best, cells = 0;
+
+    if (maze == 0 || x < 0 || y < 0 || x >= maze->width || y >= maze->height)
+        return(-1);
+    cell = y * maze->width + x;
+    Fin_MazeSetBit(maze->known, cell, !wall);
+    if (Fin_MazeBit(maze->wall, cell) == (wall != 0))
+        return(1);
+
+    Fin_MazeSetBit(maze->wall, cell, wall);
+    if (wall)
+    {
+        maze->stats.walls++;
+        cells = Fin_MazeRaise(maze, cell);
+    }
+    else
+    {
+        // a way through the cell, from its best neighbor
+        maze->stats.walls--;
+        best = cell == maze->goal ? 0 : FIN_MAZE_FAR;
+        for (dir = 0; dir < 4; dir++)
+        {
+            next = Fin_MazeNeighbor(maze, cell, dir);
+            if (next >= 0 && !Fin_MazeBit(maze->wall, next) && maze->dist[next] + 1 < best)
+                best = maze->dist[next] + 1;
+        }
+        maze->dist[cell] = best;
+        if (best < FIN_MAZE_FAR)
+        {
+            if (Fin_MazePush(maze, cell, best) < 0)
+                return(-1);
+            cells = Fin_MazeFlood(maze);
+        }
+    }
+    if (cells < 0)
+        return(-1);
+    Fin_MazeTimed(maze, start, cells);
+    return(1);
+}
+
+
+/**  Fin_MazeNext(void).
+ *  get where the plan goes from the cell of the robot
+ *
+ *  returns
+ *     FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH,
+ *     FIN_MAZE_HERE at the goal, -1 if no way is left
+ */
+int Fin_MazeNext(void)
+{
+    struct fin_maze *maze = fin_maze;
+    int cell, dir, next, turn, best = -1;
+
+    if (maze == 0)
+        return(-1);
+    cell = maze->y * maze->width + maze->x;
+    if (cell == maze->goal)
+        return(FIN_MAZE_HERE);
+    if (maze->dist[cell] == FIN_MAZE_FAR)
+        return(-1);
+
+    // straight on first, then the least turning
+    for (turn = 0; turn < 4; turn++)
+    {
+        dir = (maze->heading + (turn == 3 ? 2 : turn == 2 ? 3 : turn)) % 4;
+        next = Fin_MazeNeighbor(maze, cell, dir);
+        if (next >= 0 && !Fin_MazeBit(maze->wall, next) && maze->dist[next] < maze->dist[cell] &&
+            (best < 0 || maze->dist[next] < maze->dist[Fin_MazeNeighbor(maze, cell, best)]))
+            best = dir;
+    }
+    return(best);
+}
+
+
+/**  Fin_MazeStep(void).
+ *  take a step towards the goal: turn to where the plan goes, or look
+ *  ahead and either find a wall there (the plan is repaired) or drive
+ *  to the next cell
+ *
+ *  returns
+ *     1 if a step was taken, 0 at the goal, -1 if failure or no way left
+ */
+int Fin_MazeStep(void)
+{
+    struct fin_maze *maze = fin_maze;
+    double speed = FIN_SIM_SPEED * FIN_MAZE_WHEEL / 255;
+    int dir, turn, left, right, x, y;
+
+    dir = Fin_MazeNext();
+    if (dir < 0 || dir == FIN_MAZE_HERE)
+        return(dir < 0 ? -1 : 0);
+
+    // a quarter turn on the spot, or a half one
+    turn = (dir - maze->heading + 4) % 4;
+    if (turn != 0)
+    {
+        if (Fin_MazeDrive(turn == 3 ? FIN_MAZE_WHEEL : -FIN_MAZE_WHEEL,
+                          turn == 3 ? -FIN_MAZE_WHEEL : FIN_MAZE_WHEEL,
+                          (long long)((turn == 2 ? M_PI : M_PI / 2) * FIN_SIM_AXLE / 2 / speed * 1e6)) < 0)
+            return(-1);
+        maze->heading = dir;
+        maze->stats.turns++;
+        return(1);
+    }
+
+    x = maze->x + fin_maze_dx[dir];
+    y = maze->y + fin_maze_dy[dir];
+    if (Fin_Obstacle(&left, &right) < 0)
+        return(-1);
+    if (left || right)
+        return(Fin_MazeWall(x, y, 1));
+
+    if (Fin_MazeDrive(FIN_MAZE_WHEEL, FIN_MAZE_WHEEL, (long long)(maze->cell / speed * 1e6)) < 0)
+        return(-1);
+    maze->x = x;
+    maze->y = y;
+    Fin_MazeSetBit(maze->known, y * maze->width + x, 1);
+    maze->stats.steps++;
+    return(1);
+}
+
+
+/**  Fin_MazeSolve(steps).
+ *  take steps until the goal is reached
+ *
+ *  input:
+ *     int steps = most steps to take
+ *  returns
+ *     1 at the goal, 0 if out of steps, -1 if failure or no way
+ */
+int Fin_MazeSolve(int steps)
+{
+    int res = 1;
+
+    while (steps-- > 0 && (res = Fin_MazeStep()) > 0)
+        ;
+    return(res == 0 ? 1 : res < 0 ? -1 : 0);
+}
+
+
+/**  Fin_MazeStatus(*stats).
+ *  get the pose of the robot, what is known of the maze and what
+ *  planning took
+ *
+ *  input:
+ *     Fin_MazeStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure (no maze)
+ */
+int Fin_MazeStatus(Fin_MazeStats *stats)
+{
+    struct fin_maze *maze = fin_maze;
+    int cell;
+
+    if (maze == 0)
+        return(-1);
+    *stats = maze->stats;
+    stats->x = maze->x;
+    stats->y = maze->y;
+    stats->heading = maze->heading;
+    cell = maze->y * maze->width + maze->x;
+    stats->dist = maze->dist[cell] == FIN_MAZE_FAR ? -1 : maze->dist[cell];
+    return(1);
+}
@@ -0,0 +1,672 @@
+/*
+ * Paths of a fleet on a grid: several robots (the pieces of a chess set,
+ * each carried by a Finch) go to their cells at the same time without
+ * running into each other.
+ *  - each robot is planned in turn with A* over cells, headings and time
+ *    (a tick to drive a cell, to make a quarter turn or to wait), against
+ *    a table of the cells the robots already planned hold at each tick:
+ *    a robot never enters a cell held at that tick, nor swaps cells with
+ *    another, and once at its goal it stays there
+ *  - the robots far from their goal are planned first, keeping off the
+ *    cells of those not planned yet for the few ticks they need to leave;
+ *    when a robot finds no path (those before it block its way, or get to
+ *    its cell before it leaves), it is moved to the front and the whole
+ *    fleet planned again
+ *  - the estimate of A* is the number of ticks to the goal with the other
+ *    robots out of the way, found backwards from the goal for each robot
+ * The plan is a list of actions per robot and tick, driven on the robots
+ * of the fleet a tick at a time by Fin_PathGo.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+/* cell next to a cell in each direction */
+static const int fin_path_dx[4] = { 1, 0, -1, 0 };
+static const int fin_path_dy[4] = { 0, 1, 0, -1 };
+
+/*
+ * a robot and its path, a cell and heading per tick up to its arrival
+ */
+struct fin_path_robot
+{
+    int start, heading, goal;       // cells
+    int arrive;                     // tick it gets to the goal, -1 if not planned
+    int *cell;                      // at each tick
+    unsigned char *head;
+};
+
+/*
+ * a state reached by A*, a cell and heading at a tick
+ */
+struct fin_path_node
+{
+    int state;                      // cell * 4 + heading
+    int tick;
+    int parent;                     // node it came from, -1 for the start
+};
+
+/*
+ * a node waiting to be expanded
+ */
+struct fin_path_item
+{
+    int cost;                       // ticks so far and left
+    int tick;
+    int node;
+};
+
+/*
+ * the grid, the fleet and the cells held
+ */
+struct fin_path
+{
+    int width, height, cells, ticks;
+    unsigned int *wall;             // a bit per cell
+    unsigned char *held;            // robot + 1 holding a cell at a tick, 0 if none
+    int *parked;                    // tick a robot stops on a cell for good, FIN_MAZE_FAR if none
+    int *last;                      // last tick a cell is held, -1 if never
+    int *leave;                     // ticks a robot not planned yet has to leave its cell
+    int *dist;                      // ticks from a state to the goal of the robot planned
+    int *queue;
+    unsigned int *seen;             // a bit per state and tick, reached by A*
+    struct fin_path_node *node;
+    int node_count, node_size;
+    struct fin_path_item *heap;     // nodes to expand, least cost first
+    int heap_count, heap_size;
+    int robots;
+    struct fin_path_robot robot[FIN_PATH_ROBOTS];
+    int order[FIN_PATH_ROBOTS];     // robots in the order they are planned
+    Fin_PathStats stats;
+};
+
+static FIN_TLS struct fin_path *fin_path = 0;   // grid of this thread
+
+
+static int Fin_PathBit(const unsigned int *bits, long long bit)
+{
+    return((bits[bit / 32] >> (bit % 32)) & 1);
+}
+
+static void Fin_PathSetBit(unsigned int *bits, long long bit)
+{
+    bits[bit / 32] |= 1u << (bit % 32);
+}
+
+
+/*
+ * cell next to a cell in a direction, -1 if out of the grid or a wall
+ */
+static int Fin_PathNeighbor(struct fin_path *path, int cell, int dir)
+{
+    int x = cell % path->width + fin_path_dx[dir];
+    int y = cell / path->width + fin_path_dy[dir];
+
+    if (x < 0 || y < 0 || x >= path->width || y >= path->height ||
+        Fin_PathBit(path->wall, y * path->width + x))
+        return(-1);
+    return(y * path->width + x);
+}
+
+
+/*
+ * is a cell free at a tick
+ */
+static int Fin_PathEmpty(struct fin_path *path, int cell, int tick)
+{
+    return(path->held[(long long)tick * path->cells + cell] == 0 && tick < path->parked[cell] &&
+           tick >= path->leave[cell]);
+}
+
+
+/*
+ * ticks from each state to the goal, the other robots out of the way:
+ * breadth first from the goal, backwards (a state is reached from the
+ * cell behind it with the same heading, or by turning on the spot)
+ */
+static void Fin_PathDistances(struct fin_path *path, int goal)
+{
+    int head = 0, tail = 0, state, cell, h, prev, from[3], i;
+
+    for (i = 0; i < path->cells * 4; i++)
+        path->dist[i] = FIN_MAZE_FAR;
+    for (h = 0; h < 4; h++)
+    {
+        path->dist[goal * 4 + h] = 0;
+        path->queue[tail++] = goal * 4 + h;
+    }
+    while (head < tail)
+    {
+        state = path->queue[head++];
+        cell = state / 4;
+        h = state % 4;
+        prev = Fin_PathNeighbor(path, cell, (h + 2) % 4);
+        from[0] = prev < 0 ? -1 : prev * 4 + h;
+        from[1] = cell * 4 + (h + 1) % 4;
+        from[2] = cell * 4 + (h + 3) % 4;
+        for (i = 0; i < 3; i++)
+            if (from[i] >= 0 && path->dist[from[i]] == FIN_MAZE_FAR)
+            {
+                path->dist[from[i]] = path->dist[state] + 1;
+                path->queue[tail++] = from[i];
+            }
+    }
+}
+
+
+static int Fin_PathBefore(const struct fin_path_item *a, const struct fin_path_item *b)
+{
+    // least cost first, the deepest of equal ones
+    return(a->cost < b->cost || (a->cost == b->cost && a->tick > b->tick));
+}
+
+
+/*
+ * reach a state at a tick from a node, unless it was reached already
+ */
+static int Fin_PathPush(struct fin_path *path, int state, int tick, int parent)
+{
+    struct fin_path_item item;
+    void *more;
+    long long bit = ((long long)tick * path->cells * 4 + state);
+    int i;
+
+    if (path->dist[state] == FIN_MAZE_FAR || Fin_PathBit(path->seen, bit))
+        return(0);
+    Fin_PathSetBit(path->seen, bit);
+
+    if (path->node_count == path->node_size)
+    {
+        more = realloc(path->node, 2 * path->node_size * sizeof(*path->node));
+        if (more == 0)
+            return(-1);
+        path->node = more;
+        path->node_size *= 2;
+    }
+    if (path->heap_count == path->heap_size)
+    {
+        more = realloc(path->heap, 2 * path->heap_size * sizeof(*path->heap));
+        if (more == 0)
+            return(-1);
+        path->heap = more;
+        path->heap_size *= 2;
+    }
+    path->node[path->node_count].state = state;
+    path->node[path->node_count].tick = tick;
+    path->node[path->node_count].parent = parent;
+
+    item.cost = tick + path->dist[state];
+    item.tick = tick;
+    item.node = path->node_count++;
+    for (i = path->heap_count; i > 0 && Fin_PathBefore(&item, &path->heap[(i - 1) / 2]); i = (i - 1) / 2)
+        path->heap[i] = path->heap[(i - 1) / 2];
+    path->heap[i] = item;
+    path->heap_count++;
+    return(1);
+}
+
+
+static struct fin_path_item Fin_PathPop(struct fin_path *path)
+{
+    struct fin_path_item top = path->heap[0];
+    struct fin_path_item last = path->heap[--path->heap_count];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < path->heap_count)
+    {
+        if (child + 1 < path->heap_count && Fin_PathBefore(&path->heap[child + 1], &path->heap[child]))
+            child++;
+        if (!Fin_PathBefore(&path->heap[child], &last))
+            break;
+        path->heap[i] = path->heap[child];
+        i = child;
+    }
+    path->heap[i] = last;
+    return(top);
+}
+
+
+/*
+ * plan a robot around the cells held by those planned before it, and
+ * hold its own; returns 0 if it has no path
+ */
+static int Fin_PathRobotPlan(struct fin_path *path, int r)
+{
+    struct fin_path_robot *robot = &path->robot[r];
+    struct fin_path_item item;
+    struct fin_path_node *node;
+    int cell, h, tick, next, i, found = -1;
+
+    path->leave[robot->start] = 0;
+    Fin_PathDistances(path, robot->goal);
+    memset(path->seen, 0, ((long long)path->ticks * path->cells * 4 + 31) / 32 * sizeof(unsigned int));
+    path->node_count = 0;
+    path->heap_count = 0;
+    if (!Fin_PathEmpty(path, robot->start, 0))
+        return(0);
+    if (Fin_PathPush(path, robot->start * 4 + robot->heading, 0, -1) < 0)
+        return(-1);
+
+    while (path->heap_count > 0)
+    {
+        item = Fin_PathPop(path);
+        node = &path->node[item.node];
+        cell = node->state / 4;
+        h = node->state % 4;
+        tick = node->tick;
+        path->stats.expanded++;
+
+        // at the goal, and nobody comes through it later
+        if (cell == robot->goal && path->last[cell] < tick && path->parked[cell] == FIN_MAZE_FAR)
+        {
+            found = item.node;
+            break;
+        }
+        if (tick + 1 >= path->ticks)
+            continue;
+
+        // wait, turn or drive a cell, into a cell free then and not swapping with its robot
+        if (Fin_PathEmpty(path, cell, tick + 1) &&
+            (Fin_PathPush(path, node->state, tick + 1, item.node) < 0 ||
+             Fin_PathPush(path, cell * 4 + (h + 1) % 4, tick + 1, item.node) < 0 ||
+             Fin_PathPush(path, cell * 4 + (h + 3) % 4, tick + 1, item.node) < 0))
+            return(-1);
+        next = Fin_PathNeighbor(path, cell, h);
+        if (next >= 0 && Fin_PathEmpty(path, next, tick + 1) &&
+            (path->held[(long long)tick * path->cells + next] == 0 ||
+             path->held[(long long)tick * path->cells + next] !=
+             path->held[(long long)(tick + 1) * path->cells + cell]) &&
+            Fin_PathPush(path, next * 4 + h, tick + 1, item.node) < 0)
+            return(-1);
+    }
+    if (found < 0)
+        return(0);
+
+    // the path, backwards from the goal, and the cells it holds
+    robot->arrive = path->node[found].tick;
+    for (i = found; i >= 0; i = path->node[i].parent)
+    {
+        node = &path->node[i];
+        cell = node->state / 4;
+        robot->cell[node->tick] = cell;
+        robot->head[node->tick] = (unsigned char)(node->state % 4);
+        path->held[(long long)node->tick * path->cells + cell] = (unsigned char)(r + 1);
+        if (node->tick > path->last[cell])
+            path->last[cell] = node->tick;
+    }
+    path->parked[robot->goal] = robot->arrive + 1;
+    return(1);
+}
+
+
+/*
+ * forget the plan, all cells free again
+ */
+static void Fin_PathReset(struct fin_path *path)
+{
+    int i;
+
+    memset(path->held, 0, (size_t)path->ticks * path->cells);
+    for (i = 0; i < path->cells; i++)
+    {
+        path->parked[i] = FIN_MAZE_FAR;
+        path->last[i] = -1;
+        path->leave[i] = 0;
+    }
+    for (i = 0; i < path->robots; i++)
+    {
+        path->robot[i].arrive = -1;
+        path->leave[path->robot[i].start] = FIN_PATH_LEAVE;
+    }
+}
+
+
+/*
+ * free a grid
+ */
+static void Fin_PathFree(struct fin_path *path)
+{
+    int i;
+
+    for (i = 0; i < path->robots; i++)
+    {
+        free(path->robot[i].cell);
+        free(path->robot[i].head);
+    }
+    free(path->wall);
+    free(path->held);
+    free(path->parked);
+    free(path->last);
+    free(path->leave);
+    free(path->dist);
+    free(path->queue);
+    free(path->seen);
+    free(path->node);
+    free(path->heap);
+    free(path);
+}
+
+
+/**  Fin_PathOpen(width, height, ticks).
+ *  start planning the paths of a fleet on a grid
+ *
+ *  input:
+ *     int width/height = cells of the grid
+ *     int ticks = longest plan, in ticks
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PathOpen(int width, int height, int ticks)
+{
+    struct fin_path *path;
+    long long cells = (long long)width * height;
+
+    if (width <= 0 || height <= 0 || ticks <= 0 || cells * ticks > FIN_PATH_MAX)
+        return(-1);
+
+    path = calloc(1, sizeof(*path));
+    if (path == 0)
+        return(-1);
+    path->width = width;
+    path->height = height;
+    path->cells = (int)cells;
+    path->ticks = ticks;
+    path->wall = calloc((cells + 31) / 32, sizeof(unsigned int));
+    path->held = malloc((size_t)(cells * ticks));
+    path->parked = malloc(cells * sizeof(int));
+    path->last = malloc(cells * sizeof(int));
+    path->leave = malloc(cells * sizeof(int));
+    path->dist = malloc(cells * 4 * sizeof(int));
+    path->queue = malloc(cells * 4 * sizeof(int));
+    path->seen = malloc((cells * 4 * ticks + 31) / 32 * sizeof(unsigned int));
+    path->node_size = 256;
+    path->node = malloc(path->node_size * sizeof(*path->node));
+    path->heap_size = 256;
+    path->heap = malloc(path->heap_size * sizeof(*path->heap));
+    if (path->wall == 0 || path->held == 0 || path->parked == 0 || path->last == 0 ||
+        path->leave == 0 || path->dist == 0 || path->queue == 0 || path->seen == 0 ||
+        path->node == 0 || path->heap == 0)
+    {
+        Fin_PathFree(path);
+        return(-1);
+    }
+    Fin_PathReset(path);
+
+    Fin_PathClose();
+    fin_path = path;
+    return(1);
+}
+
+
+/**  Fin_PathClose(void).
+ *  forget the grid and the plan
+ *
+ *  returns
+ *     none
+ */
+void Fin_PathClose(void)
+{
+    if (fin_path != 0)
+        Fin_PathFree(fin_path);
+    fin_path = 0;
+}
+
+
+/**  Fin_PathWall(x, y).
+ *  a cell no robot goes through
+ *
+ *  input:
+ *     int x/y = the cell
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PathWall(int x, int y)
+{
+    struct fin_path *path = fin_path;
+
+    if (path == 0 || x < 0 || y < 0 || x >= path->width || y >= path->height)
+        return(-1);
+    Fin_PathSetBit(path->wall, y * path->width + x);
+    return(1);
+}
+
+
+/**  Fin_PathRobot(x, y, heading, goal_x, goal_y).
+ *  add a robot to the fleet
+ *
+ *  input:
+ *     int x/y = cell of the robot
+ *     int heading = where it faces, FIN_MAZE_EAST, _NORTH, _WEST or _SOUTH
+ *     int goal_x/goal_y = cell to take it to
+ *  returns
+ *     the number of the robot, -1 if failure
+ */
+int Fin_PathRobot(int x, int y, int heading, int goal_x, int goal_y)
+{
+    struct fin_path *path = fin_path;
+    struct fin_path_robot *robot;
+
+    if (path == 0 || path->robots == FIN_PATH_ROBOTS || heading < 0 || heading > 3 ||
+        x < 0 || y < 0 || x >= path->width || y >= path->height ||
+        goal_x < 0 || goal_y < 0 || goal_x >= path->width || goal_y >= path->height)
+        return(-1);
+
+    robot = &path->robot[path->robots];
+    robot->cell = malloc(path->ticks * sizeof(int));
+    robot->head = malloc(path->ticks);
+    if (robot->cell == 0 || robot->head == 0)
+    {
+        free(robot->cell);
+        free(robot->head);
+        return(-1);
+    }
+    robot->start = y * path->width + x;
+    robot->heading = heading;
+    robot->goal = goal_y * path->width + goal_x;
+    robot->arrive = -1;
+    return(path->robots++);
+}
+
+
+/**  Fin_PathPlan(void).
+ *  plan the paths of all the robots together
+ *
+ *  returns
+ *     ticks until the last robot is at its goal, -1 if no plan was found
+ */
+int Fin_PathPlan(void)
+{
+    struct fin_path *path = fin_path;
+    long long start = Fin_WallUsec();
+    int dist[FIN_PATH_ROBOTS];
+    int i, j, r, res = 0, restarts;
+
+    if (path == 0)
+        return(-1);
+
+    // farthest first, each on its own
+    path->stats.alone = 0;
+    for (i = 0; i < path->robots; i++)
+    {
+        Fin_PathDistances(path, path->robot[i].goal);
+        dist[i] = path->dist[path->robot[i].start * 4 + path->robot[i].heading];
+        if (dist[i] == FIN_MAZE_FAR)
+            return(-1);
+        path->stats.alone += dist[i];
+        for (j = i; j > 0 && dist[path->order[j - 1]] < dist[i]; j--)
+            path->order[j] = path->order[j - 1];
+        path->order[j] = i;
+    }
+
+    path->stats.expanded = 0;
+    for (restarts = 0; restarts <= path->robots; restarts++)
+    {
+        Fin_PathReset(path);
+        for (i = 0; i < path->robots; i++)
+            if ((res = Fin_PathRobotPlan(path, path->order[i])) <= 0)
+                break;
+        if (res < 0)
+            break;
+        if (i == path->robots)
+            break;
+
+        // the robot left without a path goes first
+        r = path->order[i];
+        for (; i > 0; i--)
+            path->order[i] = path->order[i - 1];
+        path->order[0] = r;
+    }
+
+    path->stats.robots = path->robots;
+    path->stats.restarts = restarts;
+    path->stats.ticks = 0;
+    path->stats.forward = 0;
+    path->stats.turns = 0;
+    for (i = 0; res > 0 && i < path->robots; i++)
+    {
+        if (path->robot[i].arrive > path->stats.ticks)
+            path->stats.ticks = path->robot[i].arrive;
+        for (j = 0; j < path->robot[i].arrive; j++)
+            if (path->robot[i].cell[j + 1] != path->robot[i].cell[j])
+                path->stats.forward++;
+            else if (path->robot[i].head[j + 1] != path->robot[i].head[j])
+                path->stats.turns++;
+    }
+    path->stats.plan_usec = Fin_WallUsec() - start;
+    if (res <= 0)
+    {
+        Fin_PathReset(path);
+        return(-1);
+    }
+    return(path->stats.ticks);
+}
+
+
+/**  Fin_PathAction(robot, tick).
+ *  what a robot does from a tick of the plan to the next
+ *
+ *  input:
+ *     int robot = number of the robot
+ *     int tick = from 0
+ *  returns
+ *     FIN_PATH_WAIT, _FORWARD, _LEFT or _RIGHT, -1 if failure (no plan)
+ */
+int Fin_PathAction(int robot, int tick)
+{
+    struct fin_path *path = fin_path;
+    struct fin_path_robot *r;
+
+    if (path == 0 || robot < 0 || robot >= path->robots || tick < 0 || path->robot[robot].arrive < 0)
+        return(-1);
+    r = &path->robot[robot];
+    if (tick >= r->arrive)
+        return(FIN_PATH_WAIT);
+    if (r->cell[tick + 1] != r->cell[tick])
+        return(FIN_PATH_FORWARD);
+    if (r->head[tick + 1] == (r->head[tick] + 1) % 4)
+        return(FIN_PATH_LEFT);
+    if (r->head[tick + 1] == (r->head[tick] + 3) % 4)
+        return(FIN_PATH_RIGHT);
+    return(FIN_PATH_WAIT);
+}
+
+
+/**  Fin_PathAt(robot, tick, *x, *y, *heading).
+ *  where a robot is at a tick of the plan
+ *
+ *  input:
+ *     int robot = number of the robot
+ *     int tick = from 0
+ *     int *x, *y, *heading = pointers where to return the cell and where it faces
+ *  returns
+ *     -1 if failure (no plan)
+ */
+int Fin_PathAt(int robot, int tick, int *x, int *y, int *heading)
+{
+    struct fin_path *path = fin_path;
+    struct fin_path_robot *r;
+
+    if (path == 0 || robot < 0 || robot >= path->robots || tick < 0 || path->robot[robot].arrive < 0)
+        return(-1);
+    r = &path->robot[robot];
+    if (tick > r->arrive)
+        tick = r->arrive;
+    *x = r->cell[tick] % path->width;
+    *y = r->cell[tick] / path->width;
+    *heading = r->head[tick];
+    return(1);
+}
+
+
+/**  Fin_PathGo(cell).
+ *  drive the plan on the fleet (see Fin_FleetOpen), robot n of the plan
+ *  being robot n of the fleet: the actions of each tick are released on
+ *  all the robots at once, the wheels timed for a tick
+ *
+ *  input:
+ *     double cell = meters a cell
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PathGo(double cell)
+{
+    struct fin_path *path = fin_path;
+    double speed = FIN_SIM_SPEED * FIN_MAZE_WHEEL / 255;
+    double quarter = M_PI / 2 * FIN_SIM_AXLE / 2;
+    int tenth, drive, turn, tick, r, action, staged, res = 1;
+
+    if (path == 0 || cell <= 0 || path->robots == 0 || path->robot[0].arrive < 0)
+        return(-1);
+
+    // a tick fits a cell or a quarter turn at the speed of the maze engine
+    tenth = (int)ceil((cell > quarter ? cell : quarter) / speed * 10);
+    drive = (int)(cell / (tenth / 10.0) / FIN_SIM_SPEED * 255 + 0.5);
+    turn = (int)(quarter / (tenth / 10.0) / FIN_SIM_SPEED * 255 + 0.5);
+
+    for (tick = 0; tick < path->stats.ticks && res > 0; tick++)
+    {
+        staged = 0;
+        for (r = 0; r < path->robots && res > 0; r++)
+        {
+            action = Fin_PathAction(r, tick);
+            if (action == FIN_PATH_FORWARD)
+                res = Fin_FleetMotor(r, tenth, drive, drive);
+            else if (action == FIN_PATH_LEFT || action == FIN_PATH_RIGHT)
+                res = Fin_FleetMotor(r, tenth, action == FIN_PATH_LEFT ? -turn : turn,
+                                     action == FIN_PATH_LEFT ? turn : -turn);
+            else
+                continue;
+            staged++;
+        }
+        if (res > 0 && staged > 0)
+            res = Fin_FleetGo(20);
+        Fin_Sleep(tenth * 100);
+    }
+    return(res);
+}
+
+
+/**  Fin_PathStatus(*stats).
+ *  get what the last plan takes and what making it took
+ *
+ *  input:
+ *     Fin_PathStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure (no grid)
+ */
+int Fin_PathStatus(Fin_PathStats *stats)
+{
+    if (fin_path == 0)
+        return(-1);
+    *stats = fin_path->stats;
+    return(1);
+}
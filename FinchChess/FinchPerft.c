@@ -0,0 +1,185 @@
+/*
+ * FinchPerft - checks the move generator of the chess board (FinchBoard.c)
+ *
+ * Counts the positions a few moves ahead of the standard test positions
+ * and compares them with the known counts, reporting the positions per
+ * second. With a position of its own it prints the count under each move
+ * (to compare with another program and find where they disagree).
+ * -k also checks at every position that the Zobrist key kept by the moves
+ * is the one computed from scratch, and that taking the moves back gives
+ * the position again.
+ *
+ * build:
+ *    gcc -O2 -o FinchPerft FinchPerft.c FinchBoard.c
+ * usage:
+ *    FinchPerft [-k] [depth]
+ *    FinchPerft [-k] depth "fen"
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "FinchBoard.h"
+
+/*
+ * a standard position and its counts, depth 1 on
+ */
+struct perft_case
+{
+    const char *name;
+    const char *fen;
+    int depth;                      // checked by default
+    unsigned long long nodes[6];
+};
+
+static const struct perft_case perft_cases[] =
+{
+    { "start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 6,
+      { 20, 400, 8902, 197281, 4865609, 119060324 } },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5,
+      { 48, 2039, 97862, 4085603, 193690690, 0 } },
+    { "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6,
+      { 14, 191, 2812, 43238, 674624, 11030083 } },
+    { "promotions", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+      { 6, 264, 9467, 422333, 15833292, 0 } },
+    { "checks", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5,
+      { 44, 1486, 62379, 2103487, 89941194, 0 } },
+    { "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 5,
+      { 46, 2079, 89890, 3894594, 164075551, 0 } },
+};
+
+static int perft_keys = 0;          // check the keys (-k)
+static int perft_bad = 0;           // keys or take backs that went wrong
+
+
+static double Perft_Seconds(void)
+{
+    return((double)clock() / CLOCKS_PER_SEC);
+}
+
+
+/*
+ * perft that checks the keys and the take backs on the way
+ */
+static unsigned long long Perft_Check(Fin_Board *board, int depth)
+{
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    char before[100], after[100];
+    unsigned long long nodes = 0;
+    int i, n;
+
+    if (board->key != Fin_BoardKey(board))
+        perft_bad++;
+    if (depth <= 0)
+        return(1);
+    n = Fin_BoardMoves(board, moves);
+    Fin_BoardFen(board, before, sizeof(before));
+    for (i = 0; i < n; i++)
+    {
+        Fin_BoardMake(board, moves[i]);
+        nodes += Perft_Check(board, depth - 1);
+        Fin_BoardUnmake(board);
+        Fin_BoardFen(board, after, sizeof(after));
+        if (strcmp(before, after) != 0)
+            perft_bad++;
+    }
+    return(nodes);
+}
+
+
+static unsigned long long Perft_Count(Fin_Board *board, int depth)
+{
+    return(perft_keys ? Perft_Check(board, depth) : Fin_BoardPerft(board, depth));
+}
+
+
+/*
+ * count under each move of a position
+ */
+static int Perft_Divide(const char *fen, int depth)
+{
+    Fin_Board board;
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    unsigned long long nodes, total = 0;
+    char text[6];
+    double start;
+    int i, n;
+
+    if (Fin_BoardSet(&board, fen) < 0)
+    {
+        printf("cannot read %s\n", fen);
+        return(1);
+    }
+    start = Perft_Seconds();
+    n = Fin_BoardMoves(&board, moves);
+    for (i = 0; i < n; i++)
+    {
+        Fin_BoardMake(&board, moves[i]);
+        nodes = depth > 1 ? Perft_Count(&board, depth - 1) : 1;
+        Fin_BoardUnmake(&board);
+        printf("%s: %llu\n", Fin_BoardText(moves[i], text), nodes);
+        total += nodes;
+    }
+    printf("\n%d moves, %llu positions in %.3f s\n", n, total, Perft_Seconds() - start);
+    if (perft_bad)
+        printf("%d wrong keys or take backs\n", perft_bad);
+    return(perft_bad != 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    const struct perft_case *c;
+    Fin_Board board;
+    unsigned long long nodes, total = 0;
+    double start, seconds, elapsed = 0;
+    int i = 1, depth = 0, d, last, failed = 0;
+
+    if (i < argc && strcmp(argv[i], "-k") == 0)
+    {
+        perft_keys = 1;
+        i++;
+    }
+    if (i < argc && (depth = atoi(argv[i++])) <= 0)
+    {
+        printf("usage: FinchPerft [-k] [depth]\n"
+               "       FinchPerft [-k] depth \"fen\"\n");
+        return(1);
+    }
+    if (i < argc)
+        return(Perft_Divide(argv[i], depth));
+
+    for (c = perft_cases; c < perft_cases + sizeof(perft_cases) / sizeof(perft_cases[0]); c++)
+    {
+        if (Fin_BoardSet(&board, c->fen) < 0)
+        {
+            printf("%-11s cannot read %s\n", c->name, c->fen);
+            failed++;
+            continue;
+        }
+        last = depth > 0 ? depth : c->depth;
+        for (d = 1; d <= last && d <= 6 && c->nodes[d - 1]; d++)
+        {
+            start = Perft_Seconds();
+            nodes = Perft_Count(&board, d);
+            seconds = Perft_Seconds() - start;
+            if (nodes != c->nodes[d - 1])
+                failed++;
+            if (d == last || d == 6 || c->nodes[d] == 0 || nodes != c->nodes[d - 1])
+                printf("%-11s depth %d %12llu positions %8.3f s %7.1f M/s %s\n", c->name, d, nodes,
+                       seconds, nodes / (seconds > 0 ? seconds : 1e-6) / 1e6,
+                       nodes == c->nodes[d - 1] ? "ok" : "WRONG");
+            total += nodes;
+            elapsed += seconds;
+        }
+    }
+    printf("%llu positions in %.3f s, %.1f M/s\n", total, elapsed,
+           total / (elapsed > 0 ? elapsed : 1e-6) / 1e6);
+    if (perft_bad)
+        printf("%d wrong keys or take backs\n", perft_bad);
+    if (failed)
+        printf("%d counts WRONG\n", failed);
+    return(failed != 0 || perft_bad != 0);
+}
@@ -0,0 +1,190 @@
+/*
+ * Sampling of the sensors by the background thread of a Finch.
+ * Only the sensors someone watches (a subscriber or a reflex) are sampled,
+ * and how often depends on what the robot is doing: obstacles and lights
+ * are read faster the faster the wheels turn, and hardly at all while it
+ * is parked; the temperature is always read slowly.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+
+/*
+ * usec between two samples of a sensor, 0 if nobody watches it,
+ * called with the device locked
+ */
+static long Fin_PollPeriod(struct fin_dev *dev, int sensor)
+{
+    int speed = abs(dev->snap.left_speed);
+
+    if (dev->subscribers[sensor] == 0 && !(dev->reflex_sensors & (1 << sensor)))
+        return(0);
+
+    if (abs(dev->snap.right_speed) > speed)
+        speed = abs(dev->snap.right_speed);
+    if (speed > 255)
+        speed = 255;
+
+    switch (sensor)
+    {
+    case FIN_LIGHTS:
+    case FIN_OBSTACLES:
+        if (speed == 0)
+            return(FIN_POLL_IDLE);
+        return(FIN_POLL_FAST + (FIN_POLL_SLOW - FIN_POLL_FAST) * (255 - speed) / 255);
+    case FIN_ACCEL:
+        return(speed ? FIN_POLL_SLOW : FIN_POLL_IDLE / 4);
+    default:
+        return(FIN_POLL_TEMP);
+    }
+}
+
+
+/*
+ * close the measuring window once it is over, called with the device locked
+ */
+static void Fin_PollWindow(struct fin_dev *dev, long long now)
+{
+    long long elapsed = now - dev->window_at;
+    int i;
+
+    if (elapsed < FIN_POLL_WINDOW)
+        return;
+    if (dev->window_at != 0)
+    {
+        for (i = 0; i < FIN_SENSORS; i++)
+            dev->poll_stats.rate[i] = dev->window_samples[i] * 1000000.0f / elapsed;
+        dev->poll_stats.bytes_per_sec = (long)((dev->link_bytes - dev->window_bytes) * 1000000 / elapsed);
+        dev->poll_stats.cmnds_per_sec = (long)((dev->cmnd_count - dev->window_cmnds) * 1000000LL / elapsed);
+    }
+    memset(dev->window_samples, 0, sizeof(dev->window_samples));
+    dev->window_bytes = dev->link_bytes;
+    dev->window_cmnds = dev->cmnd_count;
+    dev->window_at = now;
+}
+
+
+/*
+ * sensor the background thread should sample now, -1 if none,
+ * *wake is lowered to the next time one is due,
+ * called with the device locked
+ */
+int Fin_PollDue(struct fin_dev *dev, long long now, long long *wake)
+{
+    long long at, due_at = 0;
+    long period;
+    int due = -1;
+    int i;
+
+    for (i = 0; i < FIN_SENSORS; i++)
+    {
+        period = Fin_PollPeriod(dev, i);
+        if (period == 0)
+            continue;
+        at = dev->polled_at[i] + period;
+        if (at <= now && (due < 0 || at < due_at))
+        {
+            due = i;
+            due_at = at;
+        }
+        if (at < *wake)
+            *wake = at;
+    }
+    return(due);
+}
+
+
+/*
+ * a sample of a sensor went out (asked by the poller or by the program),
+ * called with the device locked
+ */
+void Fin_Polled(struct fin_dev *dev, int sensor, long long sent)
+{
+    dev->polled_at[sensor] = sent;
+    dev->window_samples[sensor]++;
+    Fin_PollWindow(dev, sent);
+}
+
+
+/*
+ * add or remove a subscriber of a sensor of a device
+ */
+int Fin_DevSubscribe(struct fin_dev *dev, int sensor, int on)
+{
+    if (sensor < 0 || sensor >= FIN_SENSORS)
+        return(-1);
+
+    Fin_Lock(&dev->lock);
+    if (on)
+    {
+        // sampled right away
+        if (dev->subscribers[sensor]++ == 0)
+            dev->polled_at[sensor] = 0;
+        Fin_Wake(dev);
+    }
+    else if (dev->subscribers[sensor] > 0)
+        dev->subscribers[sensor]--;
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
+
+
+/**  Fin_Subscribe(sensor).
+ *  have the library sample a sensor in the background
+ *
+ *  input:
+ *     int sensor = FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Subscribe(int sensor)
+{
+    // the daemon samples every sensor for the snapshot already
+    if (Fin_Attached())
+        return(sensor < 0 || sensor >= FIN_SENSORS ? -1 : 1);
+    return(Fin_DevSubscribe(Fin_Dev(), sensor, 1));
+}
+
+
+/**  Fin_Unsubscribe(sensor).
+ *  undo a Fin_Subscribe
+ *
+ *  input:
+ *     int sensor = FIN_LIGHTS, FIN_OBSTACLES, FIN_ACCEL or FIN_TEMP
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Unsubscribe(int sensor)
+{
+    if (Fin_Attached())
+        return(sensor < 0 || sensor >= FIN_SENSORS ? -1 : 1);
+    return(Fin_DevSubscribe(Fin_Dev(), sensor, 0));
+}
+
+
+/**  Fin_PollStatus(*stats).
+ *  get the sampling periods, the rates achieved and the traffic on the link
+ *
+ *  input:
+ *     Fin_PollStats *stats = pointer where to return them
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PollStatus(Fin_PollStats *stats)
+{
+    struct fin_dev *dev = Fin_Dev();
+    int i;
+
+    Fin_Lock(&dev->lock);
+    Fin_PollWindow(dev, Fin_Usec());
+    for (i = 0; i < FIN_SENSORS; i++)
+        dev->poll_stats.period_usec[i] = Fin_PollPeriod(dev, i);
+    *stats = dev->poll_stats;
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
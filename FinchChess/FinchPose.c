@@ -0,0 +1,208 @@
+/*
+ * Pose of a Finch by dead reckoning, kept by its background thread:
+ * each wheel command that goes out moves the estimate up to the time it
+ * took effect, with the speeds of the previous one (an arc at constant
+ * wheel speeds), and the covariance of x, y and heading grows with the
+ * distance driven and the angle turned. The accelerometer samples correct
+ * it: off the floor (little g on z) the wheels do not move the robot, a
+ * tap while driving is taken as a hit, after which the wheels slip (as in
+ * the simulator) until the robot turns away or backs off; pushing on the
+ * same way is felt as no new tap. Reading the pose is a copy and
+ * one more arc, whatever the time since the last command.
+ * The robot moves as the simulator has it (FIN_SIM_SPEED, FIN_SIM_AXLE).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+
+/*
+ * drive the estimate up to usec with the wheel speeds it has
+ */
+static void Fin_PoseAdvance(struct fin_pose *pose, long long usec)
+{
+    double dt = (usec - pose->usec) / 1e6;
+    double speed, turn, ds, dth, mid, c, s;
+    double f[3][3], g[3][2], q[2], p[3][3];
+    int i, j, k;
+
+    if (dt <= 0)
+        return;
+    pose->usec = usec;
+    if (pose->lifted || (pose->left == 0 && pose->right == 0))
+        return;
+
+    speed = pose->blocked ? 0 : (pose->left + pose->right) / 2;
+    turn = (pose->right - pose->left) / FIN_SIM_AXLE;
+    ds = speed * dt;
+    dth = turn * dt;
+    mid = pose->heading + dth / 2;
+
+    // along the arc, the chord when it is straight
+    if (fabs(dth) > 1e-9)
+    {
+        pose->x += speed / turn * (sin(pose->heading + dth) - sin(pose->heading));
+        pose->y -= speed / turn * (cos(pose->heading + dth) - cos(pose->heading));
+    }
+    else
+    {
+        pose->x += ds * cos(mid);
+        pose->y += ds * sin(mid);
+    }
+    pose->heading = fmod(pose->heading + dth, 2 * M_PI);
+    if (pose->heading < 0)
+        pose->heading += 2 * M_PI;
+    pose->distance += fabs(ds);
+
+    // P = F P F' + G Q G', over the chord of the arc
+    c = cos(mid);
+    s = sin(mid);
+    memset(f, 0, sizeof(f));
+    f[0][0] = f[1][1] = f[2][2] = 1;
+    f[0][2] = -ds * s;
+    f[1][2] = ds * c;
+    g[0][0] = c;
+    g[0][1] = -ds / 2 * s;
+    g[1][0] = s;
+    g[1][1] = ds / 2 * c;
+    g[2][0] = 0;
+    g[2][1] = 1;
+    q[0] = FIN_POSE_SLIP * fabs(ds);
+    q[1] = FIN_POSE_TURN * fabs(dth) + FIN_POSE_DRIFT * fabs(ds);
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            for (p[i][j] = 0, k = 0; k < 3; k++)
+                p[i][j] += f[i][k] * pose->cov[k][j];
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+        {
+            pose->cov[i][j] = g[i][0] * q[0] * g[j][0] + g[i][1] * q[1] * g[j][1];
+            for (k = 0; k < 3; k++)
+                pose->cov[i][j] += p[i][k] * f[j][k];
+        }
+}
+
+
+/*
+ * wheel speeds took effect at usec (the snapshot has them),
+ * called by the background thread with the device locked
+ */
+void Fin_PoseWheels(struct fin_dev *dev, long long at)
+{
+    struct fin_pose *pose = &dev->pose;
+
+    double off;
+
+    Fin_PoseAdvance(pose, at);
+    pose->left = dev->snap.left_speed * FIN_SIM_SPEED / 255;
+    pose->right = dev->snap.right_speed * FIN_SIM_SPEED / 255;
+
+    // still against what it hit, unless it turned away or backs off
+    off = fabs(remainder(pose->heading - pose->blocked_heading, 2 * M_PI));
+    if (off > FIN_POSE_FREED || (pose->left + pose->right) * pose->blocked_way < 0)
+        pose->blocked = 0;
+}
+
+
+/*
+ * the accelerometer was sampled (at usec, the snapshot has it),
+ * called by the background thread with the device locked
+ */
+void Fin_PoseAccel(struct fin_dev *dev, long long at)
+{
+    struct fin_pose *pose = &dev->pose;
+    int lifted = dev->snap.accel[2] < FIN_POSE_FLAT;
+
+    Fin_PoseAdvance(pose, at);
+
+    // put back down, anywhere around
+    if (pose->lifted && !lifted)
+    {
+        pose->cov[0][0] += FIN_POSE_MOVED * FIN_POSE_MOVED;
+        pose->cov[1][1] += FIN_POSE_MOVED * FIN_POSE_MOVED;
+        pose->cov[2][2] += M_PI * M_PI;
+    }
+    pose->lifted = lifted;
+
+    // a hit while driving, it stopped short of where the wheels say
+    if (dev->snap.tap && !pose->blocked && pose->left + pose->right != 0)
+    {
+        pose->blocked = 1;
+        pose->blocked_heading = pose->heading;
+        pose->blocked_way = pose->left + pose->right > 0 ? 1 : -1;
+        pose->bumps++;
+        pose->cov[0][0] += FIN_POSE_BUMP * FIN_POSE_BUMP;
+        pose->cov[1][1] += FIN_POSE_BUMP * FIN_POSE_BUMP;
+    }
+}
+
+
+/**  Fin_PoseNow(*pose).
+ *  get where the robot is now, by dead reckoning
+ *
+ *  input:
+ *     Fin_Pose *pose = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PoseNow(Fin_Pose *pose)
+{
+    struct fin_dev *dev = Fin_Dev();
+    struct fin_pose now;
+    int i, j;
+
+    Fin_Lock(&dev->lock);
+    now = dev->pose;
+    Fin_Unlock(&dev->lock);
+    Fin_PoseAdvance(&now, Fin_Usec());
+
+    pose->x = now.x;
+    pose->y = now.y;
+    pose->heading = now.heading * 180 / M_PI;
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            pose->cov[i][j] = now.cov[i][j] * (i == 2 ? 180 / M_PI : 1) * (j == 2 ? 180 / M_PI : 1);
+    pose->distance = now.distance;
+    pose->lifted = now.lifted;
+    pose->blocked = now.blocked;
+    pose->bumps = now.bumps;
+    pose->usec = now.usec;
+    return(1);
+}
+
+
+/**  Fin_PoseSet(x, y, heading).
+ *  tell the robot where it is, the uncertainty starts again from none
+ *
+ *  input:
+ *     double x/y = meters
+ *     double heading = degrees counterclockwise from the x axis
+ *  returns
+ *     -1 if failure
+ */
+int Fin_PoseSet(double x, double y, double heading)
+{
+    struct fin_dev *dev = Fin_Dev();
+    struct fin_pose *pose = &dev->pose;
+
+    Fin_Lock(&dev->lock);
+    Fin_PoseAdvance(pose, Fin_Usec());
+    pose->x = x;
+    pose->y = y;
+    pose->heading = fmod(heading * M_PI / 180, 2 * M_PI);
+    if (pose->heading < 0)
+        pose->heading += 2 * M_PI;
+    memset(pose->cov, 0, sizeof(pose->cov));
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
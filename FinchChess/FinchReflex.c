@@ -0,0 +1,263 @@
+/*
+ * Reflexes: rules evaluated by the background thread of a Finch on each
+ * sensor sample, so the robot reacts without waiting for the program
+ * (e.g. stop while the program is blocked in Fin_Move).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+
+/*
+ * sensor a condition is about
+ */
+static int Fin_RuleSensor(int when)
+{
+    switch (when)
+    {
+    case FIN_IF_OBSTACLE_BOTH:
+    case FIN_IF_OBSTACLE_ANY:
+    case FIN_IF_OBSTACLE_LEFT:
+    case FIN_IF_OBSTACLE_RIGHT:
+        return(FIN_OBSTACLES);
+    case FIN_IF_SHAKE:
+    case FIN_IF_TAP:
+        return(FIN_ACCEL);
+    case FIN_IF_LIGHT_BELOW:
+    case FIN_IF_LIGHT_ABOVE:
+        return(FIN_LIGHTS);
+    case FIN_IF_TEMP_ABOVE:
+        return(FIN_TEMP);
+    default:
+        return(-1);
+    }
+}
+
+
+/*
+ * does the condition of a rule hold on the readings
+ */
+static int Fin_RuleHolds(const Fin_Rule *rule, const Fin_Sensors *snap)
+{
+    switch (rule->when)
+    {
+    case FIN_IF_OBSTACLE_BOTH:
+        return(snap->obstacle[0] && snap->obstacle[1]);
+    case FIN_IF_OBSTACLE_ANY:
+        return(snap->obstacle[0] || snap->obstacle[1]);
+    case FIN_IF_OBSTACLE_LEFT:
+        return(snap->obstacle[0]);
+    case FIN_IF_OBSTACLE_RIGHT:
+        return(snap->obstacle[1]);
+    case FIN_IF_SHAKE:
+        return(snap->shake);
+    case FIN_IF_TAP:
+        return(snap->tap);
+    case FIN_IF_LIGHT_BELOW:
+        return(snap->lights[0] < rule->value || snap->lights[1] < rule->value);
+    case FIN_IF_LIGHT_ABOVE:
+        return(snap->lights[0] > rule->value || snap->lights[1] > rule->value);
+    case FIN_IF_TEMP_ABOVE:
+        return(snap->temp > rule->value);
+    default:
+        return(0);
+    }
+}
+
+
+/*
+ * find the sensors the armed rules watch, called with the device locked
+ */
+static void Fin_ReflexWatch(struct fin_dev *dev)
+{
+    int i;
+
+    dev->reflex_sensors = 0;
+    for (i = 0; i < FIN_REFLEXES; i++)
+        if (dev->reflex[i].armed)
+            dev->reflex_sensors |= 1 << Fin_RuleSensor(dev->reflex[i].rule.when);
+}
+
+
+/*
+ * evaluate the rules watching a sensor that was just sampled and do the
+ * actions of those whose condition became true,
+ * called by the background thread with the device locked
+ */
+void Fin_Reflexes(struct fin_dev *dev, int sensor, long long sent, long long recv)
+{
+    Fin_ReflexStats *stats = &dev->reflex_stats;
+    unsigned char IoBuffer[9];
+    struct fin_reflex *reflex;
+    Fin_Rule fire;
+    int action = 0;
+    long long now;
+    int holds;
+    int i;
+
+    for (i = 0; i < FIN_REFLEXES; i++)
+    {
+        reflex = &dev->reflex[i];
+        if (!reflex->armed || Fin_RuleSensor(reflex->rule.when) != sensor)
+            continue;
+
+        // only on the sample where the condition becomes true
+        holds = Fin_RuleHolds(&reflex->rule, &dev->snap);
+        if (holds && !reflex->active)
+        {
+            action |= reflex->rule.action;
+            fire = reflex->rule;
+            if (reflex->rule.once)
+                reflex->armed = 0;
+        }
+        reflex->active = holds;
+    }
+    if (action == 0)
+        return;
+    Fin_ReflexWatch(dev);
+
+    if (action & FIN_DO_STOP)
+    {
+        // the program sees the wheels stopped (Fin_Move returns),
+        // and wheel commands still queued are dropped
+        dev->stop_at = 0;
+        dev->left_speed = 0;
+        dev->right_speed = 0;
+        dev->snap.left_speed = 0;
+        dev->snap.right_speed = 0;
+        Fin_Cancel(dev, FIN_LANE_SAFETY, "M", FIN_ECANCELED);
+        if (dev->sampled != 0)
+            dev->sampled(dev);
+        Fin_Broadcast(&dev->done);
+    }
+    Fin_Unlock(&dev->lock);
+
+    // stop first, it is the one that matters
+    now = 0;
+    if (action & FIN_DO_STOP)
+    {
+        memset(IoBuffer, 0, sizeof(IoBuffer));
+        Fin_Transfer(dev, SEND, 'M', IoBuffer);
+        now = Fin_Usec();
+        // the pose stops where the wheels did
+        Fin_Lock(&dev->lock);
+        Fin_PoseWheels(dev, now);
+        Fin_Unlock(&dev->lock);
+    }
+    if (action & FIN_DO_LED)
+    {
+        IoBuffer[2] = (char)fire.red;
+        IoBuffer[3] = (char)fire.green;
+        IoBuffer[4] = (char)fire.blue;
+        Fin_Transfer(dev, SEND, 'O', IoBuffer);
+        if (now == 0)
+            now = Fin_Usec();
+    }
+    if (action & FIN_DO_BUZZ)
+    {
+        IoBuffer[2] = (char)(fire.msec >> 8);
+        IoBuffer[3] = (char)(fire.msec);
+        IoBuffer[4] = (char)(fire.freq >> 8);
+        IoBuffer[5] = (char)(fire.freq);
+        Fin_Transfer(dev, SEND, 'B', IoBuffer);
+        if (now == 0)
+            now = Fin_Usec();
+    }
+
+    Fin_Lock(&dev->lock);
+    stats->fired++;
+    stats->last_usec = (long)(now - recv);
+    stats->sample_usec = (long)(now - sent);
+    if (stats->last_usec > stats->max_usec)
+        stats->max_usec = stats->last_usec;
+    dev->reflex_total += stats->last_usec;
+    stats->avg_usec = (long)(dev->reflex_total / stats->fired);
+}
+
+
+/**  Fin_Reflex(*rule).
+ *  add a reflex rule
+ *
+ *  input:
+ *     Fin_Rule *rule = the rule
+ *  returns
+ *     the rule number, -1 if failure
+ */
+int Fin_Reflex(const Fin_Rule *rule)
+{
+    struct fin_dev *dev = Fin_Dev();
+    int sensor;
+    int i;
+
+    if (Fin_RuleSensor(rule->when) < 0 || rule->action == 0)
+        return(-1);
+
+    Fin_Lock(&dev->lock);
+    for (i = 0; i < FIN_REFLEXES; i++)
+        if (!dev->reflex[i].armed)
+            break;
+    if (i < FIN_REFLEXES)
+    {
+        // a sensor nobody watched yet is sampled right away
+        sensor = Fin_RuleSensor(rule->when);
+        if (dev->subscribers[sensor] == 0 && !(dev->reflex_sensors & (1 << sensor)))
+            dev->polled_at[sensor] = 0;
+        dev->reflex[i].rule = *rule;
+        dev->reflex[i].active = 0;
+        dev->reflex[i].armed = 1;
+        Fin_ReflexWatch(dev);
+        Fin_Wake(dev);
+    }
+    Fin_Unlock(&dev->lock);
+
+    return(i < FIN_REFLEXES ? i : -1);
+}
+
+
+/**  Fin_ReflexClear(id).
+ *  remove a reflex rule
+ *
+ *  input:
+ *     int id = number returned by Fin_Reflex, -1 for all the rules
+ *  returns
+ *     -1 if failure
+ */
+int Fin_ReflexClear(int id)
+{
+    struct fin_dev *dev = Fin_Dev();
+    int i;
+
+    if (id < -1 || id >= FIN_REFLEXES)
+        return(-1);
+
+    Fin_Lock(&dev->lock);
+    for (i = 0; i < FIN_REFLEXES; i++)
+        if (id == -1 || id == i)
+            dev->reflex[i].armed = 0;
+    Fin_ReflexWatch(dev);
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
+
+
+/**  Fin_ReflexStatus(*stats).
+ *  get the reaction times of the reflexes
+ *
+ *  input:
+ *     Fin_ReflexStats *stats = pointer where to return them
+ *  returns
+ *     -1 if failure
+ */
+int Fin_ReflexStatus(Fin_ReflexStats *stats)
+{
+    struct fin_dev *dev = Fin_Dev();
+
+    Fin_Lock(&dev->lock);
+    *stats = dev->reflex_stats;
+    Fin_Unlock(&dev->lock);
+    return(1);
+}
@@ -0,0 +1,917 @@
+/*
+ * Chess search of the workshop: iterative deepening alpha-beta with
+ * principal variation search, null move pruning, late move reductions,
+ * killer and history move ordering and a quiescence search of the
+ * captures.
+ *
+ * The threads share nothing but the transposition table (Lazy SMP):
+ * every one deepens on its own copy of the board, the helpers skipping
+ * some depths so they are ahead of the main thread and fill the table
+ * for it. The table is not locked: each entry is stored as its data and
+ * its key xor its data, so an entry half written by another thread does
+ * not match its key and is taken as a miss.
+ * The main thread keeps the time and the count of positions and stops
+ * the others.
+ * A search started to ponder (on the position after the reply expected,
+ * while that reply is awaited) has no limit until Fin_SearchPonderHit,
+ * after which the time it already spent counts toward its budget, so a
+ * long wait for the reply leaves the move ready at once.
+ * With endgame tables open (FinchTable.c) the positions of few pieces are
+ * looked up instead of searched, the leaves too.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "FinchBoard.h"
+
+#ifdef _LINUX_
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#else
+#include <windows.h>
+#endif
+
+#define SEARCH_INFINITE  32000
+#define SEARCH_MATED     (FIN_SEARCH_MATE - FIN_SEARCH_PLIES)   // scores past it are mates
+
+/* bounds of a score in the table */
+#define SEARCH_EXACT    1
+#define SEARCH_LOWER    2           // at least (it failed high)
+#define SEARCH_UPPER    3           // at most (no move raised alpha)
+
+/*
+ * entry of the transposition table: key ^ data, and data packing the
+ * move (16 bits), score (16), depth (8), bound (8) and age (8)
+ */
+struct search_entry
+{
+    volatile unsigned long long check;
+    volatile unsigned long long data;
+};
+
+/*
+ * a search thread and its copy of the board
+ */
+struct search_thread
+{
+    Fin_Board board;
+    int id;
+    unsigned long long nodes;
+    unsigned long long tables;      // positions found in the endgame tables
+    int depth;                      // last depth completed
+    int score;                      // its score
+    int seldepth;
+    Fin_BoardMove line[FIN_SEARCH_PLIES];
+    int length;
+    Fin_BoardMove pv[FIN_SEARCH_PLIES][FIN_SEARCH_PLIES];
+    int pv_length[FIN_SEARCH_PLIES];
+    Fin_BoardMove killer[FIN_SEARCH_PLIES][2];
+    int history[12][64];            // quiet moves by piece and square reached
+#ifdef _LINUX_
+    pthread_t handle;
+#else
+    HANDLE handle;
+#endif
+};
+
+static struct search_entry *search_table = 0;
+static unsigned long long search_mask;      // buckets - 1, a bucket is two entries
+static unsigned int search_age = 0;
+
+static volatile int search_stop;
+static volatile int search_pondering;       // no limit but Fin_SearchStop until Fin_SearchPonderHit
+static long long search_start;
+static long long search_usec;               // time for the move, 0 for no limit
+static long long search_deadline;           // 0 for no limit (or pondering)
+static unsigned long long search_nodes;     // 0 for no limit
+static int search_depth;
+static void (*search_report)(const Fin_SearchInfo *info);
+static struct search_thread *search_threads;
+static int search_count;                    // threads
+
+static int search_ready = 0;
+static int search_reduce[64][64];           // late move reductions by depth and move number
+
+static const int search_value[6] = { 100, 320, 330, 500, 900, 0 };
+
+/* the skipped depths of the helpers, spread over the threads */
+static const int search_skip_size[20] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+static const int search_skip_phase[20] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+
+/*
+ * wall clock, from an arbitrary point
+ */
+static long long Search_Usec(void)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return((long long)(now.QuadPart * 1000000.0 / freq.QuadPart));
+#endif
+}
+
+
+/*
+ * give the processor away for a millisecond
+ */
+static void Search_Nap(void)
+{
+#ifdef _LINUX_
+    usleep(1000);
+#else
+    Sleep(1);
+#endif
+}
+
+
+/*
+ * table of the reductions
+ */
+static void Search_Init(void)
+{
+    int d, m;
+
+    for (d = 1; d < 64; d++)
+        for (m = 1; m < 64; m++)
+            search_reduce[d][m] = (int)(0.75 + log(d) * log(m) / 2.25);
+    search_ready = 1;
+}
+
+
+/*
+ * score of a position for the side to move: material and squares, kept
+ * up to date by the moves (board->score), from the middle game to the end
+ * game as the pieces come off
+ */
+static int Search_Eval(const Fin_Board *board)
+{
+    int mg = FIN_SCORE_MG(board->score), eg = FIN_SCORE_EG(board->score), phase = board->phase;
+
+    if (__builtin_popcountll(board->pieces[FIN_PIECE(FIN_WHITE, FIN_BISHOP)]) >= 2)
+    {
+        mg += 30;
+        eg += 50;
+    }
+    if (__builtin_popcountll(board->pieces[FIN_PIECE(FIN_BLACK, FIN_BISHOP)]) >= 2)
+    {
+        mg -= 30;
+        eg -= 50;
+    }
+    if (phase > 24)
+        phase = 24;
+    mg = (mg * phase + eg * (24 - phase)) / 24;
+    return((board->turn == FIN_WHITE ? mg : -mg) + 10);
+}
+
+
+/*
+ * the table: look up a position
+ */
+static int Search_Probe(unsigned long long key, Fin_BoardMove *move, int *score, int *depth, int *bound)
+{
+    struct search_entry *e = &search_table[(key & search_mask) * 2];
+    unsigned long long data;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        data = e[i].data;
+        if ((e[i].check ^ data) == key)
+        {
+            *move = (Fin_BoardMove)(data & 0xffff);
+            *score = (int)((data >> 16) & 0xffff) - 32768;
+            *depth = (int)((data >> 32) & 0xff);
+            *bound = (int)((data >> 40) & 0xff);
+            return(1);
+        }
+    }
+    return(0);
+}
+
+/*
+ * the table: keep a position, in the first entry of the bucket if it is
+ * deeper than what is there or that is old, in the second one otherwise
+ */
+static void Search_Store(unsigned long long key, Fin_BoardMove move, int score, int depth, int bound)
+{
+    struct search_entry *e = &search_table[(key & search_mask) * 2];
+    unsigned long long data, old = e[0].data;
+
+    if (depth < 0)
+        depth = 0;
+    data = move | (unsigned long long)(score + 32768) << 16 | (unsigned long long)depth << 32 |
+           (unsigned long long)bound << 40 | (unsigned long long)(search_age & 0xff) << 48;
+    if ((e[0].check ^ old) != key && ((old >> 48) & 0xff) == (search_age & 0xff) &&
+        (int)((old >> 32) & 0xff) > depth)
+        e++;
+    e->data = data;
+    e->check = key ^ data;
+}
+
+/* mates are kept as from the position, not from the root */
+static int Search_ToTable(int score, int ply)
+{
+    return(score >= SEARCH_MATED ? score + ply : score <= -SEARCH_MATED ? score - ply : score);
+}
+
+static int Search_FromTable(int score, int ply)
+{
+    return(score >= SEARCH_MATED ? score - ply : score <= -SEARCH_MATED ? score + ply : score);
+}
+
+
+/*
+ * the main thread checks the time and the positions searched now and then
+ */
+static void Search_Check(struct search_thread *t)
+{
+    unsigned long long nodes = 0;
+    int i;
+
+    if (t->id != 0 || (t->nodes & 2047) != 0)
+        return;
+    if (search_deadline && Search_Usec() >= search_deadline)
+        search_stop = 1;
+    if (search_nodes && !search_pondering)
+    {
+        for (i = 0; i < search_count; i++)
+            nodes += search_threads[i].nodes;
+        if (nodes >= search_nodes)
+            search_stop = 1;
+    }
+}
+
+/* a thread always completes depth 1, so there is a move */
+#define Search_Stopped(t)   (search_stop && (t)->depth > 0)
+
+
+/*
+ * the position was seen before since the last capture or pawn move
+ */
+static int Search_Repeated(const Fin_Board *board)
+{
+    int i, first = board->ply - board->halfmove;
+
+    for (i = board->ply - 4; i >= first && i >= 0; i -= 2)
+        if (board->undo[i].key == board->key)
+            return(1);
+    return(0);
+}
+
+
+/*
+ * order of the moves: the one of the table, captures of the most
+ * valuable piece by the least valuable one, killers, then the quiet
+ * moves by how often they were good
+ */
+static void Search_Order(struct search_thread *t, Fin_BoardMove *moves, int *order, int n,
+                         Fin_BoardMove best, int ply)
+{
+    const Fin_Board *board = &t->board;
+    int i, victim, flags;
+
+    for (i = 0; i < n; i++)
+    {
+        flags = FIN_MOVE_FLAGS(moves[i]);
+        victim = flags == FIN_MOVE_EP ? FIN_PAWN : board->square[FIN_MOVE_TO(moves[i])];
+        if (moves[i] == best)
+            order[i] = 1 << 30;
+        else if (victim != FIN_EMPTY || flags == FIN_MOVE_PROMO + FIN_QUEEN - FIN_KNIGHT)
+            order[i] = (1 << 28) + (victim != FIN_EMPTY ? search_value[FIN_KIND(victim)] * 8 : 0) +
+                       (flags >= FIN_MOVE_PROMO ? search_value[FIN_MOVE_PROMOTED(moves[i])] * 8 : 0) -
+                       FIN_KIND(board->square[FIN_MOVE_FROM(moves[i])]);
+        else if (moves[i] == t->killer[ply][0])
+            order[i] = 1 << 27;
+        else if (moves[i] == t->killer[ply][1])
+            order[i] = (1 << 27) - 1;
+        else if (flags >= FIN_MOVE_PROMO)
+            order[i] = -(1 << 28);
+        else
+            order[i] = t->history[board->square[FIN_MOVE_FROM(moves[i])]][FIN_MOVE_TO(moves[i])];
+    }
+}
+
+/*
+ * bring the best of the moves left to the front
+ */
+static void Search_Pick(Fin_BoardMove *moves, int *order, int n, int first)
+{
+    Fin_BoardMove move;
+    int i, best = first, score;
+
+    for (i = first + 1; i < n; i++)
+        if (order[i] > order[best])
+            best = i;
+    move = moves[first];
+    moves[first] = moves[best];
+    moves[best] = move;
+    score = order[first];
+    order[first] = order[best];
+    order[best] = score;
+}
+
+
+static int Search_Capture(const Fin_Board *board, Fin_BoardMove move)
+{
+    return(board->square[FIN_MOVE_TO(move)] != FIN_EMPTY || FIN_MOVE_FLAGS(move) == FIN_MOVE_EP);
+}
+
+
+/*
+ * score of a position found in the endgame tables (FinchTable.c), a mate
+ * too far to tell from the others a score past any evaluation
+ */
+static int Search_Ending(struct search_thread *t, int ply, int *score)
+{
+    int result, plies;
+
+    result = Fin_TableProbe(&t->board, &plies);
+    if (result < 0)
+        return(0);
+    t->tables++;
+    if (result == FIN_TABLE_DRAW)
+        *score = 0;
+    else if (ply + plies >= FIN_SEARCH_PLIES)
+        *score = result == FIN_TABLE_WIN ? SEARCH_MATED - 1 : -SEARCH_MATED + 1;
+    else
+        *score = result == FIN_TABLE_WIN ? FIN_SEARCH_MATE - ply - plies : -FIN_SEARCH_MATE + ply + plies;
+    return(1);
+}
+
+
+/*
+ * quiescence search: only the captures (all the moves when in check),
+ * until the position is quiet
+ */
+static int Search_Quiet(struct search_thread *t, int alpha, int beta, int ply)
+{
+    Fin_Board *board = &t->board;
+    Fin_BoardMove moves[FIN_BOARD_MOVES];
+    int order[FIN_BOARD_MOVES];
+    int i, n, score, best, stand = 0, check, victim;
+
+    t->nodes++;
+    Search_Check(t);
+    if (Search_Stopped(t))
+        return(0);
+    if (ply > t->seldepth)
+        t->seldepth = ply;
+    if (ply >= FIN_SEARCH_PLIES - 1)
+        return(Search_Eval(board));
+
+    check = Fin_BoardCheck(board);
+    if (check)
+        best = -FIN_SEARCH_MATE + ply;
+    else
+    {
+        best = stand = Search_Eval(board);
+        if (stand >= beta)
+            return(stand);
+        if (stand > alpha)
+            alpha = stand;
+    }
+
+    n = Fin_BoardMoves(board, moves);
+    if (n == 0)
+        return(check ? -FIN_SEARCH_MATE + ply : 0);
+    Search_Order(t, moves, order, n, FIN_MOVE_NONE, ply);
+    for (i = 0; i < n; i++)
+    {
+        Search_Pick(moves, order, n, i);
+        if (!check)
+        {
+            if (!Search_Capture(board, moves[i]) && FIN_MOVE_FLAGS(moves[i]) < FIN_MOVE_PROMO)
+                break;              // the captures come first
+            // even taking it for free would not be enough
+            victim = FIN_MOVE_FLAGS(moves[i]) == FIN_MOVE_EP ? FIN_PAWN :
+                     board->square[FIN_MOVE_TO(moves[i])];
+            if (victim != FIN_EMPTY && FIN_MOVE_FLAGS(moves[i]) < FIN_MOVE_PROMO &&
+                stand + search_value[FIN_KIND(victim)] + 200 < alpha)
+                continue;
+        }
+        Fin_BoardMake(board, moves[i]);
+        score = -Search_Quiet(t, -beta, -alpha, ply + 1);
+        Fin_BoardUnmake(board);
+        if (Search_Stopped(t))
+            return(0);
+        if (score > best)
+        {
+            best = score;
+            if (score > alpha)
+            {
+                alpha = score;
+                if (score >= beta)
+                    break;
+            }
+        }
+    }
+    return(best);
+}
+
+
+/*
+ * alpha-beta search of a position depth plies ahead
+ */
+static int Search_Node(struct search_thread *t, int alpha, int beta, int depth, int ply, int null_ok)
+{
+    Fin_Board *board = &t->board;
+    Fin_BoardMove moves[FIN_BOARD_MOVES], quiets[FIN_BOARD_MOVES];
+    Fin_BoardMove best_move = FIN_MOVE_NONE, table_move = FIN_MOVE_NONE;
+    int order[FIN_BOARD_MOVES];
+    int pv_node = beta - alpha > 1, first_alpha = alpha;
+    int i, j, n, score, best = -SEARCH_INFINITE, eval = 0, check, reduce, searched = 0, tried = 0;
+    int table_score, table_depth, table_bound, quiet, gives_check, piece;
+
+    t->pv_length[ply] = 0;
+    // few pieces left: the tables know, at the leaves too
+    if (ply > 0 && Search_Ending(t, ply, &score))
+        return(score);
+    if (depth <= 0)
+        return(Search_Quiet(t, alpha, beta, ply));
+
+    t->nodes++;
+    Search_Check(t);
+    if (Search_Stopped(t))
+        return(0);
+    if (ply > t->seldepth)
+        t->seldepth = ply;
+
+    if (ply > 0)
+    {
+        if (board->halfmove >= 100 || Search_Repeated(board))
+            return(0);
+        // no mate found further can be better than one already found nearer
+        if (alpha < -FIN_SEARCH_MATE + ply)
+            alpha = -FIN_SEARCH_MATE + ply;
+        if (beta > FIN_SEARCH_MATE - ply - 1)
+            beta = FIN_SEARCH_MATE - ply - 1;
+        if (alpha >= beta)
+            return(alpha);
+    }
+    if (ply >= FIN_SEARCH_PLIES - 1)
+        return(Search_Eval(board));
+
+    check = Fin_BoardCheck(board);
+    if (check)
+        depth++;
+
+    if (Search_Probe(board->key, &table_move, &table_score, &table_depth, &table_bound))
+    {
+        table_score = Search_FromTable(table_score, ply);
+        if (!pv_node && table_depth >= depth &&
+            (table_bound == SEARCH_EXACT || (table_bound == SEARCH_LOWER && table_score >= beta) ||
+             (table_bound == SEARCH_UPPER && table_score <= alpha)))
+            return(table_score);
+    }
+
+    if (!check)
+    {
+        eval = Search_Eval(board);
+
+        // far enough above beta that it would not be taken back
+        if (!pv_node && depth <= 6 && eval - 80 * depth >= beta && beta < SEARCH_MATED)
+            return(eval);
+
+        // even passing the turn is enough: a real move would do better
+        if (!pv_node && null_ok && depth >= 3 && eval >= beta &&
+            (board->color[board->turn] & ~board->pieces[FIN_PIECE(board->turn, FIN_PAWN)] &
+             ~board->pieces[FIN_PIECE(board->turn, FIN_KING)]))
+        {
+            reduce = 3 + depth / 6;
+            Fin_BoardMake(board, FIN_MOVE_NONE);
+            score = -Search_Node(t, -beta, -beta + 1, depth - 1 - reduce, ply + 1, 0);
+            Fin_BoardUnmake(board);
+            if (Search_Stopped(t))
+                return(0);
+            if (score >= beta)
+                return(score >= SEARCH_MATED ? beta : score);
+        }
+    }
+
+    n = Fin_BoardMoves(board, moves);
+    if (n == 0)
+        return(check ? -FIN_SEARCH_MATE + ply : 0);
+    Search_Order(t, moves, order, n, table_move, ply);
+
+    for (i = 0; i < n; i++)
+    {
+        Search_Pick(moves, order, n, i);
+        quiet = !Search_Capture(board, moves[i]) && FIN_MOVE_FLAGS(moves[i]) < FIN_MOVE_PROMO;
+        piece = board->square[FIN_MOVE_FROM(moves[i])];
+
+        Fin_BoardMake(board, moves[i]);
+        gives_check = Fin_BoardCheck(board);
+        if (searched == 0)
+            score = -Search_Node(t, -beta, -alpha, depth - 1, ply + 1, 1);
+        else
+        {
+            // the late quiet moves are searched shallower first
+            reduce = 0;
+            if (depth >= 3 && quiet && !check && !gives_check && searched >= (pv_node ? 3 : 2))
+            {
+                reduce = search_reduce[depth < 64 ? depth : 63][searched < 64 ? searched : 63];
+                if (pv_node && reduce > 0)
+                    reduce--;
+                if (reduce > depth - 2)
+                    reduce = depth - 2;
+            }
+            score = -Search_Node(t, -alpha - 1, -alpha, depth - 1 - reduce, ply + 1, 1);
+            if (score > alpha && reduce > 0)
+                score = -Search_Node(t, -alpha - 1, -alpha, depth - 1, ply + 1, 1);
+            if (score > alpha && score < beta)
+                score = -Search_Node(t, -beta, -alpha, depth - 1, ply + 1, 1);
+        }
+        Fin_BoardUnmake(board);
+        if (Search_Stopped(t))
+            return(0);
+        searched++;
+
+        if (score > best)
+        {
+            best = score;
+            best_move = moves[i];
+            if (score > alpha)
+            {
+                alpha = score;
+                t->pv[ply][0] = moves[i];
+                for (j = 0; j < t->pv_length[ply + 1]; j++)
+                    t->pv[ply][j + 1] = t->pv[ply + 1][j];
+                t->pv_length[ply] = t->pv_length[ply + 1] + 1;
+
+                if (score >= beta)
+                {
+                    // a quiet move good enough to cut is tried early next time
+                    if (quiet)
+                    {
+                        if (t->killer[ply][0] != moves[i])
+                        {
+                            t->killer[ply][1] = t->killer[ply][0];
+                            t->killer[ply][0] = moves[i];
+                        }
+                        t->history[piece][FIN_MOVE_TO(moves[i])] += depth * depth;
+                        for (j = 0; j < tried; j++)
+                            t->history[board->square[FIN_MOVE_FROM(quiets[j])]][FIN_MOVE_TO(quiets[j])] -=
+                                depth * depth;
+                        if (t->history[piece][FIN_MOVE_TO(moves[i])] > (1 << 20))
+                            for (j = 0; j < 12 * 64; j++)
+                                t->history[j / 64][j % 64] /= 2;
+                    }
+                    break;
+                }
+            }
+        }
+        if (quiet)
+            quiets[tried++] = moves[i];
+    }
+
+    Search_Store(board->key, best_move, Search_ToTable(best, ply), depth,
+                 best >= beta ? SEARCH_LOWER : best > first_alpha ? SEARCH_EXACT : SEARCH_UPPER);
+    return(best);
+}
+
+
+/*
+ * iterative deepening of a thread, the main one (id 0) stops the others
+ * when it is done
+ */
+static void Search_Deepen(struct search_thread *t)
+{
+    Fin_SearchInfo info;
+    int depth, score, alpha, beta, window, i;
+
+    for (depth = 1; depth <= search_depth && !Search_Stopped(t); depth++)
+    {
+        // the helpers skip some depths, each its own
+        if (t->id > 0 && depth > 1)
+        {
+            i = (t->id - 1) % 20;
+            if (((depth + search_skip_phase[i]) / search_skip_size[i]) % 2)
+                continue;
+        }
+
+        // around the last score first, wider when it falls outside
+        window = depth >= 5 ? 25 : SEARCH_INFINITE;
+        alpha = depth >= 5 ? t->score - window : -SEARCH_INFINITE;
+        beta = depth >= 5 ? t->score + window : SEARCH_INFINITE;
+        while (1)
+        {
+            if (alpha < -SEARCH_INFINITE)
+                alpha = -SEARCH_INFINITE;
+            if (beta > SEARCH_INFINITE)
+                beta = SEARCH_INFINITE;
+            score = Search_Node(t, alpha, beta, depth, 0, 0);
+            if (Search_Stopped(t))
+                break;
+            if (score <= alpha)
+                alpha -= window;
+            else if (score >= beta)
+                beta += window;
+            else
+                break;
+            window *= 2;
+        }
+        if (Search_Stopped(t) || t->pv_length[0] == 0)
+            break;
+
+        t->depth = depth;
+        t->score = score;
+        t->length = t->pv_length[0];
+        memcpy(t->line, t->pv[0], t->length * sizeof(Fin_BoardMove));
+
+        if (t->id == 0)
+        {
+            if (search_report)
+            {
+                memset(&info, 0, sizeof(info));
+                info.move = t->line[0];
+                info.score = score;
+                info.depth = depth;
+                info.seldepth = t->seldepth;
+                for (i = 0; i < search_count; i++)
+                {
+                    info.nodes += search_threads[i].nodes;
+                    info.tables += search_threads[i].tables;
+                }
+                info.usec = Search_Usec() - search_start;
+                info.threads = search_count;
+                info.length = t->length;
+                memcpy(info.line, t->line, t->length * sizeof(Fin_BoardMove));
+                search_report(&info);
+            }
+            // another depth would not be done in the time left
+            if (search_deadline && Search_Usec() - search_start > search_usec / 2)
+                break;
+            // a mate was found, deeper will not change it
+            if (!search_pondering && score >= SEARCH_MATED && depth >= FIN_SEARCH_MATE - score)
+                break;
+        }
+    }
+    if (t->id == 0)
+    {
+        // the move is not wanted before the reply pondered on is played
+        while (search_pondering && !search_stop)
+            Search_Nap();
+        search_stop = 1;
+    }
+}
+
+
+#ifdef _LINUX_
+static void *Search_Thread(void *arg)
+#else
+static DWORD WINAPI Search_Thread(void *arg)
+#endif
+{
+    Search_Deepen((struct search_thread *)arg);
+    return(0);
+}
+
+
+/**  Fin_SearchHash(megabytes).
+ *  size the transposition table
+ *
+ *  input:
+ *     int megabytes = of memory for it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_SearchHash(int megabytes)
+{
+    unsigned long long buckets = 1;
+
+    while (buckets * 2 * 2 * sizeof(struct search_entry) <= (unsigned long long)megabytes << 20)
+        buckets *= 2;
+    free(search_table);
+    search_table = calloc(buckets * 2, sizeof(struct search_entry));
+    if (search_table == 0)
+        return(-1);
+    search_mask = buckets - 1;
+    return(0);
+}
+
+
+/**  Fin_SearchClear(void).
+ *  forget what previous searches found
+ *
+ *  returns
+ *     none
+ */
+void Fin_SearchClear(void)
+{
+    if (search_table)
+        memset(search_table, 0, (search_mask + 1) * 2 * sizeof(struct search_entry));
+}
+
+
+/**  Fin_SearchStart(*board, *limits).
+ *  start looking for the best move of a position, in the background
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     Fin_SearchLimits *limits = when to stop
+ *  returns
+ *     -1 if failure
+ */
+int Fin_SearchStart(const Fin_Board *board, const Fin_SearchLimits *limits)
+{
+    int i;
+#ifndef _LINUX_
+    DWORD tid;
+#endif
+
+    if (search_threads != 0)
+        return(-1);
+    if (!search_ready)
+        Search_Init();
+    if (search_table == 0 && Fin_SearchHash(16) < 0)
+        return(-1);
+
+    search_count = limits->threads > 0 ? limits->threads : Fin_SearchCores();
+    if (search_count > FIN_SEARCH_THREADS)
+        search_count = FIN_SEARCH_THREADS;
+    search_threads = calloc(search_count, sizeof(struct search_thread));
+    if (search_threads == 0)
+        return(-1);
+
+    search_start = Search_Usec();
+    search_usec = limits->usec > 0 ? limits->usec : 0;
+    search_pondering = limits->ponder;
+    search_deadline = search_usec && !search_pondering ? search_start + search_usec : 0;
+    search_nodes = limits->nodes;
+    search_depth = limits->depth > 0 && limits->depth < FIN_SEARCH_PLIES ? limits->depth : FIN_SEARCH_PLIES - 1;
+    search_report = limits->report;
+    search_age++;
+    search_stop = 0;
+
+    for (i = 0; i < search_count; i++)
+    {
+        search_threads[i].board = *board;
+        search_threads[i].id = i;
+#ifdef _LINUX_
+        pthread_create(&search_threads[i].handle, NULL, Search_Thread, &search_threads[i]);
+#else
+        search_threads[i].handle = CreateThread(NULL, 0, Search_Thread, &search_threads[i], 0, &tid);
+#endif
+    }
+    return(0);
+}
+
+
+/**  Fin_SearchWait(*info).
+ *  wait for the search started to be done
+ *
+ *  input:
+ *     Fin_SearchInfo *info = where to return what was found
+ *  returns
+ *     -1 if failure
+ */
+int Fin_SearchWait(Fin_SearchInfo *info)
+{
+    struct search_thread *best;
+    Fin_Board *board;
+    Fin_BoardMove move;
+    char text[6];
+    int i, score, depth, bound;
+
+    if (search_threads == 0)
+        return(-1);
+    for (i = 0; i < search_count; i++)
+    {
+#ifdef _LINUX_
+        pthread_join(search_threads[i].handle, NULL);
+#else
+        WaitForSingleObject(search_threads[i].handle, INFINITE);
+        CloseHandle(search_threads[i].handle);
+#endif
+    }
+
+    // the deepest line found, the main thread's when as deep
+    best = &search_threads[0];
+    for (i = 1; i < search_count; i++)
+        if (search_threads[i].depth > best->depth && search_threads[i].length > 0)
+            best = &search_threads[i];
+
+    memset(info, 0, sizeof(*info));
+    info->score = best->score;
+    info->depth = best->depth;
+    info->length = best->length;
+    memcpy(info->line, best->line, best->length * sizeof(Fin_BoardMove));
+    for (i = 0; i < search_count; i++)
+    {
+        info->nodes += search_threads[i].nodes;
+        info->tables += search_threads[i].tables;
+        if (search_threads[i].seldepth > info->seldepth)
+            info->seldepth = search_threads[i].seldepth;
+    }
+    info->usec = Search_Usec() - search_start;
+    info->threads = search_count;
+
+    // the threads took back all their moves, the board is the position searched
+    board = &search_threads[0].board;
+    if (info->length > 0)
+        info->move = info->line[0];
+    if (info->length > 1)
+        info->ponder = info->line[1];
+    else if (info->length == 1)
+    {
+        // the reply may still be in the table
+        Fin_BoardMake(board, info->move);
+        if (Search_Probe(board->key, &move, &score, &depth, &bound) &&
+            Fin_BoardParse(board, Fin_BoardText(move, text)) != FIN_MOVE_NONE)
+            info->ponder = move;
+        Fin_BoardUnmake(board);
+    }
+    if (info->length == 0)
+        info->score = Fin_BoardCheck(board) ? -FIN_SEARCH_MATE : 0;
+
+    free(search_threads);
+    search_threads = 0;
+    return(0);
+}
+
+
+/**  Fin_Search(*board, *limits, *info).
+ *  look for the best move of a position
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     Fin_SearchLimits *limits = when to stop
+ *     Fin_SearchInfo *info = where to return what was found
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Search(const Fin_Board *board, const Fin_SearchLimits *limits, Fin_SearchInfo *info)
+{
+    if (Fin_SearchStart(board, limits) < 0)
+        return(-1);
+    return(Fin_SearchWait(info));
+}
+
+
+/**  Fin_SearchPonderHit(void).
+ *  the reply pondered on was played, the search goes on with the limits
+ *  it was given, counting the time it has already searched
+ *
+ *  returns
+ *     none
+ */
+void Fin_SearchPonderHit(void)
+{
+    if (!search_pondering)
+        return;
+    if (search_usec)
+    {
+        search_deadline = search_start + search_usec;
+        // not enough time left for another depth, the last one is the move
+        if (Search_Usec() - search_start > search_usec / 2)
+            search_stop = 1;
+    }
+    search_pondering = 0;
+}
+
+
+/**  Fin_SearchStop(void).
+ *  have the search in progress return now
+ *
+ *  returns
+ *     none
+ */
+void Fin_SearchStop(void)
+{
+    search_stop = 1;
+}
+
+
+/**  Fin_SearchCores(void).
+ *  cores of the computer
+ *
+ *  returns
+ *     the number of cores
+ */
+int Fin_SearchCores(void)
+{
+#ifdef _LINUX_
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return(cores > 0 ? (int)cores : 1);
+#else
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return((int)info.dwNumberOfProcessors);
+#endif
+}
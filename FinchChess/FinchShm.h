@@ -0,0 +1,67 @@
+#ifndef FINCHSHM_H
+#define FINCHSHM_H
+
+/*
+ * Protocol between the Finch daemon (finchd) and the programs sharing its robots.
+ *
+ * Handshake, one text line each way over the Unix socket FIN_SOCKET:
+ *    client:  "ATTACH <device>\n"
+ *    daemon:  "OK <shm name> <ring>\n"   or   "ERR <reason>\n"
+ * The socket then stays open so the daemon notices when the client exits,
+ * and carries one byte from the client whenever it queues a command while
+ * the daemon sleeps (idle set), to wake it up.
+ *
+ * Everything else goes through the shared memory segment of the device:
+ *  - one command ring per client, filled by the client and drained by the daemon.
+ *    Each slot holds a 9-byte Finch command. The daemon queues it in the
+ *    scheduler of the robot (higher lanes first, see Finch.h), writes the
+ *    8-byte response back into the slot and marks it done; the client only
+ *    reuses a slot once it is done.
+ *  - the sensor snapshot, written by the daemon and read by every client.
+ *    It is guarded by a sequence lock: snap_seq is odd while being updated.
+ */
+
+#include "Finch.h"
+
+#define FIN_SOCKET          "/tmp/finchd.sock"  // default handshake socket
+#define FIN_SHM_MAGIC       0x46494E43          // "FINC"
+#define FIN_SHM_VERSION     5
+#define FIN_SHM_CLIENTS     8                   // programs sharing one robot
+#define FIN_RING_SLOTS      32                  // commands queued per client
+#define FIN_SHM_TIMEOUT     10000               // 100 usec waits (1 second)
+
+/* slot states */
+#define FIN_SLOT_FREE       0
+#define FIN_SLOT_READY      1                   // posted by the client
+#define FIN_SLOT_DONE       2                   // completed by the daemon
+
+/* full memory barrier between the two processes */
+#define Fin_Barrier()       __sync_synchronize()
+
+struct fin_slot
+{
+    volatile int state;
+    int flag;                                   // SEND or SEND_RECV
+    int res;                                    // result of the transfer
+    unsigned char buffer[9];                    // command, then response
+};
+
+struct fin_ring
+{
+    volatile unsigned int head;                 // next slot the client fills
+    volatile unsigned int tail;                 // next slot the daemon takes
+    volatile int attached;                      // ring in use by a client
+    struct fin_slot slot[FIN_RING_SLOTS];
+};
+
+struct fin_shm
+{
+    unsigned int magic;
+    unsigned int version;
+    volatile unsigned int snap_seq;             // sequence lock of snap
+    volatile int idle;                          // daemon asleep, every ring was empty
+    Fin_Sensors snap;
+    struct fin_ring ring[FIN_SHM_CLIENTS];
+};
+
+#endif  /* FINCHSHM_H */
@@ -0,0 +1,468 @@
+/*
+ * Simulated Finch: when $FINCH_SIM names a maze file, Fin_Init opens a
+ * robot that lives in that maze instead of a real one. The commands the
+ * background thread sends are answered here: 'M' drives the two wheels
+ * (differential drive, the robot stops against the walls and feels the
+ * hit as a tap), the obstacle sensors look a few centimeters ahead of
+ * each side, the light sensors read the light field of $FINCH_SIM_LIGHTS.
+ *
+ * The simulation runs on the virtual clock (FinchClock.c): each write and
+ * read on the link takes FIN_SIM_LINK of it, and when the program and the
+ * background thread all wait, the clock jumps to the first of their
+ * deadlines. A routine that takes two minutes on the robot is done in a
+ * few milliseconds.
+ *
+ * Maze file, one line per row of cells, north at the top:
+ *    cell 0.25         (optional, meters a cell)
+ *    #######
+ *    #>..#.#           # wall, > < ^ v start facing east, west, north, south
+ *    #.#..G#           (S too, facing east), G the goal, anything else is free
+ *    #######
+ * Light file, the same rows with a digit per cell, 0 dark to 9 bright.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+#define FIN_SIM_ROW  256            // longest row of a map file
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+/* start cells, facing east, north, west, south */
+static const char fin_sim_start[] = ">^<vS";
+
+/*
+ * the world of a simulated Finch
+ */
+struct fin_sim
+{
+    int width, height;              // cells of the maze
+    double cell;                    // meters a cell
+    char *wall;                     // width * height, 1 for a wall, row 0 at the bottom
+    int goal;                       // cell to reach (G), -1 if none
+    unsigned char *light;           // width * height, light (0-255)
+    double x, y;                    // meters from the bottom left corner
+    double heading;                 // radians counterclockwise from east
+    double left, right;             // speed of the wheels, m/s
+    long long started;              // when it was opened (Fin_Usec)
+    long long moved_at;             // time of the pose
+    int blocked;                    // against a wall
+    int tapped;                     // hit a wall since the last 'A'
+    unsigned char probes;           // 'z' counter
+    Fin_SimStats stats;
+    fin_mutex lock;                 // guards the above (Fin_SimStatus)
+};
+
+
+/*
+ * read the rows of a map file, padded with spaces to the longest one,
+ * the first row read is the top one
+ */
+static char *Fin_SimRead(const char *name, int *width, int *height, double *cell)
+{
+    char line[FIN_SIM_ROW + 2];
+    char *rows = 0, *more;
+    int len;
+    FILE *file;
+
+    file = fopen(name, "r");
+    if (file == NULL)
+        return(0);
+
+    *width = 0;
+    *height = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (cell != NULL && strncmp(line, "cell ", 5) == 0)
+        {
+            *cell = atof(line + 5);
+            continue;
+        }
+        more = realloc(rows, (*height + 1) * (FIN_SIM_ROW + 1));
+        if (more == 0)
+            break;
+        rows = more;
+        memset(rows + *height * (FIN_SIM_ROW + 1), ' ', FIN_SIM_ROW + 1);
+        memcpy(rows + *height * (FIN_SIM_ROW + 1), line, len);
+        if (len > *width)
+            *width = len;
+        (*height)++;
+    }
+    fclose(file);
+    if (*width == 0)
+    {
+        free(rows);
+        return(0);
+    }
+    return(rows);
+}
+
+
+/*
+ * load the maze, and the light field if there is one
+ */
+static int Fin_SimLoad(struct fin_sim *sim, const char *maze, const char *lights)
+{
+    char *rows, *glow = 0;
+    int glow_width = 0, glow_height = 0;
+    int row, col, line, c;
+    const char *start;
+
+    sim->cell = FIN_SIM_CELL;
+    rows = Fin_SimRead(maze, &sim->width, &sim->height, &sim->cell);
+    if (rows == 0 || sim->cell <= 0)
+    {
+        free(rows);
+        return(-1);
+    }
+    if (lights != NULL && (glow = Fin_SimRead(lights, &glow_width, &glow_height, NULL)) == 0)
+    {
+        free(rows);
+        return(-1);
+    }
+
+    sim->wall = calloc(sim->width * sim->height, 1);
+    sim->light = malloc(sim->width * sim->height);
+    if (sim->wall == 0 || sim->light == 0)
+    {
+        free(rows);
+        free(glow);
+        return(-1);
+    }
+
+    // the rows are flipped, so that y grows to the north
+    sim->x = -1;
+    sim->goal = -1;
+    for (row = 0; row < sim->height; row++)
+        for (col = 0; col < sim->width; col++)
+        {
+            line = sim->height - 1 - row;
+            c = rows[line * (FIN_SIM_ROW + 1) + col];
+            sim->wall[row * sim->width + col] = c == '#';
+            if (c == 'G')
+                sim->goal = row * sim->width + col;
+            if (sim->x < 0 && c != 0 && (start = strchr(fin_sim_start, c)) != NULL)
+            {
+                sim->x = (col + 0.5) * sim->cell;
+                sim->y = (row + 0.5) * sim->cell;
+                sim->heading = (start - fin_sim_start) % 4 * M_PI / 2;
+            }
+
+            c = ' ';
+            if (glow != 0 && line < glow_height)
+                c = glow[line * (FIN_SIM_ROW + 1) + col];
+            if (glow == 0)
+                sim->light[row * sim->width + col] = FIN_SIM_AMBIENT;
+            else
+                sim->light[row * sim->width + col] = c >= '0' && c <= '9' ? (c - '0') * 255 / 9 : 0;
+        }
+    free(rows);
+    free(glow);
+
+    // no start given, the first free cell
+    for (row = sim->height - 1; sim->x < 0 && row >= 0; row--)
+        for (col = 0; sim->x < 0 && col < sim->width; col++)
+            if (!sim->wall[row * sim->width + col])
+            {
+                sim->x = (col + 0.5) * sim->cell;
+                sim->y = (row + 0.5) * sim->cell;
+            }
+    return(sim->x < 0 ? -1 : 0);
+}
+
+
+/*
+ * is there a wall at a point, outside the maze is all wall
+ */
+static int Fin_SimWall(struct fin_sim *sim, double x, double y)
+{
+    int col = (int)floor(x / sim->cell);
+    int row = (int)floor(y / sim->cell);
+
+    if (col < 0 || row < 0 || col >= sim->width || row >= sim->height)
+        return(1);
+    return(sim->wall[row * sim->width + col]);
+}
+
+
+/*
+ * does the robot hit a wall with its center at x, y
+ */
+static int Fin_SimHits(struct fin_sim *sim, double x, double y)
+{
+    double near_x, near_y;
+    int col, row;
+
+    for (row = (int)floor((y - FIN_SIM_RADIUS) / sim->cell);
+         row <= (int)floor((y + FIN_SIM_RADIUS) / sim->cell); row++)
+        for (col = (int)floor((x - FIN_SIM_RADIUS) / sim->cell);
+             col <= (int)floor((x + FIN_SIM_RADIUS) / sim->cell); col++)
+        {
+            if (col >= 0 && row >= 0 && col < sim->width && row < sim->height &&
+                !sim->wall[row * sim->width + col])
+                continue;
+            // point of the cell closest to the center
+            near_x = fmax(col * sim->cell, fmin(x, (col + 1) * sim->cell));
+            near_y = fmax(row * sim->cell, fmin(y, (row + 1) * sim->cell));
+            if ((near_x - x) * (near_x - x) + (near_y - y) * (near_y - y) <
+                FIN_SIM_RADIUS * FIN_SIM_RADIUS)
+                return(1);
+        }
+    return(0);
+}
+
+
+/*
+ * drive the robot up to the virtual time now, a step at a time,
+ * called with the world locked
+ */
+static void Fin_SimMove(struct fin_sim *sim, long long now)
+{
+    double dt, speed, turn, x, y;
+
+    while (sim->moved_at < now)
+    {
+        dt = (now - sim->moved_at < FIN_SIM_STEP ? now - sim->moved_at : FIN_SIM_STEP) / 1e6;
+        sim->moved_at += (long long)(dt * 1e6);
+        if (sim->left == 0 && sim->right == 0)
+        {
+            sim->moved_at = now;
+            break;
+        }
+
+        speed = (sim->left + sim->right) / 2;
+        turn = (sim->right - sim->left) / FIN_SIM_AXLE;
+        x = sim->x + speed * dt * cos(sim->heading + turn * dt / 2);
+        y = sim->y + speed * dt * sin(sim->heading + turn * dt / 2);
+        sim->heading = fmod(sim->heading + turn * dt + 2 * M_PI, 2 * M_PI);
+
+        // against a wall, the wheels slip (turning on the spot still works)
+        if (Fin_SimHits(sim, x, y))
+        {
+            if (!sim->blocked)
+            {
+                sim->stats.collisions++;
+                sim->tapped = 1;
+            }
+            sim->blocked = 1;
+            continue;
+        }
+        sim->blocked = 0;
+        sim->stats.distance += fabs(speed) * dt;
+        sim->x = x;
+        sim->y = y;
+        if (sim->stats.goal_usec == 0 && sim->goal >= 0 &&
+            (int)floor(y / sim->cell) * sim->width + (int)floor(x / sim->cell) == sim->goal)
+            sim->stats.goal_usec = sim->moved_at - sim->started;
+    }
+}
+
+
+/*
+ * does an obstacle sensor see a wall, looking from the edge of the robot
+ * up to FIN_SIM_RANGE, side is -1 for left, 1 for right
+ */
+static int Fin_SimObstacle(struct fin_sim *sim, int side)
+{
+    double angle = sim->heading - side * FIN_SIM_SENSOR;
+    double dist;
+
+    for (dist = FIN_SIM_RADIUS; dist <= FIN_SIM_RADIUS + FIN_SIM_RANGE; dist += sim->cell / 16)
+        if (Fin_SimWall(sim, sim->x + dist * cos(angle), sim->y + dist * sin(angle)))
+            return(1);
+    return(0);
+}
+
+
+/*
+ * light at a light sensor, side is -1 for left, 1 for right,
+ * interpolated between the centers of the cells
+ */
+static int Fin_SimLight(struct fin_sim *sim, int side)
+{
+    double angle = sim->heading - side * FIN_SIM_SENSOR;
+    double x = (sim->x + FIN_SIM_RADIUS * cos(angle)) / sim->cell - 0.5;
+    double y = (sim->y + FIN_SIM_RADIUS * sin(angle)) / sim->cell - 0.5;
+    double fx, fy, level[2][2];
+    int col, row, i, j, c, r;
+
+    col = (int)floor(x);
+    row = (int)floor(y);
+    fx = x - col;
+    fy = y - row;
+    for (i = 0; i < 2; i++)
+        for (j = 0; j < 2; j++)
+        {
+            c = col + i < 0 ? 0 : col + i >= sim->width ? sim->width - 1 : col + i;
+            r = row + j < 0 ? 0 : row + j >= sim->height ? sim->height - 1 : row + j;
+            level[i][j] = sim->light[r * sim->width + c];
+        }
+    return((int)((level[0][0] * (1 - fx) + level[1][0] * fx) * (1 - fy) +
+                 (level[0][1] * (1 - fx) + level[1][1] * fx) * fy + 0.5));
+}
+
+
+/*
+ * raw value of an axis of the accelerometer (6 bits, 1.5g full scale)
+ */
+static unsigned char Fin_SimAxis(double g)
+{
+    int data = (int)floor(g * 32.0 / 1.5 + 0.5);
+
+    return((unsigned char)(data & 0x3f));
+}
+
+
+/*
+ * open a simulated Finch in a maze and start the virtual clock
+ */
+int Fin_SimOpen(struct fin_dev *dev, const char *maze, const char *lights)
+{
+    struct fin_sim *sim;
+
+    sim = calloc(1, sizeof(*sim));
+    if (sim == 0)
+        return(-1);
+    if (Fin_SimLoad(sim, maze, lights) < 0)
+    {
+        free(sim->wall);
+        free(sim->light);
+        free(sim);
+        return(-1);
+    }
+    Fin_MutexInit(&sim->lock);
+
+    Fin_Clock(FIN_CLOCK_VIRTUAL);
+    sim->started = Fin_Usec();
+    sim->moved_at = sim->started;
+
+    // no flow control, the simulation takes what it is sent
+    memset(dev, 0, sizeof(*dev));
+    strcpy(dev->path, maze);
+    dev->sim = sim;
+    Fin_DevStart(dev);
+    return(0);
+}
+
+
+/*
+ * stop the virtual clock and free the world, once the background
+ * thread is gone
+ */
+void Fin_SimClose(struct fin_dev *dev)
+{
+    struct fin_sim *sim = dev->sim;
+
+    dev->sim = 0;
+    Fin_MutexFree(&sim->lock);
+    free(sim->wall);
+    free(sim->light);
+    free(sim);
+}
+
+
+/*
+ * answer a command as the Finch would, on the virtual clock,
+ * called by the background thread (without the device locked)
+ */
+int Fin_SimTransfer(struct fin_dev *dev, int flag, char cmnd, unsigned char *buffer)
+{
+    struct fin_sim *sim = dev->sim;
+    int side;
+
+    buffer[0] = 0x00;
+    buffer[1] = cmnd;
+    if (flag == SEND_RECV)
+        buffer[8] = ++dev->seq_num;
+    Fin_ClockAdvance(FIN_SIM_LINK);
+    dev->link_bytes += 9;
+
+    Fin_Lock(&sim->lock);
+    Fin_SimMove(sim, Fin_Usec());
+    sim->stats.cmnds++;
+    switch (cmnd)
+    {
+    case 'M':
+        sim->left = (buffer[2] ? -buffer[3] : buffer[3]) * FIN_SIM_SPEED / 255;
+        sim->right = (buffer[4] ? -buffer[5] : buffer[5]) * FIN_SIM_SPEED / 255;
+        break;
+    case 'X':
+    case 'R':
+        sim->left = 0;
+        sim->right = 0;
+        break;
+    }
+    Fin_Unlock(&sim->lock);
+    if (flag != SEND_RECV)
+        return(9);
+
+    // the response comes back a moment later, with the readings of then
+    Fin_ClockAdvance(FIN_SIM_LINK);
+    dev->link_bytes += 9;
+    Fin_Lock(&sim->lock);
+    Fin_SimMove(sim, Fin_Usec());
+    memset(buffer, 0, 7);
+    switch (cmnd)
+    {
+    case 'L':
+        for (side = 0; side < 2; side++)
+            buffer[side] = (unsigned char)Fin_SimLight(sim, side * 2 - 1);
+        break;
+    case 'I':
+        for (side = 0; side < 2; side++)
+            buffer[side] = (unsigned char)Fin_SimObstacle(sim, side * 2 - 1);
+        break;
+    case 'A':
+        // flat on the floor, a hit on a wall is felt as a tap
+        buffer[0] = 153;
+        buffer[3] = Fin_SimAxis(1.0);
+        buffer[4] = sim->tapped ? 0x20 : 0;
+        sim->tapped = 0;
+        break;
+    case 'T':
+        buffer[0] = (unsigned char)((FIN_SIM_TEMP - 25.0) * 2.4 + 127 + 0.5);
+        break;
+    case 'z':
+        buffer[0] = ++sim->probes;
+        break;
+    }
+    buffer[7] = buffer[8];
+    Fin_Unlock(&sim->lock);
+    return(9);
+}
+
+
+/**  Fin_SimStatus(*stats).
+ *  get where the simulated robot is and what it went through
+ *
+ *  input:
+ *     Fin_SimStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure (not simulating)
+ */
+int Fin_SimStatus(Fin_SimStats *stats)
+{
+    struct fin_sim *sim = Fin_Dev()->sim;
+
+    if (sim == 0)
+        return(-1);
+
+    Fin_Lock(&sim->lock);
+    Fin_SimMove(sim, Fin_Usec());
+    *stats = sim->stats;
+    stats->x = sim->x;
+    stats->y = sim->y;
+    stats->heading = sim->heading * 180 / M_PI;
+    stats->usec = sim->moved_at - sim->started;
+    Fin_Unlock(&sim->lock);
+    return(1);
+}
@@ -0,0 +1,1143 @@
+/*
+ * Endgame tables of the chess search: for every position of a few pieces
+ * (the kings and one or two more, 3 or 4 in all) how many plies to mate,
+ * worked out backwards from the mates (retrograde analysis).
+ *  - a table holds one material, the stronger side as white (KQKR, KBNK,
+ *    KPK ...); a position with black stronger is looked up with the
+ *    colors swapped and the board upside down
+ *  - a position is indexed by the side to move and the square of each
+ *    piece, the white king brought by symmetry to a1-d1-d4 (10 squares)
+ *    or, with pawns, to the files a-d
+ *  - the value of a position is 0 for a draw, else 1 + the plies to mate:
+ *    odd plies the side to move mates, even plies it is mated
+ *  - pass 0 finds the mates, and for each position the moves out of the
+ *    table (captures, promotions) are looked up in the smaller tables
+ *    built before; pass n only looks again at the positions a move away
+ *    from those solved in pass n - 1 (found by taking their moves back),
+ *    so each pass costs what changed, not the whole table
+ *  - the positions of a pass are shared by the threads a few thousand at
+ *    a time, the positions to look at next kept in a bit set written
+ *    with atomic ors
+ *  - the values written to the file take as few bits as the longest mate
+ *    needs, and Fin_TableOpen maps the files in memory
+ * Castling and en passant are left out: the tables are only for positions
+ * without them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "FinchBoard.h"
+
+#ifdef _LINUX_
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <windows.h>
+#endif
+
+#define TABLE_MAGIC     "FINTBL01"
+#define TABLE_PIECES    4           // most pieces of a table, kings counted
+#define TABLE_MAX       64          // tables open at once
+#define TABLE_CHUNK     4096        // positions a thread takes at a time
+#define TABLE_BAD       255         // due of a position that cannot happen
+#define TABLE_PASSES    254         // longest mate a table can hold, plies
+
+/*
+ * start of the file
+ */
+struct table_header
+{
+    char magic[8];
+    char name[8];
+    unsigned long long count;       // positions
+    unsigned int bits;              // per position
+    unsigned int longest;           // plies of the longest mate
+};
+
+/*
+ * a position of a few pieces, white king and black king first
+ */
+struct table_pos
+{
+    int n;
+    int turn;
+    unsigned char sq[TABLE_PIECES];
+    unsigned char piece[TABLE_PIECES];
+};
+
+/*
+ * a table, open or being built
+ */
+struct table
+{
+    char name[8];
+    unsigned long code;             // pieces of white | those of black << 20
+    int n;
+    unsigned char piece[TABLE_PIECES];
+    int pawns;                      // the white king keeps to the files a-d only
+    int kings;                      // squares of the white king: 10, 32 with pawns
+    unsigned long long count;
+    int bits;
+    const unsigned char *data;      // values packed, in the file mapped
+    unsigned char *value;           // one byte each while it is built
+    const void *map;
+    size_t size;
+};
+
+/*
+ * a thread building a table
+ */
+struct table_thread
+{
+    long long solved;
+    int due;                        // furthest pass a position waits for
+#ifdef _LINUX_
+    pthread_t handle;
+#else
+    HANDLE handle;
+#endif
+};
+
+static struct table table_list[TABLE_MAX];
+static int table_count = 0;
+static int table_ready = 0;
+static Fin_Bits table_step[2][64];  // knight and king moves
+static signed char table_king[2][64];   // white king square to index, without and with pawns
+static unsigned char table_square[2][32];
+static const char table_letter[] = "PNBRQK";
+
+/* the table being built */
+static struct table *table_build;
+static unsigned char *table_due;    // pass at which to look again, TABLE_BAD if impossible
+static Fin_Bits *table_now, *table_next;
+static int table_pass;
+static int table_missing;           // a move led to a table not open
+static volatile unsigned long long table_cursor;
+
+
+static long long Table_Usec(void)
+{
+#ifdef _LINUX_
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return((long long)GetTickCount64() * 1000);
+#endif
+}
+
+
+static void Table_Init(void)
+{
+    static const int knight[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+    static const int king[8][2] = { {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1} };
+    int sq, i, f, r, n = 0;
+
+    for (sq = 0; sq < 64; sq++)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            f = FIN_FILE(sq) + knight[i][0];
+            r = FIN_RANK(sq) + knight[i][1];
+            if (f >= 0 && f < 8 && r >= 0 && r < 8)
+                table_step[0][sq] |= FIN_BIT(FIN_SQUARE(f, r));
+            f = FIN_FILE(sq) + king[i][0];
+            r = FIN_RANK(sq) + king[i][1];
+            if (f >= 0 && f < 8 && r >= 0 && r < 8)
+                table_step[1][sq] |= FIN_BIT(FIN_SQUARE(f, r));
+        }
+
+        // a1-d1-d4 without pawns, the files a-d with them
+        f = FIN_FILE(sq);
+        r = FIN_RANK(sq);
+        table_king[0][sq] = -1;
+        if (f < 4 && r <= f)
+        {
+            table_square[0][n] = (unsigned char)sq;
+            table_king[0][sq] = (signed char)n++;
+        }
+        table_king[1][sq] = -1;
+        if (f < 4)
+        {
+            table_king[1][sq] = (signed char)(r * 4 + f);
+            table_square[1][r * 4 + f] = (unsigned char)sq;
+        }
+    }
+    table_ready = 1;
+}
+
+
+/*
+ * squares a piece attacks (or moves to, but for the pawns)
+ */
+static Fin_Bits Table_Attacks(int kind, int color, int from, Fin_Bits occ)
+{
+    static const int dir[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+    Fin_Bits bits = 0;
+    int d, f, r, first, last;
+
+    switch (kind)
+    {
+    case FIN_PAWN:
+        f = FIN_FILE(from);
+        r = FIN_RANK(from) + (color == FIN_WHITE ? 1 : -1);
+        if (r < 0 || r > 7)
+            return(0);
+        if (f > 0)
+            bits |= FIN_BIT(FIN_SQUARE(f - 1, r));
+        if (f < 7)
+            bits |= FIN_BIT(FIN_SQUARE(f + 1, r));
+        return(bits);
+    case FIN_KNIGHT:
+        return(table_step[0][from]);
+    case FIN_KING:
+        return(table_step[1][from]);
+    }
+
+    first = kind == FIN_BISHOP ? 4 : 0;
+    last = kind == FIN_ROOK ? 4 : 8;
+    for (d = first; d < last; d++)
+    {
+        f = FIN_FILE(from) + dir[d][0];
+        r = FIN_RANK(from) + dir[d][1];
+        while (f >= 0 && f < 8 && r >= 0 && r < 8)
+        {
+            bits |= FIN_BIT(FIN_SQUARE(f, r));
+            if (occ & FIN_BIT(FIN_SQUARE(f, r)))
+                break;
+            f += dir[d][0];
+            r += dir[d][1];
+        }
+    }
+    return(bits);
+}
+
+
+static Fin_Bits Table_Occupied(const struct table_pos *pos)
+{
+    Fin_Bits occ = 0;
+    int i;
+
+    for (i = 0; i < pos->n; i++)
+        occ |= FIN_BIT(pos->sq[i]);
+    return(occ);
+}
+
+
+/*
+ * a square attacked by a color
+ */
+static int Table_Attacked(const struct table_pos *pos, Fin_Bits occ, int sq, int by)
+{
+    int i;
+
+    for (i = 0; i < pos->n; i++)
+        if (FIN_COLOR(pos->piece[i]) == by &&
+            (Table_Attacks(FIN_KIND(pos->piece[i]), by, pos->sq[i], occ) & FIN_BIT(sq)))
+            return(1);
+    return(0);
+}
+
+
+/*
+ * a position that can happen: pieces on squares of their own, no pawn on
+ * the first or last rank, the side that just moved not in check
+ */
+static int Table_Valid(const struct table_pos *pos)
+{
+    Fin_Bits occ = Table_Occupied(pos);
+    int i, king = -1;
+
+    if (__builtin_popcountll(occ) != pos->n)
+        return(0);
+    for (i = 0; i < pos->n; i++)
+    {
+        if (FIN_KIND(pos->piece[i]) == FIN_PAWN && (FIN_RANK(pos->sq[i]) == 0 || FIN_RANK(pos->sq[i]) == 7))
+            return(0);
+        if (pos->piece[i] == FIN_PIECE(!pos->turn, FIN_KING))
+            king = pos->sq[i];
+    }
+    return(!Table_Attacked(pos, occ, king, pos->turn));
+}
+
+
+/*
+ * pieces of a color other than the king, a count of each kind in four
+ * bits, the queens highest
+ */
+static unsigned long Table_Side(const struct table_pos *pos, int color)
+{
+    unsigned long code = 0;
+    int i;
+
+    for (i = 0; i < pos->n; i++)
+        if (FIN_COLOR(pos->piece[i]) == color && FIN_KIND(pos->piece[i]) != FIN_KING)
+            code += 1UL << (4 * FIN_KIND(pos->piece[i]));
+    return(code);
+}
+
+
+/*
+ * a position as its table has it: the stronger side white, the kings then
+ * the other pieces by color and kind, queens first
+ */
+static unsigned long Table_Canon(const struct table_pos *pos, struct table_pos *canon)
+{
+    unsigned long white = Table_Side(pos, FIN_WHITE), black = Table_Side(pos, FIN_BLACK);
+    int flip = black > white, color, kind, i;
+
+    canon->n = 0;
+    canon->turn = pos->turn ^ flip;
+    for (color = FIN_WHITE; color <= FIN_BLACK; color++)
+        for (i = 0; i < pos->n; i++)
+            if (pos->piece[i] == FIN_PIECE(color ^ flip, FIN_KING))
+            {
+                canon->piece[canon->n] = FIN_PIECE(color, FIN_KING);
+                canon->sq[canon->n++] = (unsigned char)(pos->sq[i] ^ (flip ? 56 : 0));
+            }
+    for (color = FIN_WHITE; color <= FIN_BLACK; color++)
+        for (kind = FIN_QUEEN; kind >= FIN_PAWN; kind--)
+            for (i = 0; i < pos->n; i++)
+                if (pos->piece[i] == FIN_PIECE(color ^ flip, kind))
+                {
+                    canon->piece[canon->n] = FIN_PIECE(color, kind);
+                    canon->sq[canon->n++] = (unsigned char)(pos->sq[i] ^ (flip ? 56 : 0));
+                }
+    return(flip ? black | white << 20 : white | black << 20);
+}
+
+
+/*
+ * index of a position in its table (in the order of the table)
+ */
+static unsigned long long Table_Index(const struct table *t, const struct table_pos *pos)
+{
+    unsigned long long index;
+    int wk = pos->sq[0], file, rank, diagonal, i, sq;
+    int flip_file = FIN_FILE(wk) > 3, flip_rank = !t->pawns && FIN_RANK(wk) > 3;
+
+    file = flip_file ? 7 - FIN_FILE(wk) : FIN_FILE(wk);
+    rank = flip_rank ? 7 - FIN_RANK(wk) : FIN_RANK(wk);
+    diagonal = !t->pawns && rank > file;
+
+    // the king on the diagonal, the first piece off it tells: a position and its mirror are one
+    if (!t->pawns && rank == file)
+        for (i = 1; i < t->n; i++)
+        {
+            file = flip_file ? 7 - FIN_FILE(pos->sq[i]) : FIN_FILE(pos->sq[i]);
+            rank = flip_rank ? 7 - FIN_RANK(pos->sq[i]) : FIN_RANK(pos->sq[i]);
+            if (rank != file)
+            {
+                diagonal = rank > file;
+                break;
+            }
+        }
+
+    index = pos->turn;
+    for (i = 0; i < t->n; i++)
+    {
+        sq = pos->sq[i];
+        file = flip_file ? 7 - FIN_FILE(sq) : FIN_FILE(sq);
+        rank = flip_rank ? 7 - FIN_RANK(sq) : FIN_RANK(sq);
+        sq = diagonal ? FIN_SQUARE(rank, file) : FIN_SQUARE(file, rank);
+        if (i == 0)
+            index = index * t->kings + table_king[t->pawns][sq];
+        else
+            index = index * 64 + sq;
+    }
+    return(index);
+}
+
+
+static void Table_Decode(const struct table *t, unsigned long long index, struct table_pos *pos)
+{
+    int i;
+
+    pos->n = t->n;
+    for (i = t->n - 1; i > 0; i--)
+    {
+        pos->sq[i] = (unsigned char)(index % 64);
+        index /= 64;
+    }
+    pos->sq[0] = table_square[t->pawns][index % t->kings];
+    pos->turn = (int)(index / t->kings);
+    memcpy(pos->piece, t->piece, sizeof(pos->piece));
+}
+
+
+/*
+ * value of a position from the table open (or being built), -1 if no table has it
+ */
+static int Table_Read(const struct table *t, unsigned long long index)
+{
+    unsigned long long bit;
+    unsigned int word;
+
+    if (t->value)
+        return(t->value[index]);
+    if (t->bits == 0)
+        return(0);
+    bit = index * t->bits;
+    word = t->data[bit >> 3] | (unsigned int)t->data[(bit >> 3) + 1] << 8;
+    return((int)(word >> (bit & 7)) & ((1 << t->bits) - 1));
+}
+
+
+static struct table *Table_Find(unsigned long code)
+{
+    int i;
+
+    for (i = 0; i < table_count; i++)
+        if (table_list[i].code == code)
+            return(&table_list[i]);
+    return(0);
+}
+
+
+static int Table_Value(const struct table_pos *pos)
+{
+    struct table_pos canon;
+    struct table *t;
+
+    if (pos->n == 2)
+        return(0);
+    t = Table_Find(Table_Canon(pos, &canon));
+    if (t == 0)
+        return(-1);
+    return(Table_Read(t, Table_Index(t, &canon)));
+}
+
+
+/*
+ * a piece moved (and promoted to kind), what it took removed
+ */
+static void Table_Child(const struct table_pos *pos, int i, int to, int kind, struct table_pos *child)
+{
+    int j;
+
+    child->n = 0;
+    child->turn = !pos->turn;
+    for (j = 0; j < pos->n; j++)
+    {
+        if (j == i)
+        {
+            child->piece[child->n] = (unsigned char)FIN_PIECE(pos->turn, kind);
+            child->sq[child->n++] = (unsigned char)to;
+        }
+        else if (pos->sq[j] != to)
+        {
+            child->piece[child->n] = pos->piece[j];
+            child->sq[child->n++] = pos->sq[j];
+        }
+    }
+}
+
+
+/*
+ * the value of a position from those of its moves: a win in one ply more
+ * than the quickest mate of the other side among them, a loss in one ply
+ * more than the slowest if they all win for the other side; -1 if not
+ * known yet (or a draw), else the plies to mate
+ */
+static int Table_Eval(const struct table *t, const struct table_pos *pos)
+{
+    struct table_pos child;
+    Fin_Bits occ = Table_Occupied(pos), own = 0, targets;
+    int us = pos->turn, king = 0, legal = 0, win = -1, lose = 0, sure = 1;
+    int i, kind, from, to, last, promo, v;
+
+    for (i = 0; i < pos->n; i++)
+    {
+        if (FIN_COLOR(pos->piece[i]) == us)
+            own |= FIN_BIT(pos->sq[i]);
+        if (pos->piece[i] == FIN_PIECE(us, FIN_KING))
+            king = i;
+    }
+
+    for (i = 0; i < pos->n; i++)
+    {
+        if (FIN_COLOR(pos->piece[i]) != us)
+            continue;
+        kind = FIN_KIND(pos->piece[i]);
+        from = pos->sq[i];
+        if (kind == FIN_PAWN)
+        {
+            targets = Table_Attacks(kind, us, from, occ) & occ & ~own;
+            to = from + (us == FIN_WHITE ? 8 : -8);
+            if (!(occ & FIN_BIT(to)))
+            {
+                targets |= FIN_BIT(to);
+                if (FIN_RANK(from) == (us == FIN_WHITE ? 1 : 6) && !(occ & FIN_BIT(to + to - from)))
+                    targets |= FIN_BIT(to + to - from);
+            }
+        }
+        else
+            targets = Table_Attacks(kind, us, from, occ) & ~own;
+
+        while (targets)
+        {
+            to = __builtin_ctzll(targets);
+            targets &= targets - 1;
+            last = kind == FIN_PAWN && (FIN_RANK(to) == 0 || FIN_RANK(to) == 7);
+            for (promo = last ? FIN_QUEEN : kind; promo >= (last ? FIN_KNIGHT : kind); promo--)
+            {
+                Table_Child(pos, i, to, promo, &child);
+                if (Table_Attacked(&child, Table_Occupied(&child), i == king ? to : pos->sq[king], !us))
+                    continue;
+                legal++;
+
+                // a quiet move stays in the table, in its order
+                if (child.n == pos->n && promo == kind)
+                    v = t->value[Table_Index(t, &child)];
+                else if ((v = Table_Value(&child)) < 0)
+                    table_missing = 1;
+                if (v > 0 && (v - 1) % 2 == 0)
+                {
+                    if (win < 0 || v < win)
+                        win = v;
+                }
+                else if (v > 0)
+                {
+                    if (v > lose)
+                        lose = v;
+                }
+                else
+                    sure = 0;
+            }
+        }
+    }
+
+    if (legal == 0)
+        return(Table_Attacked(pos, occ, pos->sq[king], !us) ? 0 : -1);
+    if (win >= 0)
+        return(win);
+    return(sure ? lose : -1);
+}
+
+
+/*
+ * mark the positions a quiet move away from one solved to be looked at
+ * in the next pass (no capture nor promotion, those are in other tables)
+ */
+static void Table_Back(const struct table *t, const struct table_pos *pos)
+{
+    struct table_pos prev;
+    Fin_Bits occ = Table_Occupied(pos), targets;
+    unsigned long long index;
+    int them = !pos->turn, i, kind, from, to, step;
+
+    for (i = 0; i < pos->n; i++)
+    {
+        if (FIN_COLOR(pos->piece[i]) != them)
+            continue;
+        kind = FIN_KIND(pos->piece[i]);
+        from = pos->sq[i];
+        if (kind == FIN_PAWN)
+        {
+            targets = 0;
+            step = them == FIN_WHITE ? -8 : 8;
+            to = from + step;
+            if (FIN_RANK(to) != 0 && FIN_RANK(to) != 7 && !(occ & FIN_BIT(to)))
+            {
+                targets |= FIN_BIT(to);
+                if (FIN_RANK(from) == (them == FIN_WHITE ? 3 : 4) && !(occ & FIN_BIT(to + step)))
+                    targets |= FIN_BIT(to + step);
+            }
+        }
+        else
+            targets = Table_Attacks(kind, them, from, occ) & ~occ;
+
+        while (targets)
+        {
+            prev = *pos;
+            prev.sq[i] = (unsigned char)__builtin_ctzll(targets);
+            prev.turn = them;
+            targets &= targets - 1;
+            if (!Table_Valid(&prev))
+                continue;
+            index = Table_Index(t, &prev);
+            if (!(table_next[index >> 6] & FIN_BIT(index & 63)))
+                __sync_fetch_and_or(&table_next[index >> 6], FIN_BIT(index & 63));
+        }
+    }
+}
+
+
+/*
+ * a pass over the table: the positions marked (all of them in pass 0)
+ * solved in as many plies as the pass are written, the others wait
+ */
+static void Table_Work(struct table_thread *thread)
+{
+    struct table *t = table_build;
+    struct table_pos pos;
+    unsigned long long first, index, last;
+    int r;
+
+    for (;;)
+    {
+        first = __sync_fetch_and_add(&table_cursor, TABLE_CHUNK);
+        if (first >= t->count)
+            break;
+        last = first + TABLE_CHUNK < t->count ? first + TABLE_CHUNK : t->count;
+        for (index = first; index < last; index++)
+        {
+            if (t->value[index] != 0 || table_due[index] == TABLE_BAD)
+                continue;
+            if (table_pass > 0 && table_due[index] != table_pass &&
+                !(table_now[index >> 6] & FIN_BIT(index & 63)))
+                continue;
+
+            Table_Decode(t, index, &pos);
+            // or a mirror, indexed as the other one
+            if (table_pass == 0 && (!Table_Valid(&pos) || Table_Index(t, &pos) != index))
+            {
+                table_due[index] = TABLE_BAD;
+                continue;
+            }
+            r = Table_Eval(t, &pos);
+            if (r < 0)
+                continue;
+            if (r <= table_pass)
+            {
+                t->value[index] = (unsigned char)(r + 1);
+                Table_Back(t, &pos);
+                thread->solved++;
+            }
+            else if (r < TABLE_PASSES)
+            {
+                // through a smaller table: later
+                table_due[index] = (unsigned char)r;
+                if (r > thread->due)
+                    thread->due = r;
+            }
+        }
+    }
+}
+
+
+#ifdef _LINUX_
+static void *Table_Thread(void *arg)
+#else
+static DWORD WINAPI Table_Thread(void *arg)
+#endif
+{
+    Table_Work((struct table_thread *)arg);
+    return(0);
+}
+
+
+/*
+ * name of a material, -1 if more pieces than a table holds
+ */
+static int Table_Name(unsigned long code, char *name)
+{
+    int color, kind, i, n = 0;
+
+    for (color = FIN_WHITE; color <= FIN_BLACK; color++)
+    {
+        name[n++] = 'K';
+        for (kind = FIN_QUEEN; kind >= FIN_PAWN; kind--)
+            for (i = (int)(code >> (20 * color + 4 * kind)) & 15; i > 0; i--)
+            {
+                if (n >= TABLE_PIECES)
+                    return(-1);
+                name[n++] = table_letter[kind];
+            }
+    }
+    name[n] = 0;
+    return(n);
+}
+
+
+/*
+ * material of a name (KQKR), the stronger side first whichever way it is written
+ */
+static long Table_Parse(const char *name)
+{
+    unsigned long side[2] = { 0, 0 };
+    const char *p;
+    int color = -1, n = 0;
+
+    for (p = name; *p; p++, n++)
+    {
+        if (*p == 'K')
+            color++;
+        else if (color >= 0 && color <= 1 && strchr("QRBNP", *p))
+            side[color] += 1UL << (4 * (strchr(table_letter, *p) - table_letter));
+        else
+            return(-1);
+    }
+    if (color != 1 || n < 3 || n > TABLE_PIECES)
+        return(-1);
+    if (side[1] > side[0])
+        return((long)(side[1] | side[0] << 20));
+    return((long)(side[0] | side[1] << 20));
+}
+
+
+static void Table_Setup(struct table *t, unsigned long code)
+{
+    int color, kind, i;
+
+    memset(t, 0, sizeof(*t));
+    t->code = code;
+    Table_Name(code, t->name);
+    t->piece[0] = FIN_PIECE(FIN_WHITE, FIN_KING);
+    t->piece[1] = FIN_PIECE(FIN_BLACK, FIN_KING);
+    t->n = 2;
+    for (color = FIN_WHITE; color <= FIN_BLACK; color++)
+        for (kind = FIN_QUEEN; kind >= FIN_PAWN; kind--)
+            for (i = (int)(code >> (20 * color + 4 * kind)) & 15; i > 0; i--)
+                t->piece[t->n++] = (unsigned char)FIN_PIECE(color, kind);
+    t->pawns = (code & 15) || ((code >> 20) & 15);
+    t->kings = t->pawns ? 32 : 10;
+    t->count = 2ULL * t->kings << (6 * (t->n - 1));
+}
+
+
+static void Table_Path(const char *dir, const char *name, char *path, int size)
+{
+    snprintf(path, size, "%s/%s.ftb", dir && *dir ? dir : ".", name);
+}
+
+
+static void Table_Unmap(const void *map, size_t size)
+{
+#ifdef _LINUX_
+    munmap((void *)map, size);
+#else
+    (void)size;
+    UnmapViewOfFile(map);
+#endif
+}
+
+
+/*
+ * map a table file in memory and add it, -1 if failure
+ */
+static int Table_Map(const char *dir, unsigned long code)
+{
+    const struct table_header *header;
+    struct table t;
+    char path[1024];
+    const void *map;
+    size_t size;
+#ifdef _LINUX_
+    struct stat st;
+    int fd;
+#else
+    HANDLE file, mapping;
+    LARGE_INTEGER length;
+#endif
+
+    if (Table_Find(code))
+        return(0);
+    if (table_count >= TABLE_MAX)
+        return(-1);
+    Table_Setup(&t, code);
+    Table_Path(dir, t.name, path, sizeof(path));
+
+#ifdef _LINUX_
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return(-1);
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct table_header))
+    {
+        close(fd);
+        return(-1);
+    }
+    size = (size_t)st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return(-1);
+#else
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return(-1);
+    if (!GetFileSizeEx(file, &length) || length.QuadPart < (LONGLONG)sizeof(struct table_header))
+    {
+        CloseHandle(file);
+        return(-1);
+    }
+    size = (size_t)length.QuadPart;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return(-1);
+    map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (map == NULL)
+        return(-1);
+#endif
+
+    // the table of this material, whole
+    header = map;
+    if (memcmp(header->magic, TABLE_MAGIC, 8) != 0 || strncmp(header->name, t.name, 8) != 0 ||
+        header->count != t.count || header->bits > 8 ||
+        size < sizeof(*header) + (size_t)((t.count * header->bits + 7) / 8) + 1)
+    {
+        Table_Unmap(map, size);
+        return(-1);
+    }
+    t.bits = (int)header->bits;
+    t.data = (const unsigned char *)(header + 1);
+    t.map = map;
+    t.size = size;
+    table_list[table_count++] = t;
+    return(1);
+}
+
+
+/*
+ * the passes over a table being built, on threads
+ */
+static int Table_Solve(struct table *t, int threads, Fin_TableStats *stats)
+{
+    struct table_thread *thread;
+    Fin_Bits *swap;
+    unsigned long long index, words = (t->count + 63) / 64;
+    int i, due = 0, r;
+    long long solved = 1;
+#ifndef _LINUX_
+    DWORD tid;
+#endif
+
+    thread = calloc(threads, sizeof(struct table_thread));
+    table_due = calloc(t->count, 1);
+    table_now = calloc(words, sizeof(Fin_Bits));
+    table_next = calloc(words, sizeof(Fin_Bits));
+    t->value = calloc(t->count, 1);
+    if (thread == 0 || table_due == 0 || table_now == 0 || table_next == 0 || t->value == 0)
+    {
+        free(thread);
+        free(table_due);
+        free(table_now);
+        free(table_next);
+        free(t->value);
+        t->value = 0;
+        return(-1);
+    }
+    stats->memory = (long long)t->count * 2 + (long long)words * 2 * sizeof(Fin_Bits);
+    table_build = t;
+    table_missing = 0;
+
+    for (table_pass = 0; table_pass < TABLE_PASSES && (solved > 0 || table_pass <= due); table_pass++)
+    {
+        table_cursor = 0;
+        for (i = 0; i < threads; i++)
+        {
+            thread[i].solved = 0;
+#ifdef _LINUX_
+            pthread_create(&thread[i].handle, NULL, Table_Thread, &thread[i]);
+#else
+            thread[i].handle = CreateThread(NULL, 0, Table_Thread, &thread[i], 0, &tid);
+#endif
+        }
+        solved = 0;
+        for (i = 0; i < threads; i++)
+        {
+#ifdef _LINUX_
+            pthread_join(thread[i].handle, NULL);
+#else
+            WaitForSingleObject(thread[i].handle, INFINITE);
+            CloseHandle(thread[i].handle);
+#endif
+            solved += thread[i].solved;
+            if (thread[i].due > due)
+                due = thread[i].due;
+        }
+
+        // what was marked now is looked at in the next pass
+        swap = table_now;
+        table_now = table_next;
+        table_next = swap;
+        memset(table_next, 0, words * sizeof(Fin_Bits));
+    }
+    stats->passes = table_pass;
+
+    for (index = 0; index < t->count; index++)
+    {
+        if (table_due[index] == TABLE_BAD)
+            continue;
+        stats->positions++;
+        r = t->value[index] - 1;
+        if (r < 0)
+            stats->draws++;
+        else if (r % 2)
+            stats->wins++;
+        else
+            stats->losses++;
+        if (r > stats->longest)
+            stats->longest = r;
+    }
+
+    free(thread);
+    free(table_due);
+    free(table_now);
+    free(table_next);
+    table_build = 0;
+    if (table_missing)
+    {
+        free(t->value);
+        t->value = 0;
+        return(-1);
+    }
+    return(0);
+}
+
+
+/*
+ * write the values of a table built, packed
+ */
+static int Table_Write(const struct table *t, const char *dir, int longest, Fin_TableStats *stats)
+{
+    struct table_header header;
+    unsigned char *data;
+    unsigned long long index, bit, size;
+    char path[1024];
+    FILE *file;
+    int bits = 0, ok;
+
+    while ((1 << bits) < longest + 2)
+        bits++;
+    size = (t->count * bits + 7) / 8 + 1;
+    data = calloc(size, 1);
+    if (data == 0)
+        return(-1);
+    for (index = 0, bit = 0; index < t->count; index++, bit += bits)
+    {
+        data[bit >> 3] |= (unsigned char)(t->value[index] << (bit & 7));
+        if ((bit & 7) + bits > 8)
+            data[(bit >> 3) + 1] |= (unsigned char)(t->value[index] >> (8 - (bit & 7)));
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, 8);
+    strncpy(header.name, t->name, sizeof(header.name));
+    header.count = t->count;
+    header.bits = (unsigned int)bits;
+    header.longest = (unsigned int)longest;
+
+    Table_Path(dir, t->name, path, sizeof(path));
+    file = fopen(path, "wb");
+    if (file == 0)
+    {
+        free(data);
+        return(-1);
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    free(data);
+    stats->bits = bits;
+    stats->bytes = (long long)(sizeof(header) + size);
+    return(ok ? 0 : -1);
+}
+
+
+/*
+ * material after a piece is taken and (or) a pawn promoted, -1 for none,
+ * 0 if only the kings are left
+ */
+static unsigned long Table_After(const struct table *t, int taken, int promoted, int kind)
+{
+    struct table_pos pos, canon;
+    int i;
+
+    memset(&pos, 0, sizeof(pos));
+    for (i = 0; i < t->n; i++)
+        if (i != taken)
+            pos.piece[pos.n++] = i == promoted ? (unsigned char)FIN_PIECE(FIN_COLOR(t->piece[i]), kind) : t->piece[i];
+    return(pos.n > 2 ? Table_Canon(&pos, &canon) : 0);
+}
+
+
+/*
+ * build a table and first those its captures and promotions lead to
+ */
+static int Table_Make(const char *dir, unsigned long code, int threads, void (*report)(const Fin_TableStats *stats))
+{
+    struct table t, *open;
+    Fin_TableStats stats;
+    unsigned long sub[TABLE_MAX];
+    long long start;
+    int i, j, kind, n = 0, failed;
+
+    Table_Setup(&t, code);
+    for (i = 2; i < t.n; i++)
+    {
+        sub[n++] = Table_After(&t, i, -1, 0);
+        if (FIN_KIND(t.piece[i]) != FIN_PAWN)
+            continue;
+        // promoted, taking nothing or a piece of the other side
+        for (kind = FIN_QUEEN; kind > FIN_PAWN; kind--)
+            for (j = -1; j < t.n; j++)
+                if (j == -1 || (j >= 2 && FIN_COLOR(t.piece[j]) != FIN_COLOR(t.piece[i])))
+                    sub[n++] = Table_After(&t, j, i, kind);
+    }
+    for (i = 0; i < n; i++)
+        if (sub[i] && Table_Find(sub[i]) == 0 && Table_Map(dir, sub[i]) < 0 &&
+            Table_Make(dir, sub[i], threads, report) < 0)
+            return(-1);
+    if (table_count >= TABLE_MAX)
+        return(-1);
+
+    memset(&stats, 0, sizeof(stats));
+    strcpy(stats.name, t.name);
+    stats.threads = threads;
+    start = Table_Usec();
+    if (Table_Solve(&t, threads, &stats) < 0)
+        return(-1);
+    failed = Table_Write(&t, dir, stats.longest, &stats) < 0;
+    free(t.value);
+    stats.usec = Table_Usec() - start;
+    if (failed)
+        return(-1);
+
+    // the one built replaces the one open, if any
+    if ((open = Table_Find(code)) != 0)
+    {
+        Table_Unmap(open->map, open->size);
+        *open = table_list[--table_count];
+    }
+    if (Table_Map(dir, code) < 0)
+        return(-1);
+    if (report)
+        report(&stats);
+    return(0);
+}
+
+
+/**  Fin_TableBuild(*dir, *name, threads, *report).
+ *  build the table of a material and those it needs
+ *
+ *  input:
+ *     const char *dir = where the tables are, NULL for the current directory
+ *     const char *name = material, KQKR
+ *     int threads = to build with, 0 for one per core
+ *     void (*report)(const Fin_TableStats *stats) = called for each table built
+ *  returns
+ *     -1 if failure
+ */
+int Fin_TableBuild(const char *dir, const char *name, int threads, void (*report)(const Fin_TableStats *stats))
+{
+    long code = Table_Parse(name);
+
+    if (code < 0)
+        return(-1);
+    if (!table_ready)
+        Table_Init();
+    if (threads <= 0)
+        threads = Fin_SearchCores();
+    return(Table_Make(dir, (unsigned long)code, threads, report));
+}
+
+
+/**  Fin_TableOpen(*dir).
+ *  map in memory the tables of a directory
+ *
+ *  input:
+ *     const char *dir = where the tables are, NULL for the current directory
+ *  returns
+ *     tables open, -1 if failure
+ */
+int Fin_TableOpen(const char *dir)
+{
+    struct table_pos pos;
+    unsigned long code;
+    int a, b, c;
+
+    if (!table_ready)
+        Table_Init();
+
+    // one or two pieces to the kings, the stronger side white
+    for (a = 0; a < FIN_KING; a++)
+        for (b = -1; b <= a; b++)
+            for (c = -1; c < FIN_KING; c++)
+            {
+                if (b >= 0 && c >= 0)
+                    continue;
+                pos.n = 3 + (b >= 0) + (c >= 0);
+                pos.piece[0] = FIN_PIECE(FIN_WHITE, FIN_KING);
+                pos.piece[1] = FIN_PIECE(FIN_BLACK, FIN_KING);
+                pos.piece[2] = (unsigned char)FIN_PIECE(FIN_WHITE, a);
+                if (b >= 0)
+                    pos.piece[3] = (unsigned char)FIN_PIECE(FIN_WHITE, b);
+                if (c >= 0)
+                    pos.piece[3] = (unsigned char)FIN_PIECE(FIN_BLACK, c);
+                if (Table_Side(&pos, FIN_BLACK) > Table_Side(&pos, FIN_WHITE))
+                    continue;
+                code = Table_Side(&pos, FIN_WHITE) | Table_Side(&pos, FIN_BLACK) << 20;
+                Table_Map(dir, code);
+            }
+    return(table_count);
+}
+
+
+/**  Fin_TableClose(void).
+ *  forget the tables open
+ *
+ *  returns
+ *     none
+ */
+void Fin_TableClose(void)
+{
+    while (table_count > 0)
+    {
+        table_count--;
+        Table_Unmap(table_list[table_count].map, table_list[table_count].size);
+    }
+}
+
+
+/**  Fin_TableProbe(*board, *plies).
+ *  look a position up in the tables open
+ *
+ *  input:
+ *     Fin_Board *board = the position
+ *     int *plies = where to return the plies to mate
+ *  returns
+ *     FIN_TABLE_WIN, FIN_TABLE_LOSS or FIN_TABLE_DRAW for the side to move,
+ *     -1 if no table has it
+ */
+int Fin_TableProbe(const Fin_Board *board, int *plies)
+{
+    struct table_pos pos;
+    Fin_Bits bits = board->all, pawns;
+    int v;
+
+    if (table_count == 0 || __builtin_popcountll(bits) > TABLE_PIECES || board->castle)
+        return(-1);
+    if (board->ep >= 0)
+    {
+        // a pawn can take en passant: not in the tables
+        pawns = board->pieces[FIN_PIECE(board->turn, FIN_PAWN)];
+        if (Table_Attacks(FIN_PAWN, !board->turn, board->ep, 0) & pawns)
+            return(-1);
+    }
+
+    pos.n = 0;
+    pos.turn = board->turn;
+    while (bits)
+    {
+        pos.sq[pos.n] = (unsigned char)__builtin_ctzll(bits);
+        pos.piece[pos.n] = board->square[pos.sq[pos.n]];
+        pos.n++;
+        bits &= bits - 1;
+    }
+    v = Table_Value(&pos);
+    if (v < 0)
+        return(-1);
+    *plies = v - 1;
+    if (v == 0)
+        return(FIN_TABLE_DRAW);
+    return((v - 1) % 2 ? FIN_TABLE_WIN : FIN_TABLE_LOSS);
+}
@@ -0,0 +1,438 @@
+/*
+ * Tracks of timed commands: a list of commands encoded beforehand, each
+ * one sent by the background thread of a Finch at its own time, so the
+ * program does not have to wait on the link and the sleeps of the
+ * system between them. Fin_Melody plays the notes of a melody this way.
+ *
+ * A track can also be an animation of the beak: the thread computes its
+ * frames from the key frames at a given rate, and only sends those that
+ * change the color the robot shows.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Finch.h"
+#include "FinchInt.h"
+
+/* a tone followed by another one lasts this much longer, the next one
+   cuts it, so a note sent a little late does not leave a gap */
+#define FIN_MELODY_OVERLAP  20      // msec
+
+
+/*
+ * go to the next step of a track, starting a new pass at the end
+ * if it loops, called with the device locked
+ */
+static void Fin_TrackNext(struct fin_track *track)
+{
+    track->next++;
+    if (track->next < track->count || track->loops == 0)
+        return;
+    track->start += track->length;
+    track->next = 0;
+    if (track->loops > 0)
+        track->loops--;
+}
+
+
+/*
+ * time of a step or frame of a track, from the start of the pass
+ */
+static long long Fin_TrackAt(struct fin_track *track, int i)
+{
+    if (track->period == 0)
+        return(track->step[i].at);
+    if ((long long)i * track->period > track->length)
+        return(track->length);
+    return((long long)i * track->period);
+}
+
+
+/*
+ * how far from a key frame to the next the color is, for u of the time
+ */
+static double Fin_Ease(int ease, double u)
+{
+    switch (ease)
+    {
+    case FIN_EASE_IN:
+        return(u * u);
+    case FIN_EASE_OUT:
+        return(1 - (1 - u) * (1 - u));
+    case FIN_EASE_INOUT:
+        return(u * u * (3 - 2 * u));
+    case FIN_EASE_STEP:
+        return(u < 1 ? 0 : 1);
+    default:
+        return(u);
+    }
+}
+
+
+/*
+ * color of an animation at a time of the pass
+ */
+static void Fin_TrackFrame(struct fin_track *track, long long at, unsigned char *color)
+{
+    struct fin_step *from, *to;
+    double e;
+    int k, c;
+
+    // last key frame reached
+    for (k = 0; k + 1 < track->steps && track->step[k + 1].at <= at; k++)
+        ;
+    from = &track->step[k];
+    if (k + 1 == track->steps)
+    {
+        memcpy(color, from->args, 3);
+        return;
+    }
+    to = &track->step[k + 1];
+    e = Fin_Ease(to->args[3], (double)(at - from->at) / (to->at - from->at));
+    for (c = 0; c < 3; c++)
+        color[c] = (unsigned char)(from->args[c] + (to->args[c] - from->args[c]) * e + 0.5);
+}
+
+
+/*
+ * track with the next timed command and the time it is due, -1 if none,
+ * dropping the commands that are too late to be of any use,
+ * called by the background thread with the device locked
+ */
+int Fin_TrackDue(struct fin_dev *dev, long long now, long long *due)
+{
+    struct fin_track *track;
+    long long at;
+    int first = -1;
+    int i;
+
+    for (i = 0; i < FIN_TRACKS; i++)
+    {
+        track = &dev->track[i];
+        while (track->next < track->count)
+        {
+            at = track->start + Fin_TrackAt(track, track->next);
+            if (now - at <= FIN_TRACK_LATE)
+            {
+                if (first < 0 || at < *due)
+                {
+                    first = i;
+                    *due = at;
+                }
+                break;
+            }
+            track->stats.dropped++;
+            Fin_TrackNext(track);
+        }
+    }
+    return(first);
+}
+
+
+/*
+ * send the next command of a track and time it, or the next frame
+ * if the robot does not show it already,
+ * called by the background thread with the device locked
+ */
+void Fin_TrackSend(struct fin_dev *dev, int t)
+{
+    struct fin_track *track = &dev->track[t];
+    unsigned char IoBuffer[9];
+    long long due = track->start + Fin_TrackAt(track, track->next);
+    int serial = track->serial;
+    char cmnd = 'O';
+    long late;
+    int res;
+
+    if (track->period > 0)
+    {
+        Fin_TrackFrame(track, due - track->start, &IoBuffer[2]);
+        if (memcmp(&IoBuffer[2], dev->led, 3) == 0)
+        {
+            track->stats.skipped++;
+            Fin_TrackNext(track);
+            return;
+        }
+    }
+    else
+    {
+        cmnd = track->step[track->next].cmnd;
+        memcpy(&IoBuffer[2], track->step[track->next].args, 4);
+    }
+
+    // the track goes on once the command is out, so it is not done before
+    // its last one is sent; it may be replaced while the device is unlocked
+    res = Fin_Send(dev, SEND, cmnd, IoBuffer);
+    if (track->serial != serial)
+        return;
+    Fin_TrackNext(track);
+    if (res <= 0)
+        return;
+
+    late = (long)(dev->sent_at - due);
+    track->stats.sent++;
+    track->stats.last_usec = late;
+    if (late > track->stats.max_usec)
+        track->stats.max_usec = late;
+    track->late_total += late;
+    track->stats.avg_usec = (long)(track->late_total / track->stats.sent);
+}
+
+
+/*
+ * replace a track by another one (0 to empty it), its steps
+ * are malloc'ed and taken over
+ */
+void Fin_TrackLoad(struct fin_dev *dev, int t, struct fin_track *from)
+{
+    struct fin_track *track = &dev->track[t];
+    struct fin_step *old;
+    int serial;
+
+    Fin_Lock(&dev->lock);
+    old = track->step;
+    serial = track->serial;
+    if (from != 0)
+        *track = *from;
+    else
+        memset(track, 0, sizeof(*track));
+    track->next = 0;
+    track->serial = serial + 1;
+    memset(&track->stats, 0, sizeof(track->stats));
+    track->late_total = 0;
+    Fin_Wake(dev);
+    Fin_Unlock(&dev->lock);
+    free(old);
+}
+
+
+/*
+ * stats of a track
+ */
+void Fin_TrackStatus(struct fin_dev *dev, int t, Fin_TrackStats *stats)
+{
+    struct fin_track *track = &dev->track[t];
+
+    Fin_Lock(&dev->lock);
+    *stats = track->stats;
+    stats->playing = track->count - track->next;
+    if (track->loops > 0)
+        stats->playing += track->loops * track->count;
+    else if (track->loops < 0)
+        stats->playing = track->count;
+    Fin_Unlock(&dev->lock);
+}
+
+
+/**  Fin_Melody(*notes, count, loops).
+ *  play a melody in the background, the notes are sent
+ *  by the background thread each at its own time
+ *
+ *  input:
+ *     Fin_Note *notes = the notes (freq in hz, 0 for a rest,
+ *                       msec of the tone, msec of silence after it)
+ *     int count = number of notes
+ *     int loops = times to play it, 0 for ever
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Melody(const Fin_Note *notes, int count, int loops)
+{
+    struct fin_track track;
+    struct fin_step *step;
+    long long at = 0;
+    int msec, next;
+    int i, n = 0;
+
+    if (count <= 0 || loops < 0)
+        return(-1);
+    step = malloc(count * sizeof(struct fin_step));
+    if (step == NULL)
+        return(-1);
+
+    for (i = 0; i < count; i++)
+    {
+        if (notes[i].freq < 0 || notes[i].freq > 0xffff || notes[i].msec < 0 ||
+            notes[i].msec > 0xffff - FIN_MELODY_OVERLAP || notes[i].rest < 0)
+        {
+            free(step);
+            return(-1);
+        }
+        if (notes[i].freq > 0 && notes[i].msec > 0)
+        {
+            // the note that follows, the first one again if it loops
+            next = i + 1 < count ? i + 1 : (loops != 1 ? 0 : -1);
+            msec = notes[i].msec;
+            if (notes[i].rest == 0 && next >= 0 && notes[next].freq > 0 && notes[next].msec > 0)
+                msec += FIN_MELODY_OVERLAP;
+            step[n].at = at;
+            step[n].cmnd = 'B';
+            step[n].args[0] = (unsigned char)(msec >> 8);
+            step[n].args[1] = (unsigned char)(msec);
+            step[n].args[2] = (unsigned char)(notes[i].freq >> 8);
+            step[n].args[3] = (unsigned char)(notes[i].freq);
+            n++;
+        }
+        at += (long long)(notes[i].msec + notes[i].rest) * 1000;
+    }
+    if (n == 0 || at == 0)
+    {
+        free(step);
+        return(-1);
+    }
+
+    memset(&track, 0, sizeof(track));
+    track.step = step;
+    track.steps = n;
+    track.count = n;
+    track.guard = 1;
+    track.start = Fin_Usec();
+    track.length = at;
+    track.loops = loops - 1;
+    Fin_TrackLoad(Fin_Dev(), FIN_TRACK_BUZZER, &track);
+    return(1);
+}
+
+
+/**  Fin_MelodyStop(void).
+ *  stop the melody and turn the buzzer off
+ *
+ *  returns
+ *     -1 if failure
+ */
+int Fin_MelodyStop(void)
+{
+    Fin_TrackLoad(Fin_Dev(), FIN_TRACK_BUZZER, 0);
+    return(Fin_Buzzer(0, 0));
+}
+
+
+/**  Fin_MelodyStatus(*stats).
+ *  get whether the melody still plays and how late its notes went out
+ *
+ *  input:
+ *     Fin_TrackStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_MelodyStatus(Fin_TrackStats *stats)
+{
+    Fin_TrackStatus(Fin_Dev(), FIN_TRACK_BUZZER, stats);
+    return(1);
+}
+
+
+/*
+ * start an animation of the beak of a robot at start (Fin_Usec),
+ * see Fin_Animate
+ */
+int Fin_DevAnimate(struct fin_dev *dev, const Fin_Key *keys, int count, int fps, int loops,
+                   long long start)
+{
+    struct fin_track track;
+    struct fin_step *step;
+    long long at = 0;
+    int i, n = 0;
+
+    if (count <= 0 || loops < 0 || fps < 1 || fps > 100)
+        return(-1);
+    step = malloc((count + 1) * sizeof(struct fin_step));
+    if (step == NULL)
+        return(-1);
+
+    // from the color shown now, unless the first key frame is at 0
+    if (keys[0].msec > 0)
+    {
+        Fin_Lock(&dev->lock);
+        memcpy(step[0].args, dev->led, 3);
+        Fin_Unlock(&dev->lock);
+        step[0].at = 0;
+        step[0].cmnd = 'O';
+        step[0].args[3] = FIN_EASE_LINEAR;
+        n++;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (keys[i].red < 0 || keys[i].red > 255 || keys[i].green < 0 || keys[i].green > 255 ||
+            keys[i].blue < 0 || keys[i].blue > 255 || keys[i].msec < 0 ||
+            keys[i].ease < FIN_EASE_LINEAR || keys[i].ease > FIN_EASE_STEP)
+        {
+            free(step);
+            return(-1);
+        }
+        at += keys[i].msec * 1000LL;
+        step[n].at = at;
+        step[n].cmnd = 'O';
+        step[n].args[0] = (unsigned char)keys[i].red;
+        step[n].args[1] = (unsigned char)keys[i].green;
+        step[n].args[2] = (unsigned char)keys[i].blue;
+        step[n].args[3] = (unsigned char)keys[i].ease;
+        n++;
+    }
+    if (at == 0)
+    {
+        free(step);
+        return(-1);
+    }
+
+    memset(&track, 0, sizeof(track));
+    track.step = step;
+    track.steps = n;
+    track.period = 1000000 / fps;
+    track.count = (int)((at + track.period - 1) / track.period) + 1;
+    track.start = start;
+    track.length = at;
+    track.loops = loops - 1;
+    Fin_TrackLoad(dev, FIN_TRACK_LED, &track);
+    return(1);
+}
+
+
+/**  Fin_Animate(*keys, count, fps, loops).
+ *  animate the beak in the background, the frames are computed
+ *  by the background thread and sent only when the color changes
+ *
+ *  input:
+ *     Fin_Key *keys = the key frames (color, msec after the previous one,
+ *                     FIN_EASE_... curve to get there)
+ *     int count = number of key frames
+ *     int fps = frames per second (1-100)
+ *     int loops = times to play it, 0 for ever
+ *  returns
+ *     -1 if failure
+ */
+int Fin_Animate(const Fin_Key *keys, int count, int fps, int loops)
+{
+    return(Fin_DevAnimate(Fin_Dev(), keys, count, fps, loops, Fin_Usec()));
+}
+
+
+/**  Fin_AnimateStop(void).
+ *  stop the animation, the beak keeps its color
+ *
+ *  returns
+ *     -1 if failure
+ */
+int Fin_AnimateStop(void)
+{
+    Fin_TrackLoad(Fin_Dev(), FIN_TRACK_LED, 0);
+    return(1);
+}
+
+
+/**  Fin_AnimateStatus(*stats).
+ *  get whether the animation still plays, how many frames were sent
+ *  and how many were skipped because the color did not change
+ *
+ *  input:
+ *     Fin_TrackStats *stats = pointer where to return it
+ *  returns
+ *     -1 if failure
+ */
+int Fin_AnimateStatus(Fin_TrackStats *stats)
+{
+    Fin_TrackStatus(Fin_Dev(), FIN_TRACK_LED, stats);
+    return(1);
+}